@@ -0,0 +1,82 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <limits.h>
+
+#include "ai_scheduler.h"
+
+
+//What one full monster update is guessed to cost before any have been timed
+#define AI_DEFAULT_THINK_COST_MS 0.05
+
+
+/*------------------------------------------------------------------------------
+ * Input: The scheduler and how many milliseconds of the frame monster AI may
+ *        use. Zero or less means no limit.
+ * Description: Call once per frame before planning which monsters think. The
+ *              budget is turned into a number of thinks up front, so the plan
+ *              doesn't depend on how fast the planning itself runs.
+ *----------------------------------------------------------------------------*/
+void beginAIFrame(AIScheduler* scheduler, float budgetMs)
+{
+    if (scheduler->thinkCostMs <= 0) scheduler->thinkCostMs = AI_DEFAULT_THINK_COST_MS;
+    scheduler->thinkAllowance = budgetMs > 0 ? (int)(budgetMs / scheduler->thinkCostMs) : -1;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The scheduler, how many monsters thought this frame and how long it
+ *        took them.
+ * Description: Updates the cost estimate used to size the next frame's budget.
+ *----------------------------------------------------------------------------*/
+void endAIFrame(AIScheduler* scheduler, int thinkCount, double elapsedMs)
+{
+    if (thinkCount == 0) return;
+    scheduler->thinkCostMs = 0.9 * scheduler->thinkCostMs + 0.1 * (elapsedMs / thinkCount);
+    if (scheduler->thinkCostMs < 0.0001) scheduler->thinkCostMs = 0.0001;
+}
+
+static int getThinkInterval(Monster* monster, float distanceSquared)
+{
+    if (monster->aiState == AI_CHASE || distanceSquared < AI_NEAR_DISTANCE * AI_NEAR_DISTANCE)
+        return 1;
+    if (distanceSquared < AI_FAR_DISTANCE * AI_FAR_DISTANCE)
+        return AI_MID_INTERVAL;
+    return AI_FAR_INTERVAL;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The scheduler, a monster, where it is and the player's position.
+ * Output: True if the monster should get its full update this frame (sight
+ *         check, target selection, pathfinding and audio). Otherwise the
+ *         caller should just monsterExtrapolate() it.
+ * Description: Monsters near the player or chasing it think every frame and
+ *              ignore the budget. Others think every AI_MID_INTERVAL or
+ *              AI_FAR_INTERVAL frames, and once the frame's budget is spent
+ *              they wait, unless they are already a whole interval late.
+ *              A monster about to cross a tile centre thinks then whatever
+ *              its interval, so it turns there just as it would thinking
+ *              every frame. Must be called for monsters in the same order
+ *              every frame.
+ *----------------------------------------------------------------------------*/
+bool shouldMonsterThink(AIScheduler* scheduler, Monster* monster, Vector2 pos, Vector2 playerPos)
+{
+    float dx = pos.x - playerPos.x;
+    float dy = pos.y - playerPos.y;
+    int interval = getThinkInterval(monster, dx * dx + dy * dy);
+
+    if (monster->framesSinceThink < INT_MAX) monster->framesSinceThink++;
+    bool due = monster->framesSinceThink >= interval;
+    bool overdue = monster->framesSinceThink >= 2 * interval;
+    bool overBudget = scheduler->thinkAllowance == 0;
+
+    if (interval == 1 || overdue || (due && !overBudget) || !canMonsterExtrapolate(monster, pos))
+    {
+        if (interval != 1 && scheduler->thinkAllowance > 0) scheduler->thinkAllowance--;
+        monster->framesSinceThink = 0;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,35 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include "engine_types.h"
+#include "monster.h"
+
+
+//Monsters closer than this to the player, or chasing, think every frame.
+//Must be further than the monster sight radius, so a monster that could see
+//the player never misses a sight check.
+#define AI_NEAR_DISTANCE    384.f
+#define AI_FAR_DISTANCE     1024.f
+//How many frames apart mid and far monsters think
+#define AI_MID_INTERVAL     2
+#define AI_FAR_INTERVAL     8
+
+//One per game, so each game's budget is sized from its own monsters. A zeroed
+//scheduler is ready to use.
+typedef struct
+{
+    double thinkCostMs;     //Running estimate of what one full monster update costs
+    int thinkAllowance;     //How many more optional thinks fit in this frame, -1 for no limit
+} AIScheduler;
+
+
+void beginAIFrame       (AIScheduler* scheduler, float budgetMs);
+void endAIFrame         (AIScheduler* scheduler, int thinkCount, double elapsedMs);
+bool shouldMonsterThink (AIScheduler* scheduler, Monster* monster, Vector2 pos, Vector2 playerPos);
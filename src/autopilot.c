@@ -0,0 +1,504 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "autopilot.h"
+#include "load_level.h"
+
+
+//How far the player moves in a tick, see movePlayer()
+#define PLAYER_STEP             4.f
+//Radians the autopilot turns per tick, about as fast as a player with a mouse
+#define AUTOPILOT_TURN_SPEED    0.15f
+//Only walk when heading this close to where it is going
+#define AUTOPILOT_FACING_SLACK  0.3f
+//How close to a tile's middle counts as having reached it. Turning while
+//walking cuts corners, so it can't be much less than a few steps.
+#define AUTOPILOT_REACHED_DIST  (TILE_DIMS / 4.f)
+
+typedef enum
+{
+    GOAL_PICKUPS,
+    GOAL_EXIT,
+    GOAL_DOOR,          //Any door it can open, what is behind may be the way round
+    GOAL_SAFE_TILE      //Any tile far enough from the monsters to wait on
+} AutopilotGoal;
+
+typedef enum
+{
+    MONSTER_PATROLLING, //Somewhere else along its patrol soon
+    MONSTER_GUARDING,   //Patrols a single tile, so stays where it is
+    MONSTER_CHASING
+} MonsterBehaviour;
+
+static const int neighbourX[4] = { 1, -1, 0, 0 };
+static const int neighbourY[4] = { 0, 0, 1, -1 };
+
+
+static void reserveAutopilot(Autopilot* autopilot, int tileCount)
+{
+    if (tileCount <= autopilot->tileCapacity) return;
+    //MALLOC reused between plans and levels, freed by freeAutopilot()
+    autopilot->tileCapacity = tileCount;
+    autopilot->cameFrom = (int*)realloc(autopilot->cameFrom, tileCount * sizeof(int));
+    autopilot->queue = (int*)realloc(autopilot->queue, tileCount * sizeof(int));
+    autopilot->path = (int*)realloc(autopilot->path, tileCount * sizeof(int));
+    autopilot->patrolDistance = (int*)realloc(autopilot->patrolDistance, tileCount * sizeof(int));
+    autopilot->guardDistance = (int*)realloc(autopilot->guardDistance, tileCount * sizeof(int));
+    autopilot->chaseDistance = (int*)realloc(autopilot->chaseDistance, tileCount * sizeof(int));
+    autopilot->goals = (bool*)realloc(autopilot->goals, tileCount * sizeof(bool));
+    autopilot->deathTiles = (bool*)realloc(autopilot->deathTiles, tileCount * sizeof(bool));
+    memset(autopilot->deathTiles, 0, tileCount * sizeof(bool));
+}
+
+//Which key opens a door tile, -1 if it isn't a locked door
+static int getDoorKeyId(char tile)
+{
+    if (tile == TILE_DOOR0) return 0;
+    if (tile == TILE_DOOR1) return 1;
+    if (tile == TILE_DOOR2) return 2;
+    if (tile == TILE_DOOR3) return 3;
+    return -1;
+}
+
+//Doors it has the key for and secret doors are opened on the way
+static bool canWalkThrough(const Game* game, int index)
+{
+    if (!isTileSolid(&game->level, index)) return true;
+    char tile = getLevelTile(&game->level, index);
+    if (tile == TILE_SECRET_DOOR) return true;
+    int keyId = getDoorKeyId(tile);
+    return keyId >= 0 && game->playerData.keysCollected[keyId];
+}
+
+static Vector2 getTileCentre(const Level* level, int index)
+{
+    Vector2 centre = { (index % level->width) * TILE_DIMS + TILE_DIMS / 2,
+                       (index / level->width) * TILE_DIMS + TILE_DIMS / 2 };
+    return centre;
+}
+
+static void markGoal(Autopilot* autopilot, const Level* level, Vector2 pos)
+{
+    int index = posVecToTileIndex(level, pos);
+    if (isTileIndexValid(level, index)) autopilot->goals[index] = true;
+}
+
+//Which way a monster can be expected to move from here
+static MonsterBehaviour getMonsterBehaviour(const MonsterPool* monsters, int monsterIndex)
+{
+    const Monster* monster = &monsters->monsters[monsterIndex];
+    if (monster->aiState == AI_CHASE) return MONSTER_CHASING;
+    const Vector2Int* patrolPoints = monsters->patrolPoints + monster->patrolStart;
+    for (int i = 1; i < monster->patrolLength; i++)
+    {
+        if (patrolPoints[i].x != patrolPoints[0].x || patrolPoints[i].y != patrolPoints[0].y) return MONSTER_PATROLLING;
+    }
+    return MONSTER_GUARDING;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The autopilot, the game, where to put the distances and which of the
+ *        monsters to measure to.
+ * Description: Finds how many tiles each tile is from the nearest of the
+ *              monsters, walking the way monsters do. Tiles further than
+ *              AUTOPILOT_MONSTER_RANGE are left at that.
+ *----------------------------------------------------------------------------*/
+static void findMonsterDistances(Autopilot* autopilot, const Game* game, int* distances, MonsterBehaviour behaviour)
+{
+    const Level* level = &game->level;
+    const MonsterPool* monsters = &game->pools.monsters;
+    int tileCount = level->width * level->height;
+    for (int i = 0; i < tileCount; i++) distances[i] = AUTOPILOT_MONSTER_RANGE;
+
+    int head = 0;
+    int tail = 0;
+    for (int i = 0; i < monsters->count; i++)
+    {
+        int index = posVecToTileIndex(level, monsters->pos[i]);
+        if (getMonsterBehaviour(monsters, i) != behaviour) continue;
+        if (!isTileIndexValid(level, index) || distances[index] == 0) continue;
+        distances[index] = 0;
+        autopilot->queue[tail++] = index;
+    }
+    while (head < tail)
+    {
+        int index = autopilot->queue[head++];
+        int distance = distances[index] + 1;
+        if (distance >= AUTOPILOT_MONSTER_RANGE) continue;
+
+        int x = index % level->width;
+        int y = index / level->width;
+        for (int n = 0; n < 4; n++)
+        {
+            int nextX = x + neighbourX[n];
+            int nextY = y + neighbourY[n];
+            if (nextX < 0 || nextY < 0 || nextX >= level->width || nextY >= level->height) continue;
+            int next = coordToTileIndex(level, nextX, nextY);
+            //Monsters don't open doors
+            if (distances[next] <= distance || isTileSolid(level, next)) continue;
+            distances[next] = distance;
+            autopilot->queue[tail++] = next;
+        }
+    }
+}
+
+//Tiles from a tile the player gets to steps tiles along to the nearest
+//monster that could come for it. Chasing monsters follow the player, but
+//where patrolling ones will be once it is further than AUTOPILOT_LOOKAHEAD
+//along isn't known, it will have replanned by then.
+static int getMonsterDistanceAt(const Autopilot* autopilot, int index, int steps)
+{
+    int chase = autopilot->chaseDistance[index];
+    int patrol = autopilot->patrolDistance[index];
+    return steps <= AUTOPILOT_LOOKAHEAD && patrol < chase ? patrol : chase;
+}
+
+static int getMonsterDistance(const Autopilot* autopilot, int index)
+{
+    int distance = getMonsterDistanceAt(autopilot, index, 0);
+    int guard = autopilot->guardDistance[index];
+    return guard < distance ? guard : distance;
+}
+
+//Whether the player gets to a tile steps tiles away well before any monster
+//could, as monsters walk at half its speed
+static bool isSafeToReach(const Autopilot* autopilot, int index, int steps)
+{
+    if (autopilot->guardDistance[index] <= 1) return false;
+    int distance = getMonsterDistanceAt(autopilot, index, steps);
+    return distance >= AUTOPILOT_MONSTER_RANGE || steps + AUTOPILOT_SAFETY_MARGIN < 2 * distance;
+}
+
+//Whether the player could walk back the way it came from a goal steps tiles
+//away, staying ahead of the monsters until it is as far from them as it
+//waits for them at. A chasing monster follows it anywhere, so with one about
+//it has to stay ahead all the way back. Keeps it out of dead ends a monster
+//will be in before it gets out.
+static bool canWalkBack(const Autopilot* autopilot, int goal, int steps)
+{
+    int index = goal;
+    while (autopilot->cameFrom[index] != index)
+    {
+        index = autopilot->cameFrom[index];
+        steps++;
+        int distance = getMonsterDistanceAt(autopilot, index, steps);
+        if (distance >= AUTOPILOT_MONSTER_RANGE) continue;
+        int lead = 2 * distance - steps;
+        if (lead <= AUTOPILOT_SAFETY_MARGIN) return false;
+        if (lead >= 2 * AUTOPILOT_WAIT_DISTANCE && autopilot->chaseDistance[index] >= AUTOPILOT_MONSTER_RANGE) return true;
+    }
+    return true;
+}
+
+//Whether a tile is near a monster as things are now, rather than as they
+//were when the route was planned
+static bool isTileNearMonster(const Game* game, int index)
+{
+    const MonsterPool* monsters = &game->pools.monsters;
+    int x = index % game->level.width;
+    int y = index / game->level.width;
+    for (int i = 0; i < monsters->count; i++)
+    {
+        if (getMonsterBehaviour(monsters, i) == MONSTER_GUARDING) continue;
+        int dx = (int)(monsters->pos[i].x / TILE_DIMS) - x;
+        int dy = (int)(monsters->pos[i].y / TILE_DIMS) - y;
+        if (abs(dx) <= AUTOPILOT_MONSTER_CLEARANCE && abs(dy) <= AUTOPILOT_MONSTER_CLEARANCE) return true;
+    }
+    return false;
+}
+
+//Goals are the pickups left, or once they are given up on, the exit
+static void markGoals(Autopilot* autopilot, const Game* game, AutopilotGoal goal)
+{
+    const Level* level = &game->level;
+    int tileCount = level->width * level->height;
+    for (int i = 0; i < tileCount; i++)
+    {
+        autopilot->goals[i] = (goal == GOAL_EXIT && getLevelTile(level, i) == TILE_LEVEL_END) ||
+                              (goal == GOAL_DOOR && isTileSolid(level, i) && canWalkThrough(game, i)) ||
+                              (goal == GOAL_SAFE_TILE && autopilot->patrolDistance[i] >= AUTOPILOT_WAIT_DISTANCE &&
+                               autopilot->guardDistance[i] >= AUTOPILOT_WAIT_DISTANCE &&
+                               autopilot->chaseDistance[i] >= AUTOPILOT_MONSTER_RANGE &&
+                               !autopilot->deathTiles[i]);
+    }
+    if (goal != GOAL_PICKUPS) return;
+    const PickupPool* pickups[2] = { &game->pools.rubies, &game->pools.keys };
+    for (int p = 0; p < 2; p++)
+    {
+        for (int i = 0; i < pickups[p]->count; i++)
+        {
+            markGoal(autopilot, level, pickups[p]->pos[i]);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The autopilot, the game, the tile to search from and whether to
+ *        settle for the tile furthest from the monsters when no goal can be
+ *        reached.
+ * Output: The nearest goal tile by walking distance, or -1 if none can be
+ *         reached. cameFrom leads back from it to start.
+ * Description: A breadth first search over the tiles, so unlike the monsters'
+ *              A* it finds the closest of many goals in one go. Only tiles
+ *              the player gets to well before any monster are walked, and
+ *              goals it couldn't walk back from are passed over.
+ *----------------------------------------------------------------------------*/
+static int findNearestGoal(Autopilot* autopilot, const Game* game, int start, bool orSafest)
+{
+    const Level* level = &game->level;
+    int tileCount = level->width * level->height;
+    for (int i = 0; i < tileCount; i++) autopilot->cameFrom[i] = -1;
+
+    int head = 0;
+    int tail = 0;
+    autopilot->queue[tail++] = start;
+    autopilot->cameFrom[start] = start;
+    int safest = start;
+    //The search goes out a tile at a time, steps is how far the tiles up to
+    //stepEnd in the queue are from start
+    int steps = 0;
+    int stepEnd = tail;
+    while (head < tail)
+    {
+        if (head == stepEnd)
+        {
+            steps++;
+            stepEnd = tail;
+        }
+        int index = autopilot->queue[head++];
+        if (autopilot->goals[index] && (orSafest || canWalkBack(autopilot, index, steps)))
+        {
+            return index;
+        }
+        if (getMonsterDistance(autopilot, index) > getMonsterDistance(autopilot, safest)) safest = index;
+
+        int x = index % level->width;
+        int y = index / level->width;
+        for (int n = 0; n < 4; n++)
+        {
+            int nextX = x + neighbourX[n];
+            int nextY = y + neighbourY[n];
+            if (nextX < 0 || nextY < 0 || nextX >= level->width || nextY >= level->height) continue;
+            int next = coordToTileIndex(level, nextX, nextY);
+            if (autopilot->cameFrom[next] != -1 || !canWalkThrough(game, next)) continue;
+            if (!isSafeToReach(autopilot, next, steps + 1)) continue;
+            if (autopilot->deathTiles[next] && !autopilot->goals[next]) continue;
+            autopilot->cameFrom[next] = index;
+            autopilot->queue[tail++] = next;
+        }
+    }
+    return orSafest ? safest : -1;
+}
+
+//Of the tiles next to start, the one furthest from the monsters if it is
+//further than start, otherwise start
+static int findBackOffTile(Autopilot* autopilot, const Game* game, int start)
+{
+    const Level* level = &game->level;
+    int best = start;
+    int x = start % level->width;
+    int y = start / level->width;
+    for (int n = 0; n < 4; n++)
+    {
+        int nextX = x + neighbourX[n];
+        int nextY = y + neighbourY[n];
+        if (nextX < 0 || nextY < 0 || nextX >= level->width || nextY >= level->height) continue;
+        int next = coordToTileIndex(level, nextX, nextY);
+        if (!canWalkThrough(game, next) || autopilot->deathTiles[next]) continue;
+        if (getMonsterDistance(autopilot, next) > getMonsterDistance(autopilot, best)) best = next;
+    }
+    autopilot->cameFrom[best] = start;
+    return best;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Picks where to go next. Pickups that can be reached without
+ *              coming near a monster come first, then the exit by the same
+ *              rule. When monsters are in the way of both it never walks
+ *              past them. It waits for the way to clear on the nearest tile
+ *              far enough from them, staying put if already on one, or if
+ *              there is no such tile on its side of them the furthest from
+ *              them it can get to. With a monster already too close it backs
+ *              off a tile at a time.
+ *----------------------------------------------------------------------------*/
+static void planRoute(Autopilot* autopilot, const Game* game)
+{
+    const Level* level = &game->level;
+    int start = posVecToTileIndex(level, game->player.pos);
+    autopilot->pathLength = 0;
+    autopilot->pathPos = 0;
+    autopilot->waiting = true;
+    if (!isTileIndexValid(level, start)) return;
+
+    findMonsterDistances(autopilot, game, autopilot->patrolDistance, MONSTER_PATROLLING);
+    findMonsterDistances(autopilot, game, autopilot->guardDistance, MONSTER_GUARDING);
+    findMonsterDistances(autopilot, game, autopilot->chaseDistance, MONSTER_CHASING);
+
+    static const AutopilotGoal passes[] = { GOAL_PICKUPS, GOAL_EXIT, GOAL_DOOR, GOAL_SAFE_TILE };
+    for (size_t p = 0; p < sizeof(passes) / sizeof(passes[0]); p++)
+    {
+        markGoals(autopilot, game, passes[p]);
+        int goal = findNearestGoal(autopilot, game, start, passes[p] == GOAL_SAFE_TILE);
+        if (goal < 0) continue;
+        if (goal == start && !autopilot->goals[start]) goal = findBackOffTile(autopilot, game, start);
+        autopilot->waiting = passes[p] == GOAL_SAFE_TILE;
+
+        //Walk back from the goal, then flip so the path runs from the player
+        for (int index = goal; index != start; index = autopilot->cameFrom[index])
+        {
+            autopilot->path[autopilot->pathLength++] = index;
+        }
+        autopilot->path[autopilot->pathLength++] = start;
+        for (int i = 0; i < autopilot->pathLength / 2; i++)
+        {
+            int swap = autopilot->path[i];
+            autopilot->path[i] = autopilot->path[autopilot->pathLength - 1 - i];
+            autopilot->path[autopilot->pathLength - 1 - i] = swap;
+        }
+        //Head straight for the next tile, going back to the middle of the
+        //player's own tile would turn it round every replan
+        if (autopilot->pathLength > 1) autopilot->pathPos = 1;
+        return;
+    }
+}
+
+//Turns towards target no faster than a player could. Walks with whichever of
+//forward, back and the strafes is heading at it, so backing away from a
+//monster doesn't wait on turning round. Returns how far from facing target
+//the player will still be.
+static float steerTowards(TickInput* input, const Player* player, Vector2 target, bool walk)
+{
+    //Clockwise from forward, as angles from the facing
+    static const InputButton walkButtons[4] = { INPUT_FORWARD, INPUT_STRAFE_RIGHT, INPUT_BACK, INPUT_STRAFE_LEFT };
+
+    float wanted = atan2f(target.y - player->pos.y, target.x - player->pos.x);
+    float turn = constrainAngle(wanted - player->rotation);
+    if (turn > AUTOPILOT_TURN_SPEED) turn = AUTOPILOT_TURN_SPEED;
+    if (turn < -AUTOPILOT_TURN_SPEED) turn = -AUTOPILOT_TURN_SPEED;
+    input->rotation = player->rotation + turn;
+    float offset = constrainAngle(wanted - input->rotation);
+    int walkDir = (int)lroundf(offset / (M_PI / 2)) & 3;
+    if (walk && fabsf(constrainAngle(offset - walkDir * M_PI / 2)) < AUTOPILOT_FACING_SLACK)
+    {
+        input->buttons |= walkButtons[walkDir];
+    }
+    return fabsf(offset);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The autopilot and the game it is playing, as left by the last tick.
+ * Output: What to pass to the next tickGame().
+ * Description: Replans every AUTOPILOT_REPLAN_TICKS, when the end of the path
+ *              is reached, when a monster comes near the next tile and when
+ *              it hasn't been able to move for a while. While waiting for a
+ *              monster to clear the way it replans every AUTOPILOT_WAIT_TICKS
+ *              instead. Between plans it walks from tile centre to tile
+ *              centre, and stops in front of locked doors to open them with
+ *              USE.
+ *----------------------------------------------------------------------------*/
+TickInput getAutopilotInput(Autopilot* autopilot, const Game* game)
+{
+    const Player* player = &game->player;
+    const Level* level = &game->level;
+    TickInput input = { .rotation=player->rotation };
+    reserveAutopilot(autopilot, level->width * level->height);
+
+    //Levels restart the same, so it keeps away from where it died rather
+    //than walk into the same death again
+    if (game->playerData.levelNumber != autopilot->levelNumber)
+    {
+        autopilot->levelNumber = game->playerData.levelNumber;
+        memset(autopilot->deathTiles, 0, level->width * level->height * sizeof(bool));
+    }
+    if (game->events & GAME_EVENT_PLAYER_DIED)
+    {
+        int index = posVecToTileIndex(level, player->pos);
+        if (isTileIndexValid(level, index)) autopilot->deathTiles[index] = true;
+    }
+
+    if (game->finished || game->paused)
+    {
+        //Fading in or dying, the level may be different when play resumes
+        autopilot->pathLength = 0;
+        autopilot->stillTicks = 0;
+        return input;
+    }
+
+    float moved = fabsf(player->pos.x - autopilot->lastPos.x) + fabsf(player->pos.y - autopilot->lastPos.y);
+    autopilot->stillTicks = moved < PLAYER_STEP / 4 ? autopilot->stillTicks + 1 : 0;
+    autopilot->lastPos = player->pos;
+
+    //Waiting, or with no plan at all, isn't retried every tick, searching a
+    //big level every tick for a goal that isn't there costs too much
+    bool replan;
+    if (autopilot->waiting || autopilot->pathLength == 0)
+    {
+        replan = game->tick - autopilot->planTick >= AUTOPILOT_WAIT_TICKS;
+    }
+    else
+    {
+        replan = autopilot->pathPos >= autopilot->pathLength ||
+                 game->tick - autopilot->planTick >= AUTOPILOT_REPLAN_TICKS ||
+                 autopilot->stillTicks >= AUTOPILOT_STUCK_TICKS ||
+                 isTileNearMonster(game, autopilot->path[autopilot->pathPos]);
+    }
+    if (replan)
+    {
+        planRoute(autopilot, game);
+        autopilot->planTick = game->tick;
+        autopilot->stillTicks = 0;
+        if (autopilot->pathLength == 0) return input;
+    }
+
+    if (autopilot->pathPos >= autopilot->pathLength) return input;
+
+    //Move on to the next tile once the middle of this one is reached
+    Vector2 targetPos = getTileCentre(level, autopilot->path[autopilot->pathPos]);
+    if (distanceFormula(player->pos, targetPos) <= AUTOPILOT_REACHED_DIST)
+    {
+        autopilot->pathPos++;
+        if (autopilot->pathPos >= autopilot->pathLength) return input;
+        targetPos = getTileCentre(level, autopilot->path[autopilot->pathPos]);
+    }
+
+    int target = autopilot->path[autopilot->pathPos];
+    if (isTileSolid(level, target))
+    {
+        //A door the player has the key for or a secret door. Get to the
+        //middle of the tile in front of it, then face it and open it.
+        Vector2 frontPos = getTileCentre(level, autopilot->path[autopilot->pathPos - 1]);
+        if (distanceFormula(player->pos, frontPos) > AUTOPILOT_REACHED_DIST)
+        {
+            steerTowards(&input, player, frontPos, true);
+            return input;
+        }
+        //USE looks a tile ahead, so facing roughly at the door is enough
+        if (steerTowards(&input, player, targetPos, false) < AUTOPILOT_TURN_SPEED)
+        {
+            input.buttons |= INPUT_USE;
+        }
+        return input;
+    }
+    steerTowards(&input, player, targetPos, true);
+    return input;
+}
+
+void freeAutopilot(Autopilot* autopilot)
+{
+    free(autopilot->cameFrom);
+    free(autopilot->queue);
+    free(autopilot->path);
+    free(autopilot->patrolDistance);
+    free(autopilot->guardDistance);
+    free(autopilot->chaseDistance);
+    free(autopilot->goals);
+    free(autopilot->deathTiles);
+    memset(autopilot, 0, sizeof(Autopilot));
+}
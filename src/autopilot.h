@@ -0,0 +1,68 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "game.h"
+
+
+//How often the route is replanned while walking it, since monsters move
+#define AUTOPILOT_REPLAN_TICKS  30
+//How often the route is replanned while waiting for a monster to move away
+#define AUTOPILOT_WAIT_TICKS    10
+//Ticks without moving before the autopilot gives up on its route
+#define AUTOPILOT_STUCK_TICKS   90
+//Replans straight away when a moving monster comes this many tiles from the
+//next tile
+#define AUTOPILOT_MONSTER_CLEARANCE 2
+//Tiles are only walked into when the player gets there this many tiles'
+//walk before a monster could
+#define AUTOPILOT_SAFETY_MARGIN 1
+//Patrolling monsters only count for this many tiles along a route, it is
+//replanned before it gets further
+#define AUTOPILOT_LOOKAHEAD     3
+//Waits for monsters to get out of the way at least this many tiles from them
+#define AUTOPILOT_WAIT_DISTANCE 5
+//Monsters further than this many tiles away count as being this far
+#define AUTOPILOT_MONSTER_RANGE 16
+
+/*------------------------------------------------------------------------------
+ * Plays a level the way a player would: walks to the nearest ruby or key,
+ * opens secret doors and the doors it has keys for, waits for monsters to
+ * get out of its way rather than pass them and heads for the exit once
+ * nothing else can be reached. Its input only depends on the game,
+ * so a game driven by it records and replays like any other. A zeroed
+ * autopilot is ready to use.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    int tileCapacity;
+    int* cameFrom;          //Per tile, the tile the search reached it from, -1 if not reached
+    int* queue;
+    int* patrolDistance;    //Per tile, tiles to the nearest patrolling monster
+    int* guardDistance;     //Per tile, tiles to the nearest monster guarding a single tile
+    int* chaseDistance;     //Per tile, tiles to the nearest monster chasing the player
+    bool* goals;            //Per tile, whether it is somewhere to go
+
+    int* path;              //Tiles to walk through, the player's own tile first
+    int pathLength;
+    int pathPos;            //Index in path of the tile being walked to
+    bool waiting;           //Backing off from or holding clear of a monster in the way
+
+    int levelNumber;
+    bool* deathTiles;       //Per tile, whether the player has died there on this level
+
+    uint32_t planTick;      //Game tick the path was planned on
+    uint32_t stillTicks;    //Ticks the player hasn't moved while trying to
+    Vector2 lastPos;
+} Autopilot;
+
+
+TickInput getAutopilotInput  (Autopilot* autopilot, const Game* game);
+void      freeAutopilot      (Autopilot* autopilot);
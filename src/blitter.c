@@ -0,0 +1,162 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "blitter.h"
+#include "render_kernels.h"
+
+
+//Texture coordinates are stepped in 16.16 fixed point
+#define FIXED_SHIFT 16
+#define FIXED_ONE   (1 << FIXED_SHIFT)
+
+static const uint32_t COLOR_KEY = 0xFFFF00FF;
+
+
+static const uint32_t* getImageRow(SDL_Surface* image, int y)
+{
+    return (const uint32_t*)((const uint8_t*)image->pixels + y * image->pitch);
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      GfxContext* gfx: The context to draw into
+ *      SDL_Surface* image: The image to be drawn
+ *      Rectangle* srcRect: The part of the image to draw, NULL for all of it
+ *      Rectangle destRect: The rectangle on the screen to draw it to
+ *      uint32_t maskColor: The colour to replace 0xFFFF00FF with.
+ * Description:
+ *      Draws part of an image, scaling as neccessary, to destRect, so sprite
+ *      sheets can be drawn from. The colour 0xFFFF00FF (bright pink) is
+ *      replaced with the colour maskColor. Whatever of destRect is off the
+ *      screen is cropped. Scaled, the image column under each screen column
+ *      is worked out once in fixed point and each row is read through that
+ *      table. Unscaled, rows are copied straight across. Rows are blended
+ *      with the blendRow render kernel.
+ *----------------------------------------------------------------------------*/
+void blitToPixelBuffer(GfxContext* gfx, SDL_Surface* image, const Rectangle* srcRect, Rectangle destRect, uint32_t maskColor)
+{
+    Rectangle src = { 0, 0, image->w, image->h };
+    if (srcRect != NULL) src = *srcRect;
+    if (destRect.w <= 0 || destRect.h <= 0 || src.w <= 0 || src.h <= 0) return;
+
+    //Crop to the screen
+    int left = destRect.x < 0 ? -destRect.x : 0;
+    int top = destRect.y < 0 ? -destRect.y : 0;
+    int right = destRect.x + destRect.w > gfx->pixelBuffer.width ? gfx->pixelBuffer.width - destRect.x : destRect.w;
+    int bottom = destRect.y + destRect.h > gfx->pixelBuffer.height ? gfx->pixelBuffer.height - destRect.y : destRect.h;
+    if (left >= right || top >= bottom) return;
+    int count = right - left;
+    const RenderKernels* kernels = getRenderKernels();
+
+    uint32_t stepX = (uint32_t)(((uint64_t)src.w << FIXED_SHIFT) / destRect.w);
+    uint32_t stepY = (uint32_t)(((uint64_t)src.h << FIXED_SHIFT) / destRect.h);
+    //Rows are picked with stepY either way, only columns need the table
+    bool sameWidth = src.w == destRect.w;
+    if (!sameWidth)
+    {
+        uint32_t u = left * stepX;
+        for (int x = 0; x < count; x++, u += stepX)
+        {
+            gfx->blitColumns[x] = src.x + (int)(u >> FIXED_SHIFT);
+        }
+    }
+
+    uint32_t v = top * stepY;
+    int gatheredRow = -1;
+    for (int y = top; y < bottom; y++, v += stepY)
+    {
+        int sourceRow = src.y + (int)(v >> FIXED_SHIFT);
+        const uint32_t* source = getImageRow(image, sourceRow);
+        uint32_t* dest = gfx->pixelBuffer.pixels + (destRect.y + y) * gfx->pixelBuffer.pitch + destRect.x + left;
+        if (sameWidth)
+        {
+            kernels->blendRow(dest, source + src.x + left, count, maskColor);
+            continue;
+        }
+        //Scaled up, neighbouring screen rows often show the same image row
+        if (sourceRow != gatheredRow)
+        {
+            for (int x = 0; x < count; x++) gfx->scratchRow[x] = source[gfx->blitColumns[x]];
+            gatheredRow = sourceRow;
+        }
+        kernels->blendRow(dest, gfx->scratchRow, count, maskColor);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pixel buffer to draw into, the one to draw on it and where its
+ *        top left goes.
+ * Description: Copies source across unscaled, leaving out pixels with no
+ *              alpha. Whatever is outside dest is cropped.
+ *----------------------------------------------------------------------------*/
+void blendPixelBuffer(PixelBuffer* dest, const PixelBuffer* source, int x, int y)
+{
+    int left = x < 0 ? -x : 0;
+    int top = y < 0 ? -y : 0;
+    int right = x + source->width > dest->width ? dest->width - x : source->width;
+    int bottom = y + source->height > dest->height ? dest->height - y : source->height;
+    if (left >= right || top >= bottom) return;
+    const RenderKernels* kernels = getRenderKernels();
+
+    for (int row = top; row < bottom; row++)
+    {
+        //The colour key is replaced with itself, so it is left alone
+        kernels->blendRow(dest->pixels + (y + row) * dest->pitch + x + left,
+                 source->pixels + row * source->pitch + left, right - left, COLOR_KEY);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The context, the image, the rectangle to draw it in, centred on
+ *        destRect's x and y, the colour to replace 0xFFFF00FF with and the
+ *        angle to turn it by.
+ * Description: Along a screen row the texture coordinates change by the same
+ *              amount every pixel, so they are only worked out at the start
+ *              of each row and then stepped in fixed point.
+ *----------------------------------------------------------------------------*/
+void rotatedBlitToPixelBuffer(GfxContext* gfx, SDL_Surface* image, Rectangle destRect, uint32_t maskColor, float angle)
+{
+    if (destRect.w <= 0 || destRect.h <= 0) return;
+    float cosTheta = cosf(angle);
+    float sinTheta = sinf(angle);
+    float scaleX = image->w / (float)destRect.w;
+    float scaleY = image->h / (float)destRect.h;
+
+    //Crop to the screen
+    int startX = -destRect.w / 2;
+    int endX = destRect.w / 2;
+    int startY = -destRect.h / 2;
+    int endY = destRect.h / 2;
+    if (destRect.x + startX < 0) startX = -destRect.x;
+    if (destRect.x + endX > gfx->pixelBuffer.width) endX = gfx->pixelBuffer.width - destRect.x;
+    if (destRect.y + startY < 0) startY = -destRect.y;
+    if (destRect.y + endY > gfx->pixelBuffer.height) endY = gfx->pixelBuffer.height - destRect.y;
+    if (startX >= endX || startY >= endY) return;
+    int count = endX - startX;
+    const RenderKernels* kernels = getRenderKernels();
+
+    int32_t stepU = (int32_t)(cosTheta * scaleX * FIXED_ONE);
+    int32_t stepV = (int32_t)(-sinTheta * scaleY * FIXED_ONE);
+    for (int y = startY; y < endY; y++)
+    {
+        int32_t u = (int32_t)(((startX * cosTheta + y * sinTheta) + destRect.w / 2) * scaleX * FIXED_ONE);
+        int32_t v = (int32_t)(((-startX * sinTheta + y * cosTheta) + destRect.h / 2) * scaleY * FIXED_ONE);
+        for (int x = 0; x < count; x++, u += stepU, v += stepV)
+        {
+            int texCoordX = u >> FIXED_SHIFT;
+            int texCoordY = v >> FIXED_SHIFT;
+            //Outside the image is transparent
+            bool inside = (unsigned)texCoordX < (unsigned)image->w && (unsigned)texCoordY < (unsigned)image->h;
+            gfx->scratchRow[x] = inside ? getImageRow(image, texCoordY)[texCoordX] : 0;
+        }
+        uint32_t* dest = gfx->pixelBuffer.pixels + (destRect.y + y) * gfx->pixelBuffer.pitch + destRect.x + startX;
+        kernels->blendRow(dest, gfx->scratchRow, count, maskColor);
+    }
+}
@@ -0,0 +1,23 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "engine_types.h"
+#include "gfx_engine.h"
+
+
+void blitToPixelBuffer        (GfxContext* gfx, SDL_Surface* image, const Rectangle* srcRect, Rectangle destRect, uint32_t maskColor);
+void rotatedBlitToPixelBuffer (GfxContext* gfx, SDL_Surface* image, Rectangle destRect, uint32_t maskColor, float angle);
+void blendPixelBuffer         (PixelBuffer* dest, const PixelBuffer* source, int x, int y);
@@ -28,6 +28,7 @@ typedef struct
     uint32_t* pixels;
     int width;
     int height;
+    int pitch;          //Pixels from the start of one row to the next
 } PixelBuffer;
 
 typedef struct
@@ -69,28 +70,6 @@ typedef struct
     int animationSpeed;
 } EntityTemplate;
 
-typedef struct
-{
-    Vector2 pos;
-    float zPos;
-    int xClip;
-    int yClip;
-    EntityTemplate* base;
-    void* sub;
-    int xClipCounter;
-} Entity;
-
-typedef struct
-{
-    int size;
-    Entity* data;
-} EntityArray;
-
-typedef struct
-{
-    int id;
-} Key;
-
 typedef struct
 {
     int levelNumber;
@@ -108,6 +87,10 @@ typedef struct
 
 typedef SDL_Rect Rectangle;
 
+//Defined in load_level.h, declared here so a level can be passed through
+//modules that don't need to look inside it
+typedef struct Level Level;
+
 //TODO should have tile type with properties such as isSolid, keyId
 
 Vector2 vec2Unit       (Vector2 vector);
@@ -0,0 +1,216 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "entity_pools.h"
+#include "load_level.h"
+
+
+//Grows capacity to hold at least count, returning whether it had to
+static bool growCapacity(int* capacity, int count)
+{
+    if (count <= *capacity) return false;
+    *capacity = *capacity == 0 ? 16 : *capacity * 2;
+    if (*capacity < count) *capacity = count;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pools and the template every entity in each pool is drawn with.
+ * Description: Call once at start up. The pools keep their memory between
+ *              levels, clearEntityPools() only empties them.
+ *----------------------------------------------------------------------------*/
+void initEntityPools(EntityPools* pools, EntityTemplate* rubyTemplate, EntityTemplate* keyTemplate,
+                     EntityTemplate* monsterTemplate, EntityTemplate* portalTemplate)
+{
+    memset(pools, 0, sizeof(EntityPools));
+    pools->rubies.base = rubyTemplate;
+    pools->keys.base = keyTemplate;
+    pools->monsters.base = monsterTemplate;
+    pools->portals.base = portalTemplate;
+}
+
+void clearEntityPools(EntityPools* pools)
+{
+    for (int i = 0; i < pools->monsters.count; i++)
+    {
+        LinkedList* pathList = &pools->monsters.monsters[i].pathList;
+        while (pathList->front != NULL) linkedListRemoveFront(pathList);
+    }
+    pools->rubies.count = 0;
+    pools->keys.count = 0;
+    pools->monsters.count = 0;
+    pools->monsters.patrolPointCount = 0;
+    pools->portals.count = 0;
+}
+
+//Frees everything the pools have allocated, leaving them empty
+void freeEntityPools(EntityPools* pools)
+{
+    clearEntityPools(pools);
+    free(pools->rubies.pos);
+    free(pools->rubies.zPos);
+    free(pools->rubies.keyId);
+    freeSpatialGrid(&pools->rubies.grid);
+    free(pools->keys.pos);
+    free(pools->keys.zPos);
+    free(pools->keys.keyId);
+    freeSpatialGrid(&pools->keys.grid);
+    free(pools->monsters.pos);
+    free(pools->monsters.prevPos);
+    free(pools->monsters.xClip);
+    free(pools->monsters.xClipCounter);
+    free(pools->monsters.monsters);
+    free(pools->monsters.patrolPoints);
+    freeSpatialGrid(&pools->monsters.grid);
+    free(pools->portals.pos);
+    free(pools->portals.xClip);
+    free(pools->portals.xClipCounter);
+    initEntityPools(pools, pools->rubies.base, pools->keys.base,
+                    pools->monsters.base, pools->portals.base);
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Rebuilds the spatial grids once a level's entities have all
+ *              been added.
+ *----------------------------------------------------------------------------*/
+void buildEntityPoolGrids(EntityPools* pools, const Level* level)
+{
+    buildSpatialGrid(&pools->rubies.grid, level, pools->rubies.pos, pools->rubies.count,
+                     pools->rubies.base->width, pools->rubies.base->height);
+    buildSpatialGrid(&pools->keys.grid, level, pools->keys.pos, pools->keys.count,
+                     pools->keys.base->width, pools->keys.base->height);
+    buildSpatialGrid(&pools->monsters.grid, level, pools->monsters.pos, pools->monsters.count,
+                     pools->monsters.base->width, pools->monsters.base->height);
+}
+
+void addPickup(PickupPool* pool, Vector2 pos, float zPos, int keyId)
+{
+    if (growCapacity(&pool->capacity, pool->count + 1))
+    {
+        //MALLOC kept for the lifetime of the game, reused between levels
+        pool->pos = (Vector2*)realloc(pool->pos, pool->capacity * sizeof(Vector2));
+        pool->zPos = (float*)realloc(pool->zPos, pool->capacity * sizeof(float));
+        pool->keyId = (int*)realloc(pool->keyId, pool->capacity * sizeof(int));
+    }
+    pool->pos[pool->count] = pos;
+    pool->zPos[pool->count] = zPos;
+    pool->keyId[pool->count] = keyId;
+    pool->count++;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A pool and the index of the pickup to remove.
+ * Description: Moves the last pickup into the removed one's place, so only
+ *              indices at or above index change. Removing in descending index
+ *              order never skips one.
+ *----------------------------------------------------------------------------*/
+void removePickup(PickupPool* pool, int index)
+{
+    int last = pool->count - 1;
+    removeSpatialGridEntity(&pool->grid, index, last);
+    pool->pos[index] = pool->pos[last];
+    pool->zPos[index] = pool->zPos[last];
+    pool->keyId[index] = pool->keyId[last];
+    pool->count--;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A pool and the tile coordinates of a new monster's patrol, which it
+ *        starts at the first of.
+ *----------------------------------------------------------------------------*/
+void addMonster(MonsterPool* pool, const Vector2Int* patrolPoints, int patrolLength)
+{
+    if (growCapacity(&pool->capacity, pool->count + 1))
+    {
+        //MALLOC kept for the lifetime of the game, reused between levels
+        pool->pos = (Vector2*)realloc(pool->pos, pool->capacity * sizeof(Vector2));
+        pool->prevPos = (Vector2*)realloc(pool->prevPos, pool->capacity * sizeof(Vector2));
+        pool->xClip = (int*)realloc(pool->xClip, pool->capacity * sizeof(int));
+        pool->xClipCounter = (int*)realloc(pool->xClipCounter, pool->capacity * sizeof(int));
+        pool->monsters = (Monster*)realloc(pool->monsters, pool->capacity * sizeof(Monster));
+    }
+    if (growCapacity(&pool->patrolPointCapacity, pool->patrolPointCount + patrolLength))
+    {
+        pool->patrolPoints = (Vector2Int*)realloc(pool->patrolPoints, pool->patrolPointCapacity * sizeof(Vector2Int));
+    }
+
+    Monster* monster = &pool->monsters[pool->count];
+    memset(monster, 0, sizeof(Monster));
+    monster->direction = DIR_NONE;
+    monster->patrolStart = pool->patrolPointCount;
+    monster->patrolLength = patrolLength;
+    monster->patrolIndex = 1;
+    monster->aiState = AI_PATROL;
+    monster->giveUpChaseTimer.active = false;
+    monster->pathList.front = NULL;
+    monster->roarSoundChannel = -1;
+    monster->framesSinceThink = 0;
+    memcpy(pool->patrolPoints + pool->patrolPointCount, patrolPoints, patrolLength * sizeof(Vector2Int));
+    pool->patrolPointCount += patrolLength;
+
+    Vector2 pos = { patrolPoints[0].x * TILE_DIMS + TILE_DIMS/2,
+                    patrolPoints[0].y * TILE_DIMS + TILE_DIMS/2 };
+    pool->pos[pool->count] = pos;
+    pool->prevPos[pool->count] = pos;
+    pool->xClip[pool->count] = 0;
+    pool->xClipCounter[pool->count] = 0;
+    pool->count++;
+}
+
+void addPortal(PortalPool* pool, Vector2 pos)
+{
+    if (growCapacity(&pool->capacity, pool->count + 1))
+    {
+        //MALLOC kept for the lifetime of the game, reused between levels
+        pool->pos = (Vector2*)realloc(pool->pos, pool->capacity * sizeof(Vector2));
+        pool->xClip = (int*)realloc(pool->xClip, pool->capacity * sizeof(int));
+        pool->xClipCounter = (int*)realloc(pool->xClipCounter, pool->capacity * sizeof(int));
+    }
+    pool->pos[pool->count] = pos;
+    pool->xClip[pool->count] = 0;
+    pool->xClipCounter[pool->count] = 0;
+    pool->count++;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Call at the start of every sim tick. Remembers where the
+ *              entities that move are, so they can be drawn part way between
+ *              this tick and the next.
+ *----------------------------------------------------------------------------*/
+void saveEntityPositions(EntityPools* pools)
+{
+    memcpy(pools->monsters.prevPos, pools->monsters.pos, pools->monsters.count * sizeof(Vector2));
+}
+
+static void animate(const EntityTemplate* base, int count, int* xClip, int* xClipCounter)
+{
+    for (int i = 0; i < count; i++)
+    {
+        xClipCounter[i]++;
+        if (xClipCounter[i] > base->animationSpeed)
+        {
+            xClipCounter[i] = 0;
+            xClip[i]++;
+            if (xClip[i] * base->spriteWidth >= base->width)
+            {
+                xClip[i] = 0;
+            }
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Steps the sprite sheet animation of the pools that have one.
+ *              Pickups are a single frame, so they have no animation state.
+ *----------------------------------------------------------------------------*/
+void updateEntityAnimation(EntityPools* pools)
+{
+    animate(pools->monsters.base, pools->monsters.count, pools->monsters.xClip, pools->monsters.xClipCounter);
+    animate(pools->portals.base, pools->portals.count, pools->portals.xClip, pools->portals.xClipCounter);
+}
@@ -0,0 +1,80 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include "engine_types.h"
+#include "monster.h"
+#include "spatial_grid.h"
+
+
+/*------------------------------------------------------------------------------
+ * Entities are stored per type as structure-of-arrays pools, so each system
+ * only streams through the arrays it needs: positions are contiguous for the
+ * renderer, grid and perception, and type-specific data is stored inline
+ * rather than behind a pointer. Every entity in a pool shares its template.
+ * Removing an entity swaps the last one into its place.
+ *----------------------------------------------------------------------------*/
+
+//Rubies and keys, which sit still until the player picks them up
+typedef struct
+{
+    EntityTemplate* base;
+    int count;
+    int capacity;
+    Vector2* pos;
+    float* zPos;
+    int* keyId;             //Which doors a key opens, unused for rubies
+    SpatialGrid grid;
+} PickupPool;
+
+typedef struct
+{
+    EntityTemplate* base;
+    int count;
+    int capacity;
+    Vector2* pos;
+    Vector2* prevPos;       //Where each monster was last tick, for drawing between ticks
+    int* xClip;
+    int* xClipCounter;
+    Monster* monsters;      //AI state, only touched by the monster update
+
+    int patrolPointCount;
+    int patrolPointCapacity;
+    Vector2Int* patrolPoints;   //Every monster's patrol, see Monster.patrolStart
+    SpatialGrid grid;
+} MonsterPool;
+
+typedef struct
+{
+    EntityTemplate* base;
+    int count;
+    int capacity;
+    Vector2* pos;
+    int* xClip;
+    int* xClipCounter;
+} PortalPool;
+
+typedef struct
+{
+    PickupPool rubies;
+    PickupPool keys;
+    MonsterPool monsters;
+    PortalPool portals;
+} EntityPools;
+
+
+void initEntityPools        (EntityPools* pools, EntityTemplate* rubyTemplate, EntityTemplate* keyTemplate,
+                             EntityTemplate* monsterTemplate, EntityTemplate* portalTemplate);
+void clearEntityPools       (EntityPools* pools);
+void freeEntityPools        (EntityPools* pools);
+void buildEntityPoolGrids   (EntityPools* pools, const Level* level);
+void addPickup              (PickupPool* pool, Vector2 pos, float zPos, int keyId);
+void removePickup           (PickupPool* pool, int index);
+void addMonster             (MonsterPool* pool, const Vector2Int* patrolPoints, int patrolLength);
+void addPortal              (PortalPool* pool, Vector2 pos);
+void saveEntityPositions    (EntityPools* pools);
+void updateEntityAnimation  (EntityPools* pools);
@@ -0,0 +1,320 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "frame_pacer.h"
+
+
+#define HISTOGRAM_BIN_COUNT (FRAME_HISTOGRAM_MAX_MS * FRAME_HISTOGRAM_BINS_PER_MS)
+
+typedef struct
+{
+    PaceMode mode;
+    double rateHz;
+    uint64_t frequency;
+    uint64_t period;            //Counter ticks per frame, capped and low latency modes
+
+    uint64_t nextDeadline;      //When the current frame should be presented
+    uint64_t frameStart;        //When the current frame's work started
+    uint64_t lastPresent;
+    double workEstimate;        //Counter ticks from frame start to present
+    double sleepOvershoot;      //How much later than asked SDL_Delay wakes up
+
+    uint32_t histogram[HISTOGRAM_BIN_COUNT + 1];    //Last bin is everything longer
+    uint64_t frameCount;
+    uint64_t missedDeadlines;
+    double totalIntervalMs;
+    double minIntervalMs;
+    double maxIntervalMs;
+
+    //Input to present latency, timed from SDL event timestamps (milliseconds)
+    bool hasPendingInput;
+    uint32_t oldestPendingInput;    //Oldest input not yet taken by a frame
+    uint32_t latencyHistogram[FRAME_HISTOGRAM_MAX_MS + 1];
+    uint64_t latencyCount;
+    uint64_t totalLatencyMs;
+    uint32_t maxLatencyMs;
+} FramePacer;
+
+static FramePacer pacer = { .mode=PACE_VSYNC };
+
+
+static double countsToMs(double counts)
+{
+    return counts * 1000.0 / pacer.frequency;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A performance counter value.
+ * Description: Sleeps while the target is far enough away that SDL_Delay can't
+ *              overshoot it, then spins for the rest, so it is accurate to
+ *              well under a millisecond without burning a core the whole time.
+ *----------------------------------------------------------------------------*/
+static void waitUntil(uint64_t target)
+{
+    for (;;)
+    {
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now >= target) return;
+        double remainingMs = countsToMs(target - now);
+        if (remainingMs <= 1.0 + pacer.sleepOvershoot) break;
+
+        SDL_Delay(1);
+        double sleptMs = countsToMs(SDL_GetPerformanceCounter() - now);
+        //Track the worst recent oversleep, decaying slowly
+        double overshoot = sleptMs - 1.0;
+        if (overshoot > pacer.sleepOvershoot) pacer.sleepOvershoot = overshoot;
+        else pacer.sleepOvershoot = 0.99 * pacer.sleepOvershoot + 0.01 * overshoot;
+    }
+    while (SDL_GetPerformanceCounter() < target) {}
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A mode name from the command line: "vsync", "uncapped", "lowlatency"
+ *        or a rate in Hz to cap at. Low latency may be given a rate after a
+ *        colon, e.g. "lowlatency:144", and defaults to 60.
+ * Output: False if the name wasn't recognised.
+ *----------------------------------------------------------------------------*/
+bool parsePaceMode(const char* name, PaceMode* mode, double* rateHz)
+{
+    if (strcmp(name, "vsync") == 0)
+    {
+        *mode = PACE_VSYNC;
+        return true;
+    }
+    if (strcmp(name, "uncapped") == 0)
+    {
+        *mode = PACE_UNCAPPED;
+        return true;
+    }
+    if (strncmp(name, "lowlatency", 10) == 0)
+    {
+        *mode = PACE_LOW_LATENCY;
+        *rateHz = name[10] == ':' ? atof(name + 11) : 60.0;
+        return *rateHz > 0;
+    }
+    double rate = atof(name);
+    if (rate <= 0) return false;
+    *mode = PACE_CAPPED;
+    *rateHz = rate;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: How frames should be paced, and the rate for the capped and low
+ *        latency modes.
+ * Description: Call before the renderer is created, see isFramePacerVsync().
+ *----------------------------------------------------------------------------*/
+void initFramePacer(PaceMode mode, double rateHz)
+{
+    memset(&pacer, 0, sizeof(pacer));
+    pacer.mode = mode;
+    pacer.rateHz = rateHz;
+    pacer.frequency = SDL_GetPerformanceFrequency();
+    pacer.period = rateHz > 0 ? (uint64_t)(pacer.frequency / rateHz) : 0;
+    pacer.sleepOvershoot = 1.0;
+    pacer.minIntervalMs = 1e9;
+    pacer.workEstimate = pacer.period / 2.0;
+}
+
+//Whether the renderer should be created with SDL_RENDERER_PRESENTVSYNC
+bool isFramePacerVsync(void)
+{
+    return pacer.mode == PACE_VSYNC;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Call at the very top of the frame, before polling input. In
+ *              capped mode it waits for the next frame slot. In low latency
+ *              mode it waits until just long enough before the deadline to do
+ *              the frame's work, so input is read as late as possible.
+ *----------------------------------------------------------------------------*/
+void waitForFrameStart(void)
+{
+    if (pacer.mode == PACE_CAPPED || pacer.mode == PACE_LOW_LATENCY)
+    {
+        uint64_t now = SDL_GetPerformanceCounter();
+        pacer.nextDeadline += pacer.period;
+        //Fell more than a frame behind, start a new cadence from now
+        if (pacer.nextDeadline < now)
+        {
+            pacer.nextDeadline = now + pacer.period;
+        }
+
+        uint64_t start = pacer.nextDeadline - pacer.period;
+        if (pacer.mode == PACE_LOW_LATENCY)
+        {
+            //Leave a little slack on top of the expected work
+            uint64_t lead = (uint64_t)(pacer.workEstimate * 1.25) + pacer.frequency / 2000;
+            if (lead < pacer.period) start = pacer.nextDeadline - lead;
+        }
+        waitUntil(start);
+    }
+    pacer.frameStart = SDL_GetPerformanceCounter();
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Call just before SDL_RenderPresent(). In low latency mode it
+ *              learns how long the frame's work took and holds the present
+ *              until the deadline, so frames go out at an even rate.
+ *----------------------------------------------------------------------------*/
+void waitForFramePresent(void)
+{
+    if (pacer.mode != PACE_LOW_LATENCY) return;
+
+    double work = (double)(SDL_GetPerformanceCounter() - pacer.frameStart);
+    //Rise straight away after a slow frame, fall back slowly
+    pacer.workEstimate = work > pacer.workEstimate ? work : 0.95 * pacer.workEstimate + 0.05 * work;
+    waitUntil(pacer.nextDeadline);
+}
+
+static void recordInterval(double intervalMs)
+{
+    int bin = (int)(intervalMs * FRAME_HISTOGRAM_BINS_PER_MS);
+    if (bin < 0) bin = 0;
+    if (bin > HISTOGRAM_BIN_COUNT) bin = HISTOGRAM_BIN_COUNT;
+    pacer.histogram[bin]++;
+    pacer.frameCount++;
+    pacer.totalIntervalMs += intervalMs;
+    if (intervalMs < pacer.minIntervalMs) pacer.minIntervalMs = intervalMs;
+    if (intervalMs > pacer.maxIntervalMs) pacer.maxIntervalMs = intervalMs;
+    //A frame that took half as long again as it should have was a dropped one
+    if (pacer.period != 0 && intervalMs > 1.5 * countsToMs((double)pacer.period)) pacer.missedDeadlines++;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: Whether the frame shown used any input, and if so when the oldest
+ *        of it happened, as given by takePendingInput() when it was captured.
+ * Description: Call straight after SDL_RenderPresent(), records the time since
+ *              the last present and since the input.
+ *----------------------------------------------------------------------------*/
+void markFramePresented(bool hasInput, uint32_t oldestInput)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (pacer.lastPresent != 0)
+    {
+        recordInterval(countsToMs((double)(now - pacer.lastPresent)));
+    }
+    pacer.lastPresent = now;
+
+    if (hasInput)
+    {
+        //Event timestamps are in SDL_GetTicks() time
+        uint32_t latencyMs = SDL_GetTicks() - oldestInput;
+        pacer.latencyHistogram[latencyMs > FRAME_HISTOGRAM_MAX_MS ? FRAME_HISTOGRAM_MAX_MS : latencyMs]++;
+        pacer.latencyCount++;
+        pacer.totalLatencyMs += latencyMs;
+        if (latencyMs > pacer.maxLatencyMs) pacer.maxLatencyMs = latencyMs;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Call when frames start again after being stopped, as they are
+ *              while the window is hidden, so the gap isn't recorded as a
+ *              dropped frame and capped frames don't rush to catch up.
+ *----------------------------------------------------------------------------*/
+void restartFramePacer(void)
+{
+    pacer.lastPresent = 0;
+    pacer.nextDeadline = 0;
+    pacer.hasPendingInput = false;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The timestamp of an input event that the next frame captured uses.
+ * Description: The next takePendingInput() gives the oldest such event.
+ *----------------------------------------------------------------------------*/
+void noteInputEvent(uint32_t timestamp)
+{
+    if (!pacer.hasPendingInput || (int32_t)(timestamp - pacer.oldestPendingInput) < 0)
+    {
+        pacer.oldestPendingInput = timestamp;
+    }
+    pacer.hasPendingInput = true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: Where to put the timestamp of the oldest input noted.
+ * Output: False if no input was noted since the last call.
+ * Description: Call when a frame is captured, and pass what it gives to
+ *              markFramePresented() when that frame is shown, which may be
+ *              after later frames are captured.
+ *----------------------------------------------------------------------------*/
+bool takePendingInput(uint32_t* oldestInput)
+{
+    if (!pacer.hasPendingInput) return false;
+    *oldestInput = pacer.oldestPendingInput;
+    pacer.hasPendingInput = false;
+    return true;
+}
+
+static double getPercentileMs(double percentile)
+{
+    uint64_t target = (uint64_t)(pacer.frameCount * percentile);
+    uint64_t seen = 0;
+    for (int i = 0; i <= HISTOGRAM_BIN_COUNT; i++)
+    {
+        seen += pacer.histogram[i];
+        if (seen > target) return (i + 1) / (double)FRAME_HISTOGRAM_BINS_PER_MS;
+    }
+    return FRAME_HISTOGRAM_MAX_MS;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: Where to write the report.
+ * Description: Writes a summary of the session's frame intervals followed by
+ *              the non-empty histogram bins, one "ms count" pair per line, then
+ *              the same for input to present latency.
+ *----------------------------------------------------------------------------*/
+void writeFramePacingReport(const char* filePath)
+{
+    if (pacer.frameCount == 0) return;
+    FILE* file = fopen(filePath, "w");
+    if (file == NULL)
+    {
+        SDL_Log("Could not write frame pacing report %s", filePath);
+        return;
+    }
+    static const char* modeNames[] = { "vsync", "capped", "uncapped", "lowlatency" };
+    fprintf(file, "mode %s\n", modeNames[pacer.mode]);
+    if (pacer.rateHz > 0) fprintf(file, "rate %.2f Hz\n", pacer.rateHz);
+    fprintf(file, "frames %llu\n", (unsigned long long)pacer.frameCount);
+    fprintf(file, "missed deadlines %llu\n", (unsigned long long)pacer.missedDeadlines);
+    fprintf(file, "interval min %.3f ms, mean %.3f ms, max %.3f ms\n",
+            pacer.minIntervalMs, pacer.totalIntervalMs / pacer.frameCount, pacer.maxIntervalMs);
+    fprintf(file, "interval p50 %.2f ms, p99 %.2f ms, p99.9 %.2f ms\n",
+            getPercentileMs(0.5), getPercentileMs(0.99), getPercentileMs(0.999));
+    fprintf(file, "\n#bin start ms, frames\n");
+    for (int i = 0; i <= HISTOGRAM_BIN_COUNT; i++)
+    {
+        if (pacer.histogram[i] == 0) continue;
+        fprintf(file, "%.2f %u\n", i / (double)FRAME_HISTOGRAM_BINS_PER_MS, pacer.histogram[i]);
+    }
+
+    if (pacer.latencyCount > 0)
+    {
+        fprintf(file, "\ninput to present frames %llu\n", (unsigned long long)pacer.latencyCount);
+        fprintf(file, "input to present mean %.2f ms, max %u ms\n",
+                (double)pacer.totalLatencyMs / pacer.latencyCount, pacer.maxLatencyMs);
+        fprintf(file, "\n#latency ms, frames\n");
+        for (int i = 0; i <= FRAME_HISTOGRAM_MAX_MS; i++)
+        {
+            if (pacer.latencyHistogram[i] == 0) continue;
+            fprintf(file, "%d %u\n", i, pacer.latencyHistogram[i]);
+        }
+    }
+    fclose(file);
+}
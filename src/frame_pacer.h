@@ -0,0 +1,36 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include "engine_types.h"
+
+
+typedef enum
+{
+    PACE_VSYNC,         //Present blocks on the display, no waiting of our own
+    PACE_CAPPED,        //Start frames at a fixed rate
+    PACE_UNCAPPED,      //Draw frames as fast as possible
+    PACE_LOW_LATENCY    //Start each frame as late as possible and still make the deadline
+} PaceMode;
+
+//Frame intervals are binned at this many bins per millisecond
+#define FRAME_HISTOGRAM_BINS_PER_MS 4
+#define FRAME_HISTOGRAM_MAX_MS      100
+
+
+bool  parsePaceMode          (const char* name, PaceMode* mode, double* rateHz);
+void  initFramePacer         (PaceMode mode, double rateHz);
+bool  isFramePacerVsync      (void);
+void  waitForFrameStart      (void);
+void  waitForFramePresent    (void);
+void  markFramePresented     (bool hasInput, uint32_t oldestInput);
+void  restartFramePacer      (void);
+void  noteInputEvent         (uint32_t timestamp);
+bool  takePendingInput       (uint32_t* oldestInput);
+void  writeFramePacingReport (const char* filePath);
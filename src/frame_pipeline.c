@@ -0,0 +1,343 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "frame_pipeline.h"
+#include "load_level.h"
+#include "frame_pacer.h"
+
+
+static int frameDrawThread(void* data)
+{
+    FramePipeline* pipeline = (FramePipeline*)data;
+    for (;;)
+    {
+        SDL_SemWait(pipeline->submitted);
+        if (pipeline->quit) return 0;
+        drawFrameSnapshot(pipeline, pipeline->drawing);
+        SDL_SemPost(pipeline->finished);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pipeline, the context it draws with, the HUD's font, the post
+ *        effects to draw frames with and whether to draw on a thread of its
+ *        own.
+ * Description: Falls back to single threaded if the thread can't be started.
+ *----------------------------------------------------------------------------*/
+void initFramePipeline(FramePipeline* pipeline, GfxContext* gfx, SpriteFont spriteFont,
+                       const PostEffectChain* postEffects, bool threaded)
+{
+    memset(pipeline, 0, sizeof(FramePipeline));
+    pipeline->gfx = gfx;
+    initHudLayer(&pipeline->hud, gfx->pixelBuffer.width, gfx->pixelBuffer.height, gfx->images, spriteFont);
+    //MALLOC freed by freeFramePipeline()
+    pipeline->wallPixels = (uint32_t*)malloc(gfx->pixelBuffer.width * gfx->pixelBuffer.height * sizeof(uint32_t));
+    pipeline->postEffects = *postEffects;
+    if (!threaded) return;
+
+    pipeline->submitted = SDL_CreateSemaphore(0);
+    pipeline->finished = SDL_CreateSemaphore(0);
+    pipeline->thread = SDL_CreateThread(frameDrawThread, "frameDraw", pipeline);
+    pipeline->threaded = pipeline->thread != NULL;
+    if (!pipeline->threaded)
+    {
+        SDL_Log("Could not start the draw thread, drawing on the main thread.");
+    }
+}
+
+void freeFramePipeline(FramePipeline* pipeline)
+{
+    waitForFrame(pipeline);
+    if (pipeline->thread != NULL)
+    {
+        pipeline->quit = true;
+        SDL_SemPost(pipeline->submitted);
+        SDL_WaitThread(pipeline->thread, NULL);
+    }
+    if (pipeline->submitted != NULL) SDL_DestroySemaphore(pipeline->submitted);
+    if (pipeline->finished != NULL) SDL_DestroySemaphore(pipeline->finished);
+    for (int i = 0; i < FRAME_SNAPSHOT_RING_SIZE; i++)
+    {
+        free(pipeline->ring[i].level.data);
+        freeSpriteList(&pipeline->ring[i].spriteList);
+    }
+    freePostEffectChain(&pipeline->postEffects);
+    freeHudLayer(&pipeline->hud);
+    free(pipeline->wallPixels);
+    freeSpriteList(&pipeline->drawnSprites);
+    memset(pipeline, 0, sizeof(FramePipeline));
+}
+
+//The tiles only change when a door opens or a level loads, so they are only
+//copied then rather than every frame
+static void copyLevelTiles(FrameSnapshot* snapshot, const Level* level)
+{
+    size_t tileCount = (size_t)level->width * level->height;
+    if (snapshot->level.data != NULL && snapshot->level.tileVersion == level->tileVersion &&
+        snapshot->level.width == level->width && snapshot->level.height == level->height)
+    {
+        return;
+    }
+    if (tileCount > snapshot->tileCapacity)
+    {
+        //MALLOC reused for every level, freed by freeFramePipeline()
+        snapshot->tileCapacity = tileCount;
+        snapshot->level.data = (char*)realloc(snapshot->level.data, tileCount);
+    }
+    memcpy(snapshot->level.data, level->data, tileCount);
+    snapshot->level.width = level->width;
+    snapshot->level.height = level->height;
+    snapshot->level.tileVersion = level->tileVersion;
+}
+
+//The full screen effects a snapshot is drawn with
+static PostEffects getSnapshotEffects(const FrameSnapshot* snapshot)
+{
+    PostEffects effects = { .transitionFraction=snapshot->transitionFraction, .pixelateSize=1 };
+    if (snapshot->deathEffectActive)
+    {
+        effects.pixelateSize = (snapshot->deathEffectCounter / 3) + 1;
+        effects.fadeColor = 0x00401010;
+        effects.fadeRatio = (float)snapshot->deathEffectCounter / DEATH_EFFECT_TICKS;
+    }
+    return effects;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The snapshot just captured and the last one submitted, if any.
+ * Output: Whether the walls, floor and ceiling are the same as last frame and
+ *         the effects are too, so only rows the sprites or HUD changed need
+ *         drawing. Pixelation mixes rows, so it always redraws everything.
+ *----------------------------------------------------------------------------*/
+static bool isViewUnchanged(const FrameSnapshot* snapshot, const FrameSnapshot* last)
+{
+    if (last == NULL) return false;
+    if (snapshot->camera.pos.x != last->camera.pos.x || snapshot->camera.pos.y != last->camera.pos.y ||
+        snapshot->camera.rotation != last->camera.rotation)
+    {
+        return false;
+    }
+    if (snapshot->level.tileVersion != last->level.tileVersion ||
+        snapshot->level.width != last->level.width || snapshot->level.height != last->level.height)
+    {
+        return false;
+    }
+    PostEffects effects = getSnapshotEffects(snapshot);
+    PostEffects lastEffects = getSnapshotEffects(last);
+    return effects.pixelateSize == 1 && lastEffects.pixelateSize == 1 &&
+           effects.transitionFraction == lastEffects.transitionFraction &&
+           effects.fadeColor == lastEffects.fadeColor && effects.fadeRatio == lastEffects.fadeRatio;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pipeline, the game, where to draw it from and how far the frame
+ *        is between the last tick and the next.
+ * Output: The snapshot to pass to submitFrame().
+ * Description: Takes the next slot in the ring, which is never the one being
+ *              drawn.
+ *----------------------------------------------------------------------------*/
+FrameSnapshot* captureFrameSnapshot(FramePipeline* pipeline, const Game* game, Player camera, float tickFraction)
+{
+    FrameSnapshot* snapshot = &pipeline->ring[pipeline->next];
+    assert(snapshot != pipeline->drawing);
+    pipeline->next = (pipeline->next + 1) % FRAME_SNAPSHOT_RING_SIZE;
+
+    snapshot->camera = camera;
+    copyLevelTiles(snapshot, &game->level);
+    gatherSprites(&snapshot->spriteList, &game->pools, &camera, tickFraction);
+
+    snapshot->rubiesCollected = game->playerData.rubiesCollected;
+    snapshot->levelRubies = getTotalLevelRubies(&game->level);
+    memcpy(snapshot->keysCollected, game->playerData.keysCollected, sizeof(snapshot->keysCollected));
+
+    snapshot->transitionFraction = game->transitionFraction;
+    snapshot->deathEffectActive = game->deathEffectActive;
+    snapshot->deathEffectCounter = game->deathEffectCounter;
+
+    snapshot->partial = isViewUnchanged(snapshot, pipeline->shown);
+    snapshot->hasInput = takePendingInput(&snapshot->oldestInput);
+    return snapshot;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pipeline and a snapshot from captureFrameSnapshot().
+ * Description: Draws it into the pipeline's context, either straight away or
+ *              on the draw thread. Either way waitForFrame() must be called
+ *              before the context is used again.
+ *----------------------------------------------------------------------------*/
+void submitFrame(FramePipeline* pipeline, FrameSnapshot* snapshot)
+{
+    assert(pipeline->drawing == NULL);
+    pipeline->drawing = snapshot;
+    pipeline->shown = snapshot;
+    if (pipeline->threaded)
+    {
+        SDL_SemPost(pipeline->submitted);
+    }
+    else
+    {
+        drawFrameSnapshot(pipeline, snapshot);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Output: The snapshot last submitted once it is drawn, NULL if there wasn't
+ *         one to wait for. It stays valid until its slot in the ring is
+ *         captured into again.
+ *----------------------------------------------------------------------------*/
+const FrameSnapshot* waitForFrame(FramePipeline* pipeline)
+{
+    const FrameSnapshot* drawn = pipeline->drawing;
+    if (drawn == NULL) return NULL;
+    if (pipeline->threaded) SDL_SemWait(pipeline->finished);
+    pipeline->drawing = NULL;
+    return drawn;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: For when the screen has shown something other than the last
+ *              frame submitted, so the next is drawn whole.
+ *----------------------------------------------------------------------------*/
+void forgetShownFrame(FramePipeline* pipeline)
+{
+    pipeline->shown = NULL;
+}
+
+static bool isSameSprite(const SpriteInstance* a, const SpriteInstance* b)
+{
+    return a->pos.x == b->pos.x && a->pos.y == b->pos.y && a->zPos == b->zPos && a->xClip == b->xClip &&
+           a->yClip == b->yClip && a->maskColor == b->maskColor && a->base == b->base;
+}
+
+static void addDirtyRows(GfxContext* gfx, int top, int bottom)
+{
+    if (top < 0) top = 0;
+    if (bottom > gfx->pixelBuffer.height) bottom = gfx->pixelBuffer.height;
+    if (top >= bottom) return;
+    if (gfx->dirtyTop >= gfx->dirtyBottom)
+    {
+        gfx->dirtyTop = top;
+        gfx->dirtyBottom = bottom;
+        return;
+    }
+    if (top < gfx->dirtyTop) gfx->dirtyTop = top;
+    if (bottom > gfx->dirtyBottom) gfx->dirtyBottom = bottom;
+}
+
+static void addSpriteDirtyRows(GfxContext* gfx, Player camera, const SpriteInstance* sprite)
+{
+    int top;
+    int bottom;
+    if (getSpriteRows(gfx, camera, sprite, &top, &bottom)) addDirtyRows(gfx, top, bottom);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pipeline and a partial snapshot.
+ * Description: Sets the context's dirty rows to those covering every sprite
+ *              that moved, came or went, where and wherever it was, and the
+ *              HUD if it shows something new. Sprites hidden behind walls
+ *              don't count.
+ *----------------------------------------------------------------------------*/
+static void findDirtyRows(FramePipeline* pipeline, const FrameSnapshot* snapshot)
+{
+    GfxContext* gfx = pipeline->gfx;
+    const SpriteList* drawn = &pipeline->drawnSprites;
+    const SpriteList* sprites = &snapshot->spriteList;
+    gfx->dirtyTop = 0;
+    gfx->dirtyBottom = 0;
+
+    //Sorted by distance, so a sprite coming or going moves the rest along
+    bool sameCount = drawn->count == sprites->count;
+    for (int i = 0; i < drawn->count; i++)
+    {
+        if (sameCount && isSameSprite(&drawn->sprites[i], &sprites->sprites[i])) continue;
+        addSpriteDirtyRows(gfx, snapshot->camera, &drawn->sprites[i]);
+        if (sameCount) addSpriteDirtyRows(gfx, snapshot->camera, &sprites->sprites[i]);
+    }
+    if (!sameCount)
+    {
+        for (int i = 0; i < sprites->count; i++)
+        {
+            addSpriteDirtyRows(gfx, snapshot->camera, &sprites->sprites[i]);
+        }
+    }
+
+    if (isHudOutOfDate(&pipeline->hud, snapshot->rubiesCollected, snapshot->levelRubies, snapshot->keysCollected,
+                       -snapshot->camera.rotation))
+    {
+        addDirtyRows(gfx, pipeline->hud.extent.y, pipeline->hud.extent.y + pipeline->hud.extent.h);
+    }
+}
+
+//Keeps what the last frame drew for the next to compare with
+static void keepDrawnSprites(FramePipeline* pipeline, const SpriteList* spriteList)
+{
+    SpriteList* drawn = &pipeline->drawnSprites;
+    if (spriteList->count > drawn->capacity)
+    {
+        //MALLOC reused every frame, freed by freeFramePipeline()
+        drawn->capacity = spriteList->capacity;
+        drawn->sprites = (SpriteInstance*)realloc(drawn->sprites, drawn->capacity * sizeof(SpriteInstance));
+    }
+    memcpy(drawn->sprites, spriteList->sprites, spriteList->count * sizeof(SpriteInstance));
+    drawn->count = spriteList->count;
+}
+
+//Copies rows from top up to bottom between the context and the kept walls
+static void copyWallRows(FramePipeline* pipeline, int top, int bottom, bool keep)
+{
+    PixelBuffer* buffer = &pipeline->gfx->pixelBuffer;
+    for (int y = top; y < bottom; y++)
+    {
+        uint32_t* row = buffer->pixels + y * buffer->pitch;
+        uint32_t* kept = pipeline->wallPixels + y * buffer->width;
+        if (keep) memcpy(kept, row, buffer->width * sizeof(uint32_t));
+        else memcpy(row, kept, buffer->width * sizeof(uint32_t));
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The pipeline and the snapshot to draw into its context.
+ * Description: Draws the view, then the HUD and effects on top of it. A
+ *              whole frame keeps a copy of its walls. A partial one puts
+ *              that copy back only on the rows that changed and redraws the
+ *              sprites, HUD and effects there, leaving the context's dirty
+ *              rows set to them.
+ *----------------------------------------------------------------------------*/
+void drawFrameSnapshot(FramePipeline* pipeline, const FrameSnapshot* snapshot)
+{
+    GfxContext* gfx = pipeline->gfx;
+    if (!snapshot->partial)
+    {
+        gfx->dirtyTop = 0;
+        gfx->dirtyBottom = gfx->pixelBuffer.height;
+        drawWalls(gfx, &snapshot->level, snapshot->camera);
+        copyWallRows(pipeline, 0, gfx->pixelBuffer.height, true);
+        drawSprites(gfx, snapshot->camera, &snapshot->spriteList, 0, gfx->pixelBuffer.height);
+    }
+    else
+    {
+        findDirtyRows(pipeline, snapshot);
+        //Nothing moved, the last frame is shown again
+        if (gfx->dirtyTop >= gfx->dirtyBottom) return;
+        copyWallRows(pipeline, gfx->dirtyTop, gfx->dirtyBottom, false);
+        drawSprites(gfx, snapshot->camera, &snapshot->spriteList, gfx->dirtyTop, gfx->dirtyBottom);
+    }
+    keepDrawnSprites(pipeline, &snapshot->spriteList);
+
+    drawHud(&pipeline->hud, gfx, snapshot->rubiesCollected, snapshot->levelRubies, snapshot->keysCollected,
+            -snapshot->camera.rotation, gfx->dirtyTop, gfx->dirtyBottom);
+
+    //Screen fade to black and the death effect, all in one pass, then any
+    //retro effects
+    PostEffects effects = getSnapshotEffects(snapshot);
+    applyPostEffectChain(gfx, &pipeline->postEffects, &effects, gfx->dirtyTop, gfx->dirtyBottom);
+}
@@ -0,0 +1,92 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "game.h"
+#include "gfx_engine.h"
+#include "post_effects.h"
+#include "hud.h"
+
+
+//One snapshot being drawn while the next is captured
+#define FRAME_SNAPSHOT_RING_SIZE 2
+
+/*------------------------------------------------------------------------------
+ * Everything drawing a frame reads, copied out of the game. Nothing in it
+ * changes once it is captured, so it can be drawn while the game moves on.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    Player camera;              //Part way between the last two ticks
+    Level level;                //Copy of the tiles, only width, height and data are set
+    size_t tileCapacity;
+    SpriteList spriteList;
+
+    //HUD
+    int rubiesCollected;
+    int levelRubies;
+    bool keysCollected[MAX_KEYS];
+
+    //Effects
+    float transitionFraction;
+    bool deathEffectActive;
+    int deathEffectCounter;
+
+    //Seen from where the last frame was, so only what changed since is
+    //drawn, see beginScreenRows()
+    bool partial;
+
+    //Oldest input the frame shows, for markFramePresented()
+    bool hasInput;
+    uint32_t oldestInput;
+} FrameSnapshot;
+
+/*------------------------------------------------------------------------------
+ * Draws frames from snapshots, on a thread of its own unless made single
+ * threaded. Threaded, the next frame is simulated while the last is drawn,
+ * which is faster but shows every frame a frame later. Single threaded a
+ * submitted frame is drawn straight away, for the lowest latency.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    FrameSnapshot ring[FRAME_SNAPSHOT_RING_SIZE];
+    int next;                   //Slot the next snapshot is captured into
+    FrameSnapshot* drawing;     //Submitted and not yet waited for, NULL if none
+    const FrameSnapshot* shown; //Last submitted, NULL if the screen may show something else
+
+    GfxContext* gfx;            //Only touched by the pipeline while drawing isn't NULL
+    HudLayer hud;
+    PostEffectChain postEffects;    //Likewise, read its timings once no frame is drawing
+
+    //Kept from frame to frame by the drawing side, for partial frames
+    uint32_t* wallPixels;       //The walls, floor and ceiling last drawn, before sprites
+    SpriteList drawnSprites;    //The sprites last drawn
+
+    bool threaded;
+    bool quit;
+    SDL_Thread* thread;
+    SDL_sem* submitted;
+    SDL_sem* finished;
+} FramePipeline;
+
+
+void                 initFramePipeline    (FramePipeline* pipeline, GfxContext* gfx, SpriteFont spriteFont,
+                                          const PostEffectChain* postEffects, bool threaded);
+void                 freeFramePipeline    (FramePipeline* pipeline);
+FrameSnapshot*       captureFrameSnapshot (FramePipeline* pipeline, const Game* game, Player camera, float tickFraction);
+void                 submitFrame          (FramePipeline* pipeline, FrameSnapshot* snapshot);
+const FrameSnapshot* waitForFrame         (FramePipeline* pipeline);
+void                 forgetShownFrame     (FramePipeline* pipeline);
+void                 drawFrameSnapshot    (FramePipeline* pipeline, const FrameSnapshot* snapshot);
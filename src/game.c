@@ -0,0 +1,591 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <stdlib.h>
+
+#include "game.h"
+#include "spatial_grid.h"
+
+
+//Temp Globals
+static float monsterSightRadius = 256.f;    //Should be in monster entity base
+static float monsterFov = M_PI/2;           //Should be in monster entity base
+static float monsterChaseTimeLimit = 5000;  //Should be in monster entity base
+static const float transitionSpeed = 0.01f;
+static const int JOYSTICK_DEAD_ZONE = 8000;
+
+
+static void resetPlayer(Game* game)
+{
+    game->player.pos = getPlayerStartPos(&game->level);
+    game->player.rotation = 0;
+    game->playerData.rubiesCollected = 0;
+    for (int i = 0; i < MAX_KEYS; i++)
+    {
+        game->playerData.keysCollected[i] = false;
+    }
+}
+
+typedef enum
+{
+    SNAPSHOT_MEASURE,
+    SNAPSHOT_CAPTURE,
+    SNAPSHOT_RESTORE
+} SnapshotPass;
+
+//Copies one array into or out of the snapshot, or just counts its size
+static void transferSnapshotArray(LevelSnapshot* snapshot, SnapshotPass pass, void* array, size_t bytes)
+{
+    if (pass == SNAPSHOT_CAPTURE) memcpy(snapshot->data + snapshot->size, array, bytes);
+    if (pass == SNAPSHOT_RESTORE) memcpy(array, snapshot->data + snapshot->size, bytes);
+    snapshot->size += bytes;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: The one list of what a snapshot holds, walked the same way to
+ *              size, capture and restore it so the three can't disagree.
+ *              Restoring the tiles only rewrites the ones that changed, the
+ *              doors opened, so their visibility can be updated too.
+ *----------------------------------------------------------------------------*/
+static void transferLevelSnapshot(Game* game, SnapshotPass pass)
+{
+    LevelSnapshot* snapshot = &game->snapshot;
+    Level* level = &game->level;
+    EntityPools* pools = &game->pools;
+    snapshot->size = 0;
+
+    int tileCount = level->width * level->height;
+    if (pass == SNAPSHOT_RESTORE)
+    {
+        const char* tiles = (const char*)snapshot->data;
+        for (int i = 0; i < tileCount; i++)
+        {
+            if (level->data[i] != tiles[i]) setTileTo(level, i, tiles[i]);
+        }
+        snapshot->size += tileCount;
+    }
+    else
+    {
+        transferSnapshotArray(snapshot, pass, level->data, tileCount);
+    }
+
+    PickupPool* pickups[2] = { &pools->rubies, &pools->keys };
+    int* pickupCounts[2] = { &snapshot->rubyCount, &snapshot->keyCount };
+    for (int p = 0; p < 2; p++)
+    {
+        int count = *pickupCounts[p];
+        transferSnapshotArray(snapshot, pass, pickups[p]->pos, count * sizeof(Vector2));
+        transferSnapshotArray(snapshot, pass, pickups[p]->zPos, count * sizeof(float));
+        transferSnapshotArray(snapshot, pass, pickups[p]->keyId, count * sizeof(int));
+    }
+
+    MonsterPool* monsters = &pools->monsters;
+    int monsterCount = snapshot->monsterCount;
+    transferSnapshotArray(snapshot, pass, monsters->pos, monsterCount * sizeof(Vector2));
+    transferSnapshotArray(snapshot, pass, monsters->prevPos, monsterCount * sizeof(Vector2));
+    transferSnapshotArray(snapshot, pass, monsters->xClip, monsterCount * sizeof(int));
+    transferSnapshotArray(snapshot, pass, monsters->xClipCounter, monsterCount * sizeof(int));
+    //Taken before any monster has a path, so no path list is shared
+    transferSnapshotArray(snapshot, pass, monsters->monsters, monsterCount * sizeof(Monster));
+
+    PortalPool* portals = &pools->portals;
+    int portalCount = snapshot->portalCount;
+    transferSnapshotArray(snapshot, pass, portals->pos, portalCount * sizeof(Vector2));
+    transferSnapshotArray(snapshot, pass, portals->xClip, portalCount * sizeof(int));
+    transferSnapshotArray(snapshot, pass, portals->xClipCounter, portalCount * sizeof(int));
+}
+
+static void captureLevelSnapshot(Game* game)
+{
+    LevelSnapshot* snapshot = &game->snapshot;
+    snapshot->rubyCount = game->pools.rubies.count;
+    snapshot->keyCount = game->pools.keys.count;
+    snapshot->monsterCount = game->pools.monsters.count;
+    snapshot->portalCount = game->pools.portals.count;
+
+    transferLevelSnapshot(game, SNAPSHOT_MEASURE);
+    if (snapshot->size > snapshot->capacity)
+    {
+        //MALLOC kept for the lifetime of the game, freed by freeGame()
+        snapshot->capacity = snapshot->size;
+        snapshot->data = (uint8_t*)realloc(snapshot->data, snapshot->capacity);
+    }
+    transferLevelSnapshot(game, SNAPSHOT_CAPTURE);
+    snapshot->levelNumber = game->playerData.levelNumber;
+}
+
+/*------------------------------------------------------------------------------
+ * Output: False if there's no snapshot of the current level to restore.
+ * Description: Puts the level back as it was loaded, with no file reading or
+ *              allocation. The game ends up just as loadLevel() would leave
+ *              it, so replays run the same either way.
+ *----------------------------------------------------------------------------*/
+static bool restoreLevelSnapshot(Game* game)
+{
+    LevelSnapshot* snapshot = &game->snapshot;
+    if (snapshot->levelNumber != game->playerData.levelNumber) return false;
+    EntityPools* pools = &game->pools;
+
+    for (int i = 0; i < pools->monsters.count; i++)
+    {
+        LinkedList* pathList = &pools->monsters.monsters[i].pathList;
+        while (pathList->front != NULL) linkedListRemoveFront(pathList);
+    }
+    int oldRubyCount = pools->rubies.count;
+    int oldKeyCount = pools->keys.count;
+    transferLevelSnapshot(game, SNAPSHOT_RESTORE);
+    pools->rubies.count = snapshot->rubyCount;
+    pools->keys.count = snapshot->keyCount;
+    pools->monsters.count = snapshot->monsterCount;
+    pools->portals.count = snapshot->portalCount;
+    rebucketSpatialGrid(&pools->rubies.grid, pools->rubies.pos, oldRubyCount, pools->rubies.count);
+    rebucketSpatialGrid(&pools->keys.grid, pools->keys.pos, oldKeyCount, pools->keys.count);
+    rebucketSpatialGrid(&pools->monsters.grid, pools->monsters.pos, pools->monsters.count, pools->monsters.count);
+
+    resetPlayer(game);
+    game->prevPlayerPos = game->player.pos;
+    saveEntityPositions(pools);
+    return true;
+}
+
+static void initLevel(Game* game)
+{
+    Level* level = &game->level;
+    resetPlayer(game);
+
+    clearEntityPools(&game->pools);
+    loadLevelRubies(level, &game->pools.rubies);
+    loadLevelKeys(level, &game->pools.keys);
+    loadLevelMonsters(&game->pools.monsters, game->playerData.levelNumber);
+    addPortal(&game->pools.portals, getLevelEndPos(level));
+    buildEntityPoolGrids(&game->pools, level);
+    game->prevPlayerPos = game->player.pos;
+    saveEntityPositions(&game->pools);
+    captureLevelSnapshot(game);
+}
+
+static void getLevelFilePath(char* path, int levelNumber)
+{
+    sprintf(path, "res/levels/level%d.lvl", levelNumber);
+}
+
+bool levelExists(int levelNumber)
+{
+    char path[LEVEL_FILE_PATH_MAX_LEN];
+    getLevelFilePath(path, levelNumber);
+    return fileExists(path);
+}
+
+static bool loadLevel(Game* game)
+{
+    char path[LEVEL_FILE_PATH_MAX_LEN];
+    getLevelFilePath(path, game->playerData.levelNumber);
+    if (!fileExists(path)) return false;
+    loadLevelTiles(&game->level, path);
+    initLevel(game);
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The game, the templates its entities are drawn with, the seed for
+ *        its random numbers and the level to start on.
+ * Description: Loads the level paused behind a fade in, as it is on starting
+ *              the game. Everything the sim does after this follows from the
+ *              seed and the TickInputs passed to tickGame().
+ *----------------------------------------------------------------------------*/
+void initGame(Game* game, EntityTemplate* rubyTemplate, EntityTemplate* keyTemplate,
+              EntityTemplate* monsterTemplate, EntityTemplate* portalTemplate,
+              uint32_t seed, int levelNumber)
+{
+    memset(game, 0, sizeof(Game));
+    game->snapshot.levelNumber = -1;
+    game->player.width = 32;
+    game->player.height = 32;
+    game->player.footstepSoundChannel = -1;
+    game->playerData.levelNumber = levelNumber;
+    //xorshift gets stuck on zero
+    game->rngState = seed != 0 ? seed : 0x9E3779B9;
+    game->paused = true;
+    game->deathEffectDirection = 1;
+    game->transitionFraction = 1.f;
+    game->transitionDirection = -1;
+    game->transition = TRANSITION_LEVEL_START;
+
+    initEntityPools(&game->pools, rubyTemplate, keyTemplate, monsterTemplate, portalTemplate);
+    if (!loadLevel(game))
+    {
+        SDL_Log("Level %d could not be loaded.", levelNumber);
+    }
+}
+
+//Frees everything the game allocated. The templates it was given are the caller's.
+void freeGame(Game* game)
+{
+    freeEntityPools(&game->pools);
+    freeLevel(&game->level);
+    free(game->nearbyEntities.indices);
+    freePerceptionBuffers(&game->perception);
+    freeMonsterSim(&game->monsterSim);
+    free(game->snapshot.data);
+    memset(game, 0, sizeof(Game));
+}
+
+//xorshift32, so runs with the same seed get the same numbers on every platform
+bool gameOneInXChance(Game* game, int x)
+{
+    uint32_t state = game->rngState;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    game->rngState = state;
+    return state % x == 0;
+}
+
+static void useTileInFront(Game* game)
+{
+    Player* player = &game->player;
+    Level* level = &game->level;
+    Vector2 actionTile = player->pos;
+    actionTile.x += cosf(player->rotation) * TILE_DIMS;
+    actionTile.y += sinf(player->rotation) * TILE_DIMS;
+    actionTile = posToTileCoord(actionTile);
+
+    bool* keysCollected = game->playerData.keysCollected;
+    char tile = getLevelTile(level, posVecToIndex(level, actionTile));
+    if (tile == TILE_SECRET_DOOR)
+    {
+        setTileTo(level, posVecToIndex(level, actionTile), TILE_FLOOR);
+        game->events |= GAME_EVENT_SECRET_DOOR;
+    }
+    else if ((tile == TILE_DOOR0 && keysCollected[0] == true) ||
+        (tile == TILE_DOOR1 && keysCollected[1] == true) ||
+        (tile == TILE_DOOR2 && keysCollected[2] == true) ||
+        (tile == TILE_DOOR3 && keysCollected[3] == true))
+    {
+        setTileTo(level, posVecToIndex(level, actionTile), TILE_FLOOR);
+        game->events |= GAME_EVENT_DOOR_UNLOCKED;
+    }
+    else if (tile == TILE_DOOR0 ||
+        tile == TILE_DOOR1 ||
+        tile == TILE_DOOR2 ||
+        tile == TILE_DOOR3)
+    {
+        game->events |= GAME_EVENT_DOOR_LOCKED;
+    }
+}
+
+static void movePlayer(Game* game, const TickInput* input)
+{
+    Player* player = &game->player;
+    Vector2 oldPlayerPos = player->pos;
+    Vector2 moveVector = {0};
+    int moveVel = 4;
+
+    //Joystick input
+    //Left of dead zone
+    if (input->joystickAxes[0] < -JOYSTICK_DEAD_ZONE)
+    {
+        moveVector.x += cosf(player->rotation - M_PI/2);
+        moveVector.y += sinf(player->rotation - M_PI/2);
+    }
+    //Right of dead zone
+    else if (input->joystickAxes[0] > JOYSTICK_DEAD_ZONE)
+    {
+        moveVector.x += cosf(player->rotation + M_PI/2);
+        moveVector.y += sinf(player->rotation + M_PI/2);
+    }
+    //Left of dead zone
+    if (input->joystickAxes[1] < -JOYSTICK_DEAD_ZONE)
+    {
+        moveVector.x += cosf(player->rotation);
+        moveVector.y += sinf(player->rotation);
+    }
+    //Right of dead zone
+    else if (input->joystickAxes[1] > JOYSTICK_DEAD_ZONE)
+    {
+        moveVector.x += cosf(player->rotation + M_PI);
+        moveVector.y += sinf(player->rotation + M_PI);
+    }
+    //Left of dead zone
+    if (input->joystickAxes[2] < -JOYSTICK_DEAD_ZONE)
+    {
+        player->rotation -= 0.04 * -input->joystickAxes[2] / 32767.f;
+    }
+    //Right of dead zone
+    else if (input->joystickAxes[2] > JOYSTICK_DEAD_ZONE)
+    {
+        player->rotation += 0.04 * input->joystickAxes[2] / 32767.f;
+    }
+
+    //Keyboard Input
+    if (input->buttons & INPUT_STRAFE_LEFT)
+    {
+        moveVector.x += cosf(player->rotation - M_PI/2);
+        moveVector.y += sinf(player->rotation - M_PI/2);
+    }
+    if (input->buttons & INPUT_STRAFE_RIGHT)
+    {
+        moveVector.x += cosf(player->rotation + M_PI/2);
+        moveVector.y += sinf(player->rotation + M_PI/2);
+    }
+    if (input->buttons & INPUT_BACK)
+    {
+        moveVector.x += cosf(player->rotation + M_PI);
+        moveVector.y += sinf(player->rotation + M_PI);
+    }
+    if (input->buttons & INPUT_FORWARD)
+    {
+        moveVector.x += cosf(player->rotation);
+        moveVector.y += sinf(player->rotation);
+    }
+    if (input->buttons & INPUT_TURN_LEFT)
+    {
+        player->rotation += 0.02;
+    }
+    if (input->buttons & INPUT_TURN_RIGHT)
+    {
+        player->rotation -= 0.02;
+    }
+    if (input->buttons & INPUT_RESTART)
+    {
+        game->shouldReloadLevel = true;
+    }
+
+    //Normalise moveVector
+    moveVector = vec2Unit(moveVector);
+    player->pos.x += moveVector.x * moveVel;
+    player->pos.y += moveVector.y * moveVel;
+    if (moveVector.x != 0 || moveVector.y != 0)
+    {
+        game->events |= GAME_EVENT_PLAYER_MOVED;
+    }
+
+    //Collision
+    int tileIndex = posVecToTileIndex(&game->level, player->pos);
+    char tile = getLevelTile(&game->level, tileIndex);
+    if (isTileSolid(&game->level, tileIndex))
+    {
+        player->pos = oldPlayerPos;
+    }
+    else if (tile == TILE_LEVEL_END)
+    {
+        game->events |= GAME_EVENT_REACHED_EXIT;
+        game->transition = TRANSITION_LEVEL_END;
+        game->transitionDirection = 1;
+        game->paused = true;
+    }
+}
+
+static void updateEntities(Game* game)
+{
+    Player* player = &game->player;
+    EntityPools* pools = &game->pools;
+    SDL_Rect playerRect = { player->pos.x - player->width / 2, player->pos.y - player->height / 2, player->width, player->height };
+    EntityIndexList* nearbyEntities = &game->nearbyEntities;
+
+    //update animation
+    updateEntityAnimation(pools);
+
+    //Entity Collision
+    //Only entities touching the player are looked at. Going from the
+    //highest index down means removing one never skips another.
+    querySpatialGridRect(&pools->rubies.grid, pools->rubies.pos, playerRect, nearbyEntities);
+    for (int n = nearbyEntities->count - 1; n >= 0; n--)
+    {
+        game->playerData.rubiesCollected++;
+        removePickup(&pools->rubies, nearbyEntities->indices[n]);
+        game->events |= GAME_EVENT_RUBY_PICKUP;
+    }
+    querySpatialGridRect(&pools->keys.grid, pools->keys.pos, playerRect, nearbyEntities);
+    for (int n = nearbyEntities->count - 1; n >= 0; n--)
+    {
+        //TEMPORARY!
+        game->playerData.keysCollected[pools->keys.keyId[nearbyEntities->indices[n]]] = true;
+        removePickup(&pools->keys, nearbyEntities->indices[n]);
+        game->events |= GAME_EVENT_KEY_PICKUP;
+    }
+    querySpatialGridRect(&pools->monsters.grid, pools->monsters.pos, playerRect, nearbyEntities);
+    if (nearbyEntities->count > 0)
+    {
+        game->paused = true;
+        game->deathEffectActive = true;
+        game->deathEffectCounter = 0;
+        game->deathEffectDirection = 1;
+        game->events |= GAME_EVENT_PLAYER_DIED;
+    }
+
+    //Monsters ====
+    //Range and view cone tests for every monster at once, so only the
+    //monsters that pass need a line of sight check
+    querySpatialGridRadius(&pools->monsters.grid, pools->monsters.pos, player->pos, monsterSightRadius, nearbyEntities);
+    runMonsterPerception(&game->perception, &pools->monsters, nearbyEntities, player->pos, monsterSightRadius, monsterFov);
+
+    //Monster updates run in parallel against this frozen tick. Their side
+    //effects are read back with getMonsterSimEvents() until the next tick.
+    MonsterSimFrame monsterFrame = { .level=&game->level,
+        .perception=&game->perception, .playerPos=player->pos,
+        .now=(uint32_t)((uint64_t)game->tick * 1000 / GAME_TICK_HZ),
+        .chaseTimeLimit=monsterChaseTimeLimit, .aiBudgetMs=game->aiBudgetMs };
+    runMonsterSim(&game->monsterSim, &pools->monsters, &monsterFrame);
+    game->events |= GAME_EVENT_MONSTERS_UPDATED;
+
+    //Rolled here rather than where the roar is played, so the random numbers
+    //drawn don't depend on whether sound is playing
+    for (int i = 0; i < pools->monsters.count; i++)
+    {
+        Monster* monster = &pools->monsters.monsters[i];
+        monster->mayRoar = (getMonsterSimEvents(&game->monsterSim, i) & MONSTER_EVENT_CHASING) && gameOneInXChance(game, 60);
+    }
+}
+
+static void onTransitionEnd(Game* game)
+{
+    game->transitionDirection = 0;
+    if (game->transition == TRANSITION_LEVEL_START)
+    {
+        game->paused = false;
+        return;
+    }
+
+    PlayerData* playerData = &game->playerData;
+    playerData->levelNumber++;
+    playerData->totalRubiesCollected += playerData->rubiesCollected;
+    playerData->totalRubies += getTotalLevelRubies(&game->level);
+    game->events |= GAME_EVENT_LEVEL_COMPLETE;
+    if (levelExists(playerData->levelNumber))
+    {
+        game->shouldReloadLevel = true;
+        game->transition = TRANSITION_LEVEL_START;
+        game->transitionDirection = -1;
+    }
+    else
+    {
+        game->finished = true;
+    }
+}
+
+static void updateScreenEffects(Game* game)
+{
+    //Update screen fade
+    if (game->transitionDirection != 0)
+    {
+        game->transitionFraction += game->transitionDirection * transitionSpeed;
+        if (game->transitionDirection > 0 && game->transitionFraction > 1.f)
+        {
+            game->transitionFraction = 1.f;
+            onTransitionEnd(game);
+        }
+        else if (game->transitionDirection < 0 && game->transitionFraction < 0.f)
+        {
+            game->transitionFraction = 0.f;
+            onTransitionEnd(game);
+        }
+    }
+    //Update death effect
+    if (game->deathEffectActive)
+    {
+        if (game->deathEffectDirection == 1)
+        {
+            game->deathEffectCounter++;
+            if (game->deathEffectCounter > DEATH_EFFECT_TICKS) {
+                game->deathEffectDirection = -1;
+                game->shouldReloadLevel = true;
+            }
+        }
+        else
+        {
+            game->deathEffectCounter--;
+            if (game->deathEffectCounter == 1)
+            {
+                game->deathEffectActive = false;
+                game->paused = false;
+            }
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The game and what the player did this tick.
+ * Description: Advances the game by one tick. game->events says what happened,
+ *              and getMonsterSimEvents() what each monster did, until the next
+ *              call.
+ *----------------------------------------------------------------------------*/
+void tickGame(Game* game, const TickInput* input)
+{
+    game->events = 0;
+    if (game->finished) return;
+
+    if (game->shouldReloadLevel)
+    {
+        //Restarting the same level is a copy, only a new one is read in
+        if (!restoreLevelSnapshot(game)) loadLevel(game);
+        game->shouldReloadLevel = false;
+        game->events |= GAME_EVENT_LEVEL_LOADED;
+    }
+    else
+    {
+        //The input's facing is from before the reload, which turns the
+        //player back to the way levels start facing
+        game->player.rotation = input->rotation;
+    }
+    game->prevPlayerPos = game->player.pos;
+    saveEntityPositions(&game->pools);
+
+    if (input->buttons & INPUT_PAUSE)
+    {
+        game->paused = !game->paused;
+    }
+    //After the toggle, so pressing pause the same tick can't undo it
+    if (input->buttons & INPUT_PAUSE_ON)
+    {
+        game->paused = true;
+    }
+    if (input->buttons & INPUT_USE)
+    {
+        useTileInFront(game);
+    }
+    if (!game->paused)
+    {
+        movePlayer(game, input);
+        updateEntities(game);
+    }
+    updateScreenEffects(game);
+    game->tick++;
+}
+
+/*------------------------------------------------------------------------------
+ * Output: A hash of the state that diverges first when a replay drifts: the
+ *         player, every monster and the pickups left.
+ *----------------------------------------------------------------------------*/
+uint32_t getGameChecksum(const Game* game)
+{
+    //FNV-1a
+    uint32_t hash = 2166136261u;
+    #define HASH_BYTES(data, size) \
+        for (size_t b = 0; b < (size); b++) { hash = (hash ^ ((const uint8_t*)(data))[b]) * 16777619u; }
+
+    const MonsterPool* monsters = &game->pools.monsters;
+    HASH_BYTES(&game->tick, sizeof(game->tick));
+    HASH_BYTES(&game->player.pos, sizeof(Vector2));
+    HASH_BYTES(&game->player.rotation, sizeof(float));
+    HASH_BYTES(&game->playerData.levelNumber, sizeof(int));
+    HASH_BYTES(&game->playerData.rubiesCollected, sizeof(int));
+    HASH_BYTES(&game->pools.rubies.count, sizeof(int));
+    HASH_BYTES(&game->pools.keys.count, sizeof(int));
+    HASH_BYTES(&game->rngState, sizeof(uint32_t));
+    HASH_BYTES(monsters->pos, monsters->count * sizeof(Vector2));
+    for (int i = 0; i < monsters->count; i++)
+    {
+        HASH_BYTES(&monsters->monsters[i].aiState, sizeof(monsters->monsters[i].aiState));
+        HASH_BYTES(&monsters->monsters[i].direction, sizeof(monsters->monsters[i].direction));
+    }
+    #undef HASH_BYTES
+    return hash;
+}
@@ -0,0 +1,138 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "engine_types.h"
+#include "entity_pools.h"
+#include "load_level.h"
+#include "perception.h"
+#include "monster_sim.h"
+
+
+//Simulation rate, independent of how fast frames are drawn
+#define GAME_TICK_HZ 60
+#define SIM_TICK_SECONDS (1.0 / GAME_TICK_HZ)
+
+//Length of each half of the death effect, the screen breaking up then coming back
+#define DEATH_EFFECT_TICKS 168
+
+//Buttons held during a tick, or for USE and the PAUSEs, pressed since the last one
+typedef enum
+{
+    INPUT_FORWARD       = 1 << 0,
+    INPUT_BACK          = 1 << 1,
+    INPUT_STRAFE_LEFT   = 1 << 2,
+    INPUT_STRAFE_RIGHT  = 1 << 3,
+    INPUT_TURN_LEFT     = 1 << 4,
+    INPUT_TURN_RIGHT    = 1 << 5,
+    INPUT_RESTART       = 1 << 6,
+    INPUT_USE           = 1 << 7,
+    INPUT_PAUSE         = 1 << 8,   //Pauses or unpauses
+    INPUT_PAUSE_ON      = 1 << 9    //Pauses, leaves the game paused if it already is
+} InputButton;
+
+//Everything the player does to the game in one tick. Nothing else read by
+//tickGame() comes from outside, so replaying the same inputs replays the game.
+typedef struct
+{
+    uint16_t buttons;
+    int16_t joystickAxes[3];    //Strafe, move and turn
+    float rotation;             //Facing at the start of the tick, mouse look included
+} TickInput;
+
+//What happened during a tick, for the sounds and screens outside the sim
+typedef enum
+{
+    GAME_EVENT_RUBY_PICKUP      = 1 << 0,
+    GAME_EVENT_KEY_PICKUP       = 1 << 1,
+    GAME_EVENT_SECRET_DOOR      = 1 << 2,
+    GAME_EVENT_DOOR_UNLOCKED    = 1 << 3,
+    GAME_EVENT_DOOR_LOCKED      = 1 << 4,
+    GAME_EVENT_PLAYER_MOVED     = 1 << 5,
+    GAME_EVENT_PLAYER_DIED      = 1 << 6,
+    GAME_EVENT_REACHED_EXIT     = 1 << 7,   //Level end fade starts
+    GAME_EVENT_LEVEL_COMPLETE   = 1 << 8,   //Level end fade finished, see Game.finished
+    GAME_EVENT_LEVEL_LOADED     = 1 << 9,
+    GAME_EVENT_MONSTERS_UPDATED = 1 << 10   //getMonsterSimEvents() is for this tick
+} GameEvent;
+
+typedef enum
+{
+    TRANSITION_LEVEL_START,
+    TRANSITION_LEVEL_END
+} TransitionKind;
+
+/*------------------------------------------------------------------------------
+ * The level as it was just after loading, so restarting it after a death or
+ * a press of R is a copy back rather than reading and parsing the files
+ * again. Every array is packed into data, which only grows when a bigger
+ * level is loaded.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    int levelNumber;            //Level the snapshot is of, -1 for none
+    size_t size;
+    size_t capacity;
+    uint8_t* data;
+
+    int rubyCount;
+    int keyCount;
+    int monsterCount;
+    int portalCount;
+} LevelSnapshot;
+
+/*------------------------------------------------------------------------------
+ * Everything one running game owns, level included. Nothing the sim touches
+ * lives outside it, so any number of games can be ticked side by side, each
+ * on its own thread if need be.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    Level level;
+    Player player;
+    PlayerData playerData;
+    EntityPools pools;
+    Vector2 prevPlayerPos;      //Where the player was last tick, for drawing between ticks
+
+    uint32_t tick;              //Ticks since initGame(), the sim's only clock
+    uint32_t rngState;
+    float aiBudgetMs;           //Time monster AI may take per tick, 0 for no limit
+    uint32_t events;            //GameEvent flags raised by the last tick
+
+    bool paused;
+    bool shouldReloadLevel;
+    bool finished;              //The last level has been completed
+
+    bool deathEffectActive;
+    int deathEffectCounter;
+    int deathEffectDirection;
+
+    float transitionFraction;   //How much of the screen is faded to black
+    int transitionDirection;
+    TransitionKind transition;
+
+    LevelSnapshot snapshot;
+
+    //Scratch space reused every tick
+    EntityIndexList nearbyEntities;
+    PerceptionBuffers perception;
+    MonsterSim monsterSim;
+} Game;
+
+
+void     initGame             (Game* game, EntityTemplate* rubyTemplate, EntityTemplate* keyTemplate,
+                               EntityTemplate* monsterTemplate, EntityTemplate* portalTemplate,
+                               uint32_t seed, int levelNumber);
+void     freeGame             (Game* game);
+bool     levelExists          (int levelNumber);
+void     tickGame             (Game* game, const TickInput* input);
+bool     gameOneInXChance     (Game* game, int x);
+uint32_t getGameChecksum      (const Game* game);
@@ -23,60 +23,49 @@ seoras1@gmail.com
 #include "load_level.h"
 #include "images.h"
 #include "monster.h"
+#include "blitter.h"
+#include "render_kernels.h"
 
 
 static uint32_t keyColors[MAX_KEYS] = {0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFF00AA88};
 
-static PixelBuffer pixelBuffer = {0};
-static float* zBuffer = NULL;
-
 /*---------------------
  * Defines
  *-------------------*/
 #define PLAYER_HEIGHT (TILE_DIMS / 2)
 
 
-/*---------------------
- * Precomputed tangents
- *-------------------*/
-static float tanHFovOver2;
-static float tanVFovOver2;
-
-/*---------------------------------
- * Precompute floorCeilingDistances
- *-------------------------------*/
-static float *floorCeilingDistanceTable;
-
 /*------------------------------------------------------------------------------
  * Input:
+ *      GfxContext* gfx: The context to draw into.
  *      int x: The x coordinate to draw point.
  *      int y: The y coordinate to draw point.
  *      uint32_t color: the colour the point should be draw.
  * Description:
- *      Draws a single point to the main pixel buffer
+ *      Draws a single point to the context's pixel buffer
  *----------------------------------------------------------------------------*/
-void drawPoint(int x, int y, uint32_t color)
+void drawPoint(GfxContext* gfx, int x, int y, uint32_t color)
 {
-    pixelBuffer.pixels[y  * pixelBuffer.width + x] = color;
+    gfx->pixelBuffer.pixels[y * gfx->pixelBuffer.pitch + x] = color;
 }
 
 /*------------------------------------------------------------------------------
- * Input: A rectangle that is to be drawn to the pixel buffer, and the colour it
- *        should be drawn in.
+ * Input: The context, a rectangle that is to be drawn to its pixel buffer, and
+ *        the colour it should be drawn in.
  * Description: Draws a filled rectangle, rect, of a solid colour, color, to the
- *              main pixel buffer.
+ *              context's pixel buffer.
  *----------------------------------------------------------------------------*/
-void drawRect(Rectangle rect, uint32_t color)
+void drawRect(GfxContext* gfx, Rectangle rect, uint32_t color)
 {
     ////Check and adjust the rect if it crosses screen boundaries.
     //If the left side of rect > the screen width OR the top of the rect is
     //greater than the screen height THEN return
-    if (rect.x >= pixelBuffer.width || rect.y >= pixelBuffer.height) return;
+    if (rect.x >= gfx->pixelBuffer.width || rect.y >= gfx->pixelBuffer.height) return;
     //If the right side of the rect >= the screen width THEN reduce the width
     //of the rect acordingly.
-    if (rect.x + rect.w >= pixelBuffer.width) rect.w -= rect.x + rect.w - pixelBuffer.width;
+    if (rect.x + rect.w >= gfx->pixelBuffer.width) rect.w -= rect.x + rect.w - gfx->pixelBuffer.width;
     //Same as above but for bottom of rect and screen height
-    if (rect.y + rect.h >= pixelBuffer.height) rect.h -= rect.y + rect.h - pixelBuffer.height;
+    if (rect.y + rect.h >= gfx->pixelBuffer.height) rect.h -= rect.y + rect.h - gfx->pixelBuffer.height;
     //Cut off part of rect above the screen.
     if (rect.y < 0)
     {
@@ -95,7 +84,7 @@ void drawRect(Rectangle rect, uint32_t color)
     {
         for (int x = rect.x; x < rect.x + rect.w; ++x)
         {
-            drawPoint(x, y, color);
+            drawPoint(gfx, x, y, color);
         }
     }
 }
@@ -114,122 +103,30 @@ uint32_t getPixel(SDL_Surface* image, int x, int y) {
     return ((uint32_t*)image->pixels)[y * image->w + x];
 }
 
-uint32_t getPixelBufferPixel(int x, int y) {
-    return pixelBuffer.pixels[y * pixelBuffer.width + x];
-}
-
 /*------------------------------------------------------------------------------
- * Input:
- *      SDL_Surface* image: The image to be drawn
- *      SDL_Rect destRect: The rectangle on the screen to draw the image
- *      uint32_t maskColor: The colour to replace 0xFFFF00FF with.
- * Description:
- *      Draws an image to the screen, scaling as neccessary, to the rectangle
- *      destRect. The colour 0xFFFF00FF (bright pink) is replaced with the
- *      colour maskColor.
- * To Do:
- *      Add srcRect parameter to allow the use of sprite sheets
+ * Input: The pixel buffer to draw into, the cache to get the text from, the
+ *        text, where its top left goes and the colour and font to draw it in.
+ * Description: Strings too long for one glyph run are drawn a piece at a time.
  *----------------------------------------------------------------------------*/
-void blitToPixelBuffer(SDL_Surface* image, Rectangle destRect, uint32_t maskColor)
+static void drawGlyphRuns(PixelBuffer* pixelBuffer, GlyphRunCache* cache, const char* text, int textLength,
+                          int x, int y, uint32_t color, SpriteFont spriteFont)
 {
-    ////Keep destRect inside screen boundaries
-    //IF the left side of the rectangle < left side of screen THEN
-    //shift the rectangle to the right
-    if (destRect.x < 0)
-    {
-        destRect.w += destRect.x;
-        destRect.x = 0;
-    }
-    else if (destRect.x >= pixelBuffer.width)
-    {
-        destRect.w += (pixelBuffer.width - 1) - destRect.x;
-        destRect.x = pixelBuffer.width - 1;
-    }
-    if (destRect.y < 0)
-    {
-        destRect.h += destRect.y;
-        destRect.y = 0;
-    }
-    else if (destRect.y >= pixelBuffer.height)
+    for (int i = 0; i < textLength; i += GLYPH_RUN_MAX_LENGTH)
     {
-        destRect.h += (pixelBuffer.height - 1) - destRect.y;
-        destRect.y = pixelBuffer.height - 1;
-    }
-
-    for (int y = 0; y < destRect.h; y++)
-    {
-        for (int x = 0; x < destRect.w; x++)
-        {
-            int texCoordX = x * (image->w / (float)destRect.w);
-            int texCoordY = y * (image->h / (float)destRect.h);
-            uint32_t color = getPixel(image, texCoordX, texCoordY);
-            //if color not fully transparent
-            if (color & 0xFF000000)
-            {
-                if (color == 0xFFFF00FF)
-                {
-                    color = maskColor;
-                }
-                drawPoint(destRect.x + x, destRect.y + y, color);
-            }
-        }
+        int length = textLength - i < GLYPH_RUN_MAX_LENGTH ? textLength - i : GLYPH_RUN_MAX_LENGTH;
+        const GlyphRun* run = getGlyphRun(cache, text + i, length, color, spriteFont);
+        blendPixelBuffer(pixelBuffer, &run->pixels, x + i * spriteFont.charW, y);
     }
 }
 
-void rotatedBlitToPixelBuffer(SDL_Surface* image, Rectangle destRect, uint32_t maskColor, float angle)
-{
-    ////Keep destRect inside screen boundaries
-    //IF the left side of the rectangle < left side of screen THEN
-    //shift the rectangle to the right
-    if (destRect.x < 0)
-    {
-        destRect.w += destRect.x;
-        destRect.x = 0;
-    }
-    else if (destRect.x >= pixelBuffer.width)
-    {
-        destRect.w += (pixelBuffer.width - 1) - destRect.x;
-        destRect.x = pixelBuffer.width - 1;
-    }
-    if (destRect.y < 0)
-    {
-        destRect.h += destRect.y;
-        destRect.y = 0;
-    }
-    else if (destRect.y >= pixelBuffer.height)
-    {
-        destRect.h += (pixelBuffer.height - 1) - destRect.y;
-        destRect.y = pixelBuffer.height - 1;
-    }
-
-    float cosTheta = cosf(angle);
-    float sinTheta = sinf(angle);
-    for (int y = -destRect.h / 2; y < destRect.h / 2; y++)
-    {
-        for (int x = -destRect.w / 2; x < destRect.w / 2; x++)
-        {
-            int texCoordX = ((x * cosTheta + y * sinTheta) + destRect.w / 2) * (image->w / (float)destRect.w);
-            int texCoordY = ((- x * sinTheta + y * cosTheta) + destRect.h / 2) * (image->h / (float)destRect.h);
-            uint32_t color = 0x00000000;
-            if (texCoordX >= 0 && texCoordX < image->w &&
-                texCoordY >= 0 && texCoordY < image->h)
-            {
-                color = getPixel(image, texCoordX, texCoordY);
-            }
-            //if color not fully transparent
-            if (color & 0xFF000000)
-            {
-                if (color == 0xFFFF00FF)
-                {
-                    color = maskColor;
-                }
-                drawPoint(destRect.x + x, destRect.y + y, color);
-            }
-        }
-    }
-}
-
-void drawText(char* text, SDL_Rect rect, uint32_t color, SpriteFont spriteFont, bool centered)
+/*------------------------------------------------------------------------------
+ * Input: The context, the text, where to draw it, the colour the font is
+ *        ANDed with, the font and whether rect's x and y are its centre
+ *        rather than its top left.
+ * Description: The text is drawn from the context's glyph run cache, so the
+ *              font is only read the first time a string is drawn.
+ *----------------------------------------------------------------------------*/
+void drawText(GfxContext* gfx, char* text, SDL_Rect rect, uint32_t color, SpriteFont spriteFont, bool centered)
 {
     //get text length
     int textLength = 0;
@@ -241,72 +138,182 @@ void drawText(char* text, SDL_Rect rect, uint32_t color, SpriteFont spriteFont,
         rect.y -= spriteFont.charH / 2;
     }
 
-    for (int i = 0; i < textLength; i++)
-    {
-        int spriteX = (text[i] - 32) * spriteFont.charW;
-
-        for (int y = 0; y < spriteFont.charH; y++)
-        {
-            for (int x = 0; x < spriteFont.charW; x++)
-            {
-                uint32_t pixelColor = getPixel(spriteFont.sprite, x + spriteX, y) & color;
-                if (pixelColor & 0xFF000000) {
-                    drawPoint(rect.x + i * spriteFont.charW + x, rect.y + y, pixelColor);
-                }
-            }
-        }
-    }
+    drawGlyphRuns(&gfx->pixelBuffer, &gfx->glyphRuns, text, textLength, rect.x, rect.y, color, spriteFont);
 }
 
-void drawTextToSurface(char* text, SDL_Surface* surface, SDL_Rect rect, uint32_t color, SpriteFont spriteFont)
+void drawTextToSurface(char* text, SDL_Surface* surface, SDL_Rect rect, uint32_t color, SpriteFont spriteFont,
+                       GlyphRunCache* cache)
 {
     //get text length
     int textLength = 0;
     for (textLength = 0; text[textLength] != '\0'; textLength++);
 
-    for (int i = 0; i < textLength; i++)
-    {
-        int spriteX = (text[i] - 32) * spriteFont.charW;
-        for (int y = 0; y < spriteFont.charH; y++)
-        {
-            for (int x = 0; x < spriteFont.charW; x++)
-            {
-                uint32_t pixelColor = getPixel(spriteFont.sprite, x + spriteX, y) & color;
-                if (pixelColor & 0xFF000000) {
-                    ((uint32_t*)surface->pixels)[(rect.y + y) * surface->w + rect.x + i * spriteFont.charW + x ] = pixelColor;
-                }
-            }
-        }
-    }
+    PixelBuffer surfacePixels = { (uint32_t*)surface->pixels, surface->w, surface->h, surface->pitch / 4 };
+    drawGlyphRuns(&surfacePixels, cache, text, textLength, rect.x, rect.y, color, spriteFont);
 }
 
-void createPixelBuffer(int width, int height)
+/*------------------------------------------------------------------------------
+ * Input: The context to set up, the size of the image it draws and the images
+ *        it textures the level with.
+ * Description: Everything a render needs is in the context, so several can be
+ *              drawing at once, each from its own thread.
+ *----------------------------------------------------------------------------*/
+void initGfxContext(GfxContext* gfx, int width, int height, const ImageManager* images)
 {
-    //MALLOC no need to free, kept until program end.
+    memset(gfx, 0, sizeof(GfxContext));
+    gfx->images = images;
+
+    //MALLOC freed by freeGfxContext()
     uint32_t* pixels = (uint32_t*)malloc(width * height * sizeof(uint32_t));
-    zBuffer = (float*)malloc(width * sizeof(float));
-    pixelBuffer.pixels = pixels;
-    pixelBuffer.width = width;
-    pixelBuffer.height = height;
+    gfx->zBuffer = (float*)malloc(width * sizeof(float));
+    gfx->scratchRow = (uint32_t*)malloc(width * sizeof(uint32_t));
+    gfx->blitColumns = (int*)malloc(width * sizeof(int));
+    gfx->columnPixels = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+    gfx->pixelBuffer.pixels = pixels;
+    gfx->pixelBuffer.width = width;
+    gfx->pixelBuffer.height = height;
+    gfx->pixelBuffer.pitch = width;
+    gfx->ownPixels = pixels;
 
     //Init precomputed trig functions
-    tanHFovOver2 = tanf(H_FOV/2.f);
-    tanVFovOver2 = tanf(V_FOV/2.f);
+    gfx->tanHFovOver2 = tanf(H_FOV/2.f);
+    gfx->tanVFovOver2 = tanf(V_FOV/2.f);
 
     // Precompute distances for floor / ceiling rendering.
-    // MALLOC: No free, used for duration of program
-    floorCeilingDistanceTable = malloc(sizeof(float) * height);
-    for (int i = 0; i < SCREEN_HEIGHT; i++) {
-        floorCeilingDistanceTable[i] = (TILE_DIMS - PLAYER_HEIGHT) / fabs(tanf((i - pixelBuffer.height/2) * (V_FOV / pixelBuffer.height)));
+    gfx->floorCeilingDistanceTable = malloc(sizeof(float) * height);
+    for (int i = 0; i < height; i++) {
+        gfx->floorCeilingDistanceTable[i] = (TILE_DIMS - PLAYER_HEIGHT) / fabs(tanf((i - gfx->pixelBuffer.height/2) * (V_FOV / gfx->pixelBuffer.height)));
+    }
+}
+
+void freeGfxContext(GfxContext* gfx)
+{
+    free(gfx->ownPixels);
+    free(gfx->zBuffer);
+    free(gfx->scratchRow);
+    free(gfx->blitColumns);
+    free(gfx->columnPixels);
+    free(gfx->floorCeilingDistanceTable);
+    freeGlyphRunCache(&gfx->glyphRuns);
+    memset(gfx, 0, sizeof(GfxContext));
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The textures to set up, the renderer they are for, their size and how
+ *        many to take in turn, 1 to MAX_SCREEN_TEXTURES.
+ * Output: False if none could be created.
+ *----------------------------------------------------------------------------*/
+bool initScreenTextures(ScreenTextures* screen, SDL_Renderer* renderer, int width, int height, int count)
+{
+    memset(screen, 0, sizeof(ScreenTextures));
+    screen->shown = -1;
+    if (count < 1) count = 1;
+    if (count > MAX_SCREEN_TEXTURES) count = MAX_SCREEN_TEXTURES;
+    for (int i = 0; i < count; i++)
+    {
+        SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (texture == NULL) break;
+        screen->textures[screen->count++] = texture;
     }
+    return screen->count > 0;
 }
 
-PixelBuffer* getPixelBuffer(void)
+void freeScreenTextures(ScreenTextures* screen)
 {
-    return &pixelBuffer;
+    for (int i = 0; i < screen->count; i++)
+    {
+        SDL_DestroyTexture(screen->textures[i]);
+    }
+    memset(screen, 0, sizeof(ScreenTextures));
+    screen->shown = -1;
 }
 
-Vector2Int getTileHorzIntersection(Vector2 pos, float angle, int* tileIndex)
+/*------------------------------------------------------------------------------
+ * Input: The context about to draw a frame and the textures to show it with.
+ * Description: Points the context's pixel buffer at the next screen texture's
+ *              memory, so the frame is drawn where the renderer reads it and
+ *              needn't be copied there. What locked memory holds beforehand
+ *              is undefined, every pixel has to be drawn each frame. Falls
+ *              back to the context's own pixels if the texture won't lock.
+ *----------------------------------------------------------------------------*/
+void beginScreenFrame(GfxContext* gfx, ScreenTextures* screen)
+{
+    void* pixels;
+    int pitch;
+    screen->rows = false;
+    screen->locked = SDL_LockTexture(screen->textures[screen->next], NULL, &pixels, &pitch) == 0;
+    if (screen->locked)
+    {
+        gfx->pixelBuffer.pixels = (uint32_t*)pixels;
+        gfx->pixelBuffer.pitch = pitch / sizeof(uint32_t);
+    }
+    else
+    {
+        gfx->pixelBuffer.pixels = gfx->ownPixels;
+        gfx->pixelBuffer.pitch = gfx->pixelBuffer.width;
+    }
+    gfx->dirtyTop = 0;
+    gfx->dirtyBottom = gfx->pixelBuffer.height;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The context about to draw a frame and the textures to show it with.
+ * Description: For a frame that only changes part of the last one shown. It
+ *              is drawn into the context's own pixels, and whoever draws it
+ *              sets the context's dirty rows to the rows it changed. Only
+ *              those are copied into the texture already holding the last
+ *              frame, none at all if nothing changed. There must be a last
+ *              frame, drawn with beginScreenFrame().
+ *----------------------------------------------------------------------------*/
+void beginScreenRows(GfxContext* gfx, ScreenTextures* screen)
+{
+    screen->rows = true;
+    screen->locked = false;
+    gfx->pixelBuffer.pixels = gfx->ownPixels;
+    gfx->pixelBuffer.pitch = gfx->pixelBuffer.width;
+    gfx->dirtyTop = 0;
+    gfx->dirtyBottom = 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The context that drew the frame and the textures it was drawn into.
+ * Output: The texture holding the frame, ready for SDL_RenderCopy().
+ *----------------------------------------------------------------------------*/
+SDL_Texture* endScreenFrame(GfxContext* gfx, ScreenTextures* screen)
+{
+    gfx->pixelBuffer.pixels = gfx->ownPixels;
+    gfx->pixelBuffer.pitch = gfx->pixelBuffer.width;
+    if (screen->rows)
+    {
+        SDL_Texture* shownTexture = screen->textures[screen->shown];
+        int rowCount = gfx->dirtyBottom - gfx->dirtyTop;
+        if (rowCount > 0)
+        {
+            SDL_Rect rows = { 0, gfx->dirtyTop, gfx->pixelBuffer.width, rowCount };
+            SDL_UpdateTexture(shownTexture, &rows, gfx->ownPixels + gfx->dirtyTop * gfx->pixelBuffer.width,
+                              gfx->pixelBuffer.width * sizeof(uint32_t));
+        }
+        screen->rows = false;
+        return shownTexture;
+    }
+
+    SDL_Texture* texture = screen->textures[screen->next];
+    if (screen->locked)
+    {
+        SDL_UnlockTexture(texture);
+        screen->locked = false;
+    }
+    else
+    {
+        SDL_UpdateTexture(texture, NULL, gfx->ownPixels, gfx->pixelBuffer.width * sizeof(uint32_t));
+    }
+    screen->shown = screen->next;
+    screen->next = (screen->next + 1) % screen->count;
+    return texture;
+}
+
+Vector2Int getTileHorzIntersection(const Level* level, Vector2 pos, float angle, int* tileIndex)
 {
     angle = constrainAngle(angle);
     bool xPositive = angle >= -M_PI / 2 && angle <= M_PI / 2;
@@ -322,18 +329,18 @@ Vector2Int getTileHorzIntersection(Vector2 pos, float angle, int* tileIndex)
 
     int xDir = xPositive ? 1 : -1;
     int yDir = yPositive ? -1 : 1;
-    while (isTileIndexValid(posToTileIndex(xInter + xDir, yInter + yDir)) &&
-           !isTileSolid(posToTileIndex(xInter + xDir, yInter + yDir)))
+    while (isTileIndexValid(level, posToTileIndex(level, xInter + xDir, yInter + yDir)) &&
+           !isTileSolid(level, posToTileIndex(level, xInter + xDir, yInter + yDir)))
     {
         yInter += yPositive ? -TILE_DIMS : TILE_DIMS;
         xInter += xInc;
     }
-    *tileIndex = posToTileIndex(xInter + xDir, yInter + yDir);
+    *tileIndex = posToTileIndex(level, xInter + xDir, yInter + yDir);
     Vector2Int intersectVector = { .x=xInter, .y=yInter };
     return intersectVector;
 }
 
-Vector2Int getTileVertIntersection(Vector2 pos, float angle, int* tileIndex)
+Vector2Int getTileVertIntersection(const Level* level, Vector2 pos, float angle, int* tileIndex)
 {
     angle = constrainAngle(angle);
     bool xPositive = angle >= -M_PI / 2 && angle <= M_PI / 2;
@@ -349,32 +356,32 @@ Vector2Int getTileVertIntersection(Vector2 pos, float angle, int* tileIndex)
 
     int xDir = xPositive ? 1 : -1;
     int yDir = yPositive ? -1 : 1;
-    while (isTileIndexValid(posToTileIndex(xInter + xDir, yInter + yDir)) &&
-           !isTileSolid(posToTileIndex(xInter + xDir, yInter + yDir)))
+    while (isTileIndexValid(level, posToTileIndex(level, xInter + xDir, yInter + yDir)) &&
+           !isTileSolid(level, posToTileIndex(level, xInter + xDir, yInter + yDir)))
     {
         xInter += xPositive ? TILE_DIMS : -TILE_DIMS;
         yInter += yInc;
     }
-    *tileIndex = posToTileIndex(xInter + xDir, yInter + yDir);
+    *tileIndex = posToTileIndex(level, xInter + xDir, yInter + yDir);
     Vector2Int intersectVector = { .x=xInter, .y=yInter };
     return intersectVector;
 }
 
-float wallDistanceToHeight(float distance)
+float wallDistanceToHeight(GfxContext* gfx, float distance)
 {
-    float screenViewHeight = 2 * distance * tanVFovOver2;
-    float displayHeight = TILE_DIMS * (pixelBuffer.height / screenViewHeight);
+    float screenViewHeight = 2 * distance * gfx->tanVFovOver2;
+    float displayHeight = TILE_DIMS * (gfx->pixelBuffer.height / screenViewHeight);
     return displayHeight;
 }
 
-float getWallIntersectionData(Vector2Int* intersectPos, int* intersectTileIndex, const Player* player, float angle, float cosScreenAngle)
+float getWallIntersectionData(const Level* level, Vector2Int* intersectPos, int* intersectTileIndex, const Player* player, float angle, float cosScreenAngle)
 {
     int hTileIndex;
     int vTileIndex;
-    Vector2Int hIntersect = getTileHorzIntersection(player->pos, angle, &hTileIndex);
+    Vector2Int hIntersect = getTileHorzIntersection(level, player->pos, angle, &hTileIndex);
     float hDistance = sqrt(pow(hIntersect.x - player->pos.x, 2) + pow(hIntersect.y - player->pos.y, 2)) * cosScreenAngle;
 
-    Vector2Int vIntersect = getTileVertIntersection(player->pos, angle, &vTileIndex);
+    Vector2Int vIntersect = getTileVertIntersection(level, player->pos, angle, &vTileIndex);
     float vDistance = sqrt(pow(vIntersect.x - player->pos.x, 2) + pow(vIntersect.y - player->pos.y, 2)) * cosScreenAngle;
 
     *intersectPos = hDistance <= vDistance ? hIntersect : vIntersect;
@@ -382,91 +389,125 @@ float getWallIntersectionData(Vector2Int* intersectPos, int* intersectTileIndex,
     return hDistance <= vDistance ? hDistance : vDistance;
 }
 
-uint32_t depthShading(uint32_t inColor, float distance)
+static void addSprite(SpriteList* spriteList, EntityTemplate* base, Vector2 pos, float zPos,
+                      int xClip, int yClip, uint32_t maskColor, Vector2 playerPos)
 {
-    float intensity = (0.5 / distance) * 150;
-    if (intensity >= 1.0) return inColor;
+    SpriteInstance* sprite = &spriteList->sprites[spriteList->count++];
+    float dx = pos.x - playerPos.x;
+    float dy = pos.y - playerPos.y;
+    sprite->pos = pos;
+    sprite->zPos = zPos;
+    sprite->distance = dx * dx + dy * dy;
+    sprite->xClip = xClip;
+    sprite->yClip = yClip;
+    sprite->maskColor = maskColor;
+    sprite->base = base;
+}
 
-    uint8_t outColor8[3];
-    for (int i = 0; i < 3; i++)
+//Which row of the monster sprite sheet faces the player
+static int getMonsterYClip(const Monster* monster, float playerRotation)
+{
+    float monsterAngle = constrainAngle(playerRotation - getMonsterAngle(monster));
+    int yClip = 0;
+    if (monsterAngle <= -3*M_PI/4 || monsterAngle >= 3*M_PI/4)
+    {
+        yClip = 0;
+    }
+    if (monsterAngle >= -M_PI/4 && monsterAngle <= M_PI/4)
+    {
+        yClip = 1;
+    }
+    if (monsterAngle >= M_PI/4 && monsterAngle <= 3*M_PI/4)
     {
-        outColor8[i] = (uint8_t)(inColor >> i * 8) * intensity;
+        yClip = 2;
     }
-    return (outColor8[2] << 16) | (outColor8[1] << 8) | outColor8[0];
+    if (monsterAngle <= -M_PI/4 && monsterAngle >= -3*M_PI/4)
+    {
+        yClip = 3;
+    }
+    return yClip;
 }
 
-void drawFloorCeiling(int y, int screenColumn, float sinAngle, float cosAngle, float cosScreenAngle, Player* player, SDL_Surface* texture) {
-    float distance = floorCeilingDistanceTable[y];
-
-    int texX = (int)((cosAngle * distance) * (1/cosScreenAngle) + player->pos.x) % TILE_DIMS;
-    int texY = (int)((sinAngle * distance) * (1/cosScreenAngle) + player->pos.y) % TILE_DIMS;
-
-    //Should be able to scale texture
-    uint32_t color = getPixel(texture, texX, texY);
-
-    //Depth shading
-    color = depthShading(color, distance);
-    drawPoint(screenColumn, y, color);
+static int compareSpriteDistance(const void* a, const void* b)
+{
+    float distanceA = ((const SpriteInstance*)a)->distance;
+    float distanceB = ((const SpriteInstance*)b)->distance;
+    return (distanceA < distanceB) - (distanceA > distanceB);
 }
 
-void sortSprites(EntityArray* entities, Vector2 playerPos)
+/*------------------------------------------------------------------------------
+ * Input: The list to fill, the entity pools, the player and how far the frame
+ *        is between the last sim tick and the next.
+ * Description: Replaces what is in the list with every entity's sprite,
+ *              furthest first. Each pool is streamed through on its own, only
+ *              reading the arrays drawing needs. Moving entities are placed
+ *              between their last two positions.
+ *----------------------------------------------------------------------------*/
+void gatherSprites(SpriteList* spriteList, const EntityPools* pools, const Player* player, float tickFraction)
 {
-    for (int i = entities->size - 1; i >= 0; i--)
+    int total = pools->rubies.count + pools->keys.count + pools->monsters.count + pools->portals.count;
+    if (total > spriteList->capacity)
     {
-        for (int j = 0; j < i; j++)
-        {
-            if (distanceFormula(entities->data[j].pos, playerPos) <
-                distanceFormula(entities->data[j + 1].pos, playerPos))
-            {
-                //Swap
-                Entity tmp = entities->data[j];
-                entities->data[j] = entities->data[j + 1];
-                entities->data[j + 1] = tmp;
-            }
-        }
+        //MALLOC reused every frame, freed by freeSpriteList()
+        spriteList->capacity = total * 2;
+        spriteList->sprites = (SpriteInstance*)realloc(spriteList->sprites, spriteList->capacity * sizeof(SpriteInstance));
     }
-}
 
-void pixelateScreen(int n) {
-    for (int y = 0; y < pixelBuffer.height; y += n)
+    spriteList->count = 0;
+    const PickupPool* rubies = &pools->rubies;
+    for (int i = 0; i < rubies->count; i++)
     {
-        for (int x = 0; x < pixelBuffer.width; x += n)
-        {
-            SDL_Rect tmpRect = {x, y, n, n};
-            drawRect(tmpRect, getPixelBufferPixel(x, y));
-        }
+        addSprite(spriteList, rubies->base, rubies->pos[i], rubies->zPos[i], 0, 0, 0, player->pos);
     }
-}
-
-void fadeToColor(uint32_t addColor, float ratio)
-{
-    for (int y = 0; y < pixelBuffer.height; y += 1)
+    const PickupPool* keys = &pools->keys;
+    for (int i = 0; i < keys->count; i++)
     {
-        for (int x = 0; x < pixelBuffer.width; x += 1)
-        {
-            uint32_t inColor = getPixelBufferPixel(x, y);
-
-            uint8_t outColor8[3];
-            for (int i = 0; i < 3; i++)
-            {
-                outColor8[i] = (uint8_t)(ratio * (uint8_t)(addColor >> i * 8) + (1.f - ratio) * (uint8_t)(inColor >> i * 8));
-                //SDL_Log("ratio %f, addColori %u, inColori %u", ratio, (addColor >> i * 8), (inColor >> i * 8));
-            }
-            drawPoint(x, y, (outColor8[2] << 16) | (outColor8[1] << 8) | outColor8[0]);
-        }
+        addSprite(spriteList, keys->base, keys->pos[i], keys->zPos[i], 0, 0, keyColors[keys->keyId[i]], player->pos);
+    }
+    const MonsterPool* monsters = &pools->monsters;
+    for (int i = 0; i < monsters->count; i++)
+    {
+        Vector2 pos = { monsters->prevPos[i].x + (monsters->pos[i].x - monsters->prevPos[i].x) * tickFraction,
+                        monsters->prevPos[i].y + (monsters->pos[i].y - monsters->prevPos[i].y) * tickFraction };
+        addSprite(spriteList, monsters->base, pos, 0, monsters->xClip[i],
+                  getMonsterYClip(&monsters->monsters[i], player->rotation), 0, player->pos);
+    }
+    const PortalPool* portals = &pools->portals;
+    for (int i = 0; i < portals->count; i++)
+    {
+        addSprite(spriteList, portals->base, portals->pos[i], 0, portals->xClip[i], 0, 0, player->pos);
     }
 
+    qsort(spriteList->sprites, spriteList->count, sizeof(SpriteInstance), compareSpriteDistance);
+}
+
+void freeSpriteList(SpriteList* spriteList)
+{
+    free(spriteList->sprites);
+    memset(spriteList, 0, sizeof(SpriteList));
 }
 
-void draw(Player player, EntityArray entities)
+//How many rows of a column of height rows are above row, which needn't be whole
+static int getRowsAbove(float row, int height)
 {
-    //player rotation is now fixed, so precomputing trig functions to speed up
-    const float sinPlayerAngle = sinf(player.rotation);
-    const float cosPlayerAngle = cosf(player.rotation);
+    if (!(row > 0)) return 0;
+    if (row >= height) return height;
+    return (int)ceilf(row);
+}
 
+/*------------------------------------------------------------------------------
+ * Input: The context, the level and the player to look from.
+ * Description: Draws the walls, floor and ceiling over the whole pixel buffer
+ *              and fills the context's zBuffer for drawSprites(). Columns are
+ *              drawn into the column buffer with the render kernels and then
+ *              transposed onto the pixel buffer in one go.
+ *----------------------------------------------------------------------------*/
+void drawWalls(GfxContext* gfx, const Level* level, Player player)
+{
+    const RenderKernels* kernels = getRenderKernels();
     {
         float angle = -H_FOV/2 + player.rotation;
-        for (int screenColumn = 0; screenColumn < pixelBuffer.width; screenColumn++)
+        for (int screenColumn = 0; screenColumn < gfx->pixelBuffer.width; screenColumn++)
         {
             //angle, and player rotation are now fixed, so precomputing to speed up
             const float sinAngle = sinf(angle);
@@ -476,133 +517,209 @@ void draw(Player player, EntityArray entities)
             //Get distance and intersect pos
             Vector2Int intersectPos;
             int intersectTileIndex;
-            float distance = getWallIntersectionData(&intersectPos, &intersectTileIndex, &player, angle, cosScreenAngle);
-            float height = wallDistanceToHeight(distance);
-            SDL_Surface* tileTexture = getTileTexture(intersectTileIndex);
-
-            //Save column distance in zBuffer
-            zBuffer[screenColumn] = distance;
-
-            //This should be extracted into a function
-            int y = 0;
-            //Ceiling
-            for (; y < (pixelBuffer.height - height) / 2; y++)
-            {
-                drawFloorCeiling(y, screenColumn, sinAngle, cosAngle, cosScreenAngle, &player, images.ceilingTexture);
-            }
-            //walls
-            for (; y < (pixelBuffer.height + height) / 2; y++)
-            {
-                //Range corrections
-                if (y >= pixelBuffer.height) break;
-
-                //Texture Mapping
-                int yTexCoord = ((TILE_DIMS / (height)) * (y - (pixelBuffer.height - height) / 2));
-                int xTexCoord = intersectPos.x % TILE_DIMS + intersectPos.y % TILE_DIMS;
-                uint32_t color32 = getPixel(tileTexture, xTexCoord, yTexCoord);
-
-                //ColorKey for doors
-                if (color32 == 0xFFFF00FF)
-                {
-                    char tile = getLevelTile(intersectTileIndex);
-                    if (tile == TILE_DOOR0) color32 = keyColors[0];
-                    else if (tile == TILE_DOOR1) color32 = keyColors[1];
-                    else if (tile == TILE_DOOR2) color32 = keyColors[2];
-                    else if (tile == TILE_DOOR3) color32 = keyColors[3];
-                }
-
-                //Shade pixels for depth effect
-                color32 = depthShading(color32, distance);
-                drawPoint(screenColumn, y, color32);
-            }
-            //Draw floor
-            for (; y < pixelBuffer.height; y++)
-            {
-                drawFloorCeiling(y, screenColumn, sinAngle, cosAngle, cosScreenAngle, &player, images.floorTexture);
-            }
-            angle += (H_FOV / pixelBuffer.width);
+            float distance = getWallIntersectionData(level, &intersectPos, &intersectTileIndex, &player, angle, cosScreenAngle);
+            float height = wallDistanceToHeight(gfx, distance);
+            SDL_Surface* tileTexture = getTileTexture(level, gfx->images, intersectTileIndex);
+
+            //Save column distance in gfx->zBuffer
+            gfx->zBuffer[screenColumn] = distance;
+
+            //Drawn down the column buffer, so each kernel writes in a straight line
+            uint32_t* column = gfx->columnPixels + screenColumn * gfx->pixelBuffer.height;
+            float wallTop = (gfx->pixelBuffer.height - height) / 2;
+            int wallStart = getRowsAbove(wallTop, gfx->pixelBuffer.height);
+            int wallEnd = getRowsAbove((gfx->pixelBuffer.height + height) / 2, gfx->pixelBuffer.height);
+            if (wallEnd < wallStart) wallEnd = wallStart;
+
+            FloorColumn floorColumn = { .texels=gfx->images->ceilingTexture->pixels, .texPitch=gfx->images->ceilingTexture->w,
+                                        .distances=gfx->floorCeilingDistanceTable, .cosAngle=cosAngle, .sinAngle=sinAngle,
+                                        .inverseCosScreenAngle=1/cosScreenAngle, .origin=player.pos };
+            kernels->floorColumn(column, 0, wallStart, &floorColumn);
+
+            //ColorKey for doors
+            uint32_t keyColor = 0xFFFF00FF;
+            char tile = getLevelTile(level, intersectTileIndex);
+            if (tile == TILE_DOOR0) keyColor = keyColors[0];
+            else if (tile == TILE_DOOR1) keyColor = keyColors[1];
+            else if (tile == TILE_DOOR2) keyColor = keyColors[2];
+            else if (tile == TILE_DOOR3) keyColor = keyColors[3];
+
+            int xTexCoord = intersectPos.x % TILE_DIMS + intersectPos.y % TILE_DIMS;
+            WallColumn wallColumn = { .texels=(uint32_t*)tileTexture->pixels + xTexCoord, .texPitch=tileTexture->w,
+                                      .texStep=TILE_DIMS / height, .texTop=wallTop, .keyColor=keyColor,
+                                      .distance=distance };
+            kernels->wallColumn(column, wallStart, wallEnd, &wallColumn);
+
+            floorColumn.texels = gfx->images->floorTexture->pixels;
+            floorColumn.texPitch = gfx->images->floorTexture->w;
+            kernels->floorColumn(column, wallEnd, gfx->pixelBuffer.height, &floorColumn);
+
+            angle += (H_FOV / gfx->pixelBuffer.width);
         }
     }
+    kernels->transpose(gfx->pixelBuffer.pixels, gfx->pixelBuffer.pitch, gfx->columnPixels, gfx->pixelBuffer.height,
+                       gfx->pixelBuffer.width, gfx->pixelBuffer.height);
+}
 
-    //Sprite drawing ====
-    //Sort sprites by distatnce
-    sortSprites(&entities, player.pos);
+//Where a sprite lands on the screen
+typedef struct
+{
+    Vector2 pos;                //Relative to the player, x straight ahead
+    float scaledW;
+    float scaledH;
+    int x;
+    int y;
+} SpriteProjection;
+
+static SpriteProjection projectSprite(const GfxContext* gfx, const Player* player, const SpriteInstance* entity)
+{
+    SpriteProjection projection;
+    const float sinPlayerAngle = sinf(player->rotation);
+    const float cosPlayerAngle = cosf(player->rotation);
+    Vector2 entityPos = {entity->pos.x - player->pos.x, entity->pos.y - player->pos.y};
 
-    for (int entityIndex = 0; entityIndex < entities.size; entityIndex++)
     {
-        Entity entity = entities.data[entityIndex];
-        Vector2 entityPos = {entity.pos.x - player.pos.x, entity.pos.y - player.pos.y};
+        Vector2 rotatedPos;
+        rotatedPos.x = (entityPos.x * cosPlayerAngle + entityPos.y * sinPlayerAngle);
+        rotatedPos.y = (entityPos.x * -sinPlayerAngle + entityPos.y * cosPlayerAngle);
+        entityPos = rotatedPos;
+    }
 
-        {
-            Vector2 rotatedPos;
-            rotatedPos.x = (entityPos.x * cosPlayerAngle + entityPos.y * sinPlayerAngle);
-            rotatedPos.y = (entityPos.x * -sinPlayerAngle + entityPos.y * cosPlayerAngle);
-            entityPos = rotatedPos;
-        }
+    float projW = 2 * (entityPos.x * gfx->tanHFovOver2);
+    float projH = 2 * (entityPos.x * gfx->tanVFovOver2);
+    float projWRatio = projW == 0 ? 1 : (gfx->pixelBuffer.width / projW);
+    float projHRatio = projH == 0 ? 1 : (gfx->pixelBuffer.height / projH);
+
+    projection.pos = entityPos;
+    projection.scaledW = projWRatio * entity->base->spriteWidth;
+    projection.scaledH = projHRatio * entity->base->spriteHeight;
+    projection.x = projWRatio * entityPos.y + gfx->pixelBuffer.width / 2 - projection.scaledW/2;
+    projection.y = gfx->pixelBuffer.height / 2 - projection.scaledH/2 - entity->zPos * projHRatio;
+    return projection;
+}
+
+//How far away a sprite is along a screen column, compared with the zBuffer
+static float getSpriteColumnDistance(const GfxContext* gfx, const Player* player, const SpriteProjection* projection, int x)
+{
+    float angle = -H_FOV/2 + player->rotation + (H_FOV / gfx->pixelBuffer.width) * x;
+    return sqrt(pow(projection->pos.x, 2) + pow(projection->pos.y, 2)) * cosf(angle - player->rotation);
+}
 
-        float projW = 2 * (entityPos.x * tanHFovOver2);
-        float projH = 2 * (entityPos.x * tanVFovOver2);
-        float projWRatio = projW == 0 ? 1 : (pixelBuffer.width / projW);
-        float projHRatio = projH == 0 ? 1 : (pixelBuffer.height / projH);
+/*------------------------------------------------------------------------------
+ * Input: The context, a sprite and the player the frame is drawn from.
+ * Output: Whether any of the sprite is in front of the walls drawn last, and
+ *         if so the rows from top up to bottom it can be drawn on.
+ * Description: Reads the zBuffer, so it only holds for the walls drawn from
+ *              the same place.
+ *----------------------------------------------------------------------------*/
+bool getSpriteRows(const GfxContext* gfx, Player player, const SpriteInstance* sprite, int* top, int* bottom)
+{
+    SpriteProjection projection = projectSprite(gfx, &player, sprite);
+    float spriteEnd = projection.y + projection.scaledH;
+    if (!(projection.y < spriteEnd)) return false;
 
-        float scaledSpriteW = projWRatio * entity.base->spriteWidth;
-        float scaledSpriteH = projHRatio * entity.base->spriteHeight;
-        int scaledSpriteX = projWRatio * entityPos.y + pixelBuffer.width / 2 - scaledSpriteW/2;
-        int scaledSpriteY = pixelBuffer.height / 2 - scaledSpriteH/2 - entity.zPos * projHRatio;
+    bool visible = false;
+    for (int x = projection.x; x < projection.x + projection.scaledW && !visible; x++)
+    {
+        if (x >= gfx->pixelBuffer.width) break;
+        visible = x >= 0 && gfx->zBuffer[x] >= getSpriteColumnDistance(gfx, &player, &projection, x);
+    }
+    if (!visible) return false;
+
+    //drawSprites() always draws the first row, even past spriteEnd
+    *top = projection.y < 0 ? 0 : projection.y;
+    *bottom = (int)ceilf(spriteEnd);
+    if (*bottom <= *top) *bottom = *top + 1;
+    if (*bottom > gfx->pixelBuffer.height) *bottom = gfx->pixelBuffer.height;
+    return *top < *bottom;
+}
 
-        if (entity.base->type == ENTITY_TYPE_MONSTER)
+//A screen column of a sprite, from one column of its sprite sheet
+typedef struct
+{
+    const uint32_t* texels;     //Top of the sheet column
+    int texPitch;
+    int pitchShift;             //log2 of texPitch, if it is a power of two
+    int top;                    //Screen row the sprite's top is on
+    float scaledH;
+    float spriteHeight;
+    float clipRow;              //Sheet row the sprite starts on
+    uint32_t maskColor;
+    float intensity;            //For depth shading
+} SpriteColumn;
+
+//Rows firstRow up to endRow of screen column x, see drawSprites()
+SPECIALIZED void drawSpriteColumn(PixelBuffer* pixelBuffer, int x, int firstRow, int endRow, const SpriteColumn* sprite,
+                                  bool keyed, bool shaded, bool pow2)
+{
+    for (int y = firstRow; y < endRow; y++)
+    {
+        int spriteIndexY = ((float)(y - sprite->top) / sprite->scaledH) * sprite->spriteHeight + sprite->clipRow;
+        uint32_t pixelColor = sprite->texels[pow2 ? (int)((uint32_t)spriteIndexY << sprite->pitchShift)
+                                                  : spriteIndexY * sprite->texPitch];
+        //Super basic alpha transparency
+        if (pixelColor & 0xFF000000)
         {
-            float monsterAngle = constrainAngle(player.rotation - getMonsterAngle(&entity));
-
-            if (monsterAngle <= -3*M_PI/4 || monsterAngle >= 3*M_PI/4)
-            {
-                entity.yClip = 0;
-            }
-            if (monsterAngle >= -M_PI/4 && monsterAngle <= M_PI/4)
-            {
-                entity.yClip = 1;
-            }
-            if (monsterAngle >= M_PI/4 && monsterAngle <= 3*M_PI/4)
-            {
-                entity.yClip = 2;
-            }
-            if (monsterAngle <= -M_PI/4 && monsterAngle >= -3*M_PI/4)
-            {
-                entity.yClip = 3;
-            }
+            if (keyed && pixelColor == 0xFFFF00FF) pixelColor = sprite->maskColor;
+            //Not sure if this is in sync with texture shading
+            pixelBuffer->pixels[y * pixelBuffer->pitch + x] = shaded ? shadeColor(pixelColor, sprite->intensity) : pixelColor;
         }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The context, the player to look from, the sprites gathered for it
+ *        and the rows to draw them on, from firstRow up to endRow.
+ * Description: Draws the sprites over walls just drawn by drawWalls() from
+ *              the same place, hidden where the zBuffer says a wall is nearer.
+ *              Rows outside the range are left alone, so sprites that moved
+ *              can be redrawn over a copy of the walls. Each column is drawn
+ *              by a drawSpriteColumn() specialised for whether it is keyed,
+ *              shaded and has a power of two pitch.
+ *----------------------------------------------------------------------------*/
+void drawSprites(GfxContext* gfx, Player player, const SpriteList* spriteList, int firstRow, int endRow)
+{
+    if (endRow > gfx->pixelBuffer.height) endRow = gfx->pixelBuffer.height;
+
+    //Sprites come sorted by distance, furthest first
+    for (int spriteIndex = 0; spriteIndex < spriteList->count; spriteIndex++)
+    {
+        SpriteInstance entity = spriteList->sprites[spriteIndex];
+        SpriteProjection projection = projectSprite(gfx, &player, &entity);
+        float scaledSpriteW = projection.scaledW;
+        float scaledSpriteH = projection.scaledH;
+        int scaledSpriteX = projection.x;
+        int scaledSpriteY = projection.y;
+
+        float spriteEnd = scaledSpriteY + scaledSpriteH;
+        if (!(scaledSpriteY < spriteEnd)) continue;
+        int startY = scaledSpriteY < 0 ? 0 : scaledSpriteY;
+        //The first row on the screen is drawn even if the sprite ends above it
+        int spriteRowsEnd = getRowsAbove(spriteEnd, gfx->pixelBuffer.height);
+        if (spriteRowsEnd <= startY) spriteRowsEnd = startY + 1;
+        int top = startY > firstRow ? startY : firstRow;
+        int bottom = spriteRowsEnd < endRow ? spriteRowsEnd : endRow;
+        if (top >= bottom) continue;
+
+        SDL_Surface* sheet = entity.base->sprite;
+        SpriteColumn column = { .texPitch=sheet->w, .pitchShift=getPow2Shift(sheet->w), .top=scaledSpriteY,
+                                .scaledH=scaledSpriteH, .spriteHeight=entity.base->spriteHeight,
+                                .clipRow=entity.base->spriteHeight * entity.yClip, .maskColor=entity.maskColor };
+        bool keyed = entity.maskColor != 0;
+        bool pow2 = column.pitchShift >= 0;
 
         for (int x = scaledSpriteX; x < scaledSpriteX + scaledSpriteW; x++)
         {
-            if (x >= pixelBuffer.width) break;
-            //SDL_Log("%f < %f", zBuffer[x], entityPos.x);
-            float angle = -H_FOV/2 + player.rotation + (H_FOV / pixelBuffer.width) * x;
-            float spriteDistance = sqrt(pow(entityPos.x, 2) + pow(entityPos.y, 2)) * cosf(angle - player.rotation);
-            if (x < 0 || zBuffer[x] < spriteDistance) continue;
-
-            for (int y = scaledSpriteY; y < scaledSpriteY + scaledSpriteH; y++)
-            {
-                if (y < 0) y = 0;
-                if (y >= pixelBuffer.height) break;
-
-                int spriteIndexX = ((float)(x - scaledSpriteX) / scaledSpriteW) * entity.base->spriteWidth + entity.base->spriteWidth * entity.xClip;
-                int spriteIndexY = ((float)(y - scaledSpriteY) / scaledSpriteH) * entity.base->spriteHeight + entity.base->spriteHeight * entity.yClip;
-
-                //Super basic alpha transparency
-                uint32_t pixelColor = getPixel(entity.base->sprite, spriteIndexX, spriteIndexY);
-                if (pixelColor & 0xFF000000)
-                {
-                    if (pixelColor == 0xFFFF00FF && entity.base->type == ENTITY_TYPE_KEY)
-                    {
-                        pixelColor = keyColors[((Key*)entity.sub)->id];
-                    }
-
-                    //Not sure if this is in sync with texture shading
-                    uint32_t finalColor32 = depthShading(pixelColor, spriteDistance);
-
-                    pixelBuffer.pixels[y * pixelBuffer.width + x] = finalColor32;
-                }
-            }
+            if (x >= gfx->pixelBuffer.width) break;
+            //SDL_Log("%f < %f", gfx->zBuffer[x], entityPos.x);
+            float spriteDistance = getSpriteColumnDistance(gfx, &player, &projection, x);
+            if (x < 0 || gfx->zBuffer[x] < spriteDistance) continue;
+
+            int spriteIndexX = ((float)(x - scaledSpriteX) / scaledSpriteW) * entity.base->spriteWidth + entity.base->spriteWidth * entity.xClip;
+            column.texels = (const uint32_t*)sheet->pixels + spriteIndexX;
+            column.intensity = getShadingIntensity(spriteDistance);
+            bool shaded = !(column.intensity >= 1.0);
+            CALL_SPECIALIZED3(drawSpriteColumn, keyed, shaded, pow2, &gfx->pixelBuffer, x, top, bottom, &column);
         }
     }
-}
\ No newline at end of file
+}
@@ -17,6 +17,9 @@ seoras1@gmail.com
 #endif
 
 #include "engine_types.h"
+#include "entity_pools.h"
+#include "images.h"
+#include "glyph_cache.h"
 
 
 //Resolution
@@ -27,15 +30,80 @@ static const int SCREEN_HEIGHT = 256;
 static const float H_FOV = M_PI/3;
 static const float V_FOV = M_PI/4;//(3*M_PI)/16;
 
+/*------------------------------------------------------------------------------
+ * One sprite to draw this frame. The entity pools are gathered into a single
+ * list so sprites of every type can be depth sorted together.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    Vector2 pos;
+    float zPos;
+    float distance;             //Squared distance from the player
+    int xClip;
+    int yClip;
+    uint32_t maskColor;         //Replaces 0xFFFF00FF pixels, zero for none
+    EntityTemplate* base;
+} SpriteInstance;
 
-PixelBuffer* getPixelBuffer  (void);
-void drawRect                (SDL_Rect rect, uint32_t color);
-void drawPoint               (int x, int y, uint32_t color);
-void blitToPixelBuffer       (SDL_Surface* image, Rectangle destRect, uint32_t maskColor);
-void drawText                (char* text, SDL_Rect rect, uint32_t color, SpriteFont spriteFont, bool centered);
-void drawTextToSurface       (char* text, SDL_Surface* surface, SDL_Rect rect, uint32_t color, SpriteFont spriteFont);
-void createPixelBuffer       (int width, int height);
-void draw                    (Player player, EntityArray entities);
-void pixelateScreen          (int n);
-void fadeToColor             (uint32_t addColor, float ratio);
-void rotatedBlitToPixelBuffer(SDL_Surface* image, Rectangle destRect, uint32_t maskColor, float angle);
\ No newline at end of file
+//Sprites to draw, furthest first. Its array is reused from frame to frame.
+typedef struct
+{
+    SpriteInstance* sprites;
+    int count;
+    int capacity;
+} SpriteList;
+
+//Everything drawing writes to or precomputes, one per image being drawn
+typedef struct
+{
+    PixelBuffer pixelBuffer;            //Either ownPixels or a locked screen texture
+    uint32_t* ownPixels;
+    float* zBuffer;                     //Per column, distance to the wall drawn there
+    float* floorCeilingDistanceTable;   //Per row
+    uint32_t* scratchRow;               //A row of pixels, see applyPostEffects()
+    int* blitColumns;                   //Per column, see blitToPixelBuffer()
+    uint32_t* columnPixels;             //The view a column at a time, see drawWalls()
+    float tanHFovOver2;
+    float tanVFovOver2;
+    const ImageManager* images;
+
+    int dirtyTop;                       //Rows a frame drawn with beginScreenRows()
+    int dirtyBottom;                    //changed, from dirtyTop up to dirtyBottom
+    GlyphRunCache glyphRuns;            //Strings drawText() has drawn
+} GfxContext;
+
+//Up to triple buffered
+#define MAX_SCREEN_TEXTURES 3
+
+/*------------------------------------------------------------------------------
+ * Streaming textures frames are drawn straight into, taken in turn so the one
+ * being drawn isn't one the renderer may still be reading from.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    SDL_Texture* textures[MAX_SCREEN_TEXTURES];
+    int count;
+    int next;                   //Index of the texture the next frame is drawn into
+    int shown;                  //Index of the texture holding the last frame, -1 for none
+    bool locked;                //Whether the context is drawing into textures[next]
+    bool rows;                  //Whether only the context's dirty rows are to be shown
+} ScreenTextures;
+
+
+void initGfxContext          (GfxContext* gfx, int width, int height, const ImageManager* images);
+void freeGfxContext          (GfxContext* gfx);
+void drawRect                (GfxContext* gfx, SDL_Rect rect, uint32_t color);
+void drawPoint               (GfxContext* gfx, int x, int y, uint32_t color);
+void drawText                (GfxContext* gfx, char* text, SDL_Rect rect, uint32_t color, SpriteFont spriteFont, bool centered);
+void drawTextToSurface       (char* text, SDL_Surface* surface, SDL_Rect rect, uint32_t color, SpriteFont spriteFont,
+                              GlyphRunCache* cache);
+void drawWalls               (GfxContext* gfx, const Level* level, Player player);
+void drawSprites             (GfxContext* gfx, Player player, const SpriteList* spriteList, int firstRow, int endRow);
+bool getSpriteRows           (const GfxContext* gfx, Player player, const SpriteInstance* sprite, int* top, int* bottom);
+void gatherSprites           (SpriteList* spriteList, const EntityPools* pools, const Player* player, float tickFraction);
+void freeSpriteList          (SpriteList* spriteList);
+bool initScreenTextures      (ScreenTextures* screen, SDL_Renderer* renderer, int width, int height, int count);
+void freeScreenTextures      (ScreenTextures* screen);
+void beginScreenFrame        (GfxContext* gfx, ScreenTextures* screen);
+void beginScreenRows         (GfxContext* gfx, ScreenTextures* screen);
+SDL_Texture* endScreenFrame  (GfxContext* gfx, ScreenTextures* screen);
\ No newline at end of file
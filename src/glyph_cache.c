@@ -0,0 +1,98 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glyph_cache.h"
+
+
+/*------------------------------------------------------------------------------
+ * Input: The run to draw into, the text it is for and the font and colour to
+ *        draw it with.
+ * Description: Each glyph is read from the font once, ANDed with the colour,
+ *              and whatever has no alpha left is made fully transparent.
+ *----------------------------------------------------------------------------*/
+static void rasterizeGlyphRun(GlyphRun* run, const char* text, int length, uint32_t color, SpriteFont spriteFont)
+{
+    int width = length * spriteFont.charW;
+    int height = spriteFont.charH;
+    if (run->pixels.pixels == NULL || width * height > run->pixels.pitch * run->pixels.height)
+    {
+        //MALLOC freed by freeGlyphRunCache()
+        free(run->pixels.pixels);
+        run->pixels.pixels = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+    }
+    run->pixels.width = width;
+    run->pixels.height = height;
+    run->pixels.pitch = width;
+
+    memcpy(run->text, text, length);
+    run->text[length] = '\0';
+    run->color = color;
+    run->font = spriteFont.sprite;
+
+    SDL_Surface* font = spriteFont.sprite;
+    for (int i = 0; i < length; i++)
+    {
+        int spriteX = (text[i] - 32) * spriteFont.charW;
+        for (int y = 0; y < height; y++)
+        {
+            const uint32_t* source = (const uint32_t*)((const uint8_t*)font->pixels + y * font->pitch) + spriteX;
+            uint32_t* dest = run->pixels.pixels + y * width + i * spriteFont.charW;
+            for (int x = 0; x < spriteFont.charW; x++)
+            {
+                uint32_t pixelColor = source[x] & color;
+                dest[x] = (pixelColor & 0xFF000000) ? pixelColor : 0;
+            }
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      GlyphRunCache* cache: The cache to look in
+ *      char* text: The start of the string, it needn't be terminated
+ *      int length: How many characters of it, at most GLYPH_RUN_MAX_LENGTH
+ *      uint32_t color: The colour the font is ANDed with
+ *      SpriteFont spriteFont: The font to draw it with
+ * Output:
+ *      The string drawn in the colour, only drawn from the font if it wasn't
+ *      already in the cache. It stays valid until the next call.
+ *----------------------------------------------------------------------------*/
+const GlyphRun* getGlyphRun(GlyphRunCache* cache, const char* text, int length, uint32_t color, SpriteFont spriteFont)
+{
+    if (length > GLYPH_RUN_MAX_LENGTH) length = GLYPH_RUN_MAX_LENGTH;
+    cache->useCounter++;
+
+    GlyphRun* oldest = &cache->runs[0];
+    for (int i = 0; i < GLYPH_RUN_CACHE_SIZE; i++)
+    {
+        GlyphRun* run = &cache->runs[i];
+        if (run->pixels.pixels != NULL && run->color == color && run->font == spriteFont.sprite &&
+            run->pixels.width == length * spriteFont.charW && run->pixels.height == spriteFont.charH &&
+            strncmp(run->text, text, length) == 0 && run->text[length] == '\0')
+        {
+            run->lastUsed = cache->useCounter;
+            return run;
+        }
+        if (run->lastUsed < oldest->lastUsed) oldest = run;
+    }
+
+    rasterizeGlyphRun(oldest, text, length, color, spriteFont);
+    oldest->lastUsed = cache->useCounter;
+    return oldest;
+}
+
+void freeGlyphRunCache(GlyphRunCache* cache)
+{
+    for (int i = 0; i < GLYPH_RUN_CACHE_SIZE; i++)
+    {
+        free(cache->runs[i].pixels.pixels);
+    }
+    memset(cache, 0, sizeof(GlyphRunCache));
+}
@@ -0,0 +1,37 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "engine_types.h"
+
+
+//Strings cached at once, the least recently drawn is replaced first
+#define GLYPH_RUN_CACHE_SIZE 16
+//Longer strings are cached in pieces this long
+#define GLYPH_RUN_MAX_LENGTH 31
+
+//A string already drawn from the font in one colour, ready to be blended in
+typedef struct
+{
+    char text[GLYPH_RUN_MAX_LENGTH + 1];
+    uint32_t color;
+    SDL_Surface* font;
+    PixelBuffer pixels;         //No alpha where nothing is drawn
+    uint32_t lastUsed;
+} GlyphRun;
+
+typedef struct
+{
+    GlyphRun runs[GLYPH_RUN_CACHE_SIZE];
+    uint32_t useCounter;
+} GlyphRunCache;
+
+
+const GlyphRun* getGlyphRun       (GlyphRunCache* cache, const char* text, int length, uint32_t color, SpriteFont spriteFont);
+void            freeGlyphRunCache (GlyphRunCache* cache);
@@ -0,0 +1,354 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "checks.h"
+#include "../visibility.h"
+#include "../load_level.h"
+#include "../entity_pools.h"
+#include "../perception.h"
+#include "../monster_sim.h"
+#include "../ai_scheduler.h"
+#include "../render_kernels.h"
+
+
+/*---------------------
+ * Visibility
+ *-------------------*/
+
+//Two walls touching at a corner, with . open and # solid
+static const char* SEGMENT_LEVEL_TILES =
+    "...."
+    ".#.."
+    "..#."
+    "....";
+
+//A segment from the centre of one tile to the centre of another
+typedef struct
+{
+    int fromX, fromY;
+    int toX, toY;
+    bool clear;
+} SegmentCheck;
+
+static const SegmentCheck segmentChecks[] =
+{
+    { 1, 2, 2, 1, false },  //Between the walls, through the corner they share
+    { 2, 1, 1, 2, false },
+    { 1, 0, 2, 1, false },  //Through a corner with only one wall beside it
+    { 2, 1, 1, 0, false },
+    { 2, 3, 3, 2, false },
+    { 3, 2, 2, 3, false },
+    { 0, 2, 1, 3, true },   //Through a corner with no walls beside it
+    { 1, 3, 0, 2, true },
+    { 0, 0, 3, 0, true },
+    { 0, 0, 0, 3, true },
+};
+
+/*------------------------------------------------------------------------------
+ * Output: How many segments isSegmentClear() gets wrong on a small level of
+ *         two walls touching at a corner.
+ *----------------------------------------------------------------------------*/
+int checkSegmentClear(void)
+{
+    char tiles[16];
+    memcpy(tiles, SEGMENT_LEVEL_TILES, sizeof(tiles));
+    Level level = { .width=4, .height=4, .data=tiles };
+
+    int failures = 0;
+    for (int i = 0; i < (int)(sizeof(segmentChecks) / sizeof(segmentChecks[0])); i++)
+    {
+        const SegmentCheck* check = &segmentChecks[i];
+        Vector2 from = { (check->fromX + 0.5f) * TILE_DIMS, (check->fromY + 0.5f) * TILE_DIMS };
+        Vector2 to = { (check->toX + 0.5f) * TILE_DIMS, (check->toY + 0.5f) * TILE_DIMS };
+        bool clear = isSegmentClear(&level, from, to);
+        if (clear == check->clear) continue;
+        SDL_Log("Segment from tile %d,%d to %d,%d should be %s", check->fromX, check->fromY,
+                check->toX, check->toY, check->clear ? "clear" : "blocked");
+        failures++;
+    }
+    return failures;
+}
+
+/*---------------------
+ * Monster level of detail
+ *-------------------*/
+
+//A ring of corridor round a block of wall
+static const char* PATROL_LEVEL_TILES =
+    "######"
+    "#....#"
+    "#.##.#"
+    "#.##.#"
+    "#....#"
+    "######";
+#define PATROL_LEVEL_DIMS 6
+#define PATROL_TICKS      2000
+//Far monsters may pick their next patrol point a little later, but mustn't
+//lose a step at every tile centre, which is about 1% here
+#define PATROL_MIN_PACE   0.995f
+
+/*------------------------------------------------------------------------------
+ * Input: Where the player is, which sets how often the monster thinks. It
+ *        never sees the player.
+ * Output: How far a monster patrolling the ring walks in PATROL_TICKS.
+ *----------------------------------------------------------------------------*/
+static float getPatrolDistance(Vector2 playerPos)
+{
+    char tiles[PATROL_LEVEL_DIMS * PATROL_LEVEL_DIMS];
+    memcpy(tiles, PATROL_LEVEL_TILES, sizeof(tiles));
+    Level level = { .width=PATROL_LEVEL_DIMS, .height=PATROL_LEVEL_DIMS, .data=tiles };
+    buildVisibility(&level);
+
+    EntityTemplate monsterTemplate = { .width=TILE_DIMS, .height=TILE_DIMS };
+    EntityPools pools;
+    initEntityPools(&pools, &monsterTemplate, &monsterTemplate, &monsterTemplate, &monsterTemplate);
+    Vector2Int patrol[4] = { { 1, 1 }, { 4, 1 }, { 4, 4 }, { 1, 4 } };
+    addMonster(&pools.monsters, patrol, 4);
+    buildEntityPoolGrids(&pools, &level);
+
+    PerceptionBuffers perception = {0};
+    EntityIndexList nobody = {0};
+    MonsterSim sim = {0};
+    float distance = 0;
+    for (int tick = 0; tick < PATROL_TICKS; tick++)
+    {
+        runMonsterPerception(&perception, &pools.monsters, &nobody, playerPos, 0, 0);
+        MonsterSimFrame frame = { .level=&level, .perception=&perception, .playerPos=playerPos };
+        Vector2 before = pools.monsters.pos[0];
+        runMonsterSim(&sim, &pools.monsters, &frame);
+        distance += hypotf(pools.monsters.pos[0].x - before.x, pools.monsters.pos[0].y - before.y);
+    }
+
+    freeMonsterSim(&sim);
+    freePerceptionBuffers(&perception);
+    freeEntityPools(&pools);
+    freeVisibility(&level.visibility);
+    return distance;
+}
+
+/*------------------------------------------------------------------------------
+ * Output: 1 if a monster far from the player, which only thinks every few
+ *         frames, walks noticeably less far than one thinking every frame,
+ *         otherwise 0.
+ *----------------------------------------------------------------------------*/
+int checkMonsterLod(void)
+{
+    float ringCentre = PATROL_LEVEL_DIMS * TILE_DIMS / 2;
+    Vector2 nearPlayer = { ringCentre, ringCentre };
+    Vector2 farPlayer = { ringCentre + AI_FAR_DISTANCE * 4, ringCentre };
+    float fullRate = getPatrolDistance(nearPlayer);
+    float lod = getPatrolDistance(farPlayer);
+    SDL_Log("Monster patrol over %d ticks: %.0f thinking every frame, %.0f far away", PATROL_TICKS, fullRate, lod);
+    return lod >= fullRate * PATROL_MIN_PACE ? 0 : 1;
+}
+
+/*---------------------
+ * Render kernels
+ *-------------------*/
+
+static const uint32_t COLOR_KEY = 0xFFFF00FF;
+
+#define CHECK_TRIALS      500
+#define CHECK_COLUMN_ROWS 256
+#define CHECK_ROW_LENGTH  80
+#define CHECK_TRANSPOSE   48
+//Exactly at full brightness, where depthShading() stops shading
+#define CHECK_BRIGHT_DISTANCE 75
+
+static uint32_t nextRandom(uint32_t* seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+//A float from min up to max
+static float randomRange(uint32_t* seed, float min, float max)
+{
+    return min + (max - min) * (nextRandom(seed) & 0xFFFF) / 65536.f;
+}
+
+//Pixels with and without alpha, and the colour key now and then
+static void fillRandomPixels(uint32_t* pixels, int count, uint32_t* seed)
+{
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t random = nextRandom(seed);
+        pixels[i] = random % 7 == 0 ? COLOR_KEY : random % 5 == 0 ? random & 0x00FFFFFF : random | 0xFF000000;
+    }
+}
+
+//Tile texture, walls from far enough to be shaded to close enough not to be,
+//with pitches that are a power of two and some that aren't
+static bool checkWallColumn(const RenderKernels* kernels, uint32_t* seed)
+{
+    //A row spare, rounding can take the last screen row one past the texture
+    uint32_t texture[65 * 64];
+    uint32_t expected[CHECK_COLUMN_ROWS], actual[CHECK_COLUMN_ROWS];
+    fillRandomPixels(texture, 65 * 64, seed);
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        float height = randomRange(seed, 1, CHECK_COLUMN_ROWS * 3);
+        WallColumn wall = { .texels=texture + nextRandom(seed) % 63, .texPitch=trial % 3 ? 64 : 63, .texStep=64 / height,
+                            .texTop=(CHECK_COLUMN_ROWS - height) / 2, .distance=trial % 8 ? randomRange(seed, 1, 2000) : CHECK_BRIGHT_DISTANCE,
+                            .keyColor=trial % 2 ? COLOR_KEY : nextRandom(seed) };
+        //The rows the wall covers, as drawWalls() works them out
+        int firstRow = wall.texTop <= 0 ? 0 : (int)ceilf(wall.texTop);
+        int endRow = wall.texTop + height >= CHECK_COLUMN_ROWS ? CHECK_COLUMN_ROWS : (int)ceilf(wall.texTop + height);
+        firstRow += nextRandom(seed) % 4;
+        if (endRow < firstRow) endRow = firstRow;
+        memset(expected, 0, sizeof(expected));
+        memset(actual, 0, sizeof(actual));
+        getKernelSet(KERNEL_ISA_SCALAR)->wallColumn(expected, firstRow, endRow, &wall);
+        kernels->wallColumn(actual, firstRow, endRow, &wall);
+        if (memcmp(expected, actual, sizeof(expected)) != 0) return false;
+    }
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Distances only grow or only shrink down the column, as they do
+ *              either side of the horizon. Around the origin some texture
+ *              coordinates are negative, and wrap to before the texture, so
+ *              it has spare rows either side.
+ *----------------------------------------------------------------------------*/
+static bool checkFloorColumn(const RenderKernels* kernels, uint32_t* seed)
+{
+    static uint32_t texture[3 * 64 * 80];
+    float distances[CHECK_COLUMN_ROWS];
+    uint32_t expected[CHECK_COLUMN_ROWS], actual[CHECK_COLUMN_ROWS];
+    fillRandomPixels(texture, 3 * 64 * 80, seed);
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        float nearest = randomRange(seed, 1, 100);
+        float step = randomRange(seed, 0, 10);
+        bool growing = trial % 2;
+        for (int i = 0; i < CHECK_COLUMN_ROWS; i++)
+        {
+            int fromNearest = growing ? i : CHECK_COLUMN_ROWS - 1 - i;
+            distances[i] = trial % 8 ? nearest + step * fromNearest : CHECK_BRIGHT_DISTANCE;
+        }
+        float angle = randomRange(seed, -M_PI, M_PI);
+        int texPitch = trial % 3 ? 64 : 80;
+        FloorColumn floor = { .texels=texture + 64 * 80, .texPitch=texPitch, .distances=distances, .cosAngle=cosf(angle),
+                              .sinAngle=sinf(angle), .inverseCosScreenAngle=1 / cosf(randomRange(seed, -0.5f, 0.5f)),
+                              .origin={ randomRange(seed, -2000, 2000), randomRange(seed, -2000, 2000) } };
+        int firstRow = nextRandom(seed) % CHECK_COLUMN_ROWS;
+        int endRow = firstRow + nextRandom(seed) % (CHECK_COLUMN_ROWS - firstRow + 1);
+        memset(expected, 0, sizeof(expected));
+        memset(actual, 0, sizeof(actual));
+        getKernelSet(KERNEL_ISA_SCALAR)->floorColumn(expected, firstRow, endRow, &floor);
+        kernels->floorColumn(actual, firstRow, endRow, &floor);
+        if (memcmp(expected, actual, sizeof(expected)) != 0) return false;
+    }
+    return true;
+}
+
+static bool checkBlendRow(const RenderKernels* kernels, uint32_t* seed)
+{
+    uint32_t source[CHECK_ROW_LENGTH], expected[CHECK_ROW_LENGTH], actual[CHECK_ROW_LENGTH];
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        fillRandomPixels(source, CHECK_ROW_LENGTH, seed);
+        fillRandomPixels(expected, CHECK_ROW_LENGTH, seed);
+        memcpy(actual, expected, sizeof(expected));
+        int start = nextRandom(seed) % 4;
+        int count = nextRandom(seed) % (CHECK_ROW_LENGTH - start);
+        uint32_t maskColor = nextRandom(seed);
+        getKernelSet(KERNEL_ISA_SCALAR)->blendRow(expected + start, source, count, maskColor);
+        kernels->blendRow(actual + start, source, count, maskColor);
+        if (memcmp(expected, actual, sizeof(expected)) != 0) return false;
+    }
+    return true;
+}
+
+static bool checkFadeRow(const RenderKernels* kernels, uint32_t* seed)
+{
+    uint32_t expected[CHECK_ROW_LENGTH], actual[CHECK_ROW_LENGTH];
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        fillRandomPixels(expected, CHECK_ROW_LENGTH, seed);
+        memcpy(actual, expected, sizeof(expected));
+        uint16_t weight = nextRandom(seed) % 257;
+        FadeWeights fade = { .keep=256 - weight };
+        for (int i = 0; i < 4; i++) fade.add[i] = (nextRandom(seed) & 0xFF) * weight;
+        int start = nextRandom(seed) % 4;
+        int count = nextRandom(seed) % (CHECK_ROW_LENGTH - start);
+        getKernelSet(KERNEL_ISA_SCALAR)->fadeRow(expected + start, count, &fade);
+        kernels->fadeRow(actual + start, count, &fade);
+        if (memcmp(expected, actual, sizeof(expected)) != 0) return false;
+    }
+    return true;
+}
+
+static bool checkTranspose(const RenderKernels* kernels, uint32_t* seed)
+{
+    static uint32_t source[CHECK_TRANSPOSE * CHECK_TRANSPOSE];
+    static uint32_t expected[CHECK_TRANSPOSE * CHECK_TRANSPOSE], actual[CHECK_TRANSPOSE * CHECK_TRANSPOSE];
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        fillRandomPixels(source, CHECK_TRANSPOSE * CHECK_TRANSPOSE, seed);
+        memset(expected, 0, sizeof(expected));
+        memset(actual, 0, sizeof(actual));
+        int width = 1 + nextRandom(seed) % (CHECK_TRANSPOSE - 8);
+        int height = 1 + nextRandom(seed) % (CHECK_TRANSPOSE - 8);
+        int destPitch = width + nextRandom(seed) % 8;
+        int sourcePitch = height + nextRandom(seed) % 8;
+        getKernelSet(KERNEL_ISA_SCALAR)->transpose(expected, destPitch, source, sourcePitch, width, height);
+        kernels->transpose(actual, destPitch, source, sourcePitch, width, height);
+        if (memcmp(expected, actual, sizeof(expected)) != 0) return false;
+    }
+    return true;
+}
+
+typedef struct
+{
+    const char* name;
+    bool (*check)(const RenderKernels* kernels, uint32_t* seed);
+} KernelCheck;
+
+static const KernelCheck kernelChecks[] =
+{
+    { "wall column", checkWallColumn },
+    { "floor column", checkFloorColumn },
+    { "blend row", checkBlendRow },
+    { "fade row", checkFadeRow },
+    { "transpose", checkTranspose },
+};
+
+/*------------------------------------------------------------------------------
+ * Output: How many kernels differ from the scalar ones, over every
+ *         instruction set this CPU supports.
+ * Description: Runs each kernel on random pixels and compares the results
+ *              with the scalar kernel's, which must be exactly the same.
+ *----------------------------------------------------------------------------*/
+int checkRenderKernels(void)
+{
+    int failures = 0;
+    KernelIsa best = getBestKernelIsa();
+    for (int isa = KERNEL_ISA_SCALAR + 1; isa <= best; isa++)
+    {
+        for (int i = 0; i < (int)(sizeof(kernelChecks) / sizeof(kernelChecks[0])); i++)
+        {
+            //Every set sees the same inputs
+            uint32_t seed = 12345 + i;
+            bool matched = kernelChecks[i].check(getKernelSet(isa), &seed);
+            SDL_Log("%-6s %-12s %s", getKernelIsaName(isa), kernelChecks[i].name, matched ? "matches scalar" : "DIFFERS from scalar");
+            if (!matched) failures++;
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,17 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+/*------------------------------------------------------------------------------
+ * Self checks the headless runner can run in place of a simulation. Each
+ * logs what it finds and returns how many things were wrong.
+ *----------------------------------------------------------------------------*/
+
+
+int checkSegmentClear  (void);
+int checkMonsterLod    (void);
+int checkRenderKernels (void);
@@ -0,0 +1,507 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+
+/*------------------------------------------------------------------------------
+ * Headless simulation runner, built with "make headless". Runs the game's
+ * ticks as fast as possible with no window or sound, driven by a recording or
+ * a script, for soak testing the AI and catching slowdowns in long sessions.
+ *
+ * A script is a text file of lines "<ticks> [button]... [turn=<radians>]",
+ * each holding the buttons down (forward, back, left, right, turn_left,
+ * turn_right, use, pause, restart) and turning by the given amount every tick
+ * for that many ticks. use, pause and restart are only pressed on the line's
+ * first tick. The script repeats until --ticks have run. '#' starts a comment.
+ *
+ * --autopilot plays the game instead, see autopilot.h, for a workload that
+ * looks like a real session: walking, opening doors, finishing levels.
+ *
+ * --games=N runs N independent games at once, each on its own thread, to use
+ * every core of a farm machine. Script and autopilot runs use seeds seed,
+ * seed+1, ...
+ *
+ * --check-kernels checks every render kernel this CPU can run gives the same
+ * pixels as the scalar one, see checkRenderKernels(), and exits.
+ *
+ * --check-visibility checks line of sight along segments past walls and
+ * through their corners, see checkSegmentClear(), and exits.
+ *
+ * --check-monster-lod checks monsters far from the player, which think less
+ * often, keep pace with ones thinking every tick, see checkMonsterLod(), and
+ * exits.
+ *----------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+    #include <sys/resource.h>
+#elif _WIN32
+    #include <SDL.h>
+    #include <windows.h>
+    #include <psapi.h>
+#endif
+
+#include "../game.h"
+#include "../replay.h"
+#include "../autopilot.h"
+#include "../job_pool.h"
+#include "../render_kernels.h"
+#include "checks.h"
+
+
+#define MAX_SCRIPT_LINES 1024
+
+typedef struct
+{
+    int ticks;
+    uint16_t buttons;
+    float turn;
+} ScriptLine;
+
+typedef struct
+{
+    ScriptLine lines[MAX_SCRIPT_LINES];
+    int lineCount;
+    int line;
+    int tickInLine;
+} Script;
+
+#define MAX_HEADLESS_GAMES 256
+
+//Buttons that act once per press, only sent on a script line's first tick
+static const uint16_t PRESS_BUTTONS = INPUT_USE | INPUT_PAUSE | INPUT_RESTART;
+
+#ifdef COUNT_ALLOCATIONS
+/*------------------------------------------------------------------------------
+ * The game's calls to the allocator are counted by linking with
+ * -Wl,--wrap=malloc and friends, see the Makefile. The job pool's workers
+ * allocate too, so the counters are atomic.
+ *----------------------------------------------------------------------------*/
+static SDL_atomic_t mallocCount;
+static SDL_atomic_t reallocCount;
+static SDL_atomic_t freeCount;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void  __real_free(void* pointer);
+
+void* __wrap_malloc(size_t size)
+{
+    SDL_AtomicAdd(&mallocCount, 1);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    SDL_AtomicAdd(&mallocCount, 1);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size)
+{
+    SDL_AtomicAdd(pointer == NULL ? &mallocCount : &reallocCount, 1);
+    return __real_realloc(pointer, size);
+}
+
+void __wrap_free(void* pointer)
+{
+    if (pointer != NULL) SDL_AtomicAdd(&freeCount, 1);
+    __real_free(pointer);
+}
+#endif
+
+typedef struct
+{
+    long mallocs;
+    long reallocs;
+    long frees;
+} AllocationCounts;
+
+static AllocationCounts getAllocationCounts(void)
+{
+    AllocationCounts counts = {0};
+#ifdef COUNT_ALLOCATIONS
+    counts.mallocs = SDL_AtomicGet(&mallocCount);
+    counts.reallocs = SDL_AtomicGet(&reallocCount);
+    counts.frees = SDL_AtomicGet(&freeCount);
+#endif
+    return counts;
+}
+
+//Peak resident memory of the process in KiB, 0 where it isn't known
+static long getPeakMemoryKiB(void)
+{
+#ifdef __linux__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss;
+#elif _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return (long)(counters.PeakWorkingSetSize / 1024);
+    }
+#endif
+    return 0;
+}
+
+static bool parseScriptWord(const char* word, ScriptLine* line)
+{
+    static const struct { const char* name; uint16_t button; } BUTTON_NAMES[] = {
+        { "forward", INPUT_FORWARD }, { "back", INPUT_BACK },
+        { "left", INPUT_STRAFE_LEFT }, { "right", INPUT_STRAFE_RIGHT },
+        { "turn_left", INPUT_TURN_LEFT }, { "turn_right", INPUT_TURN_RIGHT },
+        { "use", INPUT_USE }, { "pause", INPUT_PAUSE }, { "restart", INPUT_RESTART }
+    };
+    if (strncmp(word, "turn=", 5) == 0)
+    {
+        line->turn = (float)atof(word + 5);
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(BUTTON_NAMES) / sizeof(BUTTON_NAMES[0]); i++)
+    {
+        if (strcmp(word, BUTTON_NAMES[i].name) == 0)
+        {
+            line->buttons |= BUTTON_NAMES[i].button;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The script to fill and the file to read it from.
+ * Output: False if the file couldn't be read or has a line that makes no
+ *         sense, which is logged.
+ *----------------------------------------------------------------------------*/
+static bool loadScript(Script* script, const char* filePath)
+{
+    memset(script, 0, sizeof(Script));
+    FILE* file = fopen(filePath, "r");
+    if (file == NULL)
+    {
+        printf("Could not open script %s.\n", filePath);
+        return false;
+    }
+    char text[256];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(text, sizeof(text), file) != NULL)
+    {
+        lineNumber++;
+        char* comment = strchr(text, '#');
+        if (comment != NULL) *comment = '\0';
+
+        char* word = strtok(text, " \t\r\n");
+        if (word == NULL) continue;
+        if (script->lineCount == MAX_SCRIPT_LINES)
+        {
+            printf("%s has more than %d lines.\n", filePath, MAX_SCRIPT_LINES);
+            ok = false;
+            break;
+        }
+        ScriptLine* line = &script->lines[script->lineCount];
+        line->ticks = atoi(word);
+        if (line->ticks <= 0)
+        {
+            printf("%s:%d: expected a tick count, got %s.\n", filePath, lineNumber, word);
+            ok = false;
+            break;
+        }
+        while ((word = strtok(NULL, " \t\r\n")) != NULL)
+        {
+            if (!parseScriptWord(word, line))
+            {
+                printf("%s:%d: unknown input %s.\n", filePath, lineNumber, word);
+                ok = false;
+                break;
+            }
+        }
+        script->lineCount++;
+    }
+    fclose(file);
+    return ok;
+}
+
+static TickInput nextScriptInput(Script* script, const Game* game)
+{
+    TickInput input = { .rotation=game->player.rotation };
+    if (script->lineCount == 0) return input;
+
+    const ScriptLine* line = &script->lines[script->line];
+    input.buttons = line->buttons;
+    if (script->tickInLine != 0) input.buttons &= ~PRESS_BUTTONS;
+    input.rotation += line->turn;
+
+    script->tickInLine++;
+    if (script->tickInLine >= line->ticks)
+    {
+        script->tickInLine = 0;
+        script->line = (script->line + 1) % script->lineCount;
+    }
+    return input;
+}
+
+static void printReport(const char* label, uint32_t ticks, double seconds, AllocationCounts allocations)
+{
+    printf("%-8s %10u ticks %9.3f s %10.0f ticks/s  peak %8ld KiB",
+           label, ticks, seconds, ticks / (seconds > 0 ? seconds : 1e-9), getPeakMemoryKiB());
+#ifdef COUNT_ALLOCATIONS
+    printf("  allocs %ld reallocs %ld frees %ld", allocations.mallocs, allocations.reallocs, allocations.frees);
+#endif
+    printf("\n");
+}
+
+//One game run by the headless runner, on its own thread when there are several
+typedef struct
+{
+    Game game;
+    Replay replay;
+    Script script;
+    Autopilot autopilot;
+    bool useReplay;
+    bool useAutopilot;
+    uint32_t seed;
+    uint32_t maxTicks;
+    uint32_t reportInterval;    //Ticks between reports, 0 for none
+    double seconds;
+    int deaths;
+    int levelsCompleted;
+} HeadlessRun;
+
+static int runHeadlessGame(void* data)
+{
+    HeadlessRun* run = (HeadlessRun*)data;
+    Game* game = &run->game;
+
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    uint64_t startCounter = SDL_GetPerformanceCounter();
+    uint64_t intervalCounter = startCounter;
+    uint32_t intervalStartTick = 0;
+    AllocationCounts intervalAllocations = getAllocationCounts();
+    while (!game->finished && (run->maxTicks == 0 || game->tick < run->maxTicks))
+    {
+        TickInput input;
+        if (run->useReplay)
+        {
+            if (!readReplayTick(&run->replay, &input)) break;
+        }
+        else if (run->useAutopilot)
+        {
+            input = getAutopilotInput(&run->autopilot, game);
+        }
+        else
+        {
+            input = nextScriptInput(&run->script, game);
+        }
+        tickGame(game, &input);
+        if (run->useReplay) verifyReplayTick(&run->replay, game);
+        if (game->events & GAME_EVENT_PLAYER_DIED) run->deaths++;
+        if (game->events & GAME_EVENT_LEVEL_COMPLETE) run->levelsCompleted++;
+
+        //Rate over the last interval, so a slowdown late in a long run shows up
+        if (run->reportInterval != 0 && game->tick - intervalStartTick >= run->reportInterval)
+        {
+            uint64_t now = SDL_GetPerformanceCounter();
+            AllocationCounts allocations = getAllocationCounts();
+            AllocationCounts delta = { allocations.mallocs - intervalAllocations.mallocs,
+                allocations.reallocs - intervalAllocations.reallocs, allocations.frees - intervalAllocations.frees };
+            printReport("interval", game->tick - intervalStartTick, (double)(now - intervalCounter) / frequency, delta);
+            intervalCounter = now;
+            intervalStartTick = game->tick;
+            intervalAllocations = allocations;
+        }
+    }
+    run->seconds = (double)(SDL_GetPerformanceCounter() - startCounter) / frequency;
+    if (run->useReplay) closeReplay(&run->replay);
+    freeAutopilot(&run->autopilot);
+    return 0;
+}
+
+int main(int argc, char* args[])
+{
+    const char* replayPath = NULL;
+    const char* scriptPath = NULL;
+    bool useAutopilot = false;
+    uint32_t maxTicks = 0;
+    uint32_t reportInterval = 60 * GAME_TICK_HZ;
+    int levelNumber = 0;
+    int workerCount = -1;
+    int gameCount = 1;
+    bool checkKernels = false;
+    bool checkVisibility = false;
+    bool checkLod = false;
+    uint32_t seed = (uint32_t)time(NULL);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(args[i], "--replay=", 9) == 0) replayPath = args[i] + 9;
+        else if (strncmp(args[i], "--script=", 9) == 0) scriptPath = args[i] + 9;
+        else if (strcmp(args[i], "--autopilot") == 0) useAutopilot = true;
+        else if (strncmp(args[i], "--ticks=", 8) == 0) maxTicks = (uint32_t)strtoul(args[i] + 8, NULL, 10);
+        else if (strncmp(args[i], "--report-every=", 15) == 0) reportInterval = (uint32_t)strtoul(args[i] + 15, NULL, 10);
+        else if (strncmp(args[i], "--level=", 8) == 0) levelNumber = atoi(args[i] + 8);
+        else if (strncmp(args[i], "--workers=", 10) == 0) workerCount = atoi(args[i] + 10);
+        else if (strncmp(args[i], "--games=", 8) == 0) gameCount = atoi(args[i] + 8);
+        else if (strncmp(args[i], "--seed=", 7) == 0) seed = (uint32_t)strtoul(args[i] + 7, NULL, 10);
+        else if (strcmp(args[i], "--check-kernels") == 0) checkKernels = true;
+        else if (strcmp(args[i], "--check-visibility") == 0) checkVisibility = true;
+        else if (strcmp(args[i], "--check-monster-lod") == 0) checkLod = true;
+        else
+        {
+            printf("Usage: %s [--replay=FILE | --script=FILE | --autopilot] [--ticks=N] [--report-every=N]\n"
+                   "       [--level=N] [--seed=N] [--workers=N] [--games=N] [--check-kernels]\n"
+                   "       [--check-visibility] [--check-monster-lod]\n", args[0]);
+            return 1;
+        }
+    }
+    if (checkKernels)
+    {
+        int failures = checkRenderKernels();
+        printf("%d render kernels differ from the scalar ones, up to %s.\n", failures,
+               getKernelIsaName(getBestKernelIsa()));
+        return failures == 0 ? 0 : 1;
+    }
+    if (checkVisibility)
+    {
+        int failures = checkSegmentClear();
+        printf("%d segments got the wrong line of sight.\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    if (checkLod)
+    {
+        int failures = checkMonsterLod();
+        printf("Far monsters %s.\n", failures == 0 ? "keep pace" : "fall BEHIND");
+        return failures;
+    }
+    if ((replayPath != NULL) + (scriptPath != NULL) + useAutopilot > 1)
+    {
+        printf("Give only one of a replay, a script or the autopilot.\n");
+        return 1;
+    }
+    if (gameCount < 1 || gameCount > MAX_HEADLESS_GAMES)
+    {
+        printf("--games must be between 1 and %d.\n", MAX_HEADLESS_GAMES);
+        return 1;
+    }
+    if (replayPath == NULL && maxTicks == 0)
+    {
+        //Without a recording to run out of, stop after an hour of game time
+        maxTicks = 60 * 60 * GAME_TICK_HZ;
+    }
+
+    //Timers and threads only, no video or audio
+    if (SDL_Init(SDL_INIT_TIMER) < 0)
+    {
+        printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    //MALLOC freed at the end of the run. Games are big, so not on the stack.
+    HeadlessRun* runs = (HeadlessRun*)calloc(gameCount, sizeof(HeadlessRun));
+    for (int i = 0; i < gameCount; i++)
+    {
+        HeadlessRun* run = &runs[i];
+        run->seed = seed + i;
+        run->maxTicks = maxTicks;
+        //Interleaved reports from several games would be unreadable
+        run->reportInterval = gameCount == 1 ? reportInterval : 0;
+        run->useAutopilot = useAutopilot;
+        if (replayPath != NULL)
+        {
+            //Each game reads the file through its own handle
+            if (!openReplay(&run->replay, replayPath)) return 1;
+            run->useReplay = true;
+            run->seed = run->replay.seed;
+            levelNumber = run->replay.levelNumber;
+        }
+        else if (scriptPath != NULL && !loadScript(&run->script, scriptPath))
+        {
+            return 1;
+        }
+    }
+
+    //Games run side by side share the workers, see runParallelFor()
+    initJobPool(workerCount >= 0 ? workerCount : SDL_GetCPUCount() - 1);
+
+    EntityTemplate rubyTemplate = { .width=16, .height=16, .spriteWidth=16, .spriteHeight=16, .type=ENTITY_TYPE_RUBY };
+    EntityTemplate keyTemplate = { .width=16, .height=16, .spriteWidth=16, .spriteHeight=16, .type=ENTITY_TYPE_KEY};
+    EntityTemplate monsterTemplate = { .width=64, .height=64, .spriteWidth=64, .spriteHeight=64, .type=ENTITY_TYPE_MONSTER};
+    EntityTemplate endPortalTemplate = { .width=64, .height=64, .spriteWidth=64, .spriteHeight=64, .animationSpeed=30, .type=ENTITY_TYPE_PORTAL};
+
+    AllocationCounts startAllocations = getAllocationCounts();
+    for (int i = 0; i < gameCount; i++)
+    {
+        Game* game = &runs[i].game;
+        initGame(game, &rubyTemplate, &keyTemplate, &monsterTemplate, &endPortalTemplate, runs[i].seed, levelNumber);
+        //Recordings think on the fixed schedule alone, so must their replays
+        game->aiBudgetMs = 0;
+    }
+    printf("level %d, seed %u, %d monsters, %d workers, %d games\n", levelNumber, runs[0].seed,
+           runs[0].game.pools.monsters.count, getJobPoolSize(), gameCount);
+
+    uint64_t startCounter = SDL_GetPerformanceCounter();
+    if (gameCount == 1)
+    {
+        runHeadlessGame(&runs[0]);
+    }
+    else
+    {
+        SDL_Thread* threads[MAX_HEADLESS_GAMES] = {0};
+        for (int i = 0; i < gameCount; i++)
+        {
+            threads[i] = SDL_CreateThread(runHeadlessGame, "headlessGame", &runs[i]);
+            //Run it here if no thread could be had
+            if (threads[i] == NULL) runHeadlessGame(&runs[i]);
+        }
+        for (int i = 0; i < gameCount; i++)
+        {
+            if (threads[i] != NULL) SDL_WaitThread(threads[i], NULL);
+        }
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - startCounter) / SDL_GetPerformanceFrequency();
+
+    uint32_t totalTicks = 0;
+    bool drifted = false;
+    for (int i = 0; i < gameCount; i++)
+    {
+        HeadlessRun* run = &runs[i];
+        totalTicks += run->game.tick;
+        if (gameCount > 1)
+        {
+            printf("game %3d seed %10u %10u ticks %9.3f s level %2d rubies %4d deaths %4d completed %2d checksum %08x\n",
+                   i, run->seed, run->game.tick, run->seconds, run->game.playerData.levelNumber,
+                   run->game.playerData.totalRubiesCollected + run->game.playerData.rubiesCollected,
+                   run->deaths, run->levelsCompleted, getGameChecksum(&run->game));
+        }
+        if (run->useReplay && run->replay.drifted)
+        {
+            printf("Game %d drifted from the recording by tick %u.\n", i, run->replay.driftTick);
+            drifted = true;
+        }
+    }
+    AllocationCounts allocations = getAllocationCounts();
+    AllocationCounts total = { allocations.mallocs - startAllocations.mallocs,
+        allocations.reallocs - startAllocations.reallocs, allocations.frees - startAllocations.frees };
+    printReport("total", totalTicks, seconds, total);
+    if (gameCount == 1)
+    {
+        printf("level %d, %d rubies, %d deaths, %d levels completed, checksum %08x\n",
+               runs[0].game.playerData.levelNumber,
+               runs[0].game.playerData.totalRubiesCollected + runs[0].game.playerData.rubiesCollected,
+               runs[0].deaths, runs[0].levelsCompleted, getGameChecksum(&runs[0].game));
+        if (replayPath != NULL && !drifted) printf("Matched the recording for %u ticks.\n", runs[0].replay.ticksRead);
+    }
+
+    for (int i = 0; i < gameCount; i++) freeGame(&runs[i].game);
+    free(runs);
+    return drifted ? 2 : 0;
+}
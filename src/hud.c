@@ -0,0 +1,211 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "hud.h"
+#include "blitter.h"
+
+
+static uint32_t keyColors[MAX_KEYS] = {0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFF00AA88};
+//Transparent in an image becomes this rather than no alpha, which would leave
+//the layer's pixel out
+static const uint32_t HUD_BLACK = 0xFF000000;
+static const uint32_t HUD_TEXT_COLOR = 0xFF7A0927;
+
+static const int KEY_SPACING = 16;
+static const int ICON_SIZE = 11;
+static const int COMPASS_SIZE = 32;
+
+
+static Rectangle unionRect(Rectangle a, Rectangle b)
+{
+    int left = a.x < b.x ? a.x : b.x;
+    int top = a.y < b.y ? a.y : b.y;
+    int right = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+    int bottom = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+    Rectangle rect = { left, top, right - left, bottom - top };
+    return rect;
+}
+
+static bool isOverlapping(Rectangle a, Rectangle b)
+{
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+//Makes an element's part of the layer transparent again
+static void clearBounds(HudLayer* hud, HudElement element)
+{
+    Rectangle bounds = hud->bounds[element];
+    PixelBuffer* layer = &hud->layer.pixelBuffer;
+    for (int y = bounds.y; y < bounds.y + bounds.h; y++)
+    {
+        memset(layer->pixels + y * layer->pitch + bounds.x, 0, bounds.w * sizeof(uint32_t));
+    }
+}
+
+static int getCompassStep(float angle)
+{
+    int step = (int)lroundf(angle / (2 * M_PI) * HUD_COMPASS_STEPS) % HUD_COMPASS_STEPS;
+    return step < 0 ? step + HUD_COMPASS_STEPS : step;
+}
+
+static Rectangle toLayer(const HudLayer* hud, Rectangle rect)
+{
+    rect.x -= hud->extent.x;
+    rect.y -= hud->extent.y;
+    return rect;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The HUD, the size of the screen it goes on, the images it draws and
+ *        the font for the ruby count.
+ * Description: Works out where each element goes and makes a layer just big
+ *              enough for all of them. Nothing is drawn until drawHud().
+ *----------------------------------------------------------------------------*/
+void initHudLayer(HudLayer* hud, int screenWidth, int screenHeight, const ImageManager* images, SpriteFont spriteFont)
+{
+    memset(hud, 0, sizeof(HudLayer));
+    hud->spriteFont = spriteFont;
+
+    //Where they go on the screen first
+    Rectangle rubyIcon = { screenWidth/8 - 1.5 * images->rubySprite->w, screenHeight/16 - 2, ICON_SIZE, ICON_SIZE };
+    Rectangle rubyText = { screenWidth/8, screenHeight/16, HUD_RUBY_TEXT_LENGTH * spriteFont.charW, spriteFont.charH };
+    Rectangle keys = { screenWidth/3, screenHeight/16, (MAX_KEYS - 1) * KEY_SPACING + ICON_SIZE, ICON_SIZE };
+    Rectangle compass = { (screenWidth*7)/8 - COMPASS_SIZE/2, screenHeight/8 - 8 - COMPASS_SIZE/2, COMPASS_SIZE, COMPASS_SIZE };
+    hud->extent = unionRect(unionRect(rubyIcon, rubyText), unionRect(keys, compass));
+
+    //Then where they go in the layer
+    hud->rubyIcon = toLayer(hud, rubyIcon);
+    hud->rubyText = toLayer(hud, rubyText);
+    hud->keys = toLayer(hud, keys);
+    hud->compass = toLayer(hud, compass);
+    hud->bounds[HUD_RUBIES] = unionRect(hud->rubyIcon, hud->rubyText);
+    hud->bounds[HUD_KEYS] = hud->keys;
+    hud->bounds[HUD_COMPASS] = hud->compass;
+    hud->rubiesOverKeys = isOverlapping(hud->bounds[HUD_RUBIES], hud->bounds[HUD_KEYS]);
+
+    //MALLOC freed by freeHudLayer()
+    initGfxContext(&hud->layer, hud->extent.w, hud->extent.h, images);
+    memset(hud->layer.ownPixels, 0, hud->extent.w * hud->extent.h * sizeof(uint32_t));
+}
+
+void freeHudLayer(HudLayer* hud)
+{
+    freeGfxContext(&hud->layer);
+    memset(hud, 0, sizeof(HudLayer));
+}
+
+static bool isRubiesOutOfDate(const HudLayer* hud, int rubiesCollected, int levelRubies)
+{
+    return !hud->drawn[HUD_RUBIES] || rubiesCollected != hud->rubiesCollected || levelRubies != hud->levelRubies;
+}
+
+static bool isKeysOutOfDate(const HudLayer* hud, const bool keysCollected[MAX_KEYS])
+{
+    return !hud->drawn[HUD_KEYS] || memcmp(keysCollected, hud->keysCollected, sizeof(hud->keysCollected)) != 0;
+}
+
+static bool isCompassOutOfDate(const HudLayer* hud, int compassStep)
+{
+    return !hud->drawn[HUD_COMPASS] || compassStep != hud->compassStep;
+}
+
+//Whether drawHud() would show anything different to last time
+bool isHudOutOfDate(const HudLayer* hud, int rubiesCollected, int levelRubies,
+                    const bool keysCollected[MAX_KEYS], float compassAngle)
+{
+    return isRubiesOutOfDate(hud, rubiesCollected, levelRubies) || isKeysOutOfDate(hud, keysCollected) ||
+           isCompassOutOfDate(hud, getCompassStep(compassAngle));
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      HudLayer* hud: The HUD
+ *      GfxContext* gfx: The context to draw it over
+ *      int rubiesCollected, levelRubies: The ruby count to show
+ *      bool keysCollected[]: Which keys to show
+ *      float compassAngle: The angle to turn the compass by
+ *      int firstRow, endRow: The screen rows to blend the layer over
+ * Description:
+ *      Redraws any element showing something different to last time into
+ *      the layer, then blends the layer over the context's pixel buffer, on
+ *      rows firstRow up to endRow only. The compass angle is rounded to one
+ *      of HUD_COMPASS_STEPS, so turning slowly doesn't redraw it every frame.
+ *      The ruby count and keys are redrawn together if their parts of the
+ *      layer overlap, as clearing either would wipe some of the other.
+ *----------------------------------------------------------------------------*/
+void drawHud(HudLayer* hud, GfxContext* gfx, int rubiesCollected, int levelRubies,
+             const bool keysCollected[MAX_KEYS], float compassAngle, int firstRow, int endRow)
+{
+    const ImageManager* images = hud->layer.images;
+
+    bool redrawRubies = isRubiesOutOfDate(hud, rubiesCollected, levelRubies);
+    bool redrawKeys = isKeysOutOfDate(hud, keysCollected);
+    if (hud->rubiesOverKeys && (redrawRubies || redrawKeys))
+    {
+        redrawRubies = true;
+        redrawKeys = true;
+    }
+    //Both cleared before either is drawn
+    if (redrawRubies) clearBounds(hud, HUD_RUBIES);
+    if (redrawKeys) clearBounds(hud, HUD_KEYS);
+
+    if (redrawRubies)
+    {
+        blitToPixelBuffer(&hud->layer, images->rubySprite, NULL, hud->rubyIcon, HUD_BLACK);
+        char rubyCountStr[HUD_RUBY_TEXT_LENGTH + 1];
+        snprintf(rubyCountStr, sizeof(rubyCountStr), "%d/%d", rubiesCollected, levelRubies);
+        SDL_Rect textRect = { hud->rubyText.x, hud->rubyText.y, 0, 0 };
+        drawText(&hud->layer, rubyCountStr, textRect, HUD_TEXT_COLOR, hud->spriteFont, false);
+        hud->rubiesCollected = rubiesCollected;
+        hud->levelRubies = levelRubies;
+        hud->drawn[HUD_RUBIES] = true;
+    }
+
+    if (redrawKeys)
+    {
+        for (int i = 0; i < MAX_KEYS; i++)
+        {
+            if (keysCollected[i] == true)
+            {
+                Rectangle keyImageRect = { hud->keys.x + i * KEY_SPACING, hud->keys.y, ICON_SIZE, ICON_SIZE };
+                blitToPixelBuffer(&hud->layer, images->keySprite, NULL, keyImageRect, keyColors[i]);
+            }
+        }
+        memcpy(hud->keysCollected, keysCollected, sizeof(hud->keysCollected));
+        hud->drawn[HUD_KEYS] = true;
+    }
+
+    int compassStep = getCompassStep(compassAngle);
+    if (isCompassOutOfDate(hud, compassStep))
+    {
+        clearBounds(hud, HUD_COMPASS);
+        //Centred on x and y
+        Rectangle compassRect = { hud->compass.x + COMPASS_SIZE/2, hud->compass.y + COMPASS_SIZE/2, COMPASS_SIZE, COMPASS_SIZE };
+        rotatedBlitToPixelBuffer(&hud->layer, images->compass, compassRect, HUD_BLACK,
+                                 compassStep * (2 * M_PI / HUD_COMPASS_STEPS));
+        hud->compassStep = compassStep;
+        hud->drawn[HUD_COMPASS] = true;
+    }
+
+    //Only the elements' parts of the layer, the gaps between are empty
+    const PixelBuffer* layer = &hud->layer.pixelBuffer;
+    for (int i = 0; i < HUD_ELEMENT_COUNT; i++)
+    {
+        Rectangle bounds = hud->bounds[i];
+        int screenY = hud->extent.y + bounds.y;
+        int top = screenY > firstRow ? screenY : firstRow;
+        int bottom = screenY + bounds.h < endRow ? screenY + bounds.h : endRow;
+        if (top >= bottom) continue;
+        PixelBuffer element = { layer->pixels + (bounds.y + top - screenY) * layer->pitch + bounds.x, bounds.w,
+                                bottom - top, layer->pitch };
+        blendPixelBuffer(&gfx->pixelBuffer, &element, hud->extent.x + bounds.x, top);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include "engine_types.h"
+#include "gfx_engine.h"
+
+
+//Angles the compass is drawn at, any finer isn't seen at its size
+#define HUD_COMPASS_STEPS 128
+//Longest ruby count shown, two ints of up to 10 digits and the '/'
+#define HUD_RUBY_TEXT_LENGTH 21
+
+//The parts of the HUD, each redrawn on its own
+typedef enum
+{
+    HUD_RUBIES,                 //Ruby icon and how many are collected
+    HUD_KEYS,
+    HUD_COMPASS,
+    HUD_ELEMENT_COUNT
+} HudElement;
+
+/*------------------------------------------------------------------------------
+ * The HUD, drawn into a layer of its own that is only redrawn where what it
+ * shows has changed, then blended over every frame in one pass.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    GfxContext layer;           //Covers extent, no alpha where nothing is drawn
+    Rectangle extent;           //Part of the screen the HUD covers
+    Rectangle bounds[HUD_ELEMENT_COUNT];    //Each element's part of the layer
+    bool drawn[HUD_ELEMENT_COUNT];          //Whether it is up to date below
+    SpriteFont spriteFont;
+
+    //Where things are drawn in the layer
+    Rectangle rubyIcon;
+    Rectangle rubyText;
+    Rectangle keys;
+    Rectangle compass;
+    bool rubiesOverKeys;        //Room for a long ruby count runs into the keys
+
+    //What each element was last drawn showing
+    int rubiesCollected;
+    int levelRubies;
+    bool keysCollected[MAX_KEYS];
+    int compassStep;
+} HudLayer;
+
+
+void initHudLayer   (HudLayer* hud, int screenWidth, int screenHeight, const ImageManager* images, SpriteFont spriteFont);
+void freeHudLayer   (HudLayer* hud);
+void drawHud        (HudLayer* hud, GfxContext* gfx, int rubiesCollected, int levelRubies,
+                     const bool keysCollected[MAX_KEYS], float compassAngle, int firstRow, int endRow);
+bool isHudOutOfDate (const HudLayer* hud, int rubiesCollected, int levelRubies,
+                     const bool keysCollected[MAX_KEYS], float compassAngle);
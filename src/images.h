@@ -34,8 +34,5 @@ typedef struct
     SDL_Surface* compass;
 } ImageManager;
 
-//??
-extern ImageManager images;
 
-
-void loadImages(void);
+void loadImages(ImageManager* images);
@@ -0,0 +1,131 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdlib.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "job_pool.h"
+
+
+#define MAX_JOB_WORKERS 15
+
+/*------------------------------------------------------------------------------
+ * Every worker takes part in every runParallelFor call: the caller posts
+ * workStart once per worker and then waits on workDone once per worker, so
+ * no worker can still be busy with an old job when a new one is set up.
+ * Batches are handed out with an atomic counter. The pool is shared by every
+ * game in the process, one runParallelFor at a time; busy is taken with a
+ * compare and swap, and a caller that finds it taken runs its job itself.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    int workerCount;
+    SDL_Thread* workers[MAX_JOB_WORKERS];
+    SDL_sem* workStart;
+    SDL_sem* workDone;
+
+    JobFunction function;
+    void* data;
+    int count;
+    int batchSize;
+    SDL_atomic_t nextIndex;
+    SDL_atomic_t busy;
+} JobPool;
+
+static JobPool pool = {0};
+
+
+static void runBatches(void)
+{
+    for (;;)
+    {
+        int begin = SDL_AtomicAdd(&pool.nextIndex, pool.batchSize);
+        if (begin >= pool.count) return;
+        int end = begin + pool.batchSize < pool.count ? begin + pool.batchSize : pool.count;
+        pool.function(pool.data, begin, end);
+    }
+}
+
+static int jobWorker(void* unused)
+{
+    for (;;)
+    {
+        SDL_SemWait(pool.workStart);
+        runBatches();
+        SDL_SemPost(pool.workDone);
+    }
+    return 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: How many threads to start on top of the calling thread. Zero runs
+ *        every job on the calling thread.
+ *----------------------------------------------------------------------------*/
+void initJobPool(int workerCount)
+{
+    if (pool.workStart != NULL) return;
+    if (workerCount > MAX_JOB_WORKERS) workerCount = MAX_JOB_WORKERS;
+    if (workerCount < 0) workerCount = 0;
+
+    //MALLOC no need to free, workers live until program end.
+    pool.workStart = SDL_CreateSemaphore(0);
+    pool.workDone = SDL_CreateSemaphore(0);
+    for (int i = 0; i < workerCount; i++)
+    {
+        pool.workers[i] = SDL_CreateThread(jobWorker, "jobWorker", NULL);
+        if (pool.workers[i] == NULL)
+        {
+            SDL_Log("Could not start job worker: %s", SDL_GetError());
+            break;
+        }
+        pool.workerCount++;
+    }
+}
+
+int getJobPoolSize(void)
+{
+    return pool.workerCount + 1;
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      JobFunction function: Called on batches of the items.
+ *      void* data: Passed through to function.
+ *      int count: How many items there are.
+ *      int batchSize: The most items function is called with at once.
+ * Description:
+ *      Runs function over every item on the pool's workers and the calling
+ *      thread, returning once all of them are done. Which thread gets which
+ *      batch varies from run to run, so function must only write state that
+ *      belongs to the items it was given. Safe to call from several threads,
+ *      or from inside a job; only one call at a time gets the workers.
+ *----------------------------------------------------------------------------*/
+void runParallelFor(JobFunction function, void* data, int count, int batchSize)
+{
+    if (count <= 0) return;
+    if (batchSize < 1) batchSize = 1;
+    if (pool.workerCount == 0 || count <= batchSize || !SDL_AtomicCAS(&pool.busy, 0, 1))
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    pool.function = function;
+    pool.data = data;
+    pool.count = count;
+    pool.batchSize = batchSize;
+    SDL_AtomicSet(&pool.nextIndex, 0);
+
+    for (int i = 0; i < pool.workerCount; i++) SDL_SemPost(pool.workStart);
+    runBatches();
+    for (int i = 0; i < pool.workerCount; i++) SDL_SemWait(pool.workDone);
+    SDL_AtomicSet(&pool.busy, 0);
+}
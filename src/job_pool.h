@@ -0,0 +1,16 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+
+//Called with a range [begin, end) of the items passed to runParallelFor
+typedef void (*JobFunction)(void* data, int begin, int end);
+
+
+void initJobPool    (int workerCount);
+int  getJobPoolSize (void);
+void runParallelFor (JobFunction function, void* data, int count, int batchSize);
@@ -0,0 +1,504 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+
+/*------------------------------------------------------------------------------
+ * Level generator, built with "make levelgen". Writes a .lvl/.mon pair of any
+ * size for stress testing the renderer, the monsters' pathfinding and the
+ * entity pools on maps far bigger than the hand made ones.
+ *
+ * The map is a maze with rectangular rooms carved into it, so every floor
+ * tile joins up. Locked doors go on the maze's route from the start to the
+ * exit, and rooms are only carved where they can't open a way round one.
+ * Each door's key goes somewhere the player can reach with only the earlier
+ * doors opened, so every level can be finished and needs every key. The
+ * same seed and options always give the same level.
+ *
+ * The files are named <out>.lvl and <out>.mon. The default out path makes
+ * them level 100, for the headless runner's or the game's --level=100.
+ *----------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "../load_level.h"
+
+
+#define MAX_LEVEL_DIMS      16384
+//Monsters don't start within this many steps of the player
+#define MONSTER_START_CLEARANCE 12
+//How far a monster wanders from one patrol point to the next
+#define PATROL_WALK_STEPS   16
+#define MAX_PATROL_POINTS   4
+//Rooms that would join two parts of the maze a door keeps apart are tried
+//somewhere else, up to this many times in a row
+#define MAX_ROOM_TRIES      1000
+//How far a key wanders off the route to the exit
+#define KEY_WANDER_STEPS    256
+#define MAX_KEY_WANDER_STEPS (1 << 20)
+
+typedef struct
+{
+    int width;
+    int height;
+    uint32_t seed;
+    int keyCount;           //Locked doors, one key each
+    float roomFraction;     //Share of the map given to open rooms rather than corridors
+    float rubyDensity;      //Chance a floor tile holds a ruby
+    float monsterDensity;   //Chance a floor tile starts a monster's patrol
+    const char* outPath;
+} LevelOptions;
+
+typedef struct
+{
+    LevelOptions options;
+    char* tiles;
+    uint8_t* cameFrom;      //Per maze cell, the step the maze was carved into it by
+    uint8_t* regions;       //Per tile, how many doors are between it and the start
+    uint32_t rngState;
+    int start;
+    int exit;
+    int* route;             //Tiles from the start to the exit through the maze
+    int routeLength;
+    int doorRoutePos[MAX_KEYS];
+    int doorCount;
+} LevelGen;
+
+static const int stepX[4] = { 1, -1, 0, 0 };
+static const int stepY[4] = { 0, 0, 1, -1 };
+
+//Regions besides the ones between doors
+#define REGION_WALL 0xFF
+#define REGION_DOOR 0xFE
+
+
+//xorshift32, fast and the same on every platform
+static uint32_t nextRandom(LevelGen* gen)
+{
+    uint32_t x = gen->rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    gen->rngState = x;
+    return x;
+}
+
+static int randomRange(LevelGen* gen, int count)
+{
+    return (int)(nextRandom(gen) % (uint32_t)count);
+}
+
+static bool randomChance(LevelGen* gen, float chance)
+{
+    return (nextRandom(gen) >> 8) < (uint32_t)(chance * (1 << 24));
+}
+
+static bool isDoor(char tile)
+{
+    return tile == TILE_DOOR0 || tile == TILE_DOOR1 || tile == TILE_DOOR2 || tile == TILE_DOOR3;
+}
+
+static bool isFloor(char tile)
+{
+    return tile != TILE_WALL && !isDoor(tile);
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Carves a maze through cells on the odd tiles with a depth
+ *              first search from the start, so there's exactly one way
+ *              between any two cells and the corridors between them are a
+ *              tile wide. The cell the search got deepest at is the exit, as
+ *              far from the start as the maze allows.
+ *----------------------------------------------------------------------------*/
+static void carveMaze(LevelGen* gen)
+{
+    int width = gen->options.width;
+    int cellsX = (width - 1) / 2;
+    int cellsY = (gen->options.height - 1) / 2;
+    //The search's stack shares the route buffer, it's not needed yet
+    int* stack = gen->route;
+    int stackSize = 0;
+
+    gen->start = (1 + 2 * randomRange(gen, cellsY)) * width + 1 + 2 * randomRange(gen, cellsX);
+    gen->exit = gen->start;
+    gen->routeLength = 0;
+    gen->tiles[gen->start] = TILE_FLOOR;
+    stack[stackSize++] = gen->start;
+    while (stackSize > 0)
+    {
+        int cell = stack[stackSize - 1];
+        int x = cell % width;
+        int y = cell / width;
+        int options[4];
+        int optionCount = 0;
+        for (int n = 0; n < 4; n++)
+        {
+            int nextX = x + stepX[n] * 2;
+            int nextY = y + stepY[n] * 2;
+            if (nextX < 1 || nextY < 1 || nextX > cellsX * 2 - 1 || nextY > cellsY * 2 - 1) continue;
+            if (gen->tiles[nextY * width + nextX] == TILE_WALL) options[optionCount++] = n;
+        }
+        if (optionCount == 0)
+        {
+            stackSize--;
+            continue;
+        }
+        int n = options[randomRange(gen, optionCount)];
+        gen->tiles[(y + stepY[n]) * width + x + stepX[n]] = TILE_FLOOR;
+        int next = (y + stepY[n] * 2) * width + x + stepX[n] * 2;
+        gen->tiles[next] = TILE_FLOOR;
+        gen->cameFrom[next] = (uint8_t)n;
+        stack[stackSize++] = next;
+        //Two tiles a cell, the one between them and the cell itself
+        if ((stackSize - 1) * 2 > gen->routeLength)
+        {
+            gen->routeLength = (stackSize - 1) * 2;
+            gen->exit = next;
+        }
+    }
+}
+
+//Fills route with the maze's way from the start to the exit. Rooms may give
+//shorter ways round, which only makes it easier.
+static void traceRoute(LevelGen* gen)
+{
+    int width = gen->options.width;
+    int index = gen->exit;
+    for (int i = gen->routeLength; i > 0; i -= 2)
+    {
+        int n = gen->cameFrom[index];
+        gen->route[i] = index;
+        gen->route[i - 1] = index - stepY[n] * width - stepX[n];
+        index -= (stepY[n] * width + stepX[n]) * 2;
+    }
+    gen->route[0] = gen->start;
+}
+
+//A door only looks right with wall either side of it
+static bool isCorridor(const LevelGen* gen, int index)
+{
+    int width = gen->options.width;
+    const char* tiles = gen->tiles;
+    bool wallsLeftRight = tiles[index - 1] == TILE_WALL && tiles[index + 1] == TILE_WALL;
+    bool wallsUpDown = tiles[index - width] == TILE_WALL && tiles[index + width] == TILE_WALL;
+    return tiles[index] == TILE_FLOOR && wallsLeftRight != wallsUpDown;
+}
+
+//Spaces the doors out along the route, in key order. A route too short for
+//every door just gets fewer.
+static void placeDoors(LevelGen* gen)
+{
+    static const char doorTiles[MAX_KEYS] = { TILE_DOOR0, TILE_DOOR1, TILE_DOOR2, TILE_DOOR3 };
+    //Each door needs a tile before it for its key
+    int routePos = 2;
+    gen->doorCount = 0;
+    for (int door = 0; door < gen->options.keyCount; door++)
+    {
+        int wantedPos = gen->routeLength * (door + 1) / (gen->options.keyCount + 1);
+        if (routePos < wantedPos) routePos = wantedPos;
+        while (routePos < gen->routeLength && !isCorridor(gen, gen->route[routePos])) routePos++;
+        if (routePos >= gen->routeLength) return;
+        gen->doorRoutePos[door] = routePos;
+        gen->tiles[gen->route[routePos]] = doorTiles[door];
+        gen->doorCount++;
+        routePos += 2;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Labels every floor tile with how many doors are between it
+ *              and the start. The maze has exactly one way between any two
+ *              tiles, so the doors split it into parts joined only by them.
+ *----------------------------------------------------------------------------*/
+static void findRegions(LevelGen* gen)
+{
+    int width = gen->options.width;
+    int tileCount = width * gen->options.height;
+    //MALLOC freed at the end of findRegions()
+    int* stack = (int*)malloc(tileCount * sizeof(int));
+    int stackSize = 0;
+    memset(gen->regions, REGION_WALL, tileCount);
+    gen->regions[gen->start] = 0;
+    stack[stackSize++] = gen->start;
+    while (stackSize > 0)
+    {
+        int index = stack[--stackSize];
+        for (int n = 0; n < 4; n++)
+        {
+            int step = stepY[n] * width + stepX[n];
+            int next = index + step;
+            if (gen->tiles[next] == TILE_WALL || gen->regions[next] != REGION_WALL) continue;
+            int region = gen->regions[index];
+            if (isDoor(gen->tiles[next]))
+            {
+                //A door has wall either side, so the way on is straight through it
+                gen->regions[next] = REGION_DOOR;
+                next += step;
+                region++;
+            }
+            gen->regions[next] = (uint8_t)region;
+            stack[stackSize++] = next;
+        }
+    }
+    free(stack);
+}
+
+//Output: The one region a room touches, REGION_WALL if it would touch a door
+//or more than one region
+static int getRoomRegion(const LevelGen* gen, int left, int top, int roomWidth, int roomHeight)
+{
+    int width = gen->options.width;
+    int region = REGION_WALL;
+    //The tiles round it too, which it would join up with
+    for (int y = top - 1; y <= top + roomHeight; y++)
+    {
+        for (int x = left - 1; x <= left + roomWidth; x++)
+        {
+            int tileRegion = gen->regions[y * width + x];
+            if (tileRegion == REGION_WALL) continue;
+            if (tileRegion == REGION_DOOR || (region != REGION_WALL && tileRegion != region)) return REGION_WALL;
+            region = tileRegion;
+        }
+    }
+    return region;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Rooms only turn walls into floor, so everything stays joined
+ *              up, and each stays within one region, so the doors still
+ *              can't be walked round. Gives up early if rooms keep landing
+ *              across doors, as they can on a small map.
+ *----------------------------------------------------------------------------*/
+static void carveRooms(LevelGen* gen)
+{
+    int width = gen->options.width;
+    int height = gen->options.height;
+    long long areaLeft = (long long)(gen->options.roomFraction * (width - 2) * (height - 2));
+    int tries = 0;
+    while (areaLeft > 0 && tries < MAX_ROOM_TRIES)
+    {
+        int roomWidth = 3 + randomRange(gen, 10);
+        int roomHeight = 3 + randomRange(gen, 10);
+        if (roomWidth > width - 2) roomWidth = width - 2;
+        if (roomHeight > height - 2) roomHeight = height - 2;
+        int left = 1 + randomRange(gen, width - 1 - roomWidth);
+        int top = 1 + randomRange(gen, height - 1 - roomHeight);
+        int region = getRoomRegion(gen, left, top, roomWidth, roomHeight);
+        if (region == REGION_WALL)
+        {
+            tries++;
+            continue;
+        }
+        tries = 0;
+        for (int y = top; y < top + roomHeight; y++)
+        {
+            memset(gen->tiles + y * width + left, TILE_FLOOR, roomWidth);
+            memset(gen->regions + y * width + left, region, roomWidth);
+        }
+        areaLeft -= roomWidth * roomHeight;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Key k goes somewhere off the route between doors k-1 and k.
+ *              Every tile there can be reached with only the earlier doors
+ *              open, and so can any tile wandered to from one without going
+ *              through a door, so the level can always be finished.
+ *----------------------------------------------------------------------------*/
+static void placeKeys(LevelGen* gen)
+{
+    static const char keyTiles[MAX_KEYS] = { TILE_KEY0, TILE_KEY1, TILE_KEY2, TILE_KEY3 };
+    int width = gen->options.width;
+    for (int key = 0; key < gen->doorCount; key++)
+    {
+        int firstPos = key == 0 ? 0 : gen->doorRoutePos[key - 1] + 1;
+        int index = gen->route[firstPos + randomRange(gen, gen->doorRoutePos[key] - firstPos)];
+        //Wander off, then on until somewhere free
+        int step = 0;
+        for (; step < MAX_KEY_WANDER_STEPS; step++)
+        {
+            bool free = gen->tiles[index] == TILE_FLOOR && index != gen->start;
+            if (free && step >= KEY_WANDER_STEPS) break;
+            int n = randomRange(gen, 4);
+            int next = index + stepY[n] * width + stepX[n];
+            if (isFloor(gen->tiles[next])) index = next;
+        }
+        if (step == MAX_KEY_WANDER_STEPS)
+        {
+            //Shut in with nowhere free, so this door and the ones after it go
+            for (int door = key; door < gen->doorCount; door++)
+            {
+                gen->tiles[gen->route[gen->doorRoutePos[door]]] = TILE_FLOOR;
+            }
+            gen->doorCount = key;
+            return;
+        }
+        gen->tiles[index] = keyTiles[key];
+    }
+}
+
+static void placeRubies(LevelGen* gen)
+{
+    int tileCount = gen->options.width * gen->options.height;
+    for (int i = 0; i < tileCount; i++)
+    {
+        if (gen->tiles[i] == TILE_FLOOR && randomChance(gen, gen->options.rubyDensity))
+        {
+            gen->tiles[i] = TILE_RUBY;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Writes a patrol for each monster, wandering from its start
+ *              without passing through doors, so it can always walk its
+ *              patrol whatever the player has unlocked. One line per monster
+ *              as loadLevelMonsters() reads them.
+ *----------------------------------------------------------------------------*/
+static int writeMonsters(LevelGen* gen, FILE* file)
+{
+    int width = gen->options.width;
+    int tileCount = width * gen->options.height;
+    int monsterCount = 0;
+    for (int i = 0; i < tileCount; i++)
+    {
+        if (!isFloor(gen->tiles[i]) || !randomChance(gen, gen->options.monsterDensity)) continue;
+        int startDist = abs(i % width - gen->start % width) + abs(i / width - gen->start / width);
+        if (startDist < MONSTER_START_CLEARANCE) continue;
+
+        int patrolLength = 2 + randomRange(gen, MAX_PATROL_POINTS - 1);
+        int index = i;
+        for (int p = 0; p < patrolLength; p++)
+        {
+            fprintf(file, p == 0 ? "%d %d" : " %d %d", index % width, index / width);
+            for (int step = 0; step < PATROL_WALK_STEPS; step++)
+            {
+                int n = randomRange(gen, 4);
+                int next = index + stepY[n] * width + stepX[n];
+                if (isFloor(gen->tiles[next])) index = next;
+            }
+        }
+        fputc('\n', file);
+        monsterCount++;
+    }
+    return monsterCount;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The options to generate with.
+ * Output: False if a file couldn't be written.
+ *----------------------------------------------------------------------------*/
+static bool generateLevel(const LevelOptions* options)
+{
+    LevelGen gen = { .options=*options, .rngState=options->seed ? options->seed : 1 };
+    int width = options->width;
+    int height = options->height;
+    int tileCount = width * height;
+    //MALLOC freed at the end of generateLevel()
+    gen.tiles = (char*)malloc(tileCount);
+    gen.cameFrom = (uint8_t*)malloc(tileCount);
+    gen.route = (int*)malloc(tileCount * sizeof(int));
+    gen.regions = (uint8_t*)malloc(tileCount);
+    memset(gen.tiles, TILE_WALL, tileCount);
+
+    carveMaze(&gen);
+    traceRoute(&gen);
+    placeDoors(&gen);
+    findRegions(&gen);
+    carveRooms(&gen);
+    placeKeys(&gen);
+    gen.tiles[gen.start] = TILE_PLAYER_START;
+    gen.tiles[gen.exit] = TILE_LEVEL_END;
+    placeRubies(&gen);
+
+    char path[FILENAME_MAX];
+    snprintf(path, sizeof(path), "%s.lvl", options->outPath);
+    FILE* file = fopen(path, "wb");
+    bool ok = file != NULL;
+    if (ok)
+    {
+        //Every line ends in a newline, as loadLevelTiles() expects
+        for (int y = 0; y < height; y++)
+        {
+            fwrite(gen.tiles + y * width, 1, width, file);
+            fputc('\n', file);
+        }
+        ok = fclose(file) == 0;
+    }
+    int monsterCount = 0;
+    snprintf(path, sizeof(path), "%s.mon", options->outPath);
+    file = ok ? fopen(path, "wb") : NULL;
+    ok = file != NULL;
+    if (ok)
+    {
+        monsterCount = writeMonsters(&gen, file);
+        ok = fclose(file) == 0;
+    }
+    if (!ok) printf("Could not write %s.\n", path);
+
+    int floorCount = 0;
+    int rubyCount = 0;
+    for (int i = 0; i < tileCount; i++)
+    {
+        floorCount += isFloor(gen.tiles[i]);
+        rubyCount += gen.tiles[i] == TILE_RUBY;
+    }
+    printf("%dx%d, %d floor tiles, %d rubies, %d doors, %d monsters, %d steps through the maze to the exit\n",
+           width, height, floorCount, rubyCount, gen.doorCount, monsterCount, gen.routeLength);
+
+    free(gen.tiles);
+    free(gen.cameFrom);
+    free(gen.route);
+    free(gen.regions);
+    return ok;
+}
+
+int main(int argc, char* args[])
+{
+    LevelOptions options = { .width=64, .height=64, .seed=(uint32_t)time(NULL), .keyCount=2,
+        .roomFraction=0.3f, .rubyDensity=0.02f, .monsterDensity=0.002f, .outPath="res/levels/level100" };
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(args[i], "--width=", 8) == 0) options.width = atoi(args[i] + 8);
+        else if (strncmp(args[i], "--height=", 9) == 0) options.height = atoi(args[i] + 9);
+        else if (strncmp(args[i], "--seed=", 7) == 0) options.seed = (uint32_t)strtoul(args[i] + 7, NULL, 10);
+        else if (strncmp(args[i], "--keys=", 7) == 0) options.keyCount = atoi(args[i] + 7);
+        else if (strncmp(args[i], "--rooms=", 8) == 0) options.roomFraction = (float)atof(args[i] + 8);
+        else if (strncmp(args[i], "--rubies=", 9) == 0) options.rubyDensity = (float)atof(args[i] + 9);
+        else if (strncmp(args[i], "--monsters=", 11) == 0) options.monsterDensity = (float)atof(args[i] + 11);
+        else if (strncmp(args[i], "--out=", 6) == 0) options.outPath = args[i] + 6;
+        else
+        {
+            printf("Usage: %s [--width=N] [--height=N] [--seed=N] [--keys=0-4] [--rooms=0-1]\n"
+                   "       [--rubies=0-1] [--monsters=0-1] [--out=PATH]\n", args[0]);
+            return 1;
+        }
+    }
+    if (options.width < 5 || options.height < 5 || options.width > MAX_LEVEL_DIMS || options.height > MAX_LEVEL_DIMS)
+    {
+        printf("Levels must be between 5 and %d tiles across.\n", MAX_LEVEL_DIMS);
+        return 1;
+    }
+    if (options.keyCount < 0 || options.keyCount > MAX_KEYS)
+    {
+        printf("--keys must be between 0 and %d.\n", MAX_KEYS);
+        return 1;
+    }
+    if (strlen(options.outPath) + 5 > FILENAME_MAX)
+    {
+        printf("--out is too long.\n");
+        return 1;
+    }
+
+    clock_t startClock = clock();
+    bool ok = generateLevel(&options);
+    printf("Generated in %.3f s.\n", (double)(clock() - startClock) / CLOCKS_PER_SEC);
+    return ok ? 0 : 1;
+}
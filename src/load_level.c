@@ -18,38 +18,36 @@
 #include "load_level.h"
 #include "images.h"
 #include "monster.h"
+#include "visibility.h"
 
 
-static Level level = {0};
-
-
-bool isTileIndexValid(int i)
+bool isTileIndexValid(const Level* level, int i)
 {
-    return i >= 0 && i < level.width * level.height;
+    return i >= 0 && i < level->width * level->height;
 }
 
 //TODO get rid of some of these by chaining together some of them.
-int posToTileIndex(int x, int y)
+int posToTileIndex(const Level* level, int x, int y)
 {
-    int index = (int)((y / TILE_DIMS) * level.width + (x / TILE_DIMS));
+    int index = (int)((y / TILE_DIMS) * level->width + (x / TILE_DIMS));
     return index;
 }
 
-int coordToTileIndex(int x, int y)
+int coordToTileIndex(const Level* level, int x, int y)
 {
-    int index = (int)(y * level.width + x);
+    int index = (int)(y * level->width + x);
     return index;
 }
 
 
-int posVecToTileIndex(Vector2 pos)
+int posVecToTileIndex(const Level* level, Vector2 pos)
 {
-    return (int)(pos.y / TILE_DIMS) * level.width + (int)(pos.x / TILE_DIMS);
+    return (int)(pos.y / TILE_DIMS) * level->width + (int)(pos.x / TILE_DIMS);
 }
 
-int posVecToIndex(Vector2 pos)
+int posVecToIndex(const Level* level, Vector2 pos)
 {
-    return (int)(pos.y * level.width + pos.x);
+    return (int)(pos.y * level->width + pos.x);
 }
 
 Vector2 posToTileCoord(Vector2 pos)
@@ -58,13 +56,13 @@ Vector2 posToTileCoord(Vector2 pos)
     return coordVec;
 }
 
-Vector2 getPlayerStartPos(void)
+Vector2 getPlayerStartPos(const Level* level)
 {
-    for (int y = 0; y < level.height; y++)
+    for (int y = 0; y < level->height; y++)
     {
-        for (int x = 0; x < level.width; x++)
+        for (int x = 0; x < level->width; x++)
         {
-            if (level.data[y * level.width + x] == TILE_PLAYER_START)
+            if (level->data[y * level->width + x] == TILE_PLAYER_START)
             {
                 Vector2 playerPos = { x * TILE_DIMS + TILE_DIMS/2, y * TILE_DIMS + TILE_DIMS/2 };
                 return playerPos;
@@ -76,145 +74,99 @@ Vector2 getPlayerStartPos(void)
 }
 
 //Should be a more elegant way to do this. Time to overhall tile representation?
-bool isTileSolid(int index)
+bool isTileSolid(const Level* level, int index)
 {
-    return level.data[index] == TILE_WALL ||
-           level.data[index] == TILE_SECRET_DOOR ||
-           level.data[index] == TILE_DOOR0 ||
-           level.data[index] == TILE_DOOR1 ||
-           level.data[index] == TILE_DOOR2 ||
-           level.data[index] == TILE_DOOR3 ||
-           level.data[index] == TILE_INSTRUCTIONS1 ||
-           level.data[index] == TILE_INSTRUCTIONS2 ||
-           level.data[index] == TILE_INSTRUCTIONS3 ||
-           level.data[index] == TILE_INSTRUCTIONS4;
+    return level->data[index] == TILE_WALL ||
+           level->data[index] == TILE_SECRET_DOOR ||
+           level->data[index] == TILE_DOOR0 ||
+           level->data[index] == TILE_DOOR1 ||
+           level->data[index] == TILE_DOOR2 ||
+           level->data[index] == TILE_DOOR3 ||
+           level->data[index] == TILE_INSTRUCTIONS1 ||
+           level->data[index] == TILE_INSTRUCTIONS2 ||
+           level->data[index] == TILE_INSTRUCTIONS3 ||
+           level->data[index] == TILE_INSTRUCTIONS4;
 }
 
-void setTileTo(int index, char tile)
+void setTileTo(Level* level, int index, char tile)
 {
-    level.data[index] = tile;
+    level->data[index] = tile;
+    level->tileVersion++;
+    updateVisibilityAroundTile(level, index);
 }
 
-int getTotalLevelRubies(void)
+int getLevelWidth(const Level* level)
 {
-    return level.rubyCount;
+    return level->width;
 }
 
-char getLevelTile(int index)
+int getLevelHeight(const Level* level)
 {
-    return level.data[index];
+    return level->height;
 }
 
-EntityArray getLevelRubies(EntityTemplate* rubyTemplate)
+int getTotalLevelRubies(const Level* level)
 {
-    //Create EntityArray of correct size
-    EntityArray rubyArray = {0};
-    {
-        int rubyCount = 0;
-        for (int i = 0; i < level.width * level.height; i++)
-            if (level.data[i] == TILE_RUBY)
-                rubyCount++;
-
-        //Set correct ruby total
-        level.rubyCount = rubyCount;
-        //MALLOC should free when loading a new level
-        rubyArray.size = rubyCount;
-        rubyArray.data = (Entity*)malloc(rubyCount * sizeof(Entity));
-    }
+    return level->rubyCount;
+}
 
-    //Populate array with ruby coords
-    int rubyIndex = 0;
-    for (int y = 0; y < level.height; y++)
+char getLevelTile(const Level* level, int index)
+{
+    return level->data[index];
+}
+
+void loadLevelRubies(Level* level, PickupPool* rubies)
+{
+    //Populate pool with ruby coords
+    level->rubyCount = 0;
+    for (int y = 0; y < level->height; y++)
     {
-        for (int x = 0; x < level.width; x++)
+        for (int x = 0; x < level->width; x++)
         {
-            if (level.data[y * level.width + x] == TILE_RUBY)
+            if (level->data[y * level->width + x] == TILE_RUBY)
             {
                 Vector2 tmp = { x * TILE_DIMS + TILE_DIMS/2, y * TILE_DIMS + TILE_DIMS/2 };
-                rubyArray.data[rubyIndex].pos = tmp;
-                rubyArray.data[rubyIndex].zPos = -16;
-                rubyArray.data[rubyIndex].xClip = 0;
-                rubyArray.data[rubyIndex].yClip = 0;
-                rubyArray.data[rubyIndex].base = rubyTemplate;
-                rubyArray.data[rubyIndex].sub = NULL;
-                rubyIndex++;
+                addPickup(rubies, tmp, -16, -1);
+                //Set correct ruby total
+                level->rubyCount++;
             }
         }
     }
-    return rubyArray;
 }
 
-EntityArray getLevelKeys(EntityTemplate* keyTemplate)
+void loadLevelKeys(const Level* level, PickupPool* keys)
 {
-    //Create EntityArray of correct size
-    EntityArray keyArray = {0};
+    //Populate pool with key coords
+    for (int y = 0; y < level->height; y++)
     {
-        int keyCount = 0;
-        for (int i = 0; i < level.width * level.height; i++)
-            if (level.data[i] == TILE_KEY0 ||
-                level.data[i] == TILE_KEY1 ||
-                level.data[i] == TILE_KEY2 ||
-                level.data[i] == TILE_KEY3)
-            {
-                keyCount++;
-            }
-
-        //MALLOC should free when loading a new level
-        keyArray.size = keyCount;
-        keyArray.data = (Entity*)malloc(keyCount * sizeof(Entity));
-    }
-
-    //Populate array with key coords
-    int keyIndex = 0;
-    for (int y = 0; y < level.height; y++)
-    {
-        for (int x = 0; x < level.width; x++)
+        for (int x = 0; x < level->width; x++)
         {
-            if (level.data[y * level.width + x] == TILE_KEY0 ||
-                level.data[y * level.width + x] == TILE_KEY1 ||
-                level.data[y * level.width + x] == TILE_KEY2 ||
-                level.data[y * level.width + x] == TILE_KEY3)
+            char tile = level->data[y * level->width + x];
+            if (tile == TILE_KEY0 ||
+                tile == TILE_KEY1 ||
+                tile == TILE_KEY2 ||
+                tile == TILE_KEY3)
             {
                 Vector2 tmp = { x * TILE_DIMS + TILE_DIMS/2, y * TILE_DIMS + TILE_DIMS/2 };
-                keyArray.data[keyIndex].pos = tmp;
-                keyArray.data[keyIndex].zPos = -12;
-                keyArray.data[keyIndex].xClip = 0;
-                keyArray.data[keyIndex].yClip = 0;
-                keyArray.data[keyIndex].base = keyTemplate;
-                //MALLOC should free on new level
-                keyArray.data[keyIndex].sub = malloc(sizeof(Key));
 
                 //Determine id of key, i.e. it's colour
-                if (level.data[y * level.width + x] == TILE_KEY0)
-                {
-                    ((Key*)(keyArray.data[keyIndex].sub))->id = 0;
-                }
-                else if (level.data[y * level.width + x] == TILE_KEY1)
-                {
-                    ((Key*)(keyArray.data[keyIndex].sub))->id = 1;
-                }
-                else if (level.data[y * level.width + x] == TILE_KEY2)
-                {
-                    ((Key*)(keyArray.data[keyIndex].sub))->id = 2;
-                }
-                else
-                {
-                    ((Key*)(keyArray.data[keyIndex].sub))->id = 3;
-                }
-
-                keyIndex++;
+                int id;
+                if (tile == TILE_KEY0)      id = 0;
+                else if (tile == TILE_KEY1) id = 1;
+                else if (tile == TILE_KEY2) id = 2;
+                else                        id = 3;
+
+                addPickup(keys, tmp, -12, id);
             }
         }
     }
-    return keyArray;
 }
 
-EntityArray getLevelMonsters(EntityTemplate* monsterTemplate, int levelNumber)
+void loadLevelMonsters(MonsterPool* monsters, int levelNumber)
 {
     //TEMP!!
     //Should store monster patrol array in level struct (loaded in the loadLevel function)
-    //And then initialise the monsterArray using the patrol array in the level struct
-    //Should patrol points be stored in monster struct? Probably.
+    //And then initialise the monster pool using the patrol array in the level struct
     char fileName[128];// = "res/levels/level0.mon";
     sprintf(fileName, "res/levels/level%d.mon", levelNumber);
     FILE* file = fopen(fileName, "r");
@@ -225,145 +177,66 @@ EntityArray getLevelMonsters(EntityTemplate* monsterTemplate, int levelNumber)
         exit(1);
     }
 
-    //Create EntityArray of correct size
-    EntityArray monsterArray = {0};
+    //One monster per line, each line a list of patrol tile coordinates
+    char line [256];
+    while (fgets(line, 255, file) != NULL)
     {
-        //Save the pos beginning of file
-        fpos_t filePos;
-        fgetpos(file, &filePos);
-        int monsterCount = 0;
-        //Count the number of lines in the file
-        {
-            int ch;
-            while (EOF != (ch=getc(file)))
-            {
-                if (ch == '\n')
-                    ++monsterCount;
-            }
-        }
-        //Go back to beginning of file
-        fsetpos(file, &filePos);
+        //A line of 255 chars can't hold more points than this
+        Vector2Int patrolPoints[128];
+        int patrolLength = 0;
 
-        //MALLOC should free when loading a new level
-        monsterArray.size = monsterCount;
-        monsterArray.data = (Entity*)malloc(monsterCount * sizeof(Entity));
-    }
-    if (monsterArray.size >= 1)
-    {
-        char line [256];
-        if(fgets(line, 255, file) == NULL)
+        char* xToken = strtok(line, " \r\n");
+        while (xToken != NULL)
         {
-            SDL_Log("Error reading a line in the monster file.");
-            exit(-1);
+            char* yToken = strtok(NULL, " \r\n");
+            if (yToken == NULL) break;
+            patrolPoints[patrolLength].x = atoi(xToken);
+            patrolPoints[patrolLength].y = atoi(yToken);
+            patrolLength++;
+            xToken = strtok(NULL, " \r\n");
         }
-        int monsterIndex = 0;
-        while (!feof(file))
-        {
-            int monsterX = 0;
-            int monsterY = 0;
-            char* buf;
-
-            //Count tokens in line
-            buf = line;
-            int tokenCount = 0;
-            for (;;)
-            {
-                while (*buf == ' ')
-                {
-                    buf++;
-                }
-                if (*buf == '\0')
-                {
-                    break;
-                }
-                tokenCount++;
-                while (*buf != '\0' && *buf != ' ')
-                {
-                    buf++;
-                }
-            }
 
-            //MALLOC should free on new level
-            monsterArray.data[monsterIndex].sub = malloc(sizeof(Monster));
-            ((Monster*)monsterArray.data[monsterIndex].sub)->direction = DIR_NONE;
-            //MALLOC, should free on new level
-            ((Monster*)monsterArray.data[monsterIndex].sub)->patrolPoints = malloc((tokenCount / 2) * sizeof(Vector2Int));
-            ((Monster*)monsterArray.data[monsterIndex].sub)->patrolLength = (tokenCount / 2);
-
-            bool firstLoop = true;
-            int patrolIndex = 0;
-            monsterX = atoi(strtok(line, " "));
-            while(true)
-            {
-                if (!firstLoop)
-                {
-                    buf = strtok(NULL, " ");
-                    if (buf == NULL) break;
-                    monsterX = atoi(buf);
-                }
-                buf = strtok(NULL, " ");
-                if (buf == NULL) break;
-                monsterY = atoi(buf);
-
-                ((Monster*)monsterArray.data[monsterIndex].sub)->patrolPoints[patrolIndex].x = monsterX;
-                ((Monster*)monsterArray.data[monsterIndex].sub)->patrolPoints[patrolIndex].y = monsterY;
-                firstLoop = false;
-                patrolIndex++;
-            }
-            ((Monster*)monsterArray.data[monsterIndex].sub)->patrolIndex = 1;
-            ((Monster*)monsterArray.data[monsterIndex].sub)->aiState = AI_PATROL;
-            ((Monster*)monsterArray.data[monsterIndex].sub)->giveUpChaseTimer.active = false;
-            ((Monster*)monsterArray.data[monsterIndex].sub)->pathList.front = NULL;
-            ((Monster*)monsterArray.data[monsterIndex].sub)->roarSoundChannel = -1;
-
-            Vector2 tmp = { ((Monster*)monsterArray.data[monsterIndex].sub)->patrolPoints[0].x * TILE_DIMS + TILE_DIMS/2,
-                            ((Monster*)monsterArray.data[monsterIndex].sub)->patrolPoints[0].y * TILE_DIMS + TILE_DIMS/2 };
-            monsterArray.data[monsterIndex].pos = tmp;
-            monsterArray.data[monsterIndex].zPos = 0;
-            monsterArray.data[monsterIndex].xClip = 0;
-            monsterArray.data[monsterIndex].yClip = 0;
-            monsterArray.data[monsterIndex].base = monsterTemplate;
-
-            monsterIndex++;
-            if(fgets(line, 255, file) == NULL && ferror(file))
-            {
-                SDL_Log("Error reading a line in the monster file.");
-                exit(-1);
-            }
+        if (patrolLength > 0)
+        {
+            addMonster(monsters, patrolPoints, patrolLength);
         }
     }
-
-    return monsterArray;
+    if (ferror(file))
+    {
+        SDL_Log("Error reading a line in the monster file.");
+        exit(-1);
+    }
+    fclose(file);
 }
 
-SDL_Surface* getTileTexture(int index) {
-    assert(index >=0 && index < level.width * level.height);
-    if(level.data[index] == TILE_WALL)
+SDL_Surface* getTileTexture(const Level* level, const ImageManager* images, int index) {
+    assert(index >=0 && index < level->width * level->height);
+    if(level->data[index] == TILE_WALL)
     {
-        return images.caveTexture;
+        return images->caveTexture;
     }
-    else if (level.data[index] == TILE_DOOR0 ||
-             level.data[index] == TILE_DOOR1 ||
-             level.data[index] == TILE_DOOR2 ||
-             level.data[index] == TILE_DOOR3)
+    else if (level->data[index] == TILE_DOOR0 ||
+             level->data[index] == TILE_DOOR1 ||
+             level->data[index] == TILE_DOOR2 ||
+             level->data[index] == TILE_DOOR3)
     {
-        return images.doorTexture;
+        return images->doorTexture;
     }
-    else if (level.data[index] == TILE_SECRET_DOOR)
+    else if (level->data[index] == TILE_SECRET_DOOR)
     {
-        return images.secretDoorTexture;
+        return images->secretDoorTexture;
     }
-    else if (level.data[index] == TILE_INSTRUCTIONS1) {
-        return images.instructionsTexture1;
+    else if (level->data[index] == TILE_INSTRUCTIONS1) {
+        return images->instructionsTexture1;
     }
-    else if (level.data[index] == TILE_INSTRUCTIONS2) {
-        return images.instructionsTexture2;
+    else if (level->data[index] == TILE_INSTRUCTIONS2) {
+        return images->instructionsTexture2;
     }
-    else if (level.data[index] == TILE_INSTRUCTIONS3) {
-        return images.instructionsTexture3;
+    else if (level->data[index] == TILE_INSTRUCTIONS3) {
+        return images->instructionsTexture3;
     }
-    else if (level.data[index] == TILE_INSTRUCTIONS4) {
-        return images.instructionsTexture4;
+    else if (level->data[index] == TILE_INSTRUCTIONS4) {
+        return images->instructionsTexture4;
     }
     SDL_Log("Imposible value at data[index], cannot getTileTexture().");
     exit(-1);
@@ -372,16 +245,18 @@ SDL_Surface* getTileTexture(int index) {
 bool fileExists(char* filePath)
 {
     FILE* file = fopen(filePath, "r");
-    return file == NULL ? false : true;
+    if (file == NULL) return false;
+    fclose(file);
+    return true;
 }
 
-Vector2 getLevelEndPos()
+Vector2 getLevelEndPos(const Level* level)
 {
-    for (int y = 0; y < level.height; y++)
+    for (int y = 0; y < level->height; y++)
     {
-        for (int x = 0; x < level.width; x++)
+        for (int x = 0; x < level->width; x++)
         {
-            if (level.data[y * level.width + x] == TILE_LEVEL_END)
+            if (level->data[y * level->width + x] == TILE_LEVEL_END)
             {
                 Vector2 levelEndPos = { x * TILE_DIMS + TILE_DIMS/2, y * TILE_DIMS + TILE_DIMS/2 };
                 return levelEndPos;
@@ -393,7 +268,7 @@ Vector2 getLevelEndPos()
 }
 
 //TODO Fix levels breaking if they don't end on a blank line
-void loadLevelTiles(char* fileName)
+void loadLevelTiles(Level* level, char* fileName)
 {
     FILE* file = fopen(fileName, "r");
     if (file == NULL)
@@ -417,15 +292,16 @@ void loadLevelTiles(char* fileName)
             if (ch == '\n')
                 ++lineCount;
         }
-        level.height = lineCount;
-        level.width = (charCount / lineCount) - 1;
+        level->height = lineCount;
+        level->width = (charCount / lineCount) - 1;
     }
 
     //Go back to beginning of file
     fsetpos(file, &filePos);
     //MALLOC should free when loading a new level
-    if (level.data != NULL) free(level.data);
-    level.data = (char*)malloc(level.width * level.height * sizeof(char));
+    if (level->data != NULL) free(level->data);
+    level->data = (char*)malloc(level->width * level->height * sizeof(char));
+    level->tileVersion++;
     //Re-read the file, loading the actual data into the level structure.
     {
         int ch;
@@ -434,9 +310,20 @@ void loadLevelTiles(char* fileName)
         {
             if (ch != '\n')
             {
-                level.data[i] = ch;
+                level->data[i] = ch;
                 i++;
             }
         }
     }
+    fclose(file);
+
+    buildVisibility(level);
+}
+
+//Frees what the level owns, leaving it empty to load another into
+void freeLevel(Level* level)
+{
+    free(level->data);
+    freeVisibility(&level->visibility);
+    memset(level, 0, sizeof(Level));
 }
@@ -9,6 +9,9 @@
 #include <stdbool.h>
 
 #include "engine_types.h"
+#include "entity_pools.h"
+#include "images.h"
+#include "visibility.h"
 
 
 static const int TILE_DIMS = 64;
@@ -36,31 +39,40 @@ static const char TILE_INSTRUCTIONS4= 'l';
 static const int LEVEL_FILE_PATH_MAX_LEN = 32;
 
 
-typedef struct
+/*------------------------------------------------------------------------------
+ * Everything known about the level being played. A Level belongs to one game,
+ * so any number can be loaded at once, each on its own thread.
+ *----------------------------------------------------------------------------*/
+struct Level
 {
     int width;
     int height;
     char* data;
+    uint32_t tileVersion;   //Changes whenever data does
 
     int rubyCount;
-} Level;
+    VisibilityCache visibility;
+};
 
 
-EntityArray     getLevelRubies      (EntityTemplate* rubyTemplate);
-EntityArray     getLevelKeys        (EntityTemplate* keyTemplate);
-EntityArray     getLevelMonsters    (EntityTemplate* monsterTemplate, int levelNumber);
-SDL_Surface*    getTileTexture      (int index);
+void            loadLevelRubies     (Level* level, PickupPool* rubies);
+void            loadLevelKeys       (const Level* level, PickupPool* keys);
+void            loadLevelMonsters   (MonsterPool* monsters, int levelNumber);
+SDL_Surface*    getTileTexture      (const Level* level, const ImageManager* images, int index);
 Vector2         posToTileCoord      (Vector2 pos);
-Vector2         getPlayerStartPos   (void);
-Vector2         getLevelEndPos      ();
-int             posVecToTileIndex   (Vector2 pos);
-int             posVecToIndex       (Vector2 pos);
-int             posToTileIndex      (int x, int y);
-int             coordToTileIndex    (int x, int y);
-int             getTotalLevelRubies (void);
-char            getLevelTile        (int index);
+Vector2         getPlayerStartPos   (const Level* level);
+Vector2         getLevelEndPos      (const Level* level);
+int             posVecToTileIndex   (const Level* level, Vector2 pos);
+int             posVecToIndex       (const Level* level, Vector2 pos);
+int             posToTileIndex      (const Level* level, int x, int y);
+int             coordToTileIndex    (const Level* level, int x, int y);
+int             getLevelWidth       (const Level* level);
+int             getLevelHeight      (const Level* level);
+int             getTotalLevelRubies (const Level* level);
+char            getLevelTile        (const Level* level, int index);
 bool            fileExists          (char* filePath);
-bool            isTileIndexValid    (int i);
-bool            isTileSolid         (int index);
-void            loadLevelTiles      (char* fileName);
-void            setTileTo           (int index, char tile);
\ No newline at end of file
+bool            isTileIndexValid    (const Level* level, int i);
+bool            isTileSolid         (const Level* level, int index);
+void            loadLevelTiles      (Level* level, char* fileName);
+void            setTileTo           (Level* level, int index, char tile);
+void            freeLevel           (Level* level);
@@ -12,6 +12,7 @@ seoras1@gmail.com
 #include <math.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 
 #ifdef __linux__
     #include <SDL2/SDL.h>
@@ -26,56 +27,162 @@ seoras1@gmail.com
 #include "engine_types.h"
 #include "load_level.h"
 #include "gfx_engine.h"
+#include "blitter.h"
 #include "images.h"
 #include "monster.h"
+#include "monster_sim.h"
+#include "job_pool.h"
+#include "entity_pools.h"
+#include "frame_pacer.h"
+#include "game.h"
+#include "replay.h"
+#include "autopilot.h"
+#include "frame_pipeline.h"
+#include "window_state.h"
+#include "render_kernels.h"
 
 
 //Temp Globals
-static uint32_t keyColorsTemp[MAX_KEYS] = {0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFF00AA88};
-static float monsterSightRadius = 256.f;    //Should be in monster entity base
-static float monsterFov = M_PI/2;           //Should be in monster entity base
-static float monsterChaseTimeLimit = 5000;  //Should be in monster entity base
+static float aiBudgetMs = 4.f;              //Time monster AI may take per tick
 
+static const int MAX_SIM_TICKS_PER_FRAME = 5;
 
-bool oneInXChance(int x) {
-    return rand() % x == 0;
+static const float MOUSE_SENSITIVITY = 0.001f;  //Radians per mouse count
+
+
+//Audio SHOULD EXTRACT TO SEPARATE FILE
+typedef struct
+{
+    Mix_Music* gameBackgroundMusic;
+    Mix_Music* levelEndMusic;
+    Mix_Chunk* rubySfx;
+    Mix_Chunk* keySfx;
+    Mix_Chunk* unlockDoorSfx;
+    Mix_Chunk* lockedDoorSfx;
+    Mix_Chunk* playerFootstepSfx;
+    Mix_Chunk* roarSfx;
+    Mix_Chunk* playerFinishedLevelSfx;
+    Mix_Chunk* secretDoorSfx;
+    Mix_Chunk* playerDeathSfx;
+} GameSounds;
+
+/*------------------------------------------------------------------------------
+ * Output: How far to turn the camera for the mouse motion since the last call.
+ * Description: Reads the relative mouse state rather than waiting for the
+ *              motion events to be polled at the start of the next frame. The
+ *              motion events it has consumed are taken off the queue, after
+ *              their timestamps have been noted for the latency stats.
+ *----------------------------------------------------------------------------*/
+float latchMouseLook(void)
+{
+    SDL_PumpEvents();
+    SDL_Event motionEvents[32];
+    int count;
+    while ((count = SDL_PeepEvents(motionEvents, 32, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION)) > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            noteInputEvent(motionEvents[i].common.timestamp);
+        }
+    }
+    int xrel = 0;
+    SDL_GetRelativeMouseState(&xrel, NULL);
+    return xrel * MOUSE_SENSITIVITY;
 }
 
-EntityArray initLevel(
-    Player* player, PlayerData* playerData, EntityTemplate* rubyTemplate,
-    EntityTemplate* keyTemplate, EntityTemplate* monsterTemplate, EntityTemplate* endPortalTemplate)
+/*------------------------------------------------------------------------------
+ * Input: The game, the input devices and the buttons pressed since the last
+ *        tick.
+ * Output: The tick's input, everything the game reads from the player.
+ *----------------------------------------------------------------------------*/
+TickInput readTickInput(const Game* game, SDL_Joystick* gamePad, const uint8_t* keyState, uint16_t pressedButtons)
 {
-    player->pos = getPlayerStartPos();
-    player->rotation = 0;
-    playerData->rubiesCollected = 0;
-    for (int i = 0; i < MAX_KEYS; i++)
+    TickInput input = { .buttons=pressedButtons, .rotation=game->player.rotation };
+    for (int i = 0; i < 3; i++)
     {
-        playerData->keysCollected[i] = false;
+        input.joystickAxes[i] = SDL_JoystickGetAxis(gamePad, i);
     }
+    if (keyState[SDL_SCANCODE_W])     input.buttons |= INPUT_FORWARD;
+    if (keyState[SDL_SCANCODE_S])     input.buttons |= INPUT_BACK;
+    if (keyState[SDL_SCANCODE_A])     input.buttons |= INPUT_STRAFE_LEFT;
+    if (keyState[SDL_SCANCODE_D])     input.buttons |= INPUT_STRAFE_RIGHT;
+    if (keyState[SDL_SCANCODE_LEFT])  input.buttons |= INPUT_TURN_LEFT;
+    if (keyState[SDL_SCANCODE_RIGHT]) input.buttons |= INPUT_TURN_RIGHT;
+    if (keyState[SDL_SCANCODE_R])     input.buttons |= INPUT_RESTART;
+    return input;
+}
 
-    EntityArray rubies = getLevelRubies(rubyTemplate);
-    EntityArray keys = getLevelKeys(keyTemplate);
-    EntityArray monsters = getLevelMonsters(monsterTemplate, playerData->levelNumber);
-    Entity endPortalEntity = { .pos=getLevelEndPos(),
-                               .zPos=0,
-                               .xClip=0,
-                               .yClip=0,
-                               .base=endPortalTemplate,
-                               .sub=NULL};
-
-    EntityArray entities;
-    entities.size = rubies.size + keys.size + monsters.size + 1;
-    entities.data = (Entity*)malloc(entities.size * sizeof(Entity));
-    memcpy((void*)entities.data, (void*)rubies.data, rubies.size * sizeof(Entity));
-    memcpy((void*)(entities.data + rubies.size), (void*)keys.data, keys.size * sizeof(Entity));
-    memcpy((void*)(entities.data + rubies.size + keys.size), (void*)monsters.data, monsters.size * sizeof(Entity));
-    entities.data[entities.size - 1] = endPortalEntity;
-    //Free memory
-    free(rubies.data);
-    free(keys.data);
-    free(monsters.data);
-
-    return entities;
+/*------------------------------------------------------------------------------
+ * Description: Plays the sounds for what happened in the last tick. Nothing
+ *              here feeds back into the game, so replays run the same with or
+ *              without it.
+ *----------------------------------------------------------------------------*/
+void playGameSounds(Game* game, const GameSounds* sounds)
+{
+    uint32_t events = game->events;
+    if (events & GAME_EVENT_LEVEL_LOADED)
+    {
+        Mix_HaltMusic();
+        Mix_PlayMusic(sounds->gameBackgroundMusic, -1);
+    }
+    if (events & GAME_EVENT_SECRET_DOOR)   Mix_PlayChannel(-1, sounds->secretDoorSfx, 0);
+    if (events & GAME_EVENT_DOOR_UNLOCKED) Mix_PlayChannel(-1, sounds->unlockDoorSfx, 0);
+    if (events & GAME_EVENT_DOOR_LOCKED)   Mix_PlayChannel(-1, sounds->lockedDoorSfx, 0);
+    if (events & GAME_EVENT_RUBY_PICKUP)   Mix_PlayChannel(-1, sounds->rubySfx, 0);
+    if (events & GAME_EVENT_KEY_PICKUP)    Mix_PlayChannel(-1, sounds->keySfx, 0);
+    if (events & GAME_EVENT_PLAYER_DIED)   Mix_PlayChannel(-1, sounds->playerDeathSfx, 0);
+    if ((events & GAME_EVENT_PLAYER_MOVED) && !Mix_Playing(game->player.footstepSoundChannel))
+    {
+        game->player.footstepSoundChannel = Mix_PlayChannel(-1, sounds->playerFootstepSfx, 0);
+    }
+    if (events & GAME_EVENT_REACHED_EXIT)
+    {
+        Mix_PlayChannel(-1, sounds->playerFinishedLevelSfx, 0);
+        Mix_HaltMusic();
+        Mix_PlayMusic(sounds->levelEndMusic, -1);
+    }
+
+    if (!(events & GAME_EVENT_MONSTERS_UPDATED)) return;
+    MonsterPool* monsters = &game->pools.monsters;
+    for (int i = 0; i < monsters->count; i++)
+    {
+        uint8_t monsterEvents = getMonsterSimEvents(&game->monsterSim, i);
+        if (monsterEvents == 0) continue;
+        Monster* monster = &monsters->monsters[i];
+
+        if (monsterEvents & MONSTER_EVENT_SPOTTED_PLAYER)
+        {
+            Mix_PlayChannel(-1, sounds->roarSfx, 0);
+        }
+        if (monster->mayRoar && !Mix_Playing(monster->roarSoundChannel))
+        {
+            monster->roarSoundChannel = Mix_PlayChannel(-1, sounds->roarSfx, 0);
+        }
+        if (monsterEvents & MONSTER_EVENT_THOUGHT)
+        {
+            int distVolume = distanceFormula(game->player.pos, monsters->pos[i]) / 4;
+            Mix_SetPosition(
+                monster->roarSoundChannel,
+                (constrainAngle(getMonsterAngle(monster) - game->player.rotation) + M_PI) * (360.0 / (2 * M_PI)),
+                distVolume > 255 ? 255 : distVolume
+            );
+        }
+    }
+}
+
+//Holds the music and every sound while the window is hidden
+void pauseGameAudio(bool paused)
+{
+    if (paused)
+    {
+        Mix_Pause(-1);
+        Mix_PauseMusic();
+    }
+    else
+    {
+        Mix_Resume(-1);
+        Mix_ResumeMusic();
+    }
 }
 
 bool initSDL(SDL_Window** window, SDL_Renderer** renderer)
@@ -111,34 +218,10 @@ bool initSDL(SDL_Window** window, SDL_Renderer** renderer)
         return false;
     }
 
-    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_PRESENTVSYNC);
+    *renderer = SDL_CreateRenderer(*window, -1, isFramePacerVsync() ? SDL_RENDERER_PRESENTVSYNC : 0);
     return true;
 }
 
-bool loadLevel(EntityArray* entities, Player* player,
-    PlayerData* playerData, EntityTemplate* rubyTemplate,
-    EntityTemplate* keyTemplate, EntityTemplate* monsterTemplate, EntityTemplate* levelEndPortal)
-{
-    char nextLevelFilePath[LEVEL_FILE_PATH_MAX_LEN];
-    sprintf(nextLevelFilePath, "res/levels/level%d.lvl", playerData->levelNumber);
-    if(fileExists(nextLevelFilePath))
-    {
-        loadLevelTiles(nextLevelFilePath);
-        for (int i = 0; i < entities->size; i++)
-        {
-            if (entities->data[i].base->type == ENTITY_TYPE_MONSTER)
-            {
-                free(((Monster*)entities->data[i].sub)->patrolPoints);
-            }
-            free(entities->data[i].sub);
-        }
-        free(entities->data);
-        (*entities) = initLevel(player, playerData, rubyTemplate, keyTemplate, monsterTemplate, levelEndPortal);
-        return true;
-    }
-    else return false;
-}
-
 void toggleFullscreen(SDL_Window* window)
 {
     uint32_t flags = SDL_GetWindowFlags(window);
@@ -152,109 +235,237 @@ void toggleFullscreen(SDL_Window* window)
     }
 }
 
-void onLevelStartTransitionEnd(void** args, int length)
+//Shows the frame waitForFrame() gave, just drawn into the screen textures, if
+//it gave one
+void presentFrame(SDL_Renderer* renderer, GfxContext* gfx, ScreenTextures* screen, const FrameSnapshot* frame)
 {
-    bool* paused = args[0];
-    *paused = false;
+    if (frame == NULL) return;
+    SDL_RenderCopy(renderer, endScreenFrame(gfx, screen), NULL, NULL);
+    waitForFramePresent();
+    SDL_RenderPresent(renderer);
+    markFramePresented(frame->hasInput, frame->oldestInput);
 }
 
-void onLevelEndTransitionEnd(void** args, int length)
+/*------------------------------------------------------------------------------
+ * Description: Shows the screen between levels for the level just completed,
+ *              or the end screen once the last one is done. Holds the screen
+ *              for a few seconds, the game doesn't tick meanwhile.
+ *----------------------------------------------------------------------------*/
+void showLevelEndScreen(const Game* game, GfxContext* gfx, ScreenTextures* screen, SDL_Renderer* renderer, SpriteFont spriteFont)
 {
-    static int frameCounter = 0;
-    frameCounter++;
-
-    PlayerData*     playerData =        args[0];
-
-    void***  transitionArgs =            args[1];
-    void***  levelStartTransitionArgs =  args[2];
-    void (**onTransitionDone) (void**, int) = args[3];
-    void (*onLevelStartTransitionEnd) (void**, int) = args[4];
-    bool* shouldReloadLevel = args[5];
-    int* transitionDirection = args[6];
-    //ImageManager* images = args[7]; // images is global, no need to pass.
-    SDL_Texture** screenTexture = args[8];
-    SDL_Renderer** renderer = args[9];
-    SpriteFont* spriteFont = args[10];
-
-    char nextLevelFilePath[LEVEL_FILE_PATH_MAX_LEN];
-    sprintf(nextLevelFilePath, "res/levels/level%d.lvl", playerData->levelNumber + 1);
-    if(fileExists(nextLevelFilePath))
-    {
+    const PlayerData* playerData = &game->playerData;
+    beginScreenFrame(gfx, screen);
 
-        uint32_t fadeColour = 0x000000;
-        SDL_Rect topRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-        drawRect(topRect, fadeColour);
-        SDL_Rect tmpRect = {SCREEN_WIDTH / 2 - 2 * images.rubySprite->w + 2, SCREEN_HEIGHT / 2 - 4, images.rubySprite->w, images.rubySprite->h};
-        blitToPixelBuffer(images.rubySprite, tmpRect, 0);
+    uint32_t fadeColour = 0x000000;
+    SDL_Rect topRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+    drawRect(gfx, topRect, fadeColour);
+    SDL_Rect tmpRect = {SCREEN_WIDTH / 2 - 2 * gfx->images->rubySprite->w + 2, SCREEN_HEIGHT / 2 - 4, gfx->images->rubySprite->w, gfx->images->rubySprite->h};
+    blitToPixelBuffer(gfx, gfx->images->rubySprite, NULL, tmpRect, 0);
 
+    if (!game->finished)
+    {
         {char levelEndText[32];
-        sprintf(levelEndText, "LEVEL %d COMPLETE", playerData->levelNumber + 1);
+        sprintf(levelEndText, "LEVEL %d COMPLETE", playerData->levelNumber);
         SDL_Rect textRect = { SCREEN_WIDTH / 2, SCREEN_HEIGHT/3, 0, 0 };
-        drawText(levelEndText, textRect, 0xFF7A0927, *spriteFont, true);}
+        drawText(gfx, levelEndText, textRect, 0xFF7A0927, spriteFont, true);}
 
         {char rubyCountStr[32];
-        sprintf(rubyCountStr, "%d/%d", playerData->rubiesCollected, getTotalLevelRubies());
+        sprintf(rubyCountStr, "%d/%d", playerData->rubiesCollected, getTotalLevelRubies(&game->level));
         SDL_Rect textRect = { SCREEN_WIDTH / 2 - 2, SCREEN_HEIGHT/2, 0, 0 };
-        drawText(rubyCountStr, textRect, 0xFF7A0927, *spriteFont, false);}
-
-        //Render the pixel buffer to the screen
-        SDL_UpdateTexture(*screenTexture, NULL, getPixelBuffer()->pixels, SCREEN_WIDTH * sizeof(uint32_t));
-        SDL_RenderCopy(*renderer, *screenTexture, NULL, NULL);
-        SDL_RenderPresent(*renderer);
-        SDL_Delay(4000);
-
-        (*playerData).levelNumber++;
-        (*playerData).totalRubiesCollected += (*playerData).rubiesCollected;
-        (*playerData).totalRubies += getTotalLevelRubies();
-        //loadLevel(entities, player, playerData, rubyTemplate, keyTemplate, monsterTemplate);
-        *shouldReloadLevel = true;
-        *transitionArgs = (void**)levelStartTransitionArgs;
-        *onTransitionDone = onLevelStartTransitionEnd;
-        *transitionDirection = -1;
+        drawText(gfx, rubyCountStr, textRect, 0xFF7A0927, spriteFont, false);}
     }
     else
     {
-        (*playerData).levelNumber++;
-        (*playerData).totalRubiesCollected += (*playerData).rubiesCollected;
-        (*playerData).totalRubies += getTotalLevelRubies();
-
-        uint32_t fadeColour = 0x000000;
-        SDL_Rect topRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-        drawRect(topRect, fadeColour);
-
-        SDL_Rect tmpRect = {SCREEN_WIDTH / 2 - 2 * images.rubySprite->w + 2, SCREEN_HEIGHT / 2 - 4, images.rubySprite->w, images.rubySprite->h};
-        blitToPixelBuffer(images.rubySprite, tmpRect, 0);
-
         {char levelEndText[32];
         sprintf(levelEndText, "THE END");
         SDL_Rect textRect = { SCREEN_WIDTH / 2, SCREEN_HEIGHT/3, 0, 0 };
-        drawText(levelEndText, textRect, 0xFF7A0927, *spriteFont, true);}
+        drawText(gfx, levelEndText, textRect, 0xFF7A0927, spriteFont, true);}
 
         {char levelEndText[32];
         sprintf(levelEndText, "A GAME BY SEORAS MACDONALD");
         SDL_Rect textRect = { SCREEN_WIDTH / 2, (SCREEN_HEIGHT * 9/10), 0, 0 };
-        drawText(levelEndText, textRect, 0xFF7A0927, *spriteFont, true);}
+        drawText(gfx, levelEndText, textRect, 0xFF7A0927, spriteFont, true);}
 
         {char rubyCountStr[32];
         sprintf(rubyCountStr, "%d/%d", playerData->totalRubiesCollected, playerData->totalRubies);
         SDL_Rect textRect = { SCREEN_WIDTH / 2 - 2, SCREEN_HEIGHT/2, 0, 0 };
-        drawText(rubyCountStr, textRect, 0xFF7A0927, *spriteFont, false);}
-
-        //Render the pixel buffer to the screen
-        SDL_UpdateTexture(*screenTexture, NULL, getPixelBuffer()->pixels, SCREEN_WIDTH * sizeof(uint32_t));
-        SDL_RenderCopy(*renderer, *screenTexture, NULL, NULL);
-        SDL_RenderPresent(*renderer);
-        SDL_Delay(8000);
-        exit(0);
+        drawText(gfx, rubyCountStr, textRect, 0xFF7A0927, spriteFont, false);}
     }
+
+    //Render the pixel buffer to the screen
+    SDL_RenderCopy(renderer, endScreenFrame(gfx, screen), NULL, NULL);
+    SDL_RenderPresent(renderer);
+    SDL_Delay(game->finished ? 8000 : 4000);
 }
 
-int sign(int x) {
-    return (x > 0) - (x < 0);
+/*------------------------------------------------------------------------------
+ * Input: A game started from the replay's seed and level.
+ * Output: The exit code, non-zero if the game drifted from the recording.
+ * Description: Runs every recorded tick as fast as possible, without a window
+ *              or sound, and reports the simulation rate.
+ *----------------------------------------------------------------------------*/
+int runReplayWithoutRendering(Game* game, Replay* replay)
+{
+    TickInput input;
+    uint64_t startCounter = SDL_GetPerformanceCounter();
+    while (!game->finished && readReplayTick(replay, &input))
+    {
+        tickGame(game, &input);
+        verifyReplayTick(replay, game);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - startCounter) / SDL_GetPerformanceFrequency();
+    printf("Replayed %u of %u ticks in %.3f s, %.0f ticks/s.\n", replay->ticksRead, replay->tickCount,
+           seconds, replay->ticksRead / (seconds > 0 ? seconds : 1e-9));
+    if (replay->drifted) printf("Drifted from the recording by tick %u.\n", replay->driftTick);
+    else printf("Matched the recording.\n");
+    closeReplay(replay);
+    return replay->drifted ? 2 : 0;
 }
 
 int main(int argc, char* args[])
 {
+    //Command line options
+    PaceMode paceMode = PACE_VSYNC;
+    double paceRateHz = 0;
+    const char* paceReportPath = "frame_pacing.txt";
+    const char* recordPath = NULL;
+    const char* replayPath = NULL;
+    bool noRender = false;
+    bool useAutopilot = false;
+    int startLevel = 0;
+    int screenBufferCount = 2;
+    bool singleThread = false;
+    KernelIsa maxKernelIsa = KERNEL_ISA_COUNT - 1;
+    PostEffectChain postEffects = {0};
+    uint32_t seed = (uint32_t)time(NULL);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(args[i], "--pace=", 7) == 0)
+        {
+            if (!parsePaceMode(args[i] + 7, &paceMode, &paceRateHz))
+            {
+                printf("Unknown pace mode %s, expected vsync, uncapped, lowlatency[:hz] or a rate in Hz.\n", args[i] + 7);
+                return 1;
+            }
+        }
+        else if (strncmp(args[i], "--pace-report=", 14) == 0)
+        {
+            paceReportPath = args[i] + 14;
+        }
+        else if (strncmp(args[i], "--record=", 9) == 0)
+        {
+            recordPath = args[i] + 9;
+        }
+        else if (strncmp(args[i], "--replay=", 9) == 0)
+        {
+            replayPath = args[i] + 9;
+        }
+        else if (strcmp(args[i], "--no-render") == 0)
+        {
+            noRender = true;
+        }
+        else if (strncmp(args[i], "--effects=", 10) == 0)
+        {
+            if (!parsePostEffectChain(&postEffects, args[i] + 10))
+            {
+                printf("Unknown effect in %s, expected chroma, scanlines, vignette, palette or retro.\n", args[i] + 10);
+                return 1;
+            }
+        }
+        else if (strcmp(args[i], "--single-thread") == 0)
+        {
+            singleThread = true;
+        }
+        else if (strncmp(args[i], "--cpu=", 6) == 0)
+        {
+            if (!parseKernelIsa(args[i] + 6, &maxKernelIsa))
+            {
+                printf("Unknown instruction set %s, expected scalar, sse2, avx2 or avx512.\n", args[i] + 6);
+                return 1;
+            }
+        }
+        else if (strcmp(args[i], "--autopilot") == 0)
+        {
+            useAutopilot = true;
+        }
+        else if (strncmp(args[i], "--seed=", 7) == 0)
+        {
+            seed = (uint32_t)strtoul(args[i] + 7, NULL, 10);
+        }
+        else if (strncmp(args[i], "--level=", 8) == 0)
+        {
+            startLevel = atoi(args[i] + 8);
+        }
+        else if (strncmp(args[i], "--screen-buffers=", 17) == 0)
+        {
+            screenBufferCount = atoi(args[i] + 17);
+            if (screenBufferCount < 1 || screenBufferCount > MAX_SCREEN_TEXTURES)
+            {
+                printf("--screen-buffers must be 1 to %d.\n", MAX_SCREEN_TEXTURES);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Usage: %s [--pace=MODE] [--pace-report=FILE] [--record=FILE | --replay=FILE [--no-render]]\n"
+                   "       [--autopilot] [--seed=N] [--level=N] [--screen-buffers=N] [--effects=LIST]\n"
+                   "       [--single-thread] [--cpu=ISA]\n", args[0]);
+            return 1;
+        }
+    }
+    if (recordPath != NULL && replayPath != NULL)
+    {
+        printf("Can't record and replay at the same time.\n");
+        return 1;
+    }
+    if (useAutopilot && replayPath != NULL)
+    {
+        printf("Can't use the autopilot while replaying.\n");
+        return 1;
+    }
+    if (noRender && replayPath == NULL)
+    {
+        printf("--no-render needs a --replay to run.\n");
+        return 1;
+    }
+
+    //The seed and level come from the recording when replaying
+    Replay replay = {0};
+    if (replayPath != NULL)
+    {
+        if (!openReplay(&replay, replayPath)) return 1;
+        seed = replay.seed;
+        startLevel = replay.levelNumber;
+    }
+    //The AI budget depends on how long thinking took, which differs between
+    //runs, so replays, recordings and benchmark runs think on the fixed
+    //schedule alone
+    float gameAiBudgetMs = (recordPath != NULL || replayPath != NULL || useAutopilot) ? 0 : aiBudgetMs;
+
+    if (noRender)
+    {
+        //No window, sound or images, only the simulation
+        if (SDL_Init(SDL_INIT_TIMER) < 0)
+        {
+            printf ("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+            return 1;
+        }
+        initJobPool(SDL_GetCPUCount() - 1);
+        EntityTemplate rubyTemplate = { .width=16, .height=16, .spriteWidth=16, .spriteHeight=16, .type=ENTITY_TYPE_RUBY };
+        EntityTemplate keyTemplate = { .width=16, .height=16, .spriteWidth=16, .spriteHeight=16, .type=ENTITY_TYPE_KEY};
+        EntityTemplate monsterTemplate = { .width=64, .height=64, .spriteWidth=64, .spriteHeight=64, .type=ENTITY_TYPE_MONSTER};
+        EntityTemplate endPortalTemplate = { .width=64, .height=64, .spriteWidth=64, .spriteHeight=64, .animationSpeed=30, .type=ENTITY_TYPE_PORTAL};
+        static Game headlessGame;
+        initGame(&headlessGame, &rubyTemplate, &keyTemplate, &monsterTemplate, &endPortalTemplate, seed, startLevel);
+        headlessGame.aiBudgetMs = gameAiBudgetMs;
+        int exitCode = runReplayWithoutRendering(&headlessGame, &replay);
+        freeGame(&headlessGame);
+        return exitCode;
+    }
+
+    initFramePacer(paceMode, paceRateHz);
+    initRenderKernels(maxKernelIsa);
+
     SDL_Window* window = NULL;
     SDL_Renderer* renderer = NULL;
     if(!initSDL(&window, &renderer))
@@ -263,96 +474,93 @@ int main(int argc, char* args[])
         return 1;
     }
 
-    SDL_Texture* screenTexture = SDL_CreateTexture(
-        renderer, SDL_PIXELFORMAT_ARGB8888,
-        SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH,
-        SCREEN_HEIGHT);
-    if (screenTexture == NULL)
+    //Frames are drawn straight into these, see beginScreenFrame()
+    ScreenTextures screen;
+    if (!initScreenTextures(&screen, renderer, SCREEN_WIDTH, SCREEN_HEIGHT, screenBufferCount))
     {
-        SDL_Log("screenTexture is NULL.");
+        SDL_Log("Could not create the screen textures.");
         return 1;
     }
 
     //Grab cursor
     SDL_SetRelativeMouseMode(true);
 
-    //Allocate pixel buffer
-    createPixelBuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+    //Worker threads for monster updates, leaving a core for the main thread
+    initJobPool(SDL_GetCPUCount() - 1);
 
-    loadImages();
+    static ImageManager images;
+    loadImages(&images);
+
+    //Allocate pixel buffer
+    static GfxContext gfx;
+    initGfxContext(&gfx, SCREEN_WIDTH, SCREEN_HEIGHT, &images);
 
     //Load sprite font
     SpriteFont spriteFont = { .charW=8, .charH=8 };
     spriteFont.sprite = IMG_Load("res/fonts/atari_font.png");
     spriteFont.sprite = SDL_ConvertSurfaceFormat(spriteFont.sprite, SDL_PIXELFORMAT_ARGB8888, 0);
 
+    //Frames are drawn on a thread of their own while the next is simulated
+    static FramePipeline pipeline;
+    initFramePipeline(&pipeline, &gfx, spriteFont, &postEffects, !singleThread);
+
     //Audio SHOULD EXTRACT TO SEPARATE FILE
-    Mix_Music* gameBackgroundMusic = Mix_LoadMUS("res/music/thrum.ogg");
-    Mix_Music* levelEndMusic = Mix_LoadMUS("res/music/thrum_outsync_double_reverse.ogg");
+    GameSounds sounds;
+    sounds.gameBackgroundMusic = Mix_LoadMUS("res/music/thrum.ogg");
+    sounds.levelEndMusic = Mix_LoadMUS("res/music/thrum_outsync_double_reverse.ogg");
     Mix_Music* titleMusic = Mix_LoadMUS("res/music/title_menu.ogg");
-    Mix_Chunk* rubySfx = Mix_LoadWAV("res/sfx/ruby_pickup.ogg");
-    Mix_Chunk* keySfx = Mix_LoadWAV("res/sfx/key_pickup.ogg");
-    Mix_Chunk* unlockDoorSfx = Mix_LoadWAV("res/sfx/unlock_door.ogg");
-    Mix_Chunk* lockedDoorSfx = Mix_LoadWAV("res/sfx/locked_door.ogg");
-    Mix_Chunk* playerFootstepSfx = Mix_LoadWAV("res/sfx/player_footstep.ogg");
-    Mix_Chunk* roarSfx = Mix_LoadWAV("res/sfx/monster_roar.ogg");
-    Mix_Chunk* playerFinishedLevelSfx = Mix_LoadWAV("res/sfx/player_finished_level.ogg");
-    Mix_Chunk* secretDoorSfx = Mix_LoadWAV("res/sfx/secret_door.ogg");
-    Mix_Chunk* playerDeathSfx = Mix_LoadWAV("res/sfx/player_death.ogg");
-
-    Mix_VolumeChunk(roarSfx, 128);
-    Mix_VolumeChunk(playerFootstepSfx, 40);
-
-    //Create player
-    Player player = { .width=32, .height=32, .footstepSoundChannel=-1};
-    PlayerData playerData = { .levelNumber=0 };
+    sounds.rubySfx = Mix_LoadWAV("res/sfx/ruby_pickup.ogg");
+    sounds.keySfx = Mix_LoadWAV("res/sfx/key_pickup.ogg");
+    sounds.unlockDoorSfx = Mix_LoadWAV("res/sfx/unlock_door.ogg");
+    sounds.lockedDoorSfx = Mix_LoadWAV("res/sfx/locked_door.ogg");
+    sounds.playerFootstepSfx = Mix_LoadWAV("res/sfx/player_footstep.ogg");
+    sounds.roarSfx = Mix_LoadWAV("res/sfx/monster_roar.ogg");
+    sounds.playerFinishedLevelSfx = Mix_LoadWAV("res/sfx/player_finished_level.ogg");
+    sounds.secretDoorSfx = Mix_LoadWAV("res/sfx/secret_door.ogg");
+    sounds.playerDeathSfx = Mix_LoadWAV("res/sfx/player_death.ogg");
+    Mix_VolumeChunk(sounds.roarSfx, 128);
+    Mix_VolumeChunk(sounds.playerFootstepSfx, 40);
+
+    //Create game
     EntityTemplate rubyTemplate = { .sprite=images.rubySprite, .width=16, .height=16, .spriteWidth=16, .spriteHeight=16, .type=ENTITY_TYPE_RUBY };
     EntityTemplate keyTemplate = { .sprite=images.keySprite, .width=16, .height=16, .spriteWidth=16, .spriteHeight=16, .type=ENTITY_TYPE_KEY};
     EntityTemplate monsterTemplate = { .sprite=images.monsterSprite, .width=64, .height=64, .spriteWidth=64, .spriteHeight=64, .type=ENTITY_TYPE_MONSTER};
     EntityTemplate endPortalTemplate = { .sprite=images.levelEndPortal, .width=64, .height=64, .spriteWidth=64, .spriteHeight=64, .animationSpeed=30, .type=ENTITY_TYPE_PORTAL};
 
-    //Init level
-    EntityArray entities = {0};
-    loadLevel(&entities, &player, &playerData, &rubyTemplate, &keyTemplate, &monsterTemplate, &endPortalTemplate);
+    static Game game;
+    initGame(&game, &rubyTemplate, &keyTemplate, &monsterTemplate, &endPortalTemplate, seed, startLevel);
+    game.aiBudgetMs = gameAiBudgetMs;
+    if (recordPath != NULL && !startRecording(&replay, recordPath, seed, startLevel))
+    {
+        return 1;
+    }
     //TEMP START PLAYING MUSIC
     Mix_FadeInMusic(titleMusic, -1, 1000);
 
-    bool paused = true;
-    bool shouldReloadLevel = false;
-
-    //should encapsulate in transition object
-    bool deathEffectActive = false;
-    int deathEffectCounter = 0;
-    int deathEffectDirection = 1;
-
-    float transitionFraction = 1.0f;
-    float transitionSpeed = 0.01f;
-    int transitionDirection = -1;
-    bool transitionJustFinished = false;
-    void** transitionArgs;
-    int transitionArgsLength;
-    void (*onTransitionDone)(void* args, int length);
-
-    //Setup level start transition
-    void* levelStartTransitionArgs[1] = {&paused};
-    transitionArgs = levelStartTransitionArgs;
-    transitionArgsLength = 1;
-    onTransitionDone = (void (*)(void*, int))onLevelStartTransitionEnd; //ugly function pointer cast
-
-    //Setup level end transition
-    void* levelEndTransitionArgs[] = {&playerData, &transitionArgs,
-        &levelStartTransitionArgs, &onTransitionDone,
-        onLevelStartTransitionEnd, &shouldReloadLevel, &transitionDirection, &images,
-        &screenTexture, &renderer, &spriteFont};
-
     //Get input devices' states
     SDL_Joystick* gamePad = SDL_JoystickOpen(0);
     const uint8_t* keyState = SDL_GetKeyboardState(NULL);
 
-    bool running = true;
+    //Replays and the autopilot start straight away
+    bool running = replayPath == NULL && !useAutopilot;
+    static Autopilot autopilot;
+
+    //The menu only changes where the start button bobs, so the rest is drawn
+    //once and kept, and after the first frame only the rows the button was
+    //or is on are drawn and shown
+    //MALLOC freed after the menu
+    uint32_t* menuBackground = (uint32_t*)malloc(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint32_t));
+    bool menuShown = false;
+    SDL_Rect lastButtonRect = {0, 0, 0, 0};
+
+    //Hidden or in the background, nothing is drawn and the loops wait on events
+    WindowState windowState;
+    initWindowState(&windowState, window);
 
     //Main Menu Loop (Complete hack but whatever)
     while(running) {
+        //Not looked at, nothing to animate for
+        if (!windowState.visible || !windowState.focused) waitForWindowEvent();
         int frameStartTime = SDL_GetTicks();
 
         //SDL Event Loop
@@ -364,6 +572,17 @@ int main(int argc, char* args[])
             case SDL_QUIT:
                 exit(0);
                 break;
+            case SDL_WINDOWEVENT:
+                if (updateWindowState(&windowState, &e))
+                {
+                    pauseGameAudio(!windowState.visible);
+                    menuShown = false;
+                }
+                break;
+            case SDL_RENDER_TARGETS_RESET:
+            case SDL_RENDER_DEVICE_RESET:
+                menuShown = false;
+                break;
             case SDL_KEYDOWN:
                 switch(e.key.keysym.sym)
                 {
@@ -371,6 +590,7 @@ int main(int argc, char* args[])
                         if (e.key.keysym.mod & KMOD_ALT)
                         {
                             toggleFullscreen(window);
+                            menuShown = false;
                         } else {
                             running = false;
                         }
@@ -382,50 +602,80 @@ int main(int argc, char* args[])
                 break;
             }
         }
+        if (!windowState.visible) continue;
+
+        SDL_Rect buttonRect = {2.f * sinf(SDL_GetTicks() / 600.0) + (SCREEN_WIDTH - images.mainMenuStartButton->w) / 2,
+            6.f * sinf(SDL_GetTicks() / 300.0) + (SCREEN_HEIGHT * 4) / 5, images.mainMenuStartButton->w, images.mainMenuStartButton->h};
+        if (!menuShown)
         {
-                SDL_Rect tmpRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-            blitToPixelBuffer(images.mainMenuBack, tmpRect, 0);
-        }
-        {
-                SDL_Rect tmpRect = {(SCREEN_WIDTH - images.mainMenuTitle->w) / 2,
-                SCREEN_HEIGHT / 5, images.mainMenuTitle->w, images.mainMenuTitle->h};
-            blitToPixelBuffer(images.mainMenuTitle, tmpRect, 0);
+            beginScreenFrame(&gfx, &screen);
+            {
+                    SDL_Rect tmpRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+                //The background has see through pixels, and the texture being
+                //drawn into holds anything
+                drawRect(&gfx, tmpRect, 0xFF000000);
+                blitToPixelBuffer(&gfx, images.mainMenuBack, NULL, tmpRect, 0);
+            }
+            {
+                    SDL_Rect tmpRect = {(SCREEN_WIDTH - images.mainMenuTitle->w) / 2,
+                    SCREEN_HEIGHT / 5, images.mainMenuTitle->w, images.mainMenuTitle->h};
+                blitToPixelBuffer(&gfx, images.mainMenuTitle, NULL, tmpRect, 0);
+            }
+            for (int y = 0; y < SCREEN_HEIGHT; y++)
+            {
+                memcpy(menuBackground + y * SCREEN_WIDTH, gfx.pixelBuffer.pixels + y * gfx.pixelBuffer.pitch,
+                       SCREEN_WIDTH * sizeof(uint32_t));
+            }
+            menuShown = true;
         }
+        else
         {
-                SDL_Rect tmpRect = {2.f * sinf(SDL_GetTicks() / 600.0) + (SCREEN_WIDTH - images.mainMenuStartButton->w) / 2,
-                6.f * sinf(SDL_GetTicks() / 300.0) + (SCREEN_HEIGHT * 4) / 5, images.mainMenuStartButton->w, images.mainMenuStartButton->h};
-            blitToPixelBuffer(images.mainMenuStartButton, tmpRect, 0);
+            beginScreenRows(&gfx, &screen);
+            int top = buttonRect.y < lastButtonRect.y ? buttonRect.y : lastButtonRect.y;
+            int bottom = buttonRect.y + buttonRect.h > lastButtonRect.y + lastButtonRect.h ?
+                buttonRect.y + buttonRect.h : lastButtonRect.y + lastButtonRect.h;
+            gfx.dirtyTop = top < 0 ? 0 : top;
+            gfx.dirtyBottom = bottom > SCREEN_HEIGHT ? SCREEN_HEIGHT : bottom;
+            for (int y = gfx.dirtyTop; y < gfx.dirtyBottom; y++)
+            {
+                memcpy(gfx.pixelBuffer.pixels + y * gfx.pixelBuffer.pitch, menuBackground + y * SCREEN_WIDTH,
+                       SCREEN_WIDTH * sizeof(uint32_t));
+            }
         }
+        blitToPixelBuffer(&gfx, images.mainMenuStartButton, NULL, buttonRect, 0);
+        lastButtonRect = buttonRect;
 
-        //Render the pixel buffer to the screen
-        SDL_UpdateTexture(screenTexture, NULL, getPixelBuffer()->pixels, SCREEN_WIDTH * sizeof(uint32_t));
-        SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+        //Render the frame to the screen
+        SDL_RenderCopy(renderer, endScreenFrame(&gfx, &screen), NULL, NULL);
         SDL_RenderPresent(renderer);
 
-        //Lock to 60 fps
+        //Lock to 60 fps, waitForWindowEvent() slows it when unfocused
         int delta = SDL_GetTicks() - frameStartTime;
-        if (delta < 1000/60)
+        if (windowState.focused && delta < 1000/60)
         {
             SDL_Delay(1000/60 - delta);
         }
         //currentFps = 1000/(SDL_GetTicks() - frameStartTime);
     }
+    free(menuBackground);
     Mix_FadeOutMusic(1000);
-    Mix_FadeInMusic(gameBackgroundMusic, -1, 1000);
+    Mix_FadeInMusic(sounds.gameBackgroundMusic, -1, 1000);
 
     running = true;
+    //Forget the mouse motion from the menu
+    SDL_GetRelativeMouseState(NULL, NULL);
+    //Buttons pressed since the last tick, see InputButton
+    uint16_t pressedButtons = 0;
+    double simAccumulator = 0;
+    uint64_t lastFrameCounter = SDL_GetPerformanceCounter();
     //Main Loop ====
     while(running)
     {
-        int frameStartTime = SDL_GetTicks();
+        //Hidden, or paused in the background, there is nothing new to show
+        bool idle = !windowState.visible || (!windowState.focused && game.paused);
+        if (idle) waitForWindowEvent();
+        else waitForFrameStart();
 
-        if (shouldReloadLevel)
-        {
-            Mix_HaltMusic();
-            Mix_PlayMusic(gameBackgroundMusic, -1);
-            loadLevel(&entities, &player, &playerData, &rubyTemplate, &keyTemplate, &monsterTemplate, &endPortalTemplate);
-            shouldReloadLevel = false;
-        }
         //SDL Event Loop
         SDL_Event e;
         while (SDL_PollEvent(&e))
@@ -435,468 +685,165 @@ int main(int argc, char* args[])
             case SDL_QUIT:
                 running = false;
                 break;
+            case SDL_RENDER_TARGETS_RESET:
+            case SDL_RENDER_DEVICE_RESET:
+                forgetShownFrame(&pipeline);
+                break;
+            case SDL_WINDOWEVENT:
+                //Played by hand, the game pauses when the window loses focus
+                if (e.window.event == SDL_WINDOWEVENT_FOCUS_LOST && windowState.focused &&
+                    replayPath == NULL && !useAutopilot)
+                {
+                    pressedButtons |= INPUT_PAUSE_ON;
+                }
+                if (updateWindowState(&windowState, &e))
+                {
+                    pauseGameAudio(!windowState.visible);
+                    //The screen may hold anything after being hidden, and the
+                    //time away shouldn't count as a dropped frame
+                    forgetShownFrame(&pipeline);
+                    restartFramePacer();
+                }
+                break;
+            case SDL_KEYUP:
+                noteInputEvent(e.common.timestamp);
+                break;
             case SDL_KEYDOWN:
+                noteInputEvent(e.common.timestamp);
                 switch(e.key.keysym.sym)
                 {
                     case SDLK_RETURN:
                         if (e.key.keysym.mod & KMOD_ALT)
+                        {
                             toggleFullscreen(window);
+                            forgetShownFrame(&pipeline);
+                        }
                         break;
                     case SDLK_p:
-                        paused = !paused;
+                        pressedButtons |= INPUT_PAUSE;
                         break;
                     case SDLK_ESCAPE:
                         running = false;
                         break;
-                    case SDLK_SPACE: {
-                        Vector2 actionTile = player.pos;
-                        actionTile.x += cosf(player.rotation) * TILE_DIMS;
-                        actionTile.y += sinf(player.rotation) * TILE_DIMS;
-                        actionTile = posToTileCoord(actionTile);
-
-                        char tile = getLevelTile(posVecToIndex(actionTile));
-                        if (tile == TILE_SECRET_DOOR)
-                        {
-                            setTileTo(posVecToIndex(actionTile), TILE_FLOOR);
-                            Mix_PlayChannel(-1, secretDoorSfx, 0);
-                        }
-                        else if ((tile == TILE_DOOR0 && playerData.keysCollected[0] == true) ||
-                            (tile == TILE_DOOR1 && playerData.keysCollected[1] == true) ||
-                            (tile == TILE_DOOR2 && playerData.keysCollected[2] == true) ||
-                            (tile == TILE_DOOR3 && playerData.keysCollected[3] == true))
-                        {
-                            setTileTo(posVecToIndex(actionTile), TILE_FLOOR);
-                            Mix_PlayChannel(-1, unlockDoorSfx, 0);
-                        }
-                        else if (tile == TILE_DOOR0 ||
-                            tile == TILE_DOOR1 ||
-                            tile == TILE_DOOR2 ||
-                            tile == TILE_DOOR3)
-                        {
-                            Mix_PlayChannel(-1, lockedDoorSfx, 0);
-                        }
-                    }
-                    break;
+                    case SDLK_SPACE:
+                        pressedButtons |= INPUT_USE;
+                        break;
                 }
                 break;
             case SDL_MOUSEMOTION:
-                if (paused) break;
-                player.rotation += e.motion.xrel * 0.001;
+                //Turning is read late, just before drawing, see latchMouseLook()
+                noteInputEvent(e.common.timestamp);
+                break;
             }
         }
-        if (!paused)
+        //Simulation ====
+        //The game advances in fixed ticks however long the frame took, so
+        //game speed doesn't depend on the frame rate
+        uint64_t frameCounter = SDL_GetPerformanceCounter();
+        simAccumulator += (double)(frameCounter - lastFrameCounter) / SDL_GetPerformanceFrequency();
+        lastFrameCounter = frameCounter;
+        //After a long stall drop the lost time rather than catching up all at once
+        if (simAccumulator > MAX_SIM_TICKS_PER_FRAME * SIM_TICK_SECONDS)
         {
-        //Joystick input
+            simAccumulator = MAX_SIM_TICKS_PER_FRAME * SIM_TICK_SECONDS;
+        }
+        //Hidden, the game only ticks once each time the loop wakes up
+        if (!windowState.visible && simAccumulator > SIM_TICK_SECONDS)
         {
-            const int JOYSTICK_DEAD_ZONE = 8000;
-            Vector2 oldPlayerPos = player.pos;
-            Vector2 moveVector = {0};
-            int moveVel = 4;
-            if( SDL_JoystickGetAxis(gamePad, 0) < -JOYSTICK_DEAD_ZONE )
-            {
-                moveVector.x += cosf(player.rotation - M_PI/2);
-                moveVector.y += sinf(player.rotation - M_PI/2);
-            }
-            //Right of dead zone
-            else if( SDL_JoystickGetAxis(gamePad, 0) > JOYSTICK_DEAD_ZONE )
-            {
-                moveVector.x += cosf(player.rotation + M_PI/2);
-                moveVector.y += sinf(player.rotation + M_PI/2);
-            }
-            //Left of dead zone
-            if( SDL_JoystickGetAxis(gamePad, 1) < -JOYSTICK_DEAD_ZONE )
-            {
-                moveVector.x += cosf(player.rotation);
-                moveVector.y += sinf(player.rotation);
-            }
-            //Right of dead zone
-            else if( SDL_JoystickGetAxis(gamePad, 1) > JOYSTICK_DEAD_ZONE )
-            {
-                moveVector.x += cosf(player.rotation + M_PI);
-                moveVector.y += sinf(player.rotation + M_PI);
-            }
-            //Left of dead zone
-            if( SDL_JoystickGetAxis(gamePad, 2) < -JOYSTICK_DEAD_ZONE )
-            {
-                player.rotation -= 0.04 * -SDL_JoystickGetAxis(gamePad, 2) / 32767.f;
-            }
-            //Right of dead zone
-            else if( SDL_JoystickGetAxis(gamePad, 2) > JOYSTICK_DEAD_ZONE )
-            {
-                player.rotation += 0.04 * SDL_JoystickGetAxis(gamePad, 2) / 32767.f;
-            }
-
-            //Keyboard Input
-            if (keyState[SDL_SCANCODE_A])
-            {
-                moveVector.x += cosf(player.rotation - M_PI/2);
-                moveVector.y += sinf(player.rotation - M_PI/2);
-            }
-            if (keyState[SDL_SCANCODE_D])
-            {
-                moveVector.x += cosf(player.rotation + M_PI/2);
-                moveVector.y += sinf(player.rotation + M_PI/2);
-            }
-            if (keyState[SDL_SCANCODE_S])
-            {
-                moveVector.x += cosf(player.rotation + M_PI);
-                moveVector.y += sinf(player.rotation + M_PI);
-            }
-            if (keyState[SDL_SCANCODE_W])
-            {
-                moveVector.x += cosf(player.rotation);
-                moveVector.y += sinf(player.rotation);
-            }
-            if (keyState[SDL_SCANCODE_LEFT])
-            {
-                player.rotation += 0.02;
-            }
-            if (keyState[SDL_SCANCODE_RIGHT])
-            {
-                player.rotation -= 0.02;
-            }
-            if (keyState[SDL_SCANCODE_R]) {
-                shouldReloadLevel = true;
-            }
-
-            //Normalise moveVector
-            moveVector = vec2Unit(moveVector);
-            player.pos.x += moveVector.x * moveVel;
-            player.pos.y += moveVector.y * moveVel;
-            if (moveVector.x == 0 && moveVector.y == 0)
-            {
-                //Mix_HaltChannel(player.footstepSoundChannel);
-            }
-            else if (!Mix_Playing(player.footstepSoundChannel))
-            {
-                player.footstepSoundChannel = Mix_PlayChannel(-1, playerFootstepSfx, 0);
-            }
-
-            //Collision
-            int tileIndex = posVecToTileIndex(player.pos);
-            char tile = getLevelTile(tileIndex);
-            if (isTileSolid(tileIndex))
-            {
-                player.pos = oldPlayerPos;
-            }
-            else if (tile == TILE_LEVEL_END)
-            {
-                //Load next level
-                Mix_PlayChannel(-1, playerFinishedLevelSfx, 0);
-                Mix_HaltMusic();
-                Mix_PlayMusic(levelEndMusic, -1);
-
-                onTransitionDone = (void (*)(void*, int))onLevelEndTransitionEnd;
-                transitionArgs = levelEndTransitionArgs;
-                transitionDirection = 1;
-                paused = true;
-                //playerData.levelNumber++;
-                //loadLevel(&entities, &player, &playerData, &rubyTemplate, &keyTemplate, &monsterTemplate);
-            }
+            simAccumulator = SIM_TICK_SECONDS;
         }
+        while (simAccumulator >= SIM_TICK_SECONDS && running)
+        {
+            simAccumulator -= SIM_TICK_SECONDS;
 
-        //Game Logic ====
-            //Main Entity Loop
-            for (int i = 0; i < entities.size; i++)
+            TickInput input;
+            if (replayPath != NULL)
             {
-                //Entity Collision
-                SDL_Rect playerRect = { player.pos.x - player.width / 2, player.pos.y - player.height / 2, player.width, player.height };
-                Entity *entity = &entities.data[i];
-                SDL_Rect entityRect = { entity->pos.x - entity->base->width / 2, entity->pos.y - entity->base->height / 2, entity->base->width, entity->base->height };
-
-                //update animation
-                entities.data[i].xClipCounter++;
-                if (entities.data[i].xClipCounter > entities.data[i].base->animationSpeed)
-                {
-                    entities.data[i].xClipCounter = 0;
-                    entities.data[i].xClip++;
-                    if (entities.data[i].xClip * entities.data[i].base->spriteWidth >= entities.data[i].base->width)
-                    {
-                        entities.data[i].xClip = 0;
-                    }
-                }
-
-                switch(entity->base->type)
+                if (!readReplayTick(&replay, &input))
                 {
-                case ENTITY_TYPE_RUBY:
-                    {
-                        if (rectsIntersect(playerRect, entityRect))
-                        {
-                            playerData.rubiesCollected++;
-                            //Remove entity
-                            entities.data[i] = entities.data[entities.size - 1];
-                            entities.size--;
-                            //Play SFX
-                            Mix_PlayChannel(-1, rubySfx, 0);
-                        }
-                        break;
-                    }
-                case ENTITY_TYPE_KEY:
-                    {
-                        if (rectsIntersect(playerRect, entityRect))
-                        {
-                            //TEMPORARY!
-                            playerData.keysCollected[((Key*)entities.data[i].sub)->id] = true;
-                            //Remove entity
-                            entities.data[i] = entities.data[entities.size - 1];
-                            entities.size--;
-                            //Play SFX
-                            Mix_PlayChannel(-1, keySfx, 0);
-                        }
-                        break;
-                    }
-                case ENTITY_TYPE_MONSTER:
-                    {
-                        //This should be in a function
-                        //  monster.c:
-                        //      update(void)
-                        //      {
-                        //          updateTargetTile(void);
-                        //          pathFind(void);
-                        //      }
-                        Monster* monster = (Monster*)entity->sub;
-                        /*-----------------------------
-                         *Check for aiState transitions
-                         *---------------------------*/
-
-                        if (rectsIntersect(playerRect, entityRect))
-                        {
-                            //shouldReloadLevel = true;
-                            paused = true;
-                            deathEffectActive = true;
-                            deathEffectCounter = 0;
-                            deathEffectDirection = 1;
-                            Mix_PlayChannel(-1, playerDeathSfx, 0);
-                        }
-                        /*--------------------------------
-                         *Check if monster has seen player
-                         *------------------------------*/
-                        if (distanceFormula(player.pos, entity->pos) < monsterSightRadius)
-                        {
-                            float monsterAngle = getMonsterAngle(entity);
-                            Vector2 tmp1 = { .x=player.pos.x - entity->pos.x, .y=player.pos.y - entity->pos.y};
-                            Vector2 tmp2 = {0};
-                            tmp2.x = cos(monsterAngle) * tmp1.x + sin(monsterAngle) * tmp1.y;
-                            tmp2.y = -sin(monsterAngle) * tmp1.x + cos(monsterAngle) * tmp1.y;
-                            float playerAngle = atan2(tmp2.y, tmp2.x);
-
-                            if (fabs(playerAngle) < monsterFov / 2)
-                            {
-                                /*------------------------------------
-                                 *Cast ray and check for walls between
-                                 *player and monster
-                                 *----------------------------------*/
-                                bool isWallBetween = false;
-                                {
-                                    int playerPos[] = {player.pos.x, player.pos.y};
-                                    int cursorPoint[] = {entity->pos.x, entity->pos.y};
-                                    int dif[] = {player.pos.x - entity->pos.x, player.pos.y - entity->pos.y};
-                                    int maxAxis = 1;
-                                    int minAxis = 0;
-                                    if (abs(dif[0]) > abs(dif[1]))
-                                    {
-                                        maxAxis = 0;
-                                        minAxis = 1;
-                                    }
-                                    if (dif[maxAxis] != 0)
-                                    {
-                                        float gradient = (float)dif[minAxis] / (float)dif[maxAxis];
-                                        float step = dif[maxAxis] < 0 ? - TILE_DIMS : TILE_DIMS;
-                                        do
-                                        {
-                                            int tileIndex = posToTileIndex(cursorPoint[0], cursorPoint[1]);
-                                            if (!isTileIndexValid(tileIndex)) break;
-                                            if (isTileSolid(tileIndex))
-                                            {
-                                                isWallBetween = true;
-                                                break;
-                                            }
-                                            cursorPoint[maxAxis] += step;
-                                            cursorPoint[minAxis] += step * gradient;
-                                        } while (sign(dif[maxAxis]) == sign(playerPos[maxAxis] - cursorPoint[maxAxis]));
-                                    }
-                                }
-
-                                if (!isWallBetween)
-                                {
-                                    switch(monster->aiState)
-                                    {
-                                        case AI_PATROL:
-                                        {
-                                            monster->aiState = AI_CHASE;
-                                            monster->giveUpChaseTimer.active = true;
-                                            monster->giveUpChaseTimer.endTime = SDL_GetTicks() + monsterChaseTimeLimit;
-                                            Mix_PlayChannel(-1, roarSfx, 0);
-                                            break;
-                                        }
-                                        case AI_CHASE:
-                                        {
-                                            monster->giveUpChaseTimer.endTime = SDL_GetTicks() + monsterChaseTimeLimit;
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-                            else if (monster->aiState == AI_CHASE && monster->giveUpChaseTimer.active &&
-                                monster->giveUpChaseTimer.endTime < SDL_GetTicks())
-                            {
-                                monster->aiState = AI_PATROL;
-                            }
-                        }
-
-                        /*-------------------------------------
-                         * Select target tile, based on aiState
-                         *-----------------------------------*/
-                        switch (monster->aiState)
-                        {
-                            case AI_PATROL:
-                            {
-                                if ((int)(entities.data[i].pos.x / TILE_DIMS) == monster->targetTile.x &&
-                                    (int)(entities.data[i].pos.y / TILE_DIMS) == monster->targetTile.y)
-                                {
-                                    monster->patrolIndex = (monster->patrolIndex + 1) % monster->patrolLength;
-                                    monsterMoveAStar(entity);
-                                }
-
-                                Vector2Int tmp = { .x=monster->patrolPoints[monster->patrolIndex].x,
-                                                   .y=monster->patrolPoints[monster->patrolIndex].y };
-                                monster->targetTile = tmp;
-                                break;
-                            }
-                            case AI_CHASE:
-                            {
-                                if (!Mix_Playing(monster->roarSoundChannel) && oneInXChance(60))
-                                {
-                                    monster->roarSoundChannel = Mix_PlayChannel(-1, roarSfx, 0);
-                                }
-                                Vector2Int tmp = { .x=player.pos.x / TILE_DIMS, .y=player.pos.y / TILE_DIMS};
-                                monster->targetTile = tmp;
-                                break;
-                            }
-                        }
-
-                        /*---------
-                         * Pathfind
-                         *-------*/
-                        monsterMove(&entities.data[i]);
-                        int distVolume = distanceFormula(player.pos, entity->pos) / 4;
-                        Mix_SetPosition(
-                            monster->roarSoundChannel,
-                            (constrainAngle(getMonsterAngle(entity) - player.rotation) + M_PI) * (360.0 / (2 * M_PI)),
-                            distVolume > 255 ? 255 : distVolume
-                        );
-                        break;
-                    }
-                    case ENTITY_TYPE_PORTAL:
-                        break;
+                    running = false;
+                    break;
                 }
             }
-        }
-        //Update screen fade
-        if (transitionDirection != 0)
-        {
-            //Mix_HaltChannel(player.footstepSoundChannel);
-            transitionFraction += transitionDirection * transitionSpeed;
-            if (transitionDirection > 0 && transitionFraction > 1.f)
-            {
-                transitionFraction = 1.f;
-                transitionJustFinished = true;
-            }
-            if (transitionDirection < 0 && transitionFraction < 0.f)
+            else if (useAutopilot)
             {
-                 transitionFraction = 0.f;
-                 transitionJustFinished = true;
+                //Pause and quit still work while it plays
+                input = getAutopilotInput(&autopilot, &game);
+                input.buttons |= pressedButtons;
+                pressedButtons = 0;
             }
-        }
-        if (transitionJustFinished)
-        {
-            transitionJustFinished = false;
-            transitionDirection = 0;
-            if (onTransitionDone != 0)
+            else
             {
-                (*onTransitionDone)(transitionArgs, transitionArgsLength);
-            }
-            else {
-                SDL_Log("Error: No transition function!");
+                input = readTickInput(&game, gamePad, keyState, pressedButtons);
+                pressedButtons = 0;
             }
-        }
-        //Draw ====
-        //Send game entities to gfx engine to be rendered
-        draw(player, entities);
-        //All this should be in a drawUI() function in gfx_engine.c
-        //Draw rubies collected
-        {
-            Rectangle rubyImageRect = { SCREEN_WIDTH/8 - 1.5 * images.rubySprite->w, SCREEN_HEIGHT/16 - 2, 11, 11 };
-            blitToPixelBuffer(images.rubySprite, rubyImageRect, 0);
-            char rubyCountStr[32];
-            sprintf(rubyCountStr, "%d/%d", playerData.rubiesCollected, getTotalLevelRubies());
-            SDL_Rect textRect = { SCREEN_WIDTH/8, SCREEN_HEIGHT/16, 0, 0 };
-            drawText(rubyCountStr, textRect, 0xFF7A0927, spriteFont, false);
-        }
+            tickGame(&game, &input);
+            if (replayPath != NULL) verifyReplayTick(&replay, &game);
+            if (recordPath != NULL) recordTick(&replay, &input, &game);
 
-        //Draw keys collected
-        {
-            for (int i = 0; i < MAX_KEYS; i++)
+            playGameSounds(&game, &sounds);
+            if (game.events & GAME_EVENT_LEVEL_COMPLETE)
             {
-                if (playerData.keysCollected[i] == true)
-                {
-                    Rectangle keyImageRect = { SCREEN_WIDTH/3 + i * 16, SCREEN_HEIGHT/16, 11, 11 };
-                    blitToPixelBuffer(images.keySprite, keyImageRect, keyColorsTemp[i]);
-                }
+                //The level end screen draws with the same context
+                presentFrame(renderer, &gfx, &screen, waitForFrame(&pipeline));
+                showLevelEndScreen(&game, &gfx, &screen, renderer, spriteFont);
+                forgetShownFrame(&pipeline);
+                if (game.finished) running = false;
+                //Don't try to catch up on the time the screen was up for
+                lastFrameCounter = SDL_GetPerformanceCounter();
+                simAccumulator = 0;
             }
         }
 
-        //Draw compass
-        Rectangle compassRect = { (SCREEN_WIDTH*7)/8, SCREEN_HEIGHT/8 - 8, 32, 32 };
-        rotatedBlitToPixelBuffer(images.compass, compassRect, 0, -player.rotation);
-
-        //Draw screen fade to black
+        //Draw ====
+        if (!windowState.visible)
         {
-            uint32_t fadeColour = 0x000000;
-            SDL_Rect topRect = {0, 0, SCREEN_WIDTH, (SCREEN_HEIGHT / 2) * transitionFraction};
-            SDL_Rect botRect = {0, SCREEN_HEIGHT - (SCREEN_HEIGHT / 2) * transitionFraction,
-                SCREEN_WIDTH, 1 + (SCREEN_HEIGHT / 2) * transitionFraction};
-            drawRect(topRect, fadeColour);
-            drawRect(botRect, fadeColour);
+            //Finish any frame still drawing so its texture is let go
+            presentFrame(renderer, &gfx, &screen, waitForFrame(&pipeline));
+            continue;
         }
-
-        //Draw death effect
-        if (deathEffectActive)
+        if (replayPath == NULL && !useAutopilot)
         {
-            pixelateScreen((deathEffectCounter / 3) + 1);
-            fadeToColor(0x00401010, (float)deathEffectCounter / ((SCREEN_WIDTH * 3) / 8.f));
-
-            if (deathEffectDirection == 1)
-            {
-                deathEffectCounter++;
-                if ((deathEffectCounter / 3) > SCREEN_WIDTH / 8) {
-                    deathEffectDirection = -1;
-                    shouldReloadLevel = true;
-                }
-            }
-            else
-            {
-                deathEffectCounter--;
-                if (deathEffectCounter == 1)
-                {
-                    deathEffectActive = false;
-                    paused = false;
-                }
-            }
+            //Mouse look is applied as late as possible, so the view is turned by
+            //everything the mouse did up to the moment the frame is drawn
+            float mouseTurn = latchMouseLook();
+            if (!game.paused) game.player.rotation += mouseTurn;
         }
 
-        //Render the pixel buffer to the screen
-        SDL_UpdateTexture(screenTexture, NULL, getPixelBuffer()->pixels, SCREEN_WIDTH * sizeof(uint32_t));
-        SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
-        SDL_RenderPresent(renderer);
-
-        //Lock to 60 fps
-        int delta = SDL_GetTicks() - frameStartTime;
-        if (delta < 1000/60)
+        //Send game entities to gfx engine to be rendered, part way between the
+        //last two ticks so movement is smooth at any frame rate
+        float tickFraction = simAccumulator / SIM_TICK_SECONDS;
+        Player renderPlayer = game.player;
+        renderPlayer.pos.x = game.prevPlayerPos.x + (game.player.pos.x - game.prevPlayerPos.x) * tickFraction;
+        renderPlayer.pos.y = game.prevPlayerPos.y + (game.player.pos.y - game.prevPlayerPos.y) * tickFraction;
+        FrameSnapshot* snapshot = captureFrameSnapshot(&pipeline, &game, renderPlayer, tickFraction);
+
+        //Threaded, the last frame was drawn while this one was simulated
+        presentFrame(renderer, &gfx, &screen, waitForFrame(&pipeline));
+        //Standing still or paused, only what changed is drawn and shown
+        if (snapshot->partial) beginScreenRows(&gfx, &screen);
+        else beginScreenFrame(&gfx, &screen);
+        submitFrame(&pipeline, snapshot);
+        if (!pipeline.threaded)
         {
-            SDL_Delay(1000/60 - delta);
+            presentFrame(renderer, &gfx, &screen, waitForFrame(&pipeline));
         }
-        //currentFps = 1000/(SDL_GetTicks() - frameStartTime);
     }
+    //Show the last frame drawn
+    presentFrame(renderer, &gfx, &screen, waitForFrame(&pipeline));
+    writeFramePacingReport(paceReportPath);
+    writePostEffectsReport(&pipeline.postEffects, paceReportPath);
+    if (recordPath != NULL) stopRecording(&replay);
+    if (replayPath != NULL)
+    {
+        if (replay.drifted) printf("Drifted from the recording by tick %u.\n", replay.driftTick);
+        else printf("Matched the recording for %u ticks.\n", replay.ticksRead);
+        closeReplay(&replay);
+    }
+    freeAutopilot(&autopilot);
+    freeGame(&game);
+    freeFramePipeline(&pipeline);
+    freeGfxContext(&gfx);
+    freeScreenTextures(&screen);
     return 0;
 }
@@ -7,10 +7,13 @@
 #include "load_level.h"
 #include "linked_list.h"
 
-float getMonsterAngle(Entity* this)
+
+static const float monsterVel = 2.f;
+
+float getMonsterAngle(const Monster* this)
 {
     float monsterAngle = 0.f;
-    switch(((Monster*)this->sub)->direction)
+    switch(this->direction)
     {
     case DIR_DOWN:
         monsterAngle = M_PI/2;
@@ -27,40 +30,38 @@ float getMonsterAngle(Entity* this)
     return monsterAngle;
 }
 
-void monsterMove(Entity* this)
+void monsterMove(Monster* this, const Level* level, Vector2* pos)
 {
-    Monster* monster = (Monster*)this->sub;
-    if (monster->pathList.front == NULL)
+    if (this->pathList.front == NULL)
     {
-        monsterMoveAStar(this);
-        if (monster->pathList.front == NULL)
+        monsterMoveAStar(this, level, *pos);
+        if (this->pathList.front == NULL)
         {
             return;
         }
     }
 
-    Vector2Int targetTile = {monster->pathList.front->tile.x, monster->pathList.front->tile.y};
+    Vector2Int targetTile = {this->pathList.front->tile.x, this->pathList.front->tile.y};
     Vector2 dirOffsets[5] = { {0}, { .y=-1 }, { .y=1 }, { .x=-1 }, { .x=1 } };
 
     //Store old center to check whether center of tile was crossed.
     Vector2Int oldTileByCenter = {
-        .x=this->pos.x / TILE_DIMS + 0.5,
-        .y=this->pos.y / TILE_DIMS + 0.5 };
+        .x=pos->x / TILE_DIMS + 0.5,
+        .y=pos->y / TILE_DIMS + 0.5 };
 
     //Move in current direction
-    float monsterVel = 2.f;
-    this->pos.x += monsterVel * dirOffsets[((Monster*)this->sub)->direction].x;
-    this->pos.y += monsterVel * dirOffsets[((Monster*)this->sub)->direction].y;
+    pos->x += monsterVel * dirOffsets[this->direction].x;
+    pos->y += monsterVel * dirOffsets[this->direction].y;
 
     //Did monster cross tile centre?
     Vector2Int newTileByCenter = {
-        .x=this->pos.x / TILE_DIMS + 0.5,
-        .y=this->pos.y / TILE_DIMS + 0.5 };
+        .x=pos->x / TILE_DIMS + 0.5,
+        .y=pos->y / TILE_DIMS + 0.5 };
     bool crossedCenter = oldTileByCenter.x != newTileByCenter.x || oldTileByCenter.y != newTileByCenter.y;
 
-    if (((Monster*)this->sub)->direction == DIR_NONE || crossedCenter)
+    if (this->direction == DIR_NONE || crossedCenter)
     {
-        Vector2 curTile = posToTileCoord(this->pos);
+        Vector2 curTile = posToTileCoord(*pos);
         float minDistance = FLT_MAX;
 
         for (int i = DIR_UP; i <= DIR_RIGHT; i++)
@@ -68,7 +69,7 @@ void monsterMove(Entity* this)
             Vector2 consideringTile = {
                 .x=curTile.x + dirOffsets[i].x,
                 .y=curTile.y + dirOffsets[i].y };
-            if (isTileSolid(posVecToIndex(consideringTile)))
+            if (isTileSolid(level, posVecToIndex(level, consideringTile)))
             {
                 continue;
             }
@@ -77,29 +78,64 @@ void monsterMove(Entity* this)
             if (distance < minDistance)
             {
                 minDistance = distance;
-                ((Monster*)this->sub)->direction = i; // THIS IS A BIT DANGEROUS
+                this->direction = i; // THIS IS A BIT DANGEROUS
             }
         }
     }
 
-    if ((int)(this->pos.x / TILE_DIMS) == targetTile.x &&
-        (int)(this->pos.y / TILE_DIMS) == targetTile.y)
+    if ((int)(pos->x / TILE_DIMS) == targetTile.x &&
+        (int)(pos->y / TILE_DIMS) == targetTile.y)
     {
-        linkedListRemoveFront(&monster->pathList);
-        monsterMoveAStar(this);
+        linkedListRemoveFront(&this->pathList);
+        monsterMoveAStar(this, level, *pos);
     }
 }
 
-bool isValidTileForPath(int x, int y)
+//Where a monster's next step in its current direction takes it
+static Vector2 getMonsterStep(const Monster* this, Vector2 pos)
+{
+    Vector2 dirOffsets[5] = { {0}, { .y=-1 }, { .y=1 }, { .x=-1 }, { .x=1 } };
+    Vector2 newPos = {
+        .x=pos.x + monsterVel * dirOffsets[this->direction].x,
+        .y=pos.y + monsterVel * dirOffsets[this->direction].y };
+    return newPos;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A monster and where it is.
+ * Output: False if the monster has no direction yet, or its next step crosses
+ *         a tile centre. That is where monsterMove() turns and follows the
+ *         path, so the step needs a full update.
+ *----------------------------------------------------------------------------*/
+bool canMonsterExtrapolate(const Monster* this, Vector2 pos)
+{
+    if (this->direction == DIR_NONE) return false;
+    Vector2 newPos = getMonsterStep(this, pos);
+    return (int)(pos.x / TILE_DIMS + 0.5) == (int)(newPos.x / TILE_DIMS + 0.5) &&
+           (int)(pos.y / TILE_DIMS + 0.5) == (int)(newPos.y / TILE_DIMS + 0.5);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A monster that isn't getting a full update this frame, which
+ *        canMonsterExtrapolate() allows.
+ * Description: Keeps the monster walking the way it was already going, at
+ *              the same speed as monsterMove().
+ *----------------------------------------------------------------------------*/
+void monsterExtrapolate(const Monster* this, Vector2* pos)
+{
+    *pos = getMonsterStep(this, *pos);
+}
+
+bool isValidTileForPath(const Level* level, int x, int y)
 {
-    int tileIndex = posToTileIndex(x, y);
-    if (isTileIndexValid(tileIndex) && !isTileSolid(tileIndex)) return true;
+    int tileIndex = posToTileIndex(level, x, y);
+    if (isTileIndexValid(level, tileIndex) && !isTileSolid(level, tileIndex)) return true;
     return false;
 }
 
-float generateHeuristic(PathTile pathTile, Vector2Int target, Entity* monster)
+float generateHeuristic(PathTile pathTile, Vector2Int target, Vector2 monsterPos)
 {
-    float f = fabsf(pathTile.x - monster->pos.x) + fabsf(pathTile.y - monster->pos.y);
+    float f = fabsf(pathTile.x - monsterPos.x) + fabsf(pathTile.y - monsterPos.y);
     float g = fabsf(pathTile.x - (float)target.x) + fabsf(pathTile.y - (float)target.y);
     return f + 2 * g;
 }
@@ -110,16 +146,16 @@ bool reachedPlayer(ListNode* current, Vector2Int target)
             current->tile.y == target.y);
 }
 
-void monsterMoveAStar(Entity* this)
+void monsterMoveAStar(Monster* this, const Level* level, Vector2 pos)
 {
     LinkedList searchTiles = {0};
     LinkedList removedTiles = {0};
     LinkedList finalPath = {0};
-    Vector2 thisTile = posToTileCoord(this->pos);
-    Vector2Int target = ((Monster*)this->sub)->targetTile;
+    Vector2 thisTile = posToTileCoord(pos);
+    Vector2Int target = this->targetTile;
 
-    if ((int)(this->pos.x / TILE_DIMS) == target.x &&
-        (int)(this->pos.y / TILE_DIMS) == target.y)
+    if ((int)(pos.x / TILE_DIMS) == target.x &&
+        (int)(pos.y / TILE_DIMS) == target.y)
     {
         return;
     }
@@ -131,9 +167,9 @@ void monsterMoveAStar(Entity* this)
 
     for (int i = 0; i < 4; i++)
     {
-        if (!isTileSolid(coordToTileIndex(nearMon[i].x, nearMon[i].y)))
+        if (!isTileSolid(level, coordToTileIndex(level, nearMon[i].x, nearMon[i].y)))
         {
-            nearMon[i].heuristic = generateHeuristic(nearMon[i], target, this);
+            nearMon[i].heuristic = generateHeuristic(nearMon[i], target, pos);
             linkedListMinPriorityAdd(&searchTiles, nearMon[i]);
         }
     }
@@ -154,9 +190,9 @@ void monsterMoveAStar(Entity* this)
         {
             if (!linkedListContainsTile(&searchTiles, nearMonCur[i]) &&
                 !linkedListContainsTile(&removedTiles, nearMonCur[i]) &&
-                !isTileSolid(coordToTileIndex(nearMonCur[i].x, nearMonCur[i].y)))
+                !isTileSolid(level, coordToTileIndex(level, nearMonCur[i].x, nearMonCur[i].y)))
             {
-                nearMonCur[i].heuristic = generateHeuristic(nearMonCur[i], target, this);
+                nearMonCur[i].heuristic = generateHeuristic(nearMonCur[i], target, pos);
                 linkedListMinPriorityAdd(&searchTiles, nearMonCur[i]);
             }
         }
@@ -182,7 +218,7 @@ void monsterMoveAStar(Entity* this)
         }
     }
 
-    ((Monster*)this->sub)->pathList = finalPath;
+    this->pathList = finalPath;
 
     // NEED TO DELETE LINKED LISTS
 }
\ No newline at end of file
@@ -37,7 +37,7 @@ typedef enum
 typedef struct
 {
     Direction direction;
-    Vector2Int* patrolPoints;
+    int patrolStart;            //Index of its first point in MonsterPool.patrolPoints
     int patrolLength;
     int patrolIndex;
     Vector2Int targetTile;
@@ -45,8 +45,12 @@ typedef struct
     AIMode aiState;
     CountdownTimer giveUpChaseTimer;
     int roarSoundChannel;
+    bool mayRoar;               //Chasing and won this tick's roll to roar
+    int framesSinceThink;
 } Monster;
 
-float getMonsterAngle(Entity* this);
-void monsterMove(Entity* this);
-void monsterMoveAStar(Entity* this);
\ No newline at end of file
+float getMonsterAngle(const Monster* this);
+void monsterMove(Monster* this, const Level* level, Vector2* pos);
+bool canMonsterExtrapolate(const Monster* this, Vector2 pos);
+void monsterExtrapolate(const Monster* this, Vector2* pos);
+void monsterMoveAStar(Monster* this, const Level* level, Vector2 pos);
\ No newline at end of file
@@ -0,0 +1,206 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "monster_sim.h"
+#include "monster.h"
+#include "load_level.h"
+#include "visibility.h"
+#include "perception.h"
+#include "ai_scheduler.h"
+#include "job_pool.h"
+#include "spatial_grid.h"
+
+
+static void reserveMonsterSim(MonsterSim* sim, int monsterCount)
+{
+    if (monsterCount <= sim->capacity) return;
+    //MALLOC reused every frame, freed by freeMonsterSim()
+    sim->capacity = monsterCount * 2;
+    sim->thinks = (bool*)realloc(sim->thinks, sim->capacity * sizeof(bool));
+    sim->events = (uint8_t*)realloc(sim->events, sim->capacity * sizeof(uint8_t));
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Sight check and aiState transitions for one monster.
+ *----------------------------------------------------------------------------*/
+static uint8_t updateMonsterSight(Monster* monster, Vector2 pos, int monsterIndex, const MonsterSimFrame* frame)
+{
+    uint8_t events = 0;
+
+    PerceptionResult perceived = getMonsterPerception(frame->perception, monsterIndex);
+    if (perceived == PERCEPTION_OUT_OF_RANGE) return events;
+
+    if (perceived == PERCEPTION_IN_FOV)
+    {
+        if (hasLineOfSight(frame->level, pos, frame->playerPos))
+        {
+            switch(monster->aiState)
+            {
+                case AI_PATROL:
+                {
+                    monster->aiState = AI_CHASE;
+                    monster->giveUpChaseTimer.active = true;
+                    monster->giveUpChaseTimer.endTime = frame->now + frame->chaseTimeLimit;
+                    events |= MONSTER_EVENT_SPOTTED_PLAYER;
+                    break;
+                }
+                case AI_CHASE:
+                {
+                    monster->giveUpChaseTimer.endTime = frame->now + frame->chaseTimeLimit;
+                    break;
+                }
+            }
+        }
+    }
+    else if (monster->aiState == AI_CHASE && monster->giveUpChaseTimer.active &&
+        monster->giveUpChaseTimer.endTime < frame->now)
+    {
+        monster->aiState = AI_PATROL;
+    }
+    return events;
+}
+
+static void updateMonster(MonsterSim* sim, int monsterIndex)
+{
+    const MonsterSimFrame* frame = sim->frame;
+    Monster* monster = &sim->monsters->monsters[monsterIndex];
+    Vector2* pos = &sim->monsters->pos[monsterIndex];
+    uint8_t events = 0;
+
+    //Far away monsters only think every few frames and keep walking the way
+    //they were going in between
+    if (!sim->thinks[monsterIndex])
+    {
+        monsterExtrapolate(monster, pos);
+        sim->events[monsterIndex] = events;
+        return;
+    }
+    events |= MONSTER_EVENT_THOUGHT;
+    events |= updateMonsterSight(monster, *pos, monsterIndex, frame);
+
+    /*-------------------------------------
+     * Select target tile, based on aiState
+     *-----------------------------------*/
+    switch (monster->aiState)
+    {
+        case AI_PATROL:
+        {
+            if ((int)(pos->x / TILE_DIMS) == monster->targetTile.x &&
+                (int)(pos->y / TILE_DIMS) == monster->targetTile.y)
+            {
+                monster->patrolIndex = (monster->patrolIndex + 1) % monster->patrolLength;
+                monsterMoveAStar(monster, frame->level, *pos);
+            }
+
+            Vector2Int* patrolPoints = sim->monsters->patrolPoints + monster->patrolStart;
+            Vector2Int tmp = { .x=patrolPoints[monster->patrolIndex].x,
+                               .y=patrolPoints[monster->patrolIndex].y };
+            monster->targetTile = tmp;
+            break;
+        }
+        case AI_CHASE:
+        {
+            events |= MONSTER_EVENT_CHASING;
+            Vector2Int tmp = { .x=frame->playerPos.x / TILE_DIMS, .y=frame->playerPos.y / TILE_DIMS};
+            monster->targetTile = tmp;
+            break;
+        }
+    }
+
+    /*---------
+     * Pathfind
+     *-------*/
+    monsterMove(monster, frame->level, pos);
+    sim->events[monsterIndex] = events;
+}
+
+static void monsterSimJob(void* data, int begin, int end)
+{
+    MonsterSim* sim = (MonsterSim*)data;
+    for (int i = begin; i < end; i++)
+    {
+        updateMonster(sim, i);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      MonsterSim* sim: The game's sim, keeps the per monster results.
+ *      MonsterPool* monsters: The monsters to update.
+ *      const MonsterSimFrame* frame: The frozen state monsters may read.
+ * Description:
+ *      Updates every monster. Works out which monsters think this frame and
+ *      prepares the shared caches on this thread, then runs the updates as
+ *      parallel jobs, and finally moves the monsters in the spatial grid.
+ *      Sounds and the like are not applied here, read them back with
+ *      getMonsterSimEvents() in monster order. The result is the same as
+ *      updating the monsters one after another.
+ *      runMonsterPerception() must already have been run on monsters with
+ *      frame->perception.
+ *----------------------------------------------------------------------------*/
+void runMonsterSim(MonsterSim* sim, MonsterPool* monsters, const MonsterSimFrame* frame)
+{
+    reserveMonsterSim(sim, monsters->count);
+    sim->monsters = monsters;
+    sim->frame = frame;
+
+    beginAIFrame(&sim->scheduler, frame->aiBudgetMs);
+    int thinkCount = 0;
+    for (int i = 0; i < monsters->count; i++)
+    {
+        bool thinks = shouldMonsterThink(&sim->scheduler, &monsters->monsters[i], monsters->pos[i], frame->playerPos);
+        if (thinks)
+        {
+            //Lazily built rows must not be built from inside the jobs
+            prepareVisibilityRow(frame->level, posVecToTileIndex(frame->level, monsters->pos[i]));
+            thinkCount++;
+        }
+        sim->thinks[i] = thinks;
+    }
+
+    uint64_t startCounter = SDL_GetPerformanceCounter();
+    if (monsters->count < MONSTER_SIM_PARALLEL_MIN)
+    {
+        monsterSimJob(sim, 0, monsters->count);
+    }
+    else
+    {
+        runParallelFor(monsterSimJob, sim, monsters->count, MONSTER_SIM_BATCH_SIZE);
+    }
+    double elapsedMs = (SDL_GetPerformanceCounter() - startCounter) * 1000.0 / SDL_GetPerformanceFrequency();
+    endAIFrame(&sim->scheduler, thinkCount, elapsedMs);
+
+    for (int i = 0; i < monsters->count; i++)
+    {
+        moveSpatialGridEntity(&monsters->grid, monsters->pos, i);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The sim and a monster index from the last runMonsterSim() with it.
+ * Output: The MonsterEvent flags that monster raised.
+ *----------------------------------------------------------------------------*/
+uint8_t getMonsterSimEvents(const MonsterSim* sim, int monsterIndex)
+{
+    return sim->events[monsterIndex];
+}
+
+void freeMonsterSim(MonsterSim* sim)
+{
+    free(sim->thinks);
+    free(sim->events);
+    memset(sim, 0, sizeof(MonsterSim));
+}
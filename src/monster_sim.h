@@ -0,0 +1,67 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "engine_types.h"
+#include "entity_pools.h"
+#include "perception.h"
+#include "ai_scheduler.h"
+
+
+/*------------------------------------------------------------------------------
+ * Everything a monster update may read about the world besides itself. It is
+ * filled in once before the update and not touched until every monster is
+ * done.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    Level* level;
+    const PerceptionBuffers* perception;    //Already run on the monsters
+    Vector2 playerPos;
+    uint32_t now;
+    float chaseTimeLimit;
+    float aiBudgetMs;
+} MonsterSimFrame;
+
+//Side effects of a monster update, applied by the caller afterwards
+typedef enum
+{
+    MONSTER_EVENT_SPOTTED_PLAYER = 1 << 0,  //Just started chasing, should roar
+    MONSTER_EVENT_CHASING        = 1 << 1,  //May roar now and then
+    MONSTER_EVENT_THOUGHT        = 1 << 2   //Had a full update, refresh its audio
+} MonsterEvent;
+
+//Monsters updated together in one job
+#define MONSTER_SIM_BATCH_SIZE 16
+//Below this many monsters waking the workers costs more than it saves
+#define MONSTER_SIM_PARALLEL_MIN 64
+
+/*------------------------------------------------------------------------------
+ * Monster updates run as jobs over batches of monsters. Each job only writes
+ * the monsters it was given and their slots in events, and only reads the
+ * frozen MonsterSimFrame, the level tiles and results computed before the
+ * jobs start, so the outcome is the same whichever thread runs which batch.
+ * One per game, a zeroed sim is ready to use.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    MonsterPool* monsters;
+    const MonsterSimFrame* frame;
+
+    int capacity;
+    bool* thinks;           //Per monster, does it get a full update this frame
+    uint8_t* events;        //Per monster, MonsterEvent flags
+    AIScheduler scheduler;
+} MonsterSim;
+
+
+void    runMonsterSim       (MonsterSim* sim, MonsterPool* monsters, const MonsterSimFrame* frame);
+uint8_t getMonsterSimEvents (const MonsterSim* sim, int monsterIndex);
+void    freeMonsterSim      (MonsterSim* sim);
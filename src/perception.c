@@ -0,0 +1,179 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "perception.h"
+#include "monster.h"
+
+
+//Unit facing vectors for each Direction, matching getMonsterAngle()
+static const float directionFacingX[5] = { 1.f, 0.f, 0.f, -1.f, 1.f };
+static const float directionFacingY[5] = { 0.f, -1.f, 1.f, 0.f, 0.f };
+
+
+static void reservePerceptionBuffers(PerceptionBuffers* perception, int nearbyCount, int monsterCount)
+{
+    if (monsterCount < 1) monsterCount = 1;
+    //Round up to a whole number of SIMD lanes so the pass never needs a tail
+    int paddedCount = (nearbyCount + 3) & ~3;
+    if (paddedCount > perception->capacity)
+    {
+        //MALLOC reused every frame, freed by freePerceptionBuffers()
+        perception->capacity = paddedCount * 2;
+        perception->posX        = (float*)realloc(perception->posX,        perception->capacity * sizeof(float));
+        perception->posY        = (float*)realloc(perception->posY,        perception->capacity * sizeof(float));
+        perception->facingX     = (float*)realloc(perception->facingX,     perception->capacity * sizeof(float));
+        perception->facingY     = (float*)realloc(perception->facingY,     perception->capacity * sizeof(float));
+        perception->monsterIndex = (int*) realloc(perception->monsterIndex, perception->capacity * sizeof(int));
+    }
+    if (monsterCount > perception->resultCapacity)
+    {
+        perception->resultCapacity = monsterCount * 2;
+        perception->results = (uint8_t*)realloc(perception->results, perception->resultCapacity);
+    }
+}
+
+static void gatherMonsters(PerceptionBuffers* perception, const MonsterPool* monsters,
+                           const EntityIndexList* nearby)
+{
+    reservePerceptionBuffers(perception, nearby->count, monsters->count);
+    memset(perception->results, PERCEPTION_OUT_OF_RANGE, monsters->count);
+
+    perception->count = 0;
+    for (int n = 0; n < nearby->count; n++)
+    {
+        int i = nearby->indices[n];
+        Direction direction = monsters->monsters[i].direction;
+        perception->posX[perception->count] = monsters->pos[i].x;
+        perception->posY[perception->count] = monsters->pos[i].y;
+        perception->facingX[perception->count] = directionFacingX[direction];
+        perception->facingY[perception->count] = directionFacingY[direction];
+        perception->monsterIndex[perception->count] = i;
+        perception->count++;
+    }
+
+    //Padding lanes sit far away so they always fail the range test
+    for (int i = perception->count; i < ((perception->count + 3) & ~3); i++)
+    {
+        perception->posX[i] = perception->posY[i] = 1e18f;
+        perception->facingX[i] = 1.f;
+        perception->facingY[i] = 0.f;
+        perception->monsterIndex[i] = -1;
+    }
+}
+
+static void storeResult(PerceptionBuffers* perception, int lane, bool inRange, bool inFov)
+{
+    int monsterIndex = perception->monsterIndex[lane];
+    if (monsterIndex < 0 || !inRange) return;
+    perception->results[monsterIndex] = inFov ? PERCEPTION_IN_FOV : PERCEPTION_IN_RANGE;
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      PerceptionBuffers* perception: Where to work and keep the results, may
+ *          be zeroed.
+ *      const MonsterPool* monsters: All monsters.
+ *      const EntityIndexList* nearby: The monsters within sightRadius of the
+ *          player, the rest are out of range.
+ *      Vector2 playerPos: Where the player is.
+ *      float sightRadius: How far a monster can see.
+ *      float fov: The full angle of a monster's view cone, in radians.
+ * Description:
+ *      Works out for every monster whether the player is in sight range and
+ *      inside its view cone. Works in squared distances and dot products, so
+ *      there is no sqrt or atan2: the player at offset d is inside a cone of
+ *      half angle a around facing f when f.d >= |d|cos(a), which for a < pi/2
+ *      is f.d > 0 && (f.d)^2 > cos(a)^2 |d|^2. Only monsters that pass need
+ *      the more expensive line of sight check.
+ *----------------------------------------------------------------------------*/
+void runMonsterPerception(PerceptionBuffers* perception, const MonsterPool* monsters,
+                          const EntityIndexList* nearby, Vector2 playerPos, float sightRadius, float fov)
+{
+    gatherMonsters(perception, monsters, nearby);
+
+    float cosHalfFov = cosf(fov / 2);
+    float radiusSquared = sightRadius * sightRadius;
+    float cosHalfFovSquared = cosHalfFov * cosHalfFov;
+    //A cone wider than a half plane accepts everything the narrow cone test
+    //rejects, except the points behind it.
+    bool wideCone = cosHalfFov < 0;
+    int laneCount = (perception->count + 3) & ~3;
+
+#ifdef __SSE2__
+    const __m128 playerX = _mm_set1_ps(playerPos.x);
+    const __m128 playerY = _mm_set1_ps(playerPos.y);
+    const __m128 radius2 = _mm_set1_ps(radiusSquared);
+    const __m128 cos2 = _mm_set1_ps(cosHalfFovSquared);
+    const __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < laneCount; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(playerX, _mm_loadu_ps(perception->posX + i));
+        __m128 dy = _mm_sub_ps(playerY, _mm_loadu_ps(perception->posY + i));
+        __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 dot = _mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(perception->facingX + i)),
+                                _mm_mul_ps(dy, _mm_loadu_ps(perception->facingY + i)));
+
+        __m128 inRange = _mm_cmplt_ps(dist2, radius2);
+        __m128 inFront = _mm_cmpgt_ps(dot, zero);
+        __m128 dot2 = _mm_mul_ps(dot, dot);
+        __m128 inCone = wideCone ?
+            _mm_or_ps(inFront, _mm_cmplt_ps(dot2, _mm_mul_ps(cos2, dist2))) :
+            _mm_and_ps(inFront, _mm_cmpgt_ps(dot2, _mm_mul_ps(cos2, dist2)));
+        //Standing right on the monster counts as being seen
+        inCone = _mm_or_ps(inCone, _mm_cmpeq_ps(dist2, zero));
+
+        int rangeMask = _mm_movemask_ps(inRange);
+        int fovMask = _mm_movemask_ps(inCone);
+        if (rangeMask == 0) continue;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            storeResult(perception, i + lane, rangeMask >> lane & 1, fovMask >> lane & 1);
+        }
+    }
+#else
+    for (int i = 0; i < laneCount; i++)
+    {
+        float dx = playerPos.x - perception->posX[i];
+        float dy = playerPos.y - perception->posY[i];
+        float dist2 = dx * dx + dy * dy;
+        float dot = dx * perception->facingX[i] + dy * perception->facingY[i];
+        bool inCone = wideCone ?
+            (dot > 0 || dot * dot < cosHalfFovSquared * dist2) :
+            (dot > 0 && dot * dot > cosHalfFovSquared * dist2);
+        storeResult(perception, i, dist2 < radiusSquared, inCone || dist2 == 0);
+    }
+#endif
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The buffers and the index of a monster in the MonsterPool last
+ *        passed to runMonsterPerception() with them.
+ * Output: What that monster could perceive of the player.
+ *----------------------------------------------------------------------------*/
+PerceptionResult getMonsterPerception(const PerceptionBuffers* perception, int monsterIndex)
+{
+    return (PerceptionResult)perception->results[monsterIndex];
+}
+
+void freePerceptionBuffers(PerceptionBuffers* perception)
+{
+    free(perception->posX);
+    free(perception->posY);
+    free(perception->facingX);
+    free(perception->facingY);
+    free(perception->monsterIndex);
+    free(perception->results);
+    memset(perception, 0, sizeof(PerceptionBuffers));
+}
@@ -0,0 +1,47 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "engine_types.h"
+#include "spatial_grid.h"
+#include "entity_pools.h"
+
+
+typedef enum
+{
+    PERCEPTION_OUT_OF_RANGE,
+    PERCEPTION_IN_RANGE,    //Close enough to see the player, but facing away
+    PERCEPTION_IN_FOV       //Player is inside the monster's view cone
+} PerceptionResult;
+
+/*------------------------------------------------------------------------------
+ * Monster positions and facings are gathered into structure-of-arrays buffers
+ * so the range and view cone tests can be done four monsters at a time.
+ * results is indexed by monster pool index. One set per game.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    int capacity;
+    int count;
+    float* posX;
+    float* posY;
+    float* facingX;
+    float* facingY;
+    int* monsterIndex;
+
+    int resultCapacity;
+    uint8_t* results;
+} PerceptionBuffers;
+
+
+void             runMonsterPerception (PerceptionBuffers* perception, const MonsterPool* monsters,
+                                       const EntityIndexList* nearby, Vector2 playerPos,
+                                       float sightRadius, float fov);
+PerceptionResult getMonsterPerception (const PerceptionBuffers* perception, int monsterIndex);
+void             freePerceptionBuffers(PerceptionBuffers* perception);
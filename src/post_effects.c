@@ -0,0 +1,381 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "post_effects.h"
+#include "render_kernels.h"
+
+
+static const char* passNames[POST_PASS_COUNT] = { "screen", "chroma", "scanlines", "vignette", "palette" };
+
+
+static FadeWeights getFadeWeights(uint32_t fadeColor, float ratio)
+{
+    if (ratio < 0) ratio = 0;
+    if (ratio > 1) ratio = 1;
+    uint16_t weight = (uint16_t)(ratio * 256 + 0.5f);
+    FadeWeights fade = { .keep=256 - weight };
+    for (int i = 0; i < 4; i++)
+    {
+        fade.add[i] = ((fadeColor >> i * 8) & 0xFF) * weight;
+    }
+    return fade;
+}
+
+static void fillRow(uint32_t* row, int count, uint32_t color)
+{
+    if (color == 0)
+    {
+        memset(row, 0, count * sizeof(uint32_t));
+        return;
+    }
+    for (int x = 0; x < count; x++) row[x] = color;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The context whose pixel buffer holds the frame, the effects and the
+ *        rows to apply them to, from firstRow up to endRow.
+ * Description: Draws the black transition bars, pixelates and fades in a
+ *              single pass down the frame. Pixelation takes each block's
+ *              colour from its top left pixel, so the top row of a band of
+ *              blocks is pixelated and faded once into the context's
+ *              scratch row, which is then copied to every row of the band.
+ *              A band's top row is read even when it is above firstRow.
+ *              Rows no effect touches are left alone.
+ *----------------------------------------------------------------------------*/
+void applyPostEffects(GfxContext* gfx, const PostEffects* effects, int firstRow, int endRow)
+{
+    PixelBuffer* buffer = &gfx->pixelBuffer;
+    int width = buffer->width;
+    int height = buffer->height;
+    if (firstRow < 0) firstRow = 0;
+    if (endRow > height) endRow = height;
+    int blockSize = effects->pixelateSize > 1 ? effects->pixelateSize : 1;
+    bool fading = effects->fadeRatio > 0;
+    FadeWeights fade = getFadeWeights(effects->fadeColor, effects->fadeRatio);
+    const RenderKernels* kernels = getRenderKernels();
+    //Black faded like everything else
+    uint32_t barColor = 0;
+    if (fading) kernels->fadeRow(&barColor, 1, &fade);
+
+    //Worked out the same way drawRect() was given them, so the bars don't move
+    int topBarEnd = (height / 2) * effects->transitionFraction;
+    int bottomBarStart = height - (height / 2) * effects->transitionFraction;
+
+    if (blockSize == 1)
+    {
+        for (int y = firstRow; y < endRow; y++)
+        {
+            uint32_t* row = buffer->pixels + y * buffer->pitch;
+            if (y < topBarEnd || y >= bottomBarStart) fillRow(row, width, barColor);
+            else if (fading) kernels->fadeRow(row, width, &fade);
+        }
+        return;
+    }
+
+    uint32_t* scratch = gfx->scratchRow;
+    for (int bandY = firstRow - firstRow % blockSize; bandY < endRow; bandY += blockSize)
+    {
+        if (bandY < topBarEnd || bandY >= bottomBarStart)
+        {
+            fillRow(scratch, width, barColor);
+        }
+        else
+        {
+            const uint32_t* source = buffer->pixels + bandY * buffer->pitch;
+            for (int blockX = 0; blockX < width; blockX += blockSize)
+            {
+                int blockEnd = blockX + blockSize < width ? blockX + blockSize : width;
+                uint32_t color = source[blockX];
+                for (int x = blockX; x < blockEnd; x++) scratch[x] = color;
+            }
+            if (fading) kernels->fadeRow(scratch, width, &fade);
+        }
+        int bandStart = bandY > firstRow ? bandY : firstRow;
+        int bandEnd = bandY + blockSize < endRow ? bandY + blockSize : endRow;
+        for (int y = bandStart; y < bandEnd; y++)
+        {
+            memcpy(buffer->pixels + y * buffer->pitch, scratch, width * sizeof(uint32_t));
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * The retro effects. Each works along a row with no branches per pixel, so
+ * the SIMD loops and the scalar tails do the same thing.
+ *----------------------------------------------------------------------------*/
+
+//Red comes from shift pixels to the right and blue from shift to the left,
+//source is a copy of the row
+static void chromaShiftRow(uint32_t* row, const uint32_t* source, int count, int shift)
+{
+    int x = 0;
+    //Near the edges the shifted pixel is clamped to the row
+    int middleStart = shift < count ? shift : count;
+    int middleEnd = count - shift > middleStart ? count - shift : middleStart;
+    for (; x < middleStart; x++)
+    {
+        int right = x + shift < count ? x + shift : count - 1;
+        row[x] = (source[right] & 0x00FF0000) | (source[x] & 0xFF00FF00) | (source[0] & 0x000000FF);
+    }
+#ifdef __SSE2__
+    const __m128i redMask = _mm_set1_epi32(0x00FF0000);
+    const __m128i greenMask = _mm_set1_epi32(0xFF00FF00);
+    const __m128i blueMask = _mm_set1_epi32(0x000000FF);
+    for (; x + 4 <= middleEnd; x += 4)
+    {
+        __m128i red = _mm_and_si128(_mm_loadu_si128((const __m128i*)(source + x + shift)), redMask);
+        __m128i green = _mm_and_si128(_mm_loadu_si128((const __m128i*)(source + x)), greenMask);
+        __m128i blue = _mm_and_si128(_mm_loadu_si128((const __m128i*)(source + x - shift)), blueMask);
+        _mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(_mm_or_si128(red, green), blue));
+    }
+#endif
+    for (; x < middleEnd; x++)
+    {
+        row[x] = (source[x + shift] & 0x00FF0000) | (source[x] & 0xFF00FF00) | (source[x - shift] & 0x000000FF);
+    }
+    for (; x < count; x++)
+    {
+        int left = x - shift >= 0 ? x - shift : 0;
+        row[x] = (source[count - 1] & 0x00FF0000) | (source[x] & 0xFF00FF00) | (source[left] & 0x000000FF);
+    }
+}
+
+//Scales every channel by the column's weight and then the row's
+static void vignetteRow(uint32_t* row, int count, const uint16_t* columns, uint16_t rowWeight)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rowWeights = _mm_set1_epi16(rowWeight);
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+        lo = _mm_srli_epi16(_mm_mullo_epi16(lo, _mm_loadu_si128((const __m128i*)(columns + x * 4))), 8);
+        hi = _mm_srli_epi16(_mm_mullo_epi16(hi, _mm_loadu_si128((const __m128i*)(columns + x * 4 + 8))), 8);
+        lo = _mm_srli_epi16(_mm_mullo_epi16(lo, rowWeights), 8);
+        hi = _mm_srli_epi16(_mm_mullo_epi16(hi, rowWeights), 8);
+        _mm_storeu_si128((__m128i*)(row + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < count; x++)
+    {
+        uint32_t out = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t channel = (((row[x] >> i * 8) & 0xFF) * columns[x * 4 + i]) >> 8;
+            out |= ((channel * rowWeight) >> 8) << i * 8;
+        }
+        row[x] = out;
+    }
+}
+
+//Rounds each channel to the nearest of its kept shades, alpha is left alone
+static void paletteRow(uint32_t* row, int count, int bits)
+{
+    uint8_t channelMask = (uint8_t)(0xFF << (8 - bits));
+    uint8_t half = (uint8_t)(1 << (7 - bits));
+    uint32_t mask = 0xFF000000 | channelMask << 16 | channelMask << 8 | channelMask;
+    uint32_t round = half << 16 | half << 8 | half;
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i masks = _mm_set1_epi32((int)mask);
+    const __m128i rounds = _mm_set1_epi32((int)round);
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+        _mm_storeu_si128((__m128i*)(row + x), _mm_and_si128(_mm_adds_epu8(pixels, rounds), masks));
+    }
+#endif
+    for (; x < count; x++)
+    {
+        uint32_t out = row[x] & 0xFF000000;
+        for (int i = 0; i < 3; i++)
+        {
+            uint32_t channel = ((row[x] >> i * 8) & 0xFF) + half;
+            if (channel > 0xFF) channel = 0xFF;
+            out |= (channel & channelMask) << i * 8;
+        }
+        row[x] = out;
+    }
+}
+
+//Weights fall off with the square of the distance from the middle
+static void reserveVignette(PostEffectChain* chain, int width, int height)
+{
+    if (chain->vignetteWidth == width && chain->vignetteHeight == height) return;
+    //MALLOC freed by freePostEffectChain()
+    chain->vignetteColumns = (uint16_t*)realloc(chain->vignetteColumns, width * 4 * sizeof(uint16_t));
+    chain->vignetteRows = (uint16_t*)realloc(chain->vignetteRows, height * sizeof(uint16_t));
+    chain->vignetteWidth = width;
+    chain->vignetteHeight = height;
+    for (int x = 0; x < width; x++)
+    {
+        float fromMiddle = (x + 0.5f) / width * 2 - 1;
+        uint16_t weight = (uint16_t)(256 * (1 - chain->vignetteStrength * fromMiddle * fromMiddle));
+        for (int i = 0; i < 4; i++) chain->vignetteColumns[x * 4 + i] = weight;
+    }
+    for (int y = 0; y < height; y++)
+    {
+        float fromMiddle = (y + 0.5f) / height * 2 - 1;
+        chain->vignetteRows[y] = (uint16_t)(256 * (1 - chain->vignetteStrength * fromMiddle * fromMiddle));
+    }
+}
+
+//Runs a retro effect over rows firstRow up to endRow
+static void runPostPass(GfxContext* gfx, PostEffectChain* chain, PostPass pass, int firstRow, int endRow)
+{
+    PixelBuffer* buffer = &gfx->pixelBuffer;
+    if (firstRow < 0) firstRow = 0;
+    if (endRow > buffer->height) endRow = buffer->height;
+    if (pass == POST_PASS_SCANLINES)
+    {
+        FadeWeights darken = getFadeWeights(0, chain->scanlineDarkness);
+        const RenderKernels* kernels = getRenderKernels();
+        //The odd rows
+        for (int y = firstRow | 1; y < endRow; y += 2)
+        {
+            kernels->fadeRow(buffer->pixels + y * buffer->pitch, buffer->width, &darken);
+        }
+        return;
+    }
+    if (pass == POST_PASS_VIGNETTE) reserveVignette(chain, buffer->width, buffer->height);
+    for (int y = firstRow; y < endRow; y++)
+    {
+        uint32_t* row = buffer->pixels + y * buffer->pitch;
+        switch (pass)
+        {
+            case POST_PASS_CHROMA_SHIFT:
+                memcpy(gfx->scratchRow, row, buffer->width * sizeof(uint32_t));
+                chromaShiftRow(row, gfx->scratchRow, buffer->width, chain->chromaShift);
+                break;
+            case POST_PASS_VIGNETTE:
+                vignetteRow(row, buffer->width, chain->vignetteColumns, chain->vignetteRows[y]);
+                break;
+            case POST_PASS_PALETTE:
+                paletteRow(row, buffer->width, chain->paletteBits);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The chain to set up and a comma separated list of the effects to
+ *        turn on, each optionally followed by a colon and its setting:
+ *        chroma:pixels, scanlines:darkness, vignette:strength, palette:bits.
+ *        "retro" turns them all on.
+ * Output: False if something in the list isn't an effect.
+ *----------------------------------------------------------------------------*/
+bool parsePostEffectChain(PostEffectChain* chain, const char* list)
+{
+    chain->chromaShift = 1;
+    chain->scanlineDarkness = 0.3f;
+    chain->vignetteStrength = 0.5f;
+    chain->paletteBits = 4;
+    while (*list != '\0')
+    {
+        size_t length = strcspn(list, ",");
+        size_t nameLength = strcspn(list, ":,");
+        const char* value = nameLength < length ? list + nameLength + 1 : NULL;
+
+        int pass = -1;
+        for (int i = POST_PASS_SCREEN + 1; i < POST_PASS_COUNT; i++)
+        {
+            if (strlen(passNames[i]) == nameLength && strncmp(list, passNames[i], nameLength) == 0) pass = i;
+        }
+        if (nameLength == 5 && strncmp(list, "retro", 5) == 0)
+        {
+            for (int i = POST_PASS_SCREEN + 1; i < POST_PASS_COUNT; i++) chain->enabled[i] = true;
+        }
+        else if (pass < 0)
+        {
+            return false;
+        }
+        else
+        {
+            chain->enabled[pass] = true;
+            if (value != NULL && pass == POST_PASS_CHROMA_SHIFT) chain->chromaShift = atoi(value);
+            if (value != NULL && pass == POST_PASS_SCANLINES) chain->scanlineDarkness = atof(value);
+            if (value != NULL && pass == POST_PASS_VIGNETTE) chain->vignetteStrength = atof(value);
+            if (value != NULL && pass == POST_PASS_PALETTE) chain->paletteBits = atoi(value);
+        }
+        list += length;
+        if (*list == ',') list++;
+    }
+    if (chain->chromaShift < 0) chain->chromaShift = 0;
+    if (chain->scanlineDarkness < 0) chain->scanlineDarkness = 0;
+    if (chain->scanlineDarkness > 1) chain->scanlineDarkness = 1;
+    if (chain->vignetteStrength < 0) chain->vignetteStrength = 0;
+    if (chain->vignetteStrength > 1) chain->vignetteStrength = 1;
+    if (chain->paletteBits < 1) chain->paletteBits = 1;
+    if (chain->paletteBits > 7) chain->paletteBits = 7;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The context holding the frame, the chain, this frame's PostEffects
+ *        and the rows to run it over, from firstRow up to endRow.
+ * Description: Runs the PostEffects and then every retro effect turned on,
+ *              timing each pass.
+ *----------------------------------------------------------------------------*/
+void applyPostEffectChain(GfxContext* gfx, PostEffectChain* chain, const PostEffects* effects,
+                          int firstRow, int endRow)
+{
+    for (int pass = 0; pass < POST_PASS_COUNT; pass++)
+    {
+        if (pass != POST_PASS_SCREEN && !chain->enabled[pass]) continue;
+        uint64_t start = SDL_GetPerformanceCounter();
+        if (pass == POST_PASS_SCREEN) applyPostEffects(gfx, effects, firstRow, endRow);
+        else runPostPass(gfx, chain, (PostPass)pass, firstRow, endRow);
+        uint64_t ticks = SDL_GetPerformanceCounter() - start;
+        chain->totalTicks[pass] += ticks;
+        if (ticks > chain->maxTicks[pass]) chain->maxTicks[pass] = ticks;
+    }
+    chain->frameCount++;
+}
+
+//Adds the time each pass took to the end of a report, see writeFramePacingReport()
+void writePostEffectsReport(const PostEffectChain* chain, const char* filePath)
+{
+    if (chain->frameCount == 0) return;
+    FILE* file = fopen(filePath, "a");
+    if (file == NULL)
+    {
+        SDL_Log("Could not write post effects report %s", filePath);
+        return;
+    }
+    double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+    double totalMs = 0;
+    fprintf(file, "\n#post effect pass, mean ms, max ms\n");
+    for (int pass = 0; pass < POST_PASS_COUNT; pass++)
+    {
+        if (pass != POST_PASS_SCREEN && !chain->enabled[pass]) continue;
+        double meanMs = chain->totalTicks[pass] * msPerTick / chain->frameCount;
+        totalMs += meanMs;
+        fprintf(file, "%s %.3f %.3f\n", passNames[pass], meanMs, chain->maxTicks[pass] * msPerTick);
+    }
+    fprintf(file, "post effects mean %.3f ms over %u frames\n", totalMs, chain->frameCount);
+    fclose(file);
+}
+
+void freePostEffectChain(PostEffectChain* chain)
+{
+    free(chain->vignetteColumns);
+    free(chain->vignetteRows);
+    memset(chain, 0, sizeof(PostEffectChain));
+}
@@ -0,0 +1,67 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gfx_engine.h"
+
+
+/*------------------------------------------------------------------------------
+ * The full screen effects drawn over a frame. They are applied together in
+ * one pass by applyPostEffects(), in the order they are listed.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    float transitionFraction;   //How much of the screen the black bars cover
+    int pixelateSize;           //Width of the pixelation blocks, 1 for none
+    uint32_t fadeColor;
+    float fadeRatio;            //How much of fadeColor to blend in, 0 for none
+} PostEffects;
+
+//The passes applyPostEffectChain() runs, in order
+typedef enum
+{
+    POST_PASS_SCREEN,           //The PostEffects, always on
+    POST_PASS_CHROMA_SHIFT,     //Red and blue pulled apart sideways
+    POST_PASS_SCANLINES,        //Every other row darkened
+    POST_PASS_VIGNETTE,         //Darkened towards the corners
+    POST_PASS_PALETTE,          //Fewer shades of each channel
+    POST_PASS_COUNT
+} PostPass;
+
+/*------------------------------------------------------------------------------
+ * Optional retro effects run after the PostEffects, and how long every pass
+ * has taken. A zeroed chain runs only the PostEffects.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    bool enabled[POST_PASS_COUNT];
+    int chromaShift;            //Pixels red and blue are moved apart by
+    float scanlineDarkness;     //0 to 1
+    float vignetteStrength;     //0 to 1, how dark the corners get
+    int paletteBits;            //Bits kept of each channel, 1 to 7
+
+    //Vignette weights, 8.8 fixed point, worked out for the screen size
+    uint16_t* vignetteColumns;  //Per column, repeated for each channel
+    uint16_t* vignetteRows;     //Per row
+    int vignetteWidth;
+    int vignetteHeight;
+
+    uint64_t totalTicks[POST_PASS_COUNT];   //Performance counter ticks
+    uint64_t maxTicks[POST_PASS_COUNT];
+    uint32_t frameCount;
+} PostEffectChain;
+
+
+void applyPostEffects       (GfxContext* gfx, const PostEffects* effects, int firstRow, int endRow);
+bool parsePostEffectChain   (PostEffectChain* chain, const char* list);
+void applyPostEffectChain   (GfxContext* gfx, PostEffectChain* chain, const PostEffects* effects,
+                             int firstRow, int endRow);
+void writePostEffectsReport (const PostEffectChain* chain, const char* filePath);
+void freePostEffectChain    (PostEffectChain* chain);
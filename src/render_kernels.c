@@ -0,0 +1,922 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+//The SIMD kernels are built with target attributes and picked at run time
+//with CPUID, so the game runs on any x86 whatever the build flags. That
+//needs GCC or clang.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <cpuid.h>
+    #include <immintrin.h>
+    #define RENDER_KERNELS_X86
+#endif
+
+//AVX-512 brings FMA with it, and a multiply and add fused into one rounds
+//differently from the scalar kernels, so none are fused
+#ifdef __clang__
+    #pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+    #pragma GCC optimize ("fp-contract=off")
+#endif
+
+#include "render_kernels.h"
+#include "load_level.h"
+
+
+static const uint32_t COLOR_KEY = 0xFFFF00FF;
+
+static const char* isaNames[KERNEL_ISA_COUNT] = { "scalar", "sse2", "avx2", "avx512" };
+
+
+/*---------------------
+ * Scalar
+ *-------------------*/
+
+//How brightly something distance away is lit, 1 or more is full brightness
+float getShadingIntensity(float distance)
+{
+    return (0.5 / distance) * 150;
+}
+
+//Output: The colour's channels times an intensity below 1, without alpha
+uint32_t shadeColor(uint32_t inColor, float intensity)
+{
+    uint8_t outColor8[3];
+    for (int i = 0; i < 3; i++)
+    {
+        outColor8[i] = (uint8_t)(inColor >> i * 8) * intensity;
+    }
+    return (outColor8[2] << 16) | (outColor8[1] << 8) | outColor8[0];
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A colour and how far away it is.
+ * Output: The colour darkened with distance. Close enough to be at full
+ *         brightness it is left as it is, otherwise its alpha is dropped.
+ *----------------------------------------------------------------------------*/
+uint32_t depthShading(uint32_t inColor, float distance)
+{
+    float intensity = getShadingIntensity(distance);
+    if (intensity >= 1.0) return inColor;
+    return shadeColor(inColor, intensity);
+}
+
+//Output: log2 of size if it is a power of two, otherwise -1
+int getPow2Shift(int size)
+{
+    if (size <= 0 || (size & (size - 1)) != 0) return -1;
+    int shift = 0;
+    while ((1 << shift) < size) shift++;
+    return shift;
+}
+
+//Index of a texel row by row, a shift for power of two pitches
+SPECIALIZED int getTexelIndex(int row, int pitch, int pitchShift, int column, bool pow2)
+{
+    return (pow2 ? (int)((uint32_t)row << pitchShift) : row * pitch) + column;
+}
+
+//How a column of wall is drawn, worked out once for the whole column
+typedef struct
+{
+    float intensity;
+    int pitchShift;
+    bool keyed;                 //The colour key is replaced with something else
+    bool shaded;                //Far enough away to be darkened
+    bool pow2;                  //The pitch is a power of two
+} WallSpecialization;
+
+static WallSpecialization getWallSpecialization(const WallColumn* wall)
+{
+    WallSpecialization special;
+    special.intensity = getShadingIntensity(wall->distance);
+    special.pitchShift = getPow2Shift(wall->texPitch);
+    special.keyed = wall->keyColor != COLOR_KEY;
+    special.shaded = !(special.intensity >= 1.0);
+    special.pow2 = special.pitchShift >= 0;
+    return special;
+}
+
+SPECIALIZED void wallColumnScalarLoop(uint32_t* column, int firstRow, int endRow, const WallColumn* wall,
+                                      const WallSpecialization* special, bool keyed, bool shaded, bool pow2)
+{
+    for (int y = firstRow; y < endRow; y++)
+    {
+        int texRow = wall->texStep * (y - wall->texTop);
+        uint32_t color = wall->texels[getTexelIndex(texRow, wall->texPitch, special->pitchShift, 0, pow2)];
+        if (keyed && color == COLOR_KEY) color = wall->keyColor;
+        column[y] = shaded ? shadeColor(color, special->intensity) : color;
+    }
+}
+
+static void wallColumnScalar(uint32_t* column, int firstRow, int endRow, const WallColumn* wall)
+{
+    WallSpecialization special = getWallSpecialization(wall);
+    CALL_SPECIALIZED3(wallColumnScalarLoop, special.keyed, special.shaded, special.pow2,
+                      column, firstRow, endRow, wall, &special);
+}
+
+//Whether the SIMD kernels can wrap floor coordinates with a mask
+static bool isTileWrapMasked(void)
+{
+    return (TILE_DIMS & (TILE_DIMS - 1)) == 0;
+}
+
+//Where the ray meets the floor at distance, before wrapping to the texture
+static void getFloorCoords(const FloorColumn* floor, float distance, int* texX, int* texY)
+{
+    *texX = (floor->cosAngle * distance) * floor->inverseCosScreenAngle + floor->origin.x;
+    *texY = (floor->sinAngle * distance) * floor->inverseCosScreenAngle + floor->origin.y;
+}
+
+//How a span of floor is drawn, worked out once for the whole span
+typedef struct
+{
+    int pitchShift;
+    bool positive;              //No coordinate is negative, so they wrap with a mask
+    bool pow2;
+} FloorSpecialization;
+
+/*------------------------------------------------------------------------------
+ * Description: Distances only grow or only shrink along a span, as they do
+ *              either side of the horizon, and the coordinates follow them.
+ *              So if the coordinates at both ends of the span are positive
+ *              the rest are too.
+ *----------------------------------------------------------------------------*/
+static FloorSpecialization getFloorSpecialization(const FloorColumn* floor, int firstRow, int endRow)
+{
+    FloorSpecialization special;
+    special.pitchShift = getPow2Shift(floor->texPitch);
+    special.pow2 = special.pitchShift >= 0;
+    special.positive = isTileWrapMasked() && firstRow < endRow;
+    int ends[2] = { firstRow, endRow - 1 };
+    for (int i = 0; i < 2 && special.positive; i++)
+    {
+        int texX, texY;
+        getFloorCoords(floor, floor->distances[ends[i]], &texX, &texY);
+        special.positive = texX >= 0 && texY >= 0;
+    }
+    return special;
+}
+
+SPECIALIZED void floorColumnScalarLoop(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor,
+                                       const FloorSpecialization* special, bool positive, bool pow2)
+{
+    for (int y = firstRow; y < endRow; y++)
+    {
+        float distance = floor->distances[y];
+        int texX, texY;
+        getFloorCoords(floor, distance, &texX, &texY);
+        //% rounds towards zero, so only a mask if nothing is negative
+        texX = positive ? texX & (TILE_DIMS - 1) : texX % TILE_DIMS;
+        texY = positive ? texY & (TILE_DIMS - 1) : texY % TILE_DIMS;
+        uint32_t texel = floor->texels[getTexelIndex(texY, floor->texPitch, special->pitchShift, texX, pow2)];
+        column[y] = depthShading(texel, distance);
+    }
+}
+
+static void floorColumnScalar(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor)
+{
+    FloorSpecialization special = getFloorSpecialization(floor, firstRow, endRow);
+    CALL_SPECIALIZED2(floorColumnScalarLoop, special.positive, special.pow2,
+                      column, firstRow, endRow, floor, &special);
+}
+
+static void blendRowScalar(uint32_t* dest, const uint32_t* source, int count, uint32_t maskColor)
+{
+    for (int x = 0; x < count; x++)
+    {
+        uint32_t color = source[x];
+        if (color & 0xFF000000) dest[x] = color == COLOR_KEY ? maskColor : color;
+    }
+}
+
+static uint32_t fadePixel(uint32_t color, const FadeWeights* fade)
+{
+    uint32_t out = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint32_t channel = (((color >> i * 8) & 0xFF) * fade->keep + fade->add[i]) >> 8;
+        out |= channel << i * 8;
+    }
+    return out;
+}
+
+static void fadeRowScalar(uint32_t* row, int count, const FadeWeights* fade)
+{
+    for (int x = 0; x < count; x++)
+    {
+        row[x] = fadePixel(row[x], fade);
+    }
+}
+
+//Transposes the block from (left, top) up to (right, bottom) of dest
+static void transposeBlock(uint32_t* dest, int destPitch, const uint32_t* source, int sourcePitch,
+                           int left, int top, int right, int bottom)
+{
+    for (int y = top; y < bottom; y++)
+    {
+        for (int x = left; x < right; x++)
+        {
+            dest[y * destPitch + x] = source[x * sourcePitch + y];
+        }
+    }
+}
+
+//In tiles, so the rows written and the columns read both stay in the cache
+#define TRANSPOSE_TILE 16
+
+static void transposeScalar(uint32_t* dest, int destPitch, const uint32_t* source, int sourcePitch,
+                            int width, int height)
+{
+    for (int top = 0; top < height; top += TRANSPOSE_TILE)
+    {
+        int bottom = top + TRANSPOSE_TILE < height ? top + TRANSPOSE_TILE : height;
+        for (int left = 0; left < width; left += TRANSPOSE_TILE)
+        {
+            int right = left + TRANSPOSE_TILE < width ? left + TRANSPOSE_TILE : width;
+            transposeBlock(dest, destPitch, source, sourcePitch, left, top, right, bottom);
+        }
+    }
+}
+
+#ifdef RENDER_KERNELS_X86
+/*---------------------
+ * SSE2, 4 pixels at a time
+ *-------------------*/
+
+/*------------------------------------------------------------------------------
+ * Input: Four pixels and the intensity each is shaded by.
+ * Output: The pixels as depthShading() shades them. Intensities are worked
+ *         out in double precision before being rounded to float, as it does.
+ *----------------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static inline __m128i shadeSse2(__m128i pixels, __m128 intensity)
+{
+    const __m128i channelMask = _mm_set1_epi32(0xFF);
+    __m128i shaded = _mm_setzero_si128();
+    for (int i = 0; i < 3; i++)
+    {
+        __m128 channel = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, i * 8), channelMask));
+        __m128i scaled = _mm_cvttps_epi32(_mm_mul_ps(channel, intensity));
+        shaded = _mm_or_si128(shaded, _mm_slli_epi32(scaled, i * 8));
+    }
+    __m128i bright = _mm_castps_si128(_mm_cmpge_ps(intensity, _mm_set1_ps(1)));
+    return _mm_or_si128(_mm_and_si128(bright, pixels), _mm_andnot_si128(bright, shaded));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 getIntensitiesSse2(const float* distances)
+{
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d scale = _mm_set1_pd(150);
+    __m128 distance = _mm_loadu_ps(distances);
+    __m128d low = _mm_mul_pd(_mm_div_pd(half, _mm_cvtps_pd(distance)), scale);
+    __m128d high = _mm_mul_pd(_mm_div_pd(half, _mm_cvtps_pd(_mm_movehl_ps(distance, distance))), scale);
+    return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+}
+
+__attribute__((target("sse2")))
+SPECIALIZED void wallColumnSse2Loop(uint32_t* column, int firstRow, int endRow, const WallColumn* wall,
+                                    const WallSpecialization* special, bool keyed, bool shaded, bool pow2)
+{
+    const __m128 intensity = _mm_set1_ps(special->intensity);
+    const __m128 texStep = _mm_set1_ps(wall->texStep);
+    const __m128 texTop = _mm_set1_ps(wall->texTop);
+    const __m128i pitchShift = _mm_cvtsi32_si128(special->pitchShift);
+    const __m128i key = _mm_set1_epi32((int)COLOR_KEY);
+    const __m128i keyColor = _mm_set1_epi32((int)wall->keyColor);
+    const __m128i rowOffsets = _mm_setr_epi32(0, 1, 2, 3);
+    int y = firstRow;
+    for (; y + 4 <= endRow; y += 4)
+    {
+        __m128 rows = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(y), rowOffsets));
+        __m128i texRows = _mm_cvttps_epi32(_mm_mul_ps(texStep, _mm_sub_ps(rows, texTop)));
+        if (pow2) texRows = _mm_sll_epi32(texRows, pitchShift);
+        int32_t indices[4];
+        _mm_storeu_si128((__m128i*)indices, texRows);
+        //No gather before AVX2
+        uint32_t texels[4];
+        for (int i = 0; i < 4; i++) texels[i] = wall->texels[pow2 ? indices[i] : indices[i] * wall->texPitch];
+
+        __m128i color = _mm_loadu_si128((const __m128i*)texels);
+        if (keyed)
+        {
+            __m128i isKey = _mm_cmpeq_epi32(color, key);
+            color = _mm_or_si128(_mm_andnot_si128(isKey, color), _mm_and_si128(isKey, keyColor));
+        }
+        _mm_storeu_si128((__m128i*)(column + y), shaded ? shadeSse2(color, intensity) : color);
+    }
+    wallColumnScalarLoop(column, y, endRow, wall, special, keyed, shaded, pow2);
+}
+
+__attribute__((target("sse2")))
+static void wallColumnSse2(uint32_t* column, int firstRow, int endRow, const WallColumn* wall)
+{
+    WallSpecialization special = getWallSpecialization(wall);
+    CALL_SPECIALIZED3(wallColumnSse2Loop, special.keyed, special.shaded, special.pow2,
+                      column, firstRow, endRow, wall, &special);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: Texture coordinates, which may be negative.
+ * Output: Each coordinate % TILE_DIMS, which rounds towards zero. TILE_DIMS
+ *         has to be a power of two, see isTileWrapMasked().
+ *----------------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static inline __m128i wrapTileSse2(__m128i coords)
+{
+    const __m128i tileMask = _mm_set1_epi32(TILE_DIMS - 1);
+    __m128i bias = _mm_and_si128(_mm_srai_epi32(coords, 31), tileMask);
+    return _mm_sub_epi32(_mm_and_si128(_mm_add_epi32(coords, bias), tileMask), bias);
+}
+
+//Wrapped to the tile as floorColumnScalarLoop() does
+__attribute__((target("sse2")))
+SPECIALIZED __m128i wrapFloorSse2(__m128i coords, bool positive)
+{
+    return positive ? _mm_and_si128(coords, _mm_set1_epi32(TILE_DIMS - 1)) : wrapTileSse2(coords);
+}
+
+__attribute__((target("sse2")))
+SPECIALIZED void floorColumnSse2Loop(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor,
+                                     const FloorSpecialization* special, bool positive, bool pow2)
+{
+    const __m128 cosAngle = _mm_set1_ps(floor->cosAngle);
+    const __m128 sinAngle = _mm_set1_ps(floor->sinAngle);
+    const __m128 inverseCos = _mm_set1_ps(floor->inverseCosScreenAngle);
+    const __m128 originX = _mm_set1_ps(floor->origin.x);
+    const __m128 originY = _mm_set1_ps(floor->origin.y);
+    const __m128i texPitch = _mm_set1_epi32(floor->texPitch);
+    const __m128i pitchShift = _mm_cvtsi32_si128(special->pitchShift);
+    int y = firstRow;
+    for (; y + 4 <= endRow; y += 4)
+    {
+        __m128 distance = _mm_loadu_ps(floor->distances + y);
+        __m128i texX = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(cosAngle, distance), inverseCos), originX));
+        __m128i texY = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinAngle, distance), inverseCos), originY));
+        texX = wrapFloorSse2(texX, positive);
+        texY = wrapFloorSse2(texY, positive);
+        //Otherwise wrapped rows and the pitch both fit in 16 bits, so madd can multiply them
+        texY = pow2 ? _mm_sll_epi32(texY, pitchShift) : _mm_madd_epi16(texY, texPitch);
+        int32_t indices[4];
+        _mm_storeu_si128((__m128i*)indices, _mm_add_epi32(texY, texX));
+        uint32_t texels[4];
+        for (int i = 0; i < 4; i++) texels[i] = floor->texels[indices[i]];
+
+        __m128i color = _mm_loadu_si128((const __m128i*)texels);
+        _mm_storeu_si128((__m128i*)(column + y), shadeSse2(color, getIntensitiesSse2(floor->distances + y)));
+    }
+    floorColumnScalarLoop(column, y, endRow, floor, special, positive, pow2);
+}
+
+//Tile sizes that aren't a power of two are left to the scalar kernel
+__attribute__((target("sse2")))
+static void floorColumnSse2(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor)
+{
+    if (!isTileWrapMasked())
+    {
+        floorColumnScalar(column, firstRow, endRow, floor);
+        return;
+    }
+    FloorSpecialization special = getFloorSpecialization(floor, firstRow, endRow);
+    CALL_SPECIALIZED2(floorColumnSse2Loop, special.positive, special.pow2,
+                      column, firstRow, endRow, floor, &special);
+}
+
+//Masks rather than a branch per pixel
+__attribute__((target("sse2")))
+static void blendRowSse2(uint32_t* dest, const uint32_t* source, int count, uint32_t maskColor)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaBits = _mm_set1_epi32((int)0xFF000000);
+    const __m128i key = _mm_set1_epi32((int)COLOR_KEY);
+    const __m128i mask = _mm_set1_epi32((int)maskColor);
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i color = _mm_loadu_si128((const __m128i*)(source + x));
+        __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(color, alphaBits), zero);
+        __m128i keyed = _mm_cmpeq_epi32(color, key);
+        color = _mm_or_si128(_mm_andnot_si128(keyed, color), _mm_and_si128(keyed, mask));
+        __m128i under = _mm_and_si128(transparent, _mm_loadu_si128((const __m128i*)(dest + x)));
+        _mm_storeu_si128((__m128i*)(dest + x), _mm_or_si128(under, _mm_andnot_si128(transparent, color)));
+    }
+    blendRowScalar(dest + x, source + x, count - x, maskColor);
+}
+
+__attribute__((target("sse2")))
+static void fadeRowSse2(uint32_t* row, int count, const FadeWeights* fade)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keep = _mm_set1_epi16(fade->keep);
+    const __m128i add = _mm_setr_epi16(fade->add[0], fade->add[1], fade->add[2], fade->add[3],
+                                       fade->add[0], fade->add[1], fade->add[2], fade->add[3]);
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, keep), add), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, keep), add), 8);
+        _mm_storeu_si128((__m128i*)(row + x), _mm_packus_epi16(lo, hi));
+    }
+    fadeRowScalar(row + x, count - x, fade);
+}
+
+//4x4 blocks, what is left over around the edges is done a pixel at a time
+__attribute__((target("sse2")))
+static void transposeSse2(uint32_t* dest, int destPitch, const uint32_t* source, int sourcePitch,
+                          int width, int height)
+{
+    int blockWidth = width & ~3;
+    int blockHeight = height & ~3;
+    for (int y = 0; y < blockHeight; y += 4)
+    {
+        for (int x = 0; x < blockWidth; x += 4)
+        {
+            const uint32_t* in = source + x * sourcePitch + y;
+            __m128i c0 = _mm_loadu_si128((const __m128i*)in);
+            __m128i c1 = _mm_loadu_si128((const __m128i*)(in + sourcePitch));
+            __m128i c2 = _mm_loadu_si128((const __m128i*)(in + sourcePitch * 2));
+            __m128i c3 = _mm_loadu_si128((const __m128i*)(in + sourcePitch * 3));
+            __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+            __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+            __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+            __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+            uint32_t* out = dest + y * destPitch + x;
+            _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(out + destPitch), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(out + destPitch * 2), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128((__m128i*)(out + destPitch * 3), _mm_unpackhi_epi64(t2, t3));
+        }
+        transposeBlock(dest, destPitch, source, sourcePitch, blockWidth, y, width, y + 4);
+    }
+    transposeBlock(dest, destPitch, source, sourcePitch, 0, blockHeight, width, height);
+}
+
+/*---------------------
+ * AVX2, 8 pixels at a time. The upper halves of the registers are cleared
+ * before going back to SSE code, which is slowed down while they're in use.
+ *-------------------*/
+
+__attribute__((target("avx2")))
+static inline __m256i shadeAvx2(__m256i pixels, __m256 intensity)
+{
+    const __m256i channelMask = _mm256_set1_epi32(0xFF);
+    __m256i shaded = _mm256_setzero_si256();
+    for (int i = 0; i < 3; i++)
+    {
+        __m256 channel = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, i * 8), channelMask));
+        __m256i scaled = _mm256_cvttps_epi32(_mm256_mul_ps(channel, intensity));
+        shaded = _mm256_or_si256(shaded, _mm256_slli_epi32(scaled, i * 8));
+    }
+    __m256i bright = _mm256_castps_si256(_mm256_cmp_ps(intensity, _mm256_set1_ps(1), _CMP_GE_OQ));
+    return _mm256_blendv_epi8(shaded, pixels, bright);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 getIntensitiesAvx2(const float* distances)
+{
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d scale = _mm256_set1_pd(150);
+    __m256d low = _mm256_mul_pd(_mm256_div_pd(half, _mm256_cvtps_pd(_mm_loadu_ps(distances))), scale);
+    __m256d high = _mm256_mul_pd(_mm256_div_pd(half, _mm256_cvtps_pd(_mm_loadu_ps(distances + 4))), scale);
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+}
+
+__attribute__((target("avx2")))
+SPECIALIZED void wallColumnAvx2Loop(uint32_t* column, int firstRow, int endRow, const WallColumn* wall,
+                                    const WallSpecialization* special, bool keyed, bool shaded, bool pow2)
+{
+    const __m256 intensity = _mm256_set1_ps(special->intensity);
+    const __m256 texStep = _mm256_set1_ps(wall->texStep);
+    const __m256 texTop = _mm256_set1_ps(wall->texTop);
+    const __m256i texPitch = _mm256_set1_epi32(wall->texPitch);
+    const __m128i pitchShift = _mm_cvtsi32_si128(special->pitchShift);
+    const __m256i key = _mm256_set1_epi32((int)COLOR_KEY);
+    const __m256i keyColor = _mm256_set1_epi32((int)wall->keyColor);
+    const __m256i rowOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int y = firstRow;
+    for (; y + 8 <= endRow; y += 8)
+    {
+        __m256 rows = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(y), rowOffsets));
+        __m256i texRows = _mm256_cvttps_epi32(_mm256_mul_ps(texStep, _mm256_sub_ps(rows, texTop)));
+        __m256i indices = pow2 ? _mm256_sll_epi32(texRows, pitchShift) : _mm256_mullo_epi32(texRows, texPitch);
+        __m256i color = _mm256_i32gather_epi32((const int*)wall->texels, indices, 4);
+        if (keyed) color = _mm256_blendv_epi8(color, keyColor, _mm256_cmpeq_epi32(color, key));
+        _mm256_storeu_si256((__m256i*)(column + y), shaded ? shadeAvx2(color, intensity) : color);
+    }
+    _mm256_zeroupper();
+    wallColumnScalarLoop(column, y, endRow, wall, special, keyed, shaded, pow2);
+}
+
+__attribute__((target("avx2")))
+static void wallColumnAvx2(uint32_t* column, int firstRow, int endRow, const WallColumn* wall)
+{
+    WallSpecialization special = getWallSpecialization(wall);
+    CALL_SPECIALIZED3(wallColumnAvx2Loop, special.keyed, special.shaded, special.pow2,
+                      column, firstRow, endRow, wall, &special);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i wrapTileAvx2(__m256i coords)
+{
+    const __m256i tileMask = _mm256_set1_epi32(TILE_DIMS - 1);
+    __m256i bias = _mm256_and_si256(_mm256_srai_epi32(coords, 31), tileMask);
+    return _mm256_sub_epi32(_mm256_and_si256(_mm256_add_epi32(coords, bias), tileMask), bias);
+}
+
+__attribute__((target("avx2")))
+SPECIALIZED __m256i wrapFloorAvx2(__m256i coords, bool positive)
+{
+    return positive ? _mm256_and_si256(coords, _mm256_set1_epi32(TILE_DIMS - 1)) : wrapTileAvx2(coords);
+}
+
+__attribute__((target("avx2")))
+SPECIALIZED void floorColumnAvx2Loop(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor,
+                                     const FloorSpecialization* special, bool positive, bool pow2)
+{
+    const __m256 cosAngle = _mm256_set1_ps(floor->cosAngle);
+    const __m256 sinAngle = _mm256_set1_ps(floor->sinAngle);
+    const __m256 inverseCos = _mm256_set1_ps(floor->inverseCosScreenAngle);
+    const __m256 originX = _mm256_set1_ps(floor->origin.x);
+    const __m256 originY = _mm256_set1_ps(floor->origin.y);
+    const __m256i texPitch = _mm256_set1_epi32(floor->texPitch);
+    const __m128i pitchShift = _mm_cvtsi32_si128(special->pitchShift);
+    int y = firstRow;
+    for (; y + 8 <= endRow; y += 8)
+    {
+        __m256 distance = _mm256_loadu_ps(floor->distances + y);
+        __m256i texX = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(cosAngle, distance), inverseCos), originX));
+        __m256i texY = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinAngle, distance), inverseCos), originY));
+        texX = wrapFloorAvx2(texX, positive);
+        texY = wrapFloorAvx2(texY, positive);
+        texY = pow2 ? _mm256_sll_epi32(texY, pitchShift) : _mm256_mullo_epi32(texY, texPitch);
+        __m256i color = _mm256_i32gather_epi32((const int*)floor->texels, _mm256_add_epi32(texY, texX), 4);
+        _mm256_storeu_si256((__m256i*)(column + y), shadeAvx2(color, getIntensitiesAvx2(floor->distances + y)));
+    }
+    _mm256_zeroupper();
+    floorColumnScalarLoop(column, y, endRow, floor, special, positive, pow2);
+}
+
+__attribute__((target("avx2")))
+static void floorColumnAvx2(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor)
+{
+    if (!isTileWrapMasked())
+    {
+        floorColumnScalar(column, firstRow, endRow, floor);
+        return;
+    }
+    FloorSpecialization special = getFloorSpecialization(floor, firstRow, endRow);
+    CALL_SPECIALIZED2(floorColumnAvx2Loop, special.positive, special.pow2,
+                      column, firstRow, endRow, floor, &special);
+}
+
+__attribute__((target("avx2")))
+static void blendRowAvx2(uint32_t* dest, const uint32_t* source, int count, uint32_t maskColor)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaBits = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i key = _mm256_set1_epi32((int)COLOR_KEY);
+    const __m256i mask = _mm256_set1_epi32((int)maskColor);
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i color = _mm256_loadu_si256((const __m256i*)(source + x));
+        __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(color, alphaBits), zero);
+        color = _mm256_blendv_epi8(color, mask, _mm256_cmpeq_epi32(color, key));
+        __m256i under = _mm256_loadu_si256((const __m256i*)(dest + x));
+        _mm256_storeu_si256((__m256i*)(dest + x), _mm256_blendv_epi8(color, under, transparent));
+    }
+    _mm256_zeroupper();
+    blendRowSse2(dest + x, source + x, count - x, maskColor);
+}
+
+__attribute__((target("avx2")))
+static void fadeRowAvx2(uint32_t* row, int count, const FadeWeights* fade)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i keep = _mm256_set1_epi16(fade->keep);
+    const __m256i add = _mm256_setr_epi16(fade->add[0], fade->add[1], fade->add[2], fade->add[3],
+                                          fade->add[0], fade->add[1], fade->add[2], fade->add[3],
+                                          fade->add[0], fade->add[1], fade->add[2], fade->add[3],
+                                          fade->add[0], fade->add[1], fade->add[2], fade->add[3]);
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(row + x));
+        __m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+        __m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, keep), add), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, keep), add), 8);
+        _mm256_storeu_si256((__m256i*)(row + x), _mm256_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    fadeRowSse2(row + x, count - x, fade);
+}
+
+//8x8 blocks, each 128 bit half transposed as in transposeSse2() and the
+//halves then swapped over
+__attribute__((target("avx2")))
+static void transposeAvx2(uint32_t* dest, int destPitch, const uint32_t* source, int sourcePitch,
+                          int width, int height)
+{
+    int blockWidth = width & ~7;
+    int blockHeight = height & ~7;
+    for (int y = 0; y < blockHeight; y += 8)
+    {
+        for (int x = 0; x < blockWidth; x += 8)
+        {
+            const uint32_t* in = source + x * sourcePitch + y;
+            __m256i c[8], t[8], u[8];
+            for (int i = 0; i < 8; i++) c[i] = _mm256_loadu_si256((const __m256i*)(in + sourcePitch * i));
+            for (int i = 0; i < 8; i += 2)
+            {
+                t[i] = _mm256_unpacklo_epi32(c[i], c[i + 1]);
+                t[i + 1] = _mm256_unpackhi_epi32(c[i], c[i + 1]);
+            }
+            for (int i = 0; i < 8; i += 4)
+            {
+                u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+                u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+                u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+                u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+            }
+            uint32_t* out = dest + y * destPitch + x;
+            for (int i = 0; i < 4; i++)
+            {
+                _mm256_storeu_si256((__m256i*)(out + destPitch * i), _mm256_permute2x128_si256(u[i], u[i + 4], 0x20));
+                _mm256_storeu_si256((__m256i*)(out + destPitch * (i + 4)), _mm256_permute2x128_si256(u[i], u[i + 4], 0x31));
+            }
+        }
+        transposeBlock(dest, destPitch, source, sourcePitch, blockWidth, y, width, y + 8);
+    }
+    _mm256_zeroupper();
+    transposeSse2(dest + blockHeight * destPitch, destPitch, source + blockHeight, sourcePitch,
+                  width, height - blockHeight);
+}
+
+/*---------------------
+ * AVX-512, 16 pixels at a time
+ *-------------------*/
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i shadeAvx512(__m512i pixels, __m512 intensity)
+{
+    const __m512i channelMask = _mm512_set1_epi32(0xFF);
+    __m512i shaded = _mm512_setzero_si512();
+    for (int i = 0; i < 3; i++)
+    {
+        __m512 channel = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(pixels, i * 8), channelMask));
+        __m512i scaled = _mm512_cvttps_epi32(_mm512_mul_ps(channel, intensity));
+        shaded = _mm512_or_si512(shaded, _mm512_slli_epi32(scaled, i * 8));
+    }
+    __mmask16 bright = _mm512_cmp_ps_mask(intensity, _mm512_set1_ps(1), _CMP_GE_OQ);
+    return _mm512_mask_blend_epi32(bright, shaded, pixels);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512 getIntensitiesAvx512(const float* distances)
+{
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d scale = _mm512_set1_pd(150);
+    __m512d low = _mm512_mul_pd(_mm512_div_pd(half, _mm512_cvtps_pd(_mm256_loadu_ps(distances))), scale);
+    __m512d high = _mm512_mul_pd(_mm512_div_pd(half, _mm512_cvtps_pd(_mm256_loadu_ps(distances + 8))), scale);
+    __m512d both = _mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(low))),
+                                      _mm256_castps_pd(_mm512_cvtpd_ps(high)), 1);
+    return _mm512_castpd_ps(both);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+SPECIALIZED void wallColumnAvx512Loop(uint32_t* column, int firstRow, int endRow, const WallColumn* wall,
+                                      const WallSpecialization* special, bool keyed, bool shaded, bool pow2)
+{
+    const __m512 intensity = _mm512_set1_ps(special->intensity);
+    const __m512 texStep = _mm512_set1_ps(wall->texStep);
+    const __m512 texTop = _mm512_set1_ps(wall->texTop);
+    const __m512i texPitch = _mm512_set1_epi32(wall->texPitch);
+    const __m128i pitchShift = _mm_cvtsi32_si128(special->pitchShift);
+    const __m512i key = _mm512_set1_epi32((int)COLOR_KEY);
+    const __m512i keyColor = _mm512_set1_epi32((int)wall->keyColor);
+    const __m512i rowOffsets = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    int y = firstRow;
+    for (; y + 16 <= endRow; y += 16)
+    {
+        __m512 rows = _mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(y), rowOffsets));
+        __m512i texRows = _mm512_cvttps_epi32(_mm512_mul_ps(texStep, _mm512_sub_ps(rows, texTop)));
+        __m512i indices = pow2 ? _mm512_sll_epi32(texRows, pitchShift) : _mm512_mullo_epi32(texRows, texPitch);
+        __m512i color = _mm512_i32gather_epi32(indices, (const void*)wall->texels, 4);
+        if (keyed) color = _mm512_mask_mov_epi32(color, _mm512_cmpeq_epi32_mask(color, key), keyColor);
+        _mm512_storeu_si512((void*)(column + y), shaded ? shadeAvx512(color, intensity) : color);
+    }
+    wallColumnAvx2Loop(column, y, endRow, wall, special, keyed, shaded, pow2);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void wallColumnAvx512(uint32_t* column, int firstRow, int endRow, const WallColumn* wall)
+{
+    WallSpecialization special = getWallSpecialization(wall);
+    CALL_SPECIALIZED3(wallColumnAvx512Loop, special.keyed, special.shaded, special.pow2,
+                      column, firstRow, endRow, wall, &special);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i wrapTileAvx512(__m512i coords)
+{
+    const __m512i tileMask = _mm512_set1_epi32(TILE_DIMS - 1);
+    __m512i bias = _mm512_and_si512(_mm512_srai_epi32(coords, 31), tileMask);
+    return _mm512_sub_epi32(_mm512_and_si512(_mm512_add_epi32(coords, bias), tileMask), bias);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+SPECIALIZED __m512i wrapFloorAvx512(__m512i coords, bool positive)
+{
+    return positive ? _mm512_and_si512(coords, _mm512_set1_epi32(TILE_DIMS - 1)) : wrapTileAvx512(coords);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+SPECIALIZED void floorColumnAvx512Loop(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor,
+                                       const FloorSpecialization* special, bool positive, bool pow2)
+{
+    const __m512 cosAngle = _mm512_set1_ps(floor->cosAngle);
+    const __m512 sinAngle = _mm512_set1_ps(floor->sinAngle);
+    const __m512 inverseCos = _mm512_set1_ps(floor->inverseCosScreenAngle);
+    const __m512 originX = _mm512_set1_ps(floor->origin.x);
+    const __m512 originY = _mm512_set1_ps(floor->origin.y);
+    const __m512i texPitch = _mm512_set1_epi32(floor->texPitch);
+    const __m128i pitchShift = _mm_cvtsi32_si128(special->pitchShift);
+    int y = firstRow;
+    for (; y + 16 <= endRow; y += 16)
+    {
+        __m512 distance = _mm512_loadu_ps(floor->distances + y);
+        __m512i texX = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(cosAngle, distance), inverseCos), originX));
+        __m512i texY = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(sinAngle, distance), inverseCos), originY));
+        texX = wrapFloorAvx512(texX, positive);
+        texY = wrapFloorAvx512(texY, positive);
+        texY = pow2 ? _mm512_sll_epi32(texY, pitchShift) : _mm512_mullo_epi32(texY, texPitch);
+        __m512i color = _mm512_i32gather_epi32(_mm512_add_epi32(texY, texX), (const void*)floor->texels, 4);
+        _mm512_storeu_si512((void*)(column + y), shadeAvx512(color, getIntensitiesAvx512(floor->distances + y)));
+    }
+    floorColumnAvx2Loop(column, y, endRow, floor, special, positive, pow2);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void floorColumnAvx512(uint32_t* column, int firstRow, int endRow, const FloorColumn* floor)
+{
+    if (!isTileWrapMasked())
+    {
+        floorColumnScalar(column, firstRow, endRow, floor);
+        return;
+    }
+    FloorSpecialization special = getFloorSpecialization(floor, firstRow, endRow);
+    CALL_SPECIALIZED2(floorColumnAvx512Loop, special.positive, special.pow2,
+                      column, firstRow, endRow, floor, &special);
+}
+
+//Pixels with no alpha are simply not stored
+__attribute__((target("avx512f,avx512bw")))
+static void blendRowAvx512(uint32_t* dest, const uint32_t* source, int count, uint32_t maskColor)
+{
+    const __m512i alphaBits = _mm512_set1_epi32((int)0xFF000000);
+    const __m512i key = _mm512_set1_epi32((int)COLOR_KEY);
+    const __m512i mask = _mm512_set1_epi32((int)maskColor);
+    int x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m512i color = _mm512_loadu_si512((const void*)(source + x));
+        __mmask16 opaque = _mm512_test_epi32_mask(color, alphaBits);
+        color = _mm512_mask_mov_epi32(color, _mm512_cmpeq_epi32_mask(color, key), mask);
+        _mm512_mask_storeu_epi32((void*)(dest + x), opaque, color);
+    }
+    blendRowAvx2(dest + x, source + x, count - x, maskColor);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void fadeRowAvx512(uint32_t* row, int count, const FadeWeights* fade)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i keep = _mm512_set1_epi16(fade->keep);
+    //Every pixel's four channels are added to alike
+    const __m512i add = _mm512_set1_epi64((long long)((uint64_t)fade->add[0] | (uint64_t)fade->add[1] << 16 |
+                                                      (uint64_t)fade->add[2] << 32 | (uint64_t)fade->add[3] << 48));
+    int x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m512i pixels = _mm512_loadu_si512((const void*)(row + x));
+        __m512i lo = _mm512_unpacklo_epi8(pixels, zero);
+        __m512i hi = _mm512_unpackhi_epi8(pixels, zero);
+        lo = _mm512_srli_epi16(_mm512_add_epi16(_mm512_mullo_epi16(lo, keep), add), 8);
+        hi = _mm512_srli_epi16(_mm512_add_epi16(_mm512_mullo_epi16(hi, keep), add), 8);
+        _mm512_storeu_si512((void*)(row + x), _mm512_packus_epi16(lo, hi));
+    }
+    fadeRowAvx2(row + x, count - x, fade);
+}
+#endif
+
+//Indexed by KernelIsa, sets that aren't built for this target are left empty
+static const RenderKernels kernelSets[KERNEL_ISA_COUNT] =
+{
+    { KERNEL_ISA_SCALAR, wallColumnScalar, floorColumnScalar, blendRowScalar, fadeRowScalar, transposeScalar },
+#ifdef RENDER_KERNELS_X86
+    { KERNEL_ISA_SSE2, wallColumnSse2, floorColumnSse2, blendRowSse2, fadeRowSse2, transposeSse2 },
+    { KERNEL_ISA_AVX2, wallColumnAvx2, floorColumnAvx2, blendRowAvx2, fadeRowAvx2, transposeAvx2 },
+    //Wider blocks don't make the transpose any faster
+    { KERNEL_ISA_AVX512, wallColumnAvx512, floorColumnAvx512, blendRowAvx512, fadeRowAvx512, transposeAvx2 },
+#endif
+};
+
+static const RenderKernels* activeKernels = NULL;
+
+
+#ifdef RENDER_KERNELS_X86
+//Which register states the OS saves on a task switch
+static uint64_t getEnabledRegisterStates(void)
+{
+    uint32_t low, high;
+    __asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (uint64_t)high << 32 | low;
+}
+#endif
+
+/*------------------------------------------------------------------------------
+ * Output: The widest instruction set both the CPU and OS support, from CPUID.
+ * Description: AVX's registers are only usable if the OS saves them, which
+ *              XGETBV tells.
+ *----------------------------------------------------------------------------*/
+KernelIsa getBestKernelIsa(void)
+{
+#ifdef RENDER_KERNELS_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & bit_SSE2)) return KERNEL_ISA_SCALAR;
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return KERNEL_ISA_SSE2;
+    uint64_t states = getEnabledRegisterStates();
+    //SSE and AVX state
+    if ((states & 0x06) != 0x06) return KERNEL_ISA_SSE2;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) return KERNEL_ISA_SSE2;
+    //Mask registers and the upper halves of all 32 ZMM registers too
+    if ((states & 0xE6) != 0xE6 || !(ebx & bit_AVX512F) || !(ebx & bit_AVX512BW)) return KERNEL_ISA_AVX2;
+    return KERNEL_ISA_AVX512;
+#else
+    return KERNEL_ISA_SCALAR;
+#endif
+}
+
+const char* getKernelIsaName(KernelIsa isa)
+{
+    return isaNames[isa];
+}
+
+//Output: False if name isn't one of the instruction sets
+bool parseKernelIsa(const char* name, KernelIsa* isa)
+{
+    for (int i = 0; i < KERNEL_ISA_COUNT; i++)
+    {
+        if (strcmp(name, isaNames[i]) == 0)
+        {
+            *isa = (KernelIsa)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The widest instruction set to use, so slower sets can be compared.
+ * Description: Picks the kernels getRenderKernels() gives out and logs which.
+ *              Call before any drawing starts, it isn't thread safe.
+ *----------------------------------------------------------------------------*/
+void initRenderKernels(KernelIsa maxIsa)
+{
+    KernelIsa best = getBestKernelIsa();
+    KernelIsa isa = maxIsa < best ? maxIsa : best;
+    activeKernels = &kernelSets[isa];
+    SDL_Log("Render kernels: %s (this CPU supports up to %s)", getKernelIsaName(isa), getKernelIsaName(best));
+}
+
+//Output: The kernels to draw with, the best this CPU has unless initRenderKernels() was told otherwise
+const RenderKernels* getRenderKernels(void)
+{
+    if (activeKernels == NULL) initRenderKernels(KERNEL_ISA_COUNT - 1);
+    return activeKernels;
+}
+
+//Output: The kernels built for isa, which must be no wider than getBestKernelIsa()
+const RenderKernels* getKernelSet(KernelIsa isa)
+{
+    return &kernelSets[isa];
+}
@@ -0,0 +1,115 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "engine_types.h"
+
+
+/*------------------------------------------------------------------------------
+ * Inner loops are written once as a SPECIALIZED function taking bool flags
+ * last, and called through CALL_SPECIALIZED2/3 once per column or span.
+ * Every call passes its flags as constants and is inlined, so each becomes a
+ * loop of its own with the branches on them compiled out.
+ *----------------------------------------------------------------------------*/
+#ifdef __GNUC__
+    #define SPECIALIZED static inline __attribute__((always_inline))
+#else
+    #define SPECIALIZED static inline
+#endif
+
+//Each flag is evaluated once, before the call
+#define CALL_SPECIALIZED2(loop, a, b, ...)                                        \
+    do {                                                                          \
+        bool specializedA = (a);                                                  \
+        bool specializedB = (b);                                                  \
+        if (specializedA && specializedB)  loop(__VA_ARGS__, true, true);         \
+        else if (specializedA)             loop(__VA_ARGS__, true, false);        \
+        else if (specializedB)             loop(__VA_ARGS__, false, true);        \
+        else                               loop(__VA_ARGS__, false, false);       \
+    } while (0)
+
+#define CALL_SPECIALIZED3(loop, a, b, c, ...)                                     \
+    do {                                                                          \
+        bool specializedFirst = (a);                                              \
+        if (specializedFirst) CALL_SPECIALIZED2(loop, b, c, __VA_ARGS__, true);   \
+        else                  CALL_SPECIALIZED2(loop, b, c, __VA_ARGS__, false);  \
+    } while (0)
+
+//Instruction sets the kernels are built for, each needing the ones before it
+typedef enum
+{
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_SSE2,
+    KERNEL_ISA_AVX2,
+    KERNEL_ISA_AVX512,          //AVX-512 F and BW
+    KERNEL_ISA_COUNT
+} KernelIsa;
+
+//Wall pixels down one screen column, all from one column of the texture
+typedef struct
+{
+    const uint32_t* texels;     //Top of the texture column
+    int texPitch;               //Pixels from one texture row to the next
+    float texStep;              //Texture rows per screen row
+    float texTop;               //Screen row the top of the texture is on
+    uint32_t keyColor;          //Replaces 0xFFFF00FF, which is kept if it's the same
+    float distance;             //For depth shading
+} WallColumn;
+
+//Floor or ceiling pixels down one screen column, looking along a ray
+typedef struct
+{
+    const uint32_t* texels;     //The whole texture, tiled every TILE_DIMS
+    int texPitch;
+    const float* distances;     //Per screen row, how far away the floor is
+    float cosAngle;             //The ray's direction
+    float sinAngle;
+    float inverseCosScreenAngle;    //Undoes the fisheye correction in distances
+    Vector2 origin;             //Where the ray starts
+} FloorColumn;
+
+//A fade as integer weights, each channel becomes (in * keep + add) >> 8
+typedef struct
+{
+    uint16_t keep;
+    uint16_t add[4];            //The fade colour's channels times its weight, blue first
+} FadeWeights;
+
+/*------------------------------------------------------------------------------
+ * The renderer's innermost loops, one set per instruction set. Every set
+ * gives exactly the same pixels as the scalar one, the headless runner's
+ * --check-kernels makes sure of it.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    KernelIsa isa;
+    //Rows firstRow up to endRow of a column stored top to bottom
+    void (*wallColumn)  (uint32_t* column, int firstRow, int endRow, const WallColumn* wall);
+    void (*floorColumn) (uint32_t* column, int firstRow, int endRow, const FloorColumn* floor);
+    //Copies a row of an image over dest leaving out pixels with no alpha,
+    //0xFFFF00FF pixels become maskColor
+    void (*blendRow)    (uint32_t* dest, const uint32_t* source, int count, uint32_t maskColor);
+    void (*fadeRow)     (uint32_t* row, int count, const FadeWeights* fade);
+    //Source's columns become dest's rows, width and height are dest's
+    void (*transpose)   (uint32_t* dest, int destPitch, const uint32_t* source, int sourcePitch,
+                         int width, int height);
+} RenderKernels;
+
+
+float                getShadingIntensity   (float distance);
+uint32_t             shadeColor            (uint32_t inColor, float intensity);
+uint32_t             depthShading          (uint32_t inColor, float distance);
+int                  getPow2Shift          (int size);
+KernelIsa            getBestKernelIsa      (void);
+const char*          getKernelIsaName      (KernelIsa isa);
+bool                 parseKernelIsa        (const char* name, KernelIsa* isa);
+void                 initRenderKernels     (KernelIsa maxIsa);
+const RenderKernels* getRenderKernels      (void);
+const RenderKernels* getKernelSet          (KernelIsa isa);
@@ -0,0 +1,216 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <string.h>
+
+#include "replay.h"
+
+
+static const char REPLAY_MAGIC[4] = { 'O', 'U', 'B', 'R' };
+static const uint8_t REPLAY_VERSION = 1;
+//Where the tick count is in the header, filled in by stopRecording()
+static const long TICK_COUNT_OFFSET = 13;
+
+enum
+{
+    TICK_BUTTONS    = 1 << 0,
+    TICK_AXES       = 1 << 1,
+    TICK_ROTATION   = 1 << 2,
+    TICK_CHECKSUM   = 1 << 3
+};
+
+//Everything is written little endian a byte at a time, so files work on any platform
+static void writeU16(FILE* file, uint16_t value)
+{
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+static void writeU32(FILE* file, uint32_t value)
+{
+    writeU16(file, value & 0xFFFF);
+    writeU16(file, value >> 16);
+}
+
+static bool readU16(FILE* file, uint16_t* value)
+{
+    int lo = fgetc(file);
+    int hi = fgetc(file);
+    if (lo == EOF || hi == EOF) return false;
+    *value = (uint16_t)(lo | (hi << 8));
+    return true;
+}
+
+static bool readU32(FILE* file, uint32_t* value)
+{
+    uint16_t lo, hi;
+    if (!readU16(file, &lo) || !readU16(file, &hi)) return false;
+    *value = lo | ((uint32_t)hi << 16);
+    return true;
+}
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The replay, the file to record to and the seed and level the game
+ *        was started with by initGame().
+ * Output: False if the file couldn't be opened.
+ *----------------------------------------------------------------------------*/
+bool startRecording(Replay* replay, const char* filePath, uint32_t seed, int levelNumber)
+{
+    memset(replay, 0, sizeof(Replay));
+    replay->file = fopen(filePath, "wb");
+    if (replay->file == NULL)
+    {
+        SDL_Log("Could not open %s to record to.", filePath);
+        return false;
+    }
+    replay->recording = true;
+    replay->seed = seed;
+    replay->levelNumber = levelNumber;
+
+    fwrite(REPLAY_MAGIC, 1, sizeof(REPLAY_MAGIC), replay->file);
+    fputc(REPLAY_VERSION, replay->file);
+    writeU32(replay->file, seed);
+    writeU32(replay->file, (uint32_t)levelNumber);
+    writeU32(replay->file, 0);
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The replay, the input a tick was run with and the game after it.
+ * Description: Call after every tickGame().
+ *----------------------------------------------------------------------------*/
+void recordTick(Replay* replay, const TickInput* input, const Game* game)
+{
+    if (replay->file == NULL) return;
+    const TickInput* last = &replay->last;
+    bool first = replay->tickCount == 0;
+    uint8_t flags = 0;
+    if (first || input->buttons != last->buttons) flags |= TICK_BUTTONS;
+    if (first || memcmp(input->joystickAxes, last->joystickAxes, sizeof(input->joystickAxes)) != 0) flags |= TICK_AXES;
+    if (first || floatBits(input->rotation) != floatBits(last->rotation)) flags |= TICK_ROTATION;
+    if (replay->tickCount % REPLAY_CHECKSUM_INTERVAL == REPLAY_CHECKSUM_INTERVAL - 1) flags |= TICK_CHECKSUM;
+
+    fputc(flags, replay->file);
+    if (flags & TICK_BUTTONS) writeU16(replay->file, input->buttons);
+    if (flags & TICK_AXES)
+    {
+        for (int i = 0; i < 3; i++) writeU16(replay->file, (uint16_t)input->joystickAxes[i]);
+    }
+    if (flags & TICK_ROTATION) writeU32(replay->file, floatBits(input->rotation));
+    if (flags & TICK_CHECKSUM) writeU32(replay->file, getGameChecksum(game));
+
+    replay->last = *input;
+    replay->tickCount++;
+}
+
+//Fills in the tick count in the header and closes the file
+void stopRecording(Replay* replay)
+{
+    if (replay->file == NULL) return;
+    fseek(replay->file, TICK_COUNT_OFFSET, SEEK_SET);
+    writeU32(replay->file, replay->tickCount);
+    fclose(replay->file);
+    replay->file = NULL;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The replay and a file written by startRecording().
+ * Output: False if it couldn't be opened or isn't a recording. Otherwise the
+ *         replay's seed and levelNumber are what to pass to initGame().
+ *----------------------------------------------------------------------------*/
+bool openReplay(Replay* replay, const char* filePath)
+{
+    memset(replay, 0, sizeof(Replay));
+    replay->file = fopen(filePath, "rb");
+    if (replay->file == NULL)
+    {
+        SDL_Log("Could not open replay %s.", filePath);
+        return false;
+    }
+    char magic[sizeof(REPLAY_MAGIC)];
+    uint32_t levelNumber;
+    if (fread(magic, 1, sizeof(magic), replay->file) != sizeof(magic) ||
+        memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+        fgetc(replay->file) != REPLAY_VERSION ||
+        !readU32(replay->file, &replay->seed) ||
+        !readU32(replay->file, &levelNumber) ||
+        !readU32(replay->file, &replay->tickCount))
+    {
+        SDL_Log("%s is not a replay this version can read.", filePath);
+        closeReplay(replay);
+        return false;
+    }
+    replay->levelNumber = (int)levelNumber;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The replay and where to put the next tick's input.
+ * Output: False once every recorded tick has been read.
+ *----------------------------------------------------------------------------*/
+bool readReplayTick(Replay* replay, TickInput* input)
+{
+    if (replay->file == NULL || replay->ticksRead >= replay->tickCount) return false;
+    int flags = fgetc(replay->file);
+    if (flags == EOF) return false;
+
+    bool ok = true;
+    if (flags & TICK_BUTTONS) ok = ok && readU16(replay->file, &replay->last.buttons);
+    if (flags & TICK_AXES)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            uint16_t axis = 0;
+            ok = ok && readU16(replay->file, &axis);
+            replay->last.joystickAxes[i] = (int16_t)axis;
+        }
+    }
+    if (flags & TICK_ROTATION)
+    {
+        uint32_t bits = 0;
+        ok = ok && readU32(replay->file, &bits);
+        memcpy(&replay->last.rotation, &bits, sizeof(bits));
+    }
+    replay->hasChecksum = (flags & TICK_CHECKSUM) != 0;
+    if (replay->hasChecksum) ok = ok && readU32(replay->file, &replay->checksum);
+    if (!ok)
+    {
+        SDL_Log("Replay ends part way through tick %u.", replay->ticksRead);
+        return false;
+    }
+    *input = replay->last;
+    replay->ticksRead++;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The replay and the game after running the tick just read.
+ * Output: False if the game no longer matches the recording. Only the first
+ *         drift is logged, everything after it is expected to differ.
+ *----------------------------------------------------------------------------*/
+bool verifyReplayTick(Replay* replay, const Game* game)
+{
+    if (!replay->hasChecksum || replay->drifted) return !replay->drifted;
+    if (getGameChecksum(game) == replay->checksum) return true;
+    replay->drifted = true;
+    replay->driftTick = replay->ticksRead - 1;
+    SDL_Log("Replay drifted from the recording by tick %u.", replay->driftTick);
+    return false;
+}
+
+void closeReplay(Replay* replay)
+{
+    if (replay->file == NULL) return;
+    fclose(replay->file);
+    replay->file = NULL;
+}
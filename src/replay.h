@@ -0,0 +1,48 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "game.h"
+
+
+//A checksum of the game is stored this often, so drift is caught near where it starts
+#define REPLAY_CHECKSUM_INTERVAL GAME_TICK_HZ
+
+/*------------------------------------------------------------------------------
+ * A recording is the seed and level a game started with followed by the
+ * TickInput of every tick. Each tick is one flags byte saying which parts of
+ * the input changed since the last tick, then only those parts, so a tick
+ * where nothing changes is a single byte.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    FILE* file;
+    bool recording;
+    uint32_t seed;
+    int levelNumber;
+    uint32_t tickCount;         //Ticks written so far, or in the file when replaying
+    uint32_t ticksRead;
+    TickInput last;
+
+    bool hasChecksum;           //The tick just read has a checksum to verify
+    uint32_t checksum;
+    bool drifted;
+    uint32_t driftTick;         //First tick that didn't match the recording
+} Replay;
+
+
+bool startRecording      (Replay* replay, const char* filePath, uint32_t seed, int levelNumber);
+void recordTick          (Replay* replay, const TickInput* input, const Game* game);
+void stopRecording       (Replay* replay);
+bool openReplay          (Replay* replay, const char* filePath);
+bool readReplayTick      (Replay* replay, TickInput* input);
+bool verifyReplayTick    (Replay* replay, const Game* game);
+void closeReplay         (Replay* replay);
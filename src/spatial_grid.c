@@ -0,0 +1,224 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "spatial_grid.h"
+#include "load_level.h"
+
+
+static int getCell(const SpatialGrid* grid, Vector2 pos)
+{
+    int x = (int)(pos.x / TILE_DIMS);
+    int y = (int)(pos.y / TILE_DIMS);
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x >= grid->width) x = grid->width - 1;
+    if (y >= grid->height) y = grid->height - 1;
+    return y * grid->width + x;
+}
+
+static void linkEntity(SpatialGrid* grid, int index, int cell)
+{
+    grid->entityCell[index] = cell;
+    grid->prev[index] = -1;
+    grid->next[index] = grid->cellHeads[cell];
+    if (grid->cellHeads[cell] != -1) grid->prev[grid->cellHeads[cell]] = index;
+    grid->cellHeads[cell] = index;
+}
+
+static void unlinkEntity(SpatialGrid* grid, int index)
+{
+    int cell = grid->entityCell[index];
+    if (grid->prev[index] != -1) grid->next[grid->prev[index]] = grid->next[index];
+    else grid->cellHeads[cell] = grid->next[index];
+    if (grid->next[index] != -1) grid->prev[grid->next[index]] = grid->prev[index];
+}
+
+static void addResult(EntityIndexList* results, int index)
+{
+    if (results->count == results->capacity)
+    {
+        //MALLOC owned by the caller's list, reused between queries
+        results->capacity = results->capacity == 0 ? 32 : results->capacity * 2;
+        results->indices = (int*)realloc(results->indices, results->capacity * sizeof(int));
+    }
+    results->indices[results->count++] = index;
+}
+
+/*------------------------------------------------------------------------------
+ * Input:
+ *      SpatialGrid* grid: The grid to (re)build, may be zeroed.
+ *      const Level* level: The level the entities are in.
+ *      const Vector2* pos: The centre of every entity in the pool.
+ *      int count: How many entities there are.
+ *      int entityWidth, entityHeight: The size of every entity's bounding box.
+ * Description:
+ *      Sizes the grid to the level and buckets every entity. Reuses
+ *      the grid's memory when it is already big enough.
+ *----------------------------------------------------------------------------*/
+void buildSpatialGrid(SpatialGrid* grid, const Level* level, const Vector2* pos, int count, int entityWidth, int entityHeight)
+{
+    grid->width = getLevelWidth(level);
+    grid->height = getLevelHeight(level);
+    int cellCount = grid->width * grid->height;
+    if (cellCount > grid->cellCapacity)
+    {
+        //MALLOC should free with the pool that owns the grid
+        grid->cellCapacity = cellCount;
+        grid->cellHeads = (int*)realloc(grid->cellHeads, cellCount * sizeof(int));
+    }
+    for (int i = 0; i < cellCount; i++) grid->cellHeads[i] = -1;
+
+    if (count > grid->capacity)
+    {
+        grid->capacity = count;
+        grid->next = (int*)realloc(grid->next, grid->capacity * sizeof(int));
+        grid->prev = (int*)realloc(grid->prev, grid->capacity * sizeof(int));
+        grid->entityCell = (int*)realloc(grid->entityCell, grid->capacity * sizeof(int));
+    }
+
+    grid->halfWidth = entityWidth / 2 + 1;
+    grid->halfHeight = entityHeight / 2 + 1;
+    for (int i = 0; i < count; i++)
+    {
+        linkEntity(grid, i, getCell(grid, pos[i]));
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: A grid already built for the level, the pool's positions, how many
+ *        entities are bucketed now and how many there are to bucket.
+ * Description: Buckets every entity afresh, leaving the grid as
+ *              buildSpatialGrid() would. Only the buckets in use are emptied,
+ *              so it costs nothing like the whole level. count mustn't be
+ *              more than the grid was built for.
+ *----------------------------------------------------------------------------*/
+void rebucketSpatialGrid(SpatialGrid* grid, const Vector2* pos, int oldCount, int count)
+{
+    for (int i = 0; i < oldCount; i++)
+    {
+        grid->cellHeads[grid->entityCell[i]] = -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        linkEntity(grid, i, getCell(grid, pos[i]));
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The grid, the pool's positions and the index of one that has moved.
+ * Description: Moves the entity to the right bucket. Cheap when it is still
+ *              in the same tile, so can be called for every monster every
+ *              frame.
+ *----------------------------------------------------------------------------*/
+void moveSpatialGridEntity(SpatialGrid* grid, const Vector2* pos, int index)
+{
+    int cell = getCell(grid, pos[index]);
+    if (cell == grid->entityCell[index]) return;
+    unlinkEntity(grid, index);
+    linkEntity(grid, index, cell);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The grid, the index of an entity being removed from its pool and the
+ *        index of the pool's last entity, which is being moved into its place.
+ * Description: Call alongside the pool's own swap-removal. Indices above the
+ *              removed one are untouched apart from the last, so removing in
+ *              descending index order never skips or revisits an entity.
+ *----------------------------------------------------------------------------*/
+void removeSpatialGridEntity(SpatialGrid* grid, int index, int last)
+{
+    unlinkEntity(grid, index);
+    if (index != last)
+    {
+        int cell = grid->entityCell[last];
+        unlinkEntity(grid, last);
+        linkEntity(grid, index, cell);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The grid, the pool's positions, a rectangle in world space and a list
+ *        for the results.
+ * Description: Fills results with every entity whose bounding box overlaps
+ *              rect, in ascending index order.
+ *----------------------------------------------------------------------------*/
+void querySpatialGridRect(const SpatialGrid* grid, const Vector2* pos, SDL_Rect rect, EntityIndexList* results)
+{
+    results->count = 0;
+    if (grid->cellHeads == NULL) return;
+
+    //Entities centred in a neighbouring tile can still poke into rect
+    Vector2 topLeft = { rect.x - grid->halfWidth, rect.y - grid->halfHeight };
+    Vector2 bottomRight = { rect.x + rect.w + grid->halfWidth, rect.y + rect.h + grid->halfHeight };
+    int firstCell = getCell(grid, topLeft);
+    int lastCell = getCell(grid, bottomRight);
+    int entityWidth = (grid->halfWidth - 1) * 2;
+    int entityHeight = (grid->halfHeight - 1) * 2;
+
+    for (int y = firstCell / grid->width; y <= lastCell / grid->width; y++)
+    {
+        for (int x = firstCell % grid->width; x <= lastCell % grid->width; x++)
+        {
+            for (int i = grid->cellHeads[y * grid->width + x]; i != -1; i = grid->next[i])
+            {
+                SDL_Rect entityRect = { pos[i].x - entityWidth / 2, pos[i].y - entityHeight / 2,
+                                        entityWidth, entityHeight };
+                if (rectsIntersect(rect, entityRect)) addResult(results, i);
+            }
+        }
+    }
+    //Buckets are small, insertion sort keeps results in index order
+    for (int i = 1; i < results->count; i++)
+    {
+        int value = results->indices[i];
+        int j = i - 1;
+        for (; j >= 0 && results->indices[j] > value; j--) results->indices[j + 1] = results->indices[j];
+        results->indices[j + 1] = value;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The grid, the pool's positions, a circle in world space and a list
+ *        for the results.
+ * Description: Fills results with every entity whose centre is inside the
+ *              circle. The order of the results is not defined.
+ *----------------------------------------------------------------------------*/
+void querySpatialGridRadius(const SpatialGrid* grid, const Vector2* pos, Vector2 center, float radius, EntityIndexList* results)
+{
+    results->count = 0;
+    if (grid->cellHeads == NULL) return;
+
+    Vector2 topLeft = { center.x - radius, center.y - radius };
+    Vector2 bottomRight = { center.x + radius, center.y + radius };
+    int firstCell = getCell(grid, topLeft);
+    int lastCell = getCell(grid, bottomRight);
+    float radiusSquared = radius * radius;
+
+    for (int y = firstCell / grid->width; y <= lastCell / grid->width; y++)
+    {
+        for (int x = firstCell % grid->width; x <= lastCell % grid->width; x++)
+        {
+            for (int i = grid->cellHeads[y * grid->width + x]; i != -1; i = grid->next[i])
+            {
+                float dx = pos[i].x - center.x;
+                float dy = pos[i].y - center.y;
+                if (dx * dx + dy * dy < radiusSquared) addResult(results, i);
+            }
+        }
+    }
+}
+
+void freeSpatialGrid(SpatialGrid* grid)
+{
+    free(grid->cellHeads);
+    free(grid->next);
+    free(grid->prev);
+    free(grid->entityCell);
+    memset(grid, 0, sizeof(SpatialGrid));
+}
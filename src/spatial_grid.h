@@ -0,0 +1,49 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include "engine_types.h"
+
+
+/*------------------------------------------------------------------------------
+ * Buckets the entities of one pool by the tile their centre is in. Each
+ * bucket is a doubly linked list threaded through next/prev, so moving or
+ * removing an entity never has to search a bucket. Every entity in a pool is
+ * the same size, given by halfWidth/halfHeight.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    int width;
+    int height;
+    int cellCapacity;
+    int* cellHeads;     //Per tile, first entity in the bucket or -1
+
+    int capacity;
+    int* next;          //Per entity
+    int* prev;          //Per entity
+    int* entityCell;    //Per entity, the tile it is bucketed in
+
+    int halfWidth;
+    int halfHeight;
+} SpatialGrid;
+
+//A growable list of entity indices filled in by the spatial grid queries
+typedef struct
+{
+    int count;
+    int capacity;
+    int* indices;
+} EntityIndexList;
+
+
+void buildSpatialGrid       (SpatialGrid* grid, const Level* level, const Vector2* pos, int count, int entityWidth, int entityHeight);
+void rebucketSpatialGrid    (SpatialGrid* grid, const Vector2* pos, int oldCount, int count);
+void moveSpatialGridEntity  (SpatialGrid* grid, const Vector2* pos, int index);
+void removeSpatialGridEntity(SpatialGrid* grid, int index, int last);
+void querySpatialGridRect   (const SpatialGrid* grid, const Vector2* pos, SDL_Rect rect, EntityIndexList* results);
+void querySpatialGridRadius (const SpatialGrid* grid, const Vector2* pos, Vector2 center, float radius, EntityIndexList* results);
+void freeSpatialGrid        (SpatialGrid* grid);
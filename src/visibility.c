@@ -0,0 +1,357 @@
+/*
+ Tile-to-tile visibility cache for monster line of sight
+ Seoras Macdonald
+ seoras1@gmail.com
+ 2015
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+#include "visibility.h"
+#include "load_level.h"
+
+
+/*---------------------
+ * Defines
+ *-------------------*/
+#define VIS_WINDOW_DIMS     (2 * VISIBILITY_RADIUS + 1)
+#define VIS_ENTRIES_PER_ROW (VIS_WINDOW_DIMS * VIS_WINDOW_DIMS)
+#define VIS_WORDS_PER_ROW   ((VIS_ENTRIES_PER_ROW * 2 + 31) / 32)
+#define VIS_ROW_NOT_BUILT   (-1)
+//Levels with more tiles than this build their rows on first use instead of
+//all at once when the level loads.
+#define VIS_EAGER_MAX_TILES (256 * 256)
+#define VIS_SAMPLE_COUNT    5
+
+//Whether a tile stops a segment, everything off the level does
+static bool isTileBlocking(const Level* level, int tileX, int tileY)
+{
+    if (tileX < 0 || tileY < 0 || tileX >= level->width || tileY >= level->height)
+        return true;
+    return isTileSolid(level, coordToTileIndex(level, tileX, tileY));
+}
+
+/*------------------------------------------------------------------------------
+ * Input: Two points in world space.
+ * Output: True if no solid tile lies between the two points.
+ * Description: Walks every tile the segment passes through (Amanatides & Woo
+ *              grid traversal), so unlike a fixed step ray it can not skip
+ *              over the corner of a wall. Passing exactly through a corner
+ *              counts as blocked if either tile beside it is solid.
+ *----------------------------------------------------------------------------*/
+bool isSegmentClear(const Level* level, Vector2 from, Vector2 to)
+{
+    int tileX = (int)(from.x / TILE_DIMS);
+    int tileY = (int)(from.y / TILE_DIMS);
+    int endTileX = (int)(to.x / TILE_DIMS);
+    int endTileY = (int)(to.y / TILE_DIMS);
+
+    float dx = to.x - from.x;
+    float dy = to.y - from.y;
+    int stepX = (dx > 0) - (dx < 0);
+    int stepY = (dy > 0) - (dy < 0);
+
+    float tDeltaX = dx != 0 ? TILE_DIMS / fabsf(dx) : FLT_MAX;
+    float tDeltaY = dy != 0 ? TILE_DIMS / fabsf(dy) : FLT_MAX;
+    float tMaxX = FLT_MAX;
+    float tMaxY = FLT_MAX;
+    if (dx > 0) tMaxX = ((tileX + 1) * TILE_DIMS - from.x) / dx;
+    else if (dx < 0) tMaxX = (from.x - tileX * TILE_DIMS) / -dx;
+    if (dy > 0) tMaxY = ((tileY + 1) * TILE_DIMS - from.y) / dy;
+    else if (dy < 0) tMaxY = (from.y - tileY * TILE_DIMS) / -dy;
+
+    //Never take more steps than there are tile borders between the ends, so
+    //float error can't walk us past the end tile.
+    int stepsLeft = abs(endTileX - tileX) + abs(endTileY - tileY);
+    while (stepsLeft > 0)
+    {
+        if (tMaxX == tMaxY && stepX != 0 && stepY != 0 && stepsLeft >= 2)
+        {
+            //Through a corner, both tiles beside it have to be open
+            if (isTileBlocking(level, tileX + stepX, tileY) || isTileBlocking(level, tileX, tileY + stepY))
+                return false;
+            tileX += stepX;
+            tileY += stepY;
+            tMaxX += tDeltaX;
+            tMaxY += tDeltaY;
+            stepsLeft -= 2;
+        }
+        else if (tMaxX < tMaxY)
+        {
+            tileX += stepX;
+            tMaxX += tDeltaX;
+            stepsLeft--;
+        }
+        else
+        {
+            tileY += stepY;
+            tMaxY += tDeltaY;
+            stepsLeft--;
+        }
+        if (isTileBlocking(level, tileX, tileY)) return false;
+    }
+    return true;
+}
+
+static TileVisibility getRowEntry(const uint32_t* row, int entry)
+{
+    return (TileVisibility)((row[entry / 16] >> ((entry % 16) * 2)) & 0x3);
+}
+
+static void setRowEntry(uint32_t* row, int entry, TileVisibility value)
+{
+    int shift = (entry % 16) * 2;
+    row[entry / 16] = (row[entry / 16] & ~(0x3u << shift)) | ((uint32_t)value << shift);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The tile coordinates of two open tiles.
+ * Output: True if a solid row or column of tiles runs right across the box
+ *         the two tiles span, with one tile on each side of it.
+ * Description: Every segment between the tiles stays inside that box, so it
+ *              has to cross the wall. This is what lets VIS_NONE be trusted.
+ *----------------------------------------------------------------------------*/
+static bool isWallBetweenTiles(const Level* level, int ax, int ay, int bx, int by)
+{
+    int minX = ax < bx ? ax : bx;
+    int maxX = ax < bx ? bx : ax;
+    int minY = ay < by ? ay : by;
+    int maxY = ay < by ? by : ay;
+
+    for (int y = minY + 1; y < maxY; y++)
+    {
+        bool solidRow = true;
+        for (int x = minX; x <= maxX && solidRow; x++)
+        {
+            solidRow = isTileSolid(level, coordToTileIndex(level, x, y));
+        }
+        if (solidRow) return true;
+    }
+    for (int x = minX + 1; x < maxX; x++)
+    {
+        bool solidColumn = true;
+        for (int y = minY; y <= maxY && solidColumn; y++)
+        {
+            solidColumn = isTileSolid(level, coordToTileIndex(level, x, y));
+        }
+        if (solidColumn) return true;
+    }
+    return false;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The tile coordinates of two open tiles.
+ * Output: How much of tile b can be seen from tile a.
+ * Description: A pair is VIS_FULL when rays between every pair of sample points
+ *              (the four corners and the centre of each tile) are clear. The
+ *              corner to corner rays bound every other segment between the
+ *              tiles, and walls are whole tiles, so nothing can be poking in
+ *              between them. A pair is only VIS_NONE when a straight wall
+ *              separates them; anything else is VIS_PARTIAL.
+ *----------------------------------------------------------------------------*/
+static TileVisibility computeTileVisibility(const Level* level, int ax, int ay, int bx, int by)
+{
+    if (ax == bx && ay == by) return VIS_FULL;
+    if (isWallBetweenTiles(level, ax, ay, bx, by)) return VIS_NONE;
+
+    //The corners are pulled in a touch so rays ending on them never brush a
+    //tile outside the box the two tiles span.
+    const float nearEdge = 0.01f;
+    const float farEdge = TILE_DIMS - 0.01f;
+    const float samples[VIS_SAMPLE_COUNT][2] = {
+        { nearEdge, nearEdge }, { farEdge, nearEdge }, { nearEdge, farEdge },
+        { farEdge, farEdge }, { TILE_DIMS / 2, TILE_DIMS / 2 } };
+
+    for (int i = 0; i < VIS_SAMPLE_COUNT; i++)
+    {
+        Vector2 from = { ax * TILE_DIMS + samples[i][0], ay * TILE_DIMS + samples[i][1] };
+        for (int j = 0; j < VIS_SAMPLE_COUNT; j++)
+        {
+            Vector2 to = { bx * TILE_DIMS + samples[j][0], by * TILE_DIMS + samples[j][1] };
+            if (!isSegmentClear(level, from, to)) return VIS_PARTIAL;
+        }
+    }
+    return VIS_FULL;
+}
+
+static TileVisibility computeRowEntry(const Level* level, int ax, int ay, int entry)
+{
+    int bx = ax + entry % VIS_WINDOW_DIMS - VISIBILITY_RADIUS;
+    int by = ay + entry / VIS_WINDOW_DIMS - VISIBILITY_RADIUS;
+    if (bx < 0 || by < 0 || bx >= level->width || by >= level->height)
+        return VIS_NONE;
+    if (isTileSolid(level, coordToTileIndex(level, bx, by)))
+        return VIS_NONE;
+    return computeTileVisibility(level, ax, ay, bx, by);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The index of an open tile.
+ * Output: The tile's visibility row, computing it first if it doesn't exist.
+ *----------------------------------------------------------------------------*/
+static uint32_t* getVisibilityRow(Level* level, int index)
+{
+    VisibilityCache* visibility = &level->visibility;
+    if (visibility->rowOffsets[index] != VIS_ROW_NOT_BUILT)
+    {
+        return visibility->rows + visibility->rowOffsets[index];
+    }
+
+    if (visibility->rowCount == visibility->rowCapacity)
+    {
+        visibility->rowCapacity = visibility->rowCapacity == 0 ? 64 : visibility->rowCapacity * 2;
+        visibility->rows = (uint32_t*)realloc(visibility->rows,
+            visibility->rowCapacity * VIS_WORDS_PER_ROW * sizeof(uint32_t));
+    }
+    visibility->rowOffsets[index] = visibility->rowCount * VIS_WORDS_PER_ROW;
+    visibility->rowCount++;
+
+    uint32_t* row = visibility->rows + visibility->rowOffsets[index];
+    memset(row, 0, VIS_WORDS_PER_ROW * sizeof(uint32_t));
+    int ax = index % visibility->width;
+    int ay = index / visibility->width;
+    for (int entry = 0; entry < VIS_ENTRIES_PER_ROW; entry++)
+    {
+        setRowEntry(row, entry, computeRowEntry(level, ax, ay, entry));
+    }
+    return row;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Throws away the cache for the previous level and sizes it for
+ *              the current one. Called after the level tiles are loaded.
+ *              Small levels have every open tile's row computed here, big
+ *              ones compute rows the first time a monster looks from them.
+ *----------------------------------------------------------------------------*/
+void buildVisibility(Level* level)
+{
+    VisibilityCache* visibility = &level->visibility;
+    visibility->width = level->width;
+    visibility->height = level->height;
+    int tileCount = visibility->width * visibility->height;
+
+    //MALLOC freed when loading a new level or by freeVisibility()
+    free(visibility->rowOffsets);
+    visibility->rowOffsets = (int32_t*)malloc(tileCount * sizeof(int32_t));
+    for (int i = 0; i < tileCount; i++)
+    {
+        visibility->rowOffsets[i] = VIS_ROW_NOT_BUILT;
+    }
+    visibility->rowCount = 0;
+
+    if (tileCount > VIS_EAGER_MAX_TILES) return;
+    for (int i = 0; i < tileCount; i++)
+    {
+        if (!isTileSolid(level, i)) getVisibilityRow(level, i);
+    }
+}
+
+//Frees the rows of a level's visibility cache
+void freeVisibility(VisibilityCache* visibility)
+{
+    free(visibility->rowOffsets);
+    free(visibility->rows);
+    memset(visibility, 0, sizeof(VisibilityCache));
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The index of a tile that has just changed (e.g. a door opening).
+ * Description: Recomputes just the entries that could have changed. A segment
+ *              between two tiles can only pass through a tile that is inside
+ *              both of their windows, so only rows within VISIBILITY_RADIUS of
+ *              the changed tile, and only their entries that are also within
+ *              VISIBILITY_RADIUS of it, need redoing.
+ *----------------------------------------------------------------------------*/
+void updateVisibilityAroundTile(Level* level, int index)
+{
+    VisibilityCache* visibility = &level->visibility;
+    if (visibility->rowOffsets == NULL) return;
+    int tx = index % visibility->width;
+    int ty = index / visibility->width;
+
+    for (int ay = ty - VISIBILITY_RADIUS; ay <= ty + VISIBILITY_RADIUS; ay++)
+    {
+        for (int ax = tx - VISIBILITY_RADIUS; ax <= tx + VISIBILITY_RADIUS; ax++)
+        {
+            if (ax < 0 || ay < 0 || ax >= visibility->width || ay >= visibility->height)
+                continue;
+            int rowIndex = coordToTileIndex(level, ax, ay);
+            if (visibility->rowOffsets[rowIndex] == VIS_ROW_NOT_BUILT)
+                continue;
+
+            uint32_t* row = visibility->rows + visibility->rowOffsets[rowIndex];
+            for (int by = ty - VISIBILITY_RADIUS; by <= ty + VISIBILITY_RADIUS; by++)
+            {
+                for (int bx = tx - VISIBILITY_RADIUS; bx <= tx + VISIBILITY_RADIUS; bx++)
+                {
+                    if (abs(bx - ax) > VISIBILITY_RADIUS || abs(by - ay) > VISIBILITY_RADIUS)
+                        continue;
+                    int entry = (by - ay + VISIBILITY_RADIUS) * VIS_WINDOW_DIMS + (bx - ax + VISIBILITY_RADIUS);
+                    setRowEntry(row, entry, computeRowEntry(level, ax, ay, entry));
+                }
+            }
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The index of a tile.
+ * Description: Makes sure the tile's row is built. Lookups from a built row
+ *              don't write to the cache, so they are safe to make from several
+ *              threads at once.
+ *----------------------------------------------------------------------------*/
+void prepareVisibilityRow(Level* level, int index)
+{
+    if (isTileIndexValid(level, index) && !isTileSolid(level, index)) getVisibilityRow(level, index);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The indices of two tiles.
+ * Output: How much of the second tile can be seen from the first. Tiles
+ *         further apart than VISIBILITY_RADIUS are reported as VIS_PARTIAL,
+ *         since the cache knows nothing about them.
+ *----------------------------------------------------------------------------*/
+TileVisibility getTileVisibility(Level* level, int fromIndex, int toIndex)
+{
+    const VisibilityCache* visibility = &level->visibility;
+    if (isTileSolid(level, fromIndex)) return VIS_NONE;
+    int dx = toIndex % visibility->width - fromIndex % visibility->width;
+    int dy = toIndex / visibility->width - fromIndex / visibility->width;
+    if (abs(dx) > VISIBILITY_RADIUS || abs(dy) > VISIBILITY_RADIUS) return VIS_PARTIAL;
+
+    int entry = (dy + VISIBILITY_RADIUS) * VIS_WINDOW_DIMS + (dx + VISIBILITY_RADIUS);
+    return getRowEntry(getVisibilityRow(level, fromIndex), entry);
+}
+
+/*------------------------------------------------------------------------------
+ * Input: Two points in world space.
+ * Output: True if a straight line between the points doesn't hit a wall.
+ * Description: Most pairs are settled by the cached tile visibility; only
+ *              pairs of tiles that are partly hidden from each other need the
+ *              exact segment walk.
+ *----------------------------------------------------------------------------*/
+bool hasLineOfSight(Level* level, Vector2 from, Vector2 to)
+{
+    int fromIndex = posVecToTileIndex(level, from);
+    int toIndex = posVecToTileIndex(level, to);
+    if (!isTileIndexValid(level, fromIndex) || !isTileIndexValid(level, toIndex)) return false;
+
+    switch (getTileVisibility(level, fromIndex, toIndex))
+    {
+    case VIS_FULL:
+        return true;
+    case VIS_NONE:
+        return false;
+    default:
+        return isSegmentClear(level, from, to);
+    }
+}
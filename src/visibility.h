@@ -0,0 +1,49 @@
+/*
+ Tile-to-tile visibility cache for monster line of sight
+ Seoras Macdonald
+ seoras1@gmail.com
+ 2015
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "engine_types.h"
+
+
+//How many tiles either side of a tile its visibility row covers. Must cover
+//monsterSightRadius plus the tile the player is straddling.
+#define VISIBILITY_RADIUS 5
+
+typedef enum
+{
+    VIS_NONE,       //A wall cuts the tiles off from each other
+    VIS_PARTIAL,    //Can't tell from the tiles alone, needs a fine check
+    VIS_FULL        //Every point can see every other point
+} TileVisibility;
+
+/*------------------------------------------------------------------------------
+ * Each open tile gets a row of 2 bit TileVisibility entries, one for every
+ * tile in the window of VISIBILITY_RADIUS tiles around it. Rows are packed
+ * together in one pool and found through rowOffsets. Solid tiles never get a
+ * row. Owned by the Level it was built for.
+ *----------------------------------------------------------------------------*/
+typedef struct
+{
+    int width;
+    int height;
+    int32_t* rowOffsets;
+    uint32_t* rows;
+    int rowCount;
+    int rowCapacity;
+} VisibilityCache;
+
+
+void            buildVisibility          (Level* level);
+void            freeVisibility           (VisibilityCache* visibility);
+void            updateVisibilityAroundTile(Level* level, int index);
+void            prepareVisibilityRow     (Level* level, int index);
+TileVisibility  getTileVisibility        (Level* level, int fromIndex, int toIndex);
+bool            isSegmentClear           (const Level* level, Vector2 from, Vector2 to);
+bool            hasLineOfSight           (Level* level, Vector2 from, Vector2 to);
@@ -0,0 +1,57 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#include <stdbool.h>
+
+#include "window_state.h"
+
+
+void initWindowState(WindowState* state, SDL_Window* window)
+{
+    uint32_t flags = SDL_GetWindowFlags(window);
+    state->visible = !(flags & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED));
+    state->focused = (flags & SDL_WINDOW_INPUT_FOCUS) != 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Input: The window's state and an event from the queue.
+ * Output: Whether the event changed whether the window is visible or focused.
+ *----------------------------------------------------------------------------*/
+bool updateWindowState(WindowState* state, const SDL_Event* event)
+{
+    if (event->type != SDL_WINDOWEVENT) return false;
+    WindowState last = *state;
+    switch (event->window.event)
+    {
+    case SDL_WINDOWEVENT_HIDDEN:
+    case SDL_WINDOWEVENT_MINIMIZED:
+        state->visible = false;
+        break;
+    case SDL_WINDOWEVENT_SHOWN:
+    case SDL_WINDOWEVENT_EXPOSED:
+    case SDL_WINDOWEVENT_RESTORED:
+    case SDL_WINDOWEVENT_MAXIMIZED:
+        state->visible = true;
+        break;
+    case SDL_WINDOWEVENT_FOCUS_GAINED:
+        state->focused = true;
+        break;
+    case SDL_WINDOWEVENT_FOCUS_LOST:
+        state->focused = false;
+        break;
+    }
+    return state->visible != last.visible || state->focused != last.focused;
+}
+
+/*------------------------------------------------------------------------------
+ * Description: Blocks until an event comes in, or BACKGROUND_WAKE_MS at most,
+ *              rather than spinning while there is nothing to show. The event
+ *              is left on the queue.
+ *----------------------------------------------------------------------------*/
+void waitForWindowEvent(void)
+{
+    SDL_WaitEventTimeout(NULL, BACKGROUND_WAKE_MS);
+}
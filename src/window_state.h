@@ -0,0 +1,31 @@
+/*
+Raycaster wolfenstein 3d style game.
+Seoras Macdonald
+seoras1@gmail.com
+2015
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __linux__
+    #include <SDL2/SDL.h>
+#elif _WIN32
+    #include <SDL.h>
+#endif
+
+
+//How often a hidden or idle window wakes up when no events come
+#define BACKGROUND_WAKE_MS 100
+
+//Whether the window can be seen and is being played in, from its events
+typedef struct
+{
+    bool visible;               //Shown and not minimised
+    bool focused;               //Has keyboard focus
+} WindowState;
+
+
+void initWindowState    (WindowState* state, SDL_Window* window);
+bool updateWindowState  (WindowState* state, const SDL_Event* event);
+void waitForWindowEvent (void);